@@ -14,12 +14,15 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/asio.hpp>
 
+#include <util/annotation_queues.h>
 #include <util/logging.h>
 
 #include "data_run.h"
+#include "hit_receiver_stats.h"
 #include "spill_schedule.h"
 
 class BasicHitReceiver : protected Logging {
@@ -41,6 +44,9 @@ public:
     virtual void startRun(std::shared_ptr<DataRun>& run);
     virtual void stopRun();
 
+    inline std::shared_ptr<HitReceiverStats> stats() const { return stats_; }
+    inline int socketHandle() { return socket_optical_.native_handle(); }
+
 protected:
     virtual void processDatagram(const char* datagram, std::size_t datagram_size, std::size_t n_hits, bool do_mine) = 0;
 
@@ -49,7 +55,8 @@ protected:
     void reportBadDatagram();
     void reportGoodDatagram(std::uint32_t plane_id, const tai_timestamp& start_time, const tai_timestamp& end_time, std::uint64_t n_hits);
 
-    SpillDataSlot* findAndLockDataSlot(const tai_timestamp& base_time);
+    /// Slot of the spill a datagram of a plane belongs to, locked. nullptr if it was discarded.
+    SpillDataSlot* findAndLockDataSlot(std::uint32_t plane_number, const tai_timestamp& base_time);
 
 private:
     enum class DataMode {
@@ -73,19 +80,36 @@ private:
     std::size_t expected_header_size_;
     std::size_t expected_hit_size_;
 
-    using SequenceNumberMap = std::unordered_map<std::uint32_t, std::uint32_t>;
+    struct PlaneSequence {
+        std::uint32_t next_seq_number;
+        tai_timestamp last_start_time; ///< Start of the last datagram received, where gaps begin
+    };
+
+    using SequenceNumberMap = std::unordered_map<std::uint32_t, PlaneSequence>;
     SequenceNumberMap plane_to_next_sequence_number_;
     bool tolerate_seq_number_drops_;
 
+    std::shared_ptr<HitReceiverStats> stats_; ///< Counters of this receiver, written by the thread receiving a datagram
+    std::uint32_t n_kernel_drops_; ///< Drops of the receive queue reported by the kernel so far
+    std::uint64_t n_unattributed_drops_; ///< Kernel drops not yet matched with a gap in the sequence of a plane
+    bool resync_kernel_drops_; ///< Take the next drop count reported as the baseline
+    AnnotationQueue pending_annotations_; ///< Annotations waiting for the slot of the next datagram mined
+    std::int64_t arrival_ns_; ///< When the kernel received the current datagram (ns since the epoch), 0 if unknown
+    std::int64_t decoded_ns_; ///< When the header of the current datagram was decoded (ns since the epoch)
+
     /**
      * IO_service optical data work function.
      * Calls the async_receive() on the IO_service for the optical data stream.
      */
     void requestDatagram();
 
-    void receiveDatagram(boost::system::error_code const& error, std::size_t size);
+    void receiveDatagram(boost::system::error_code const& error);
+
+    /// Read a datagram the socket has ready, with the drop count and arrival time reported by the kernel.
+    std::size_t readDatagram(boost::system::error_code& error);
 
     void checkAndProcessDatagram(const char* datagram, std::size_t datagram_size, bool do_mine);
 
-    void reportDataStreamGap(const tai_timestamp& gap_end);
+    void reportDataStreamGap(std::uint32_t plane_number, std::uint32_t n_missed, const tai_timestamp& gap_start, const tai_timestamp& gap_end);
+    void reportKernelDrops(std::uint32_t n_kernel_drops);
 };
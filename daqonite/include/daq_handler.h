@@ -27,6 +27,10 @@
 #include "basic_hit_receiver.h"
 #include "data_run.h"
 #include "data_run_serialiser.h"
+#include "histogram_publisher.h"
+#include "hit_receiver_stats.h"
+#include "ingest_latencies.h"
+#include "socket_buffer_monitor.h"
 #include "spill_schedule.h"
 #include "spill_schedulers.h"
 
@@ -58,6 +62,8 @@ public:
     virtual void handleExitCommand() override;
 
     inline const std::shared_ptr<DataRun>& getRun() const { return data_run_; }
+    inline HitReceiverRates getReceiverRates() const { return receiver_stats_->rates(); }
+    inline IngestLatencyPercentiles getIngestLatencies() const { return ingest_latencies_->percentiles(); }
 
     void run();
 
@@ -85,4 +91,8 @@ private:
     std::shared_ptr<SpillSchedule> spill_schedule_; ///< SpillSchedule object
     std::list<std::unique_ptr<BasicHitReceiver>> hit_receivers_; ///< Pointers to hit receivers
     std::shared_ptr<SpillSchedulers> scheduling_;
+    std::shared_ptr<HistogramPublisher> histogram_publisher_; ///< Publishes channel histograms of every spill
+    std::shared_ptr<HitReceiverStatsCollector> receiver_stats_; ///< Turns counters of hit receivers into rates
+    std::shared_ptr<SocketBufferMonitor> socket_monitor_; ///< Samples and grows receive buffers of hit receivers
+    std::shared_ptr<IngestLatencies> ingest_latencies_; ///< Latencies of spills written recently, across runs
 };
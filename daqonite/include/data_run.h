@@ -10,6 +10,7 @@
 #include <chrono>
 #include <string>
 
+#include <run_file/records.h>
 #include <util/control_msg.h>
 #include <util/timestamp.h>
 
@@ -38,6 +39,9 @@ public:
     inline const std::string& getOutputFilePath() const { return output_file_path_; }
     std::shared_ptr<BasicSpillScheduler> getScheduler() const;
 
+    /// Summary of the run, as stored in run files.
+    RunParameters getParameters() const;
+
     std::string logDescription() const;
 
 private:
@@ -1,8 +1,9 @@
 /**
  * DataRunFile - Wrapper class for file output
- * 
+ *
  * This class writes the output of data taking to output
- * files on per-run basis.
+ * files on per-run basis. Implementations differ in the
+ * format of the file, see RootDataRunFile and BinaryDataRunFile.
  *
  * Author: Petr Mánek
  * Contact: petr.manek.19@ucl.ac.uk
@@ -10,22 +11,70 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
-#include <TFile.h>
-#include <TTree.h>
+#include <Compression.h>
+#include <Rtypes.h>
 
+#include <run_file/layout.h>
+#include <run_file/records.h>
 #include <spill_scheduling/spill.h>
-#include <spill_scheduling/tdu_signal.h>
-#include <util/annotation.h>
-#include <util/pmt_hit.h>
 
 class PMTHitQueue;
-class DataRun;
+
+/// Tuning of file output, trading CPU time for disk bandwidth.
+struct DataRunFileSettings {
+    RunFileFormat format { RunFileFormat::Root }; ///< Container format
+
+    // ROOT format
+    int compression_algorithm { ROOT::RCompressionSetting::EAlgorithm::kLZ4 }; ///< ROOT compression algorithm
+    int compression_level { 4 }; ///< Compression level in [0, 9], where 0 disables compression
+    Long64_t auto_flush { -30000000 }; ///< Flush baskets every N entries (if positive) or N bytes (if negative)
+    std::map<std::string, Int_t> basket_sizes {}; ///< Basket sizes [B] keyed by tree name, or by "tree.branch"
+    HitLayout hit_layout { HitLayout::PerHit }; ///< How optical hits are stored
+    std::uint64_t time_index_bucket_ns { 1000000 }; ///< Width of time index buckets [ns], 0 disables indices
+
+    // Checkpoints, bounding data lost in a crash and the amount of work left for close()
+    std::uint64_t checkpoint_bytes { 268435456 }; ///< Checkpoint after N bytes of uncompressed hits, 0 disables
+    double checkpoint_interval_s { 60.0 }; ///< Checkpoint after N seconds, 0 disables
+
+    // Segmentation into multiple files
+    std::uint64_t rotate_bytes { 0 }; ///< Start a new segment once the current one exceeds N bytes, 0 disables
+    double rotate_interval_s { 0 }; ///< Start a new segment once the current one is N seconds old, 0 disables
+
+    // Binary format
+    int binary_compression_level { 1 }; ///< zlib level of spill blocks in [0, 9], where 0 disables compression
+    std::size_t binary_buffer_size { 16777216 }; ///< Size of individual writes [B]
+    bool binary_direct_io { true }; ///< Bypass the page cache with O_DIRECT
+
+    /// Read settings from the "run_file" section of the configuration.
+    static DataRunFileSettings fromConfig();
+
+    /// Parse compression algorithm name (ZLIB|LZMA|LZ4|ZSTD).
+    static int parseCompressionAlgorithm(const std::string& name);
+};
+
+/// Cost of a single call to DataRunFile::flush().
+struct DataRunFileFlushStats {
+    bool checkpoint {}; ///< Was data actually written out?
+    double duration_ms {}; ///< Time spent writing [ms]
+    std::uint64_t bytes_written {}; ///< Bytes written to disk [B]
+};
+
+/// Amount of data written to disk while storing a single spill.
+struct DataRunFileSpillStats {
+    std::uint64_t bytes_written {}; ///< Bytes written to disk since the previous spill
+    std::uint64_t total_bytes_written {}; ///< Bytes written to disk since the file was opened
+    std::uint64_t raw_bytes {}; ///< Uncompressed size of data stored since the previous spill
+    std::uint64_t zip_bytes {}; ///< Compressed size of data stored since the previous spill
+    double compression_ratio {}; ///< Ratio of uncompressed and compressed size of all data stored so far
+};
 
 class DataRunFile {
 public:
-    explicit DataRunFile(std::string path);
     virtual ~DataRunFile() = default;
 
     // no copy semantics
@@ -36,55 +85,38 @@ public:
     DataRunFile(DataRunFile&& other) = delete;
     DataRunFile&& operator=(DataRunFile&& other) = delete;
 
-    void writeRunParametersAtStart(const std::shared_ptr<DataRun>& run) const;
-    void writeRunParametersAtEnd(const std::shared_ptr<DataRun>& run) const;
+    /// Open a file in the format selected by settings, split into segments if rotation is enabled.
+    static std::unique_ptr<DataRunFile> create(const std::string& path, const DataRunFileSettings& settings);
+
+    virtual void writeRunParametersAtStart(const RunParameters& params) = 0;
+    virtual void writeRunParametersAtEnd(const RunParameters& params) = 0;
 
     /// Save sorted queue of hits to the file.
-    void writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits) const;
+    virtual DataRunFileSpillStats writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits) = 0;
+
+    /// Save events found in the spill written last, with hit ranges relative to its hits.
+    /// Formats that do not store events ignore them.
+    virtual void writeSpillEvents(const std::vector<EventRecord>&) { }
+
+    /// Save per-channel summaries of the spill written last. Formats that do not store them ignore them.
+    virtual void writeChannelSummaries(const std::vector<ChannelSummaryRecord>&) { }
+
+    /// Save the data quality summary of the spill written last. Formats that do not store it ignore it.
+    virtual void writeSpillSummary(const SpillSummaryRecord&) { }
 
     /// Is the file open?
-    bool isOpen() const;
+    virtual bool isOpen() const = 0;
 
-    /// Make sure data written so far is propagated to disk.
-    void flush();
+    /// Make sure data written so far is propagated to disk. Implementations may
+    /// do so only periodically, in order to bound the cost of frequent calls.
+    virtual DataRunFileFlushStats flush() = 0;
 
     /// Close the file.
-    void close();
-
-private:
-    std::unique_ptr<TFile> file_; ///< ROOT output TFile
-
-    // Run parameters tree
-    TTree* run_params_;
-    mutable ULong64_t run_number_;
-    mutable UChar_t run_type_;
-    mutable utc_timestamp run_time_started_;
-    mutable utc_timestamp run_time_stopped_;
-    void createRunParams();
-
-    // Run parameters tree
-    TTree* spills_;
-    mutable ULong64_t spill_number_;
-    mutable tai_timestamp spill_time_started_;
-    mutable tai_timestamp spill_time_stopped_;
-    mutable ULong64_t spill_opt_hits_begin_;
-    mutable ULong64_t spill_opt_hits_end_;
-    mutable ULong64_t spill_opt_annotations_begin_;
-    mutable ULong64_t spill_opt_annotations_end_;
-    void createSpills();
-
-    // Optical hits tree
-    TTree* opt_hits_;
-    mutable PMTHit hit_;
-    void createOptHits();
-
-    // Optical annotations tree
-    TTree* opt_annotations_;
-    mutable Annotation annotation_;
-    void createOptAnnotations();
-
-    // TDU signals tree
-    TTree* tdu_signals_;
-    mutable TDUSignal tdu_signal_;
-    void createTDUSignals();
+    virtual void close() = 0;
+
+protected:
+    explicit DataRunFile() = default;
+
+    /// Open a single file in the format selected by settings.
+    static std::unique_ptr<DataRunFile> createFile(const std::string& path, const DataRunFileSettings& settings);
 };
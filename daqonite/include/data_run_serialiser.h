@@ -1,5 +1,16 @@
+/**
+ * DataRunSerialiser - Sorts closed spills and writes them into the run file
+ *
+ * Work is split into a pipeline, so that sorting of one spill overlaps with writing of
+ * the previous one. The serialiser thread consolidates and sorts spills, then passes them
+ * through a bounded hand-off to a writer thread, which owns the run file. Throughput is
+ * then limited by the slower of the two stages rather than by their sum.
+ */
+
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 #include <boost/lockfree/spsc_queue.hpp>
@@ -10,23 +21,88 @@
 #include <util/pmt_hit_queues.h>
 
 #include "data_run.h"
+#include "data_run_file.h"
+#include "event_builder.h"
+#include "histogram_publisher.h"
+#include "ingest_latencies.h"
+#include "spill_handoff.h"
+#include "spill_sorter.h"
+
+/// Occupancy and stall times of the serialiser pipeline.
+struct SerialiserPipelineStats {
+    std::size_t sort_queue_occupancy {}; ///< Closed spills waiting to be sorted
+    std::size_t sort_queue_capacity {};
+    double sort_busy_ms {}; ///< Total time spent sorting
+    double sort_stall_ms {}; ///< Total time the sort stage waited for the writer
+    std::size_t write_queue_occupancy {}; ///< Sorted spills waiting to be written
+    std::size_t write_queue_capacity {};
+    double write_busy_ms {}; ///< Total time spent writing and flushing
+    double write_stall_ms {}; ///< Total time the writer waited for sorted spills
+};
+
+/// Pipeline state gathered by the writer between two reports.
+struct SerialiserPipelineInterval {
+    std::chrono::steady_clock::time_point start {};
+    SerialiserPipelineStats at_start {};
+    std::size_t n_spills {}; ///< Spills written in the interval
+    std::size_t sort_queue_peak {}; ///< Highest occupancy seen after a spill was written
+    std::size_t write_queue_peak {};
+};
 
 class DataRunSerialiser : protected Logging, public AsyncComponent {
 public:
-    explicit DataRunSerialiser(const std::shared_ptr<DataRun>& data_run);
+    explicit DataRunSerialiser(const std::shared_ptr<DataRun>& data_run,
+        std::shared_ptr<HistogramPublisher> histogram_publisher,
+        std::shared_ptr<IngestLatencies> ingest_latencies);
     virtual ~DataRunSerialiser();
 
     bool serialiseSpill(SpillPtr spill);
 
+    SerialiserPipelineStats pipelineStats() const;
+
 protected:
     void run() override;
 
 private:
     using SpillQueue = boost::lockfree::spsc_queue<SpillPtr>;
     SpillQueue waiting_spills_; ///< Thread-safe FIFO queue for closed spills pending merge-sort
+    std::atomic<std::size_t> n_waiting_spills_;
+    std::size_t max_waiting_spills_;
 
     std::shared_ptr<DataRun> data_run_;
 
-    /// Implementation of conventional insert-sort algorithm used to pre-sort CLB queues.
-    static std::size_t insertSort(PMTHitQueue& queue) noexcept;
-};
\ No newline at end of file
+    double radix_sort_disorder_threshold_; ///< Disorder above which spills are radix-sorted
+    std::size_t n_radix_sort_threads_; ///< Number of threads used by the radix sort
+    double gap_threshold_s_; ///< Minimum interval without hits from a plane counted as a gap
+    std::chrono::duration<double> pipeline_stats_interval_; ///< Interval over which the pipeline state is reported
+    EventBuilderSettings event_builder_settings_;
+    std::shared_ptr<HistogramPublisher> histogram_publisher_; ///< Receives merged histograms of every spill
+    std::shared_ptr<IngestLatencies> ingest_latencies_; ///< Receives latencies of every spill written
+
+    SpillHandoff handoff_; ///< Sorted spills pending write
+    std::atomic<std::uint64_t> sort_busy_us_;
+    std::atomic<std::uint64_t> write_busy_us_;
+
+    /// Publish merged channel histograms of a spill and summarise them for the run file.
+    void summariseChannels(const SpillPtr spill, const ChannelHistograms& histograms,
+        std::vector<ChannelSummaryRecord>& summaries);
+
+    /// Fill the data quality summary of a sorted spill from statistics gathered while sorting.
+    void summariseSpill(const SpillPtr spill, const SpillSortStats& sort_stats, const ChannelHistograms& histograms,
+        SortedSpill& sorted) const;
+
+    /// Complete the latencies of a spill once it has been written, and add them to the ingest latencies.
+    void summariseLatencies(SortedSpill& sorted, std::int64_t written_time_ns);
+
+    /// Body of the writer thread, which owns the run file until the hand-off is drained.
+    void writeSpills(std::unique_ptr<DataRunFile> out_file);
+
+    /// Log and export the cost of checkpoints.
+    void reportFlush(const DataRunFileFlushStats& stats);
+
+    /// Sample the state of the pipeline, logging and exporting it once the interval is over or on `final`.
+    void reportPipeline(SerialiserPipelineInterval& interval, bool final);
+
+    /// Export the data quality summary of a spill in a single bulk request.
+    void reportSpill(const SortedSpill& sorted);
+};
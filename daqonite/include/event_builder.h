@@ -0,0 +1,73 @@
+/**
+ * EventBuilder - Software trigger finding coincidences in time-sorted spills
+ *
+ * A time window slides over the sorted hit stream. Whenever the hits inside the
+ * window come from enough distinct planes and channels, they form (part of) an
+ * event; overlapping triggered windows are merged into a single event, which is
+ * then extended by a margin on either side. The scan is a single O(n) pass, with
+ * plane and channel multiplicities maintained incrementally in flat arrays.
+ *
+ * Optionally, hits outside events are dropped. To allow noise studies, hits in a
+ * random subset of fixed-length time slices (one in `noise_prescale`) are kept
+ * regardless of events.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <run_file/records.h>
+#include <util/pmt_hit_queues.h>
+
+struct EventBuilderSettings {
+    bool enabled { false };
+    std::uint64_t window_ns { 200 }; ///< Width of the coincidence window
+    std::uint32_t min_hits { 4 }; ///< Minimum number of hits in the window
+    std::uint32_t min_planes { 2 }; ///< Minimum number of distinct planes in the window
+    std::uint32_t min_channels { 3 }; ///< Minimum number of distinct (plane, channel) pairs in the window
+    std::uint64_t margin_ns { 100 }; ///< Extent of events before the first and after the last triggering hit
+    bool drop_hits { false }; ///< Write only hits in events and noise samples (DataNormal runs only)
+    std::uint32_t noise_prescale { 100 }; ///< One in this many slices is kept entirely, 0 keeps none
+    std::uint64_t noise_slice_ns { 1000000 }; ///< Length of noise sample slices
+
+    static EventBuilderSettings fromConfig();
+};
+
+/// Summary of building events in a single spill.
+struct EventBuilderStats {
+    std::size_t n_hits {}; ///< Number of hits in the spill
+    std::size_t n_events {};
+    std::size_t n_event_hits {}; ///< Number of hits inside events
+    std::size_t n_kept_hits {}; ///< Number of hits written out
+};
+
+class EventBuilder {
+public:
+    explicit EventBuilder(const EventBuilderSettings& settings);
+    virtual ~EventBuilder() = default;
+
+    /// Find events in time-sorted hits. Hit ranges of events are indices into `hits`.
+    EventBuilderStats build(const PMTHitQueue& hits, std::vector<EventRecord>& events);
+
+    /// Like `build()`, but also move hits outside events and noise samples out of `hits`.
+    /// Hit ranges of events then refer to the remaining hits.
+    EventBuilderStats buildAndDrop(PMTHitQueue& hits, std::vector<EventRecord>& events);
+
+private:
+    EventBuilderSettings settings_;
+    std::minstd_rand random_;
+
+    // Scratch buffers, reused across spills to avoid reallocation
+    std::vector<std::uint64_t> times_; ///< TAI time [ns] of every hit
+    std::unordered_map<std::uint32_t, std::uint32_t> plane_indices_; ///< Dense index of every plane of the spill
+    std::vector<std::uint32_t> channel_keys_; ///< Dense (plane, channel) index of every hit
+    std::vector<std::uint32_t> plane_counts_;
+    std::vector<std::uint32_t> channel_counts_;
+
+    void indexHits(const PMTHitQueue& hits);
+    void findEvents(std::vector<EventRecord>& events);
+    void extendEvents(const PMTHitQueue& hits, std::vector<EventRecord>& events) const;
+};
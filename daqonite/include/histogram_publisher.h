@@ -0,0 +1,36 @@
+/**
+ * HistogramPublisher - Publishes per-channel histograms of every spill for online monitoring
+ *
+ * One message is sent per plane and spill, carrying the merged histograms of all
+ * of its channels. Subscribers may therefore follow selected planes only.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <util/channel_histograms.h>
+#include <util/publisher.h>
+
+struct ChannelHistogramsMessage {
+    const char Zero = '\0'; ///< The first bit must be '\0' otherwise NNG pub/sub discards the message.
+    std::uint64_t run_number;
+    std::uint64_t spill_number;
+    std::uint32_t plane_number;
+    double duration_s; ///< Length of the spill, dividing hit counts into rates
+    ChannelHistogram channels[PlaneHistograms::N_CHANNELS];
+};
+
+class HistogramPublisher : public Publisher<ChannelHistogramsMessage> {
+protected:
+    void connected() override;
+    void disconnected(const nng::exception& e) override;
+
+public:
+    explicit HistogramPublisher(const std::string& bus_url);
+    virtual ~HistogramPublisher() = default;
+
+    /// Queue histograms of all planes of a spill for publishing.
+    void publishSpill(std::uint64_t run_number, std::uint64_t spill_number, double duration_s,
+        const ChannelHistograms& histograms);
+};
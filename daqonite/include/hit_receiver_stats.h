@@ -0,0 +1,162 @@
+/**
+ * HitReceiverStats - Counters of datagrams and hits seen by a single hit receiver
+ *
+ * A receiver has at most one datagram in flight, so its counters only ever have a
+ * single writer. They are therefore kept per receiver and plane, in blocks of their own
+ * cache line, and updated by plain loads and stores instead of atomic read-modify-writes.
+ * HitReceiverStatsCollector reads them every few seconds, turning them into rates which
+ * are published on the bus and indexed to elasticsearch.
+ *
+ * Datagrams missing from the sequence of a plane are told apart by where they were lost:
+ * the kernel reports how many its receive queue dropped (SO_RXQ_OVFL), and as many of the
+ * following gaps are attributed to it, the rest to the network or the sender.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <util/async_component.h>
+#include <util/logging.h>
+
+/// Counts of a single plane, or totals of a receiver
+struct PlaneCounts {
+    std::uint64_t n_datagrams;
+    std::uint64_t n_hits;
+    std::uint64_t n_gaps; ///< Jumps in sequence numbers
+    std::uint64_t n_missed; ///< Datagrams skipped by the jumps, lost upstream
+    std::uint64_t n_dropped; ///< Datagrams skipped by the jumps, dropped by our socket
+    std::uint64_t n_late; ///< Datagrams with an old sequence number, also counted as bad
+    std::uint64_t n_discarded; ///< Datagrams which did not match any open spill
+};
+
+struct alignas(64) PlaneCounters {
+    std::atomic<std::uint64_t> key; ///< Plane number + 1, 0 while unused
+    std::atomic<std::uint64_t> n_datagrams;
+    std::atomic<std::uint64_t> n_hits;
+    std::atomic<std::uint64_t> n_gaps;
+    std::atomic<std::uint64_t> n_missed;
+    std::atomic<std::uint64_t> n_dropped;
+    std::atomic<std::uint64_t> n_late;
+    std::atomic<std::uint64_t> n_discarded;
+};
+
+/// Counts of a receiver which cannot be attributed to planes
+struct ReceiverCounts {
+    std::uint64_t n_bad; ///< Datagrams which could not be attributed to a plane
+    std::uint64_t n_kernel_drops; ///< Datagrams dropped by the receive queue, as counted by the kernel
+    std::uint64_t rx_queue_peak; ///< Most bytes in the receive queue since the last read
+    std::uint64_t rcvbuf; ///< Size of the receive buffer (bytes)
+};
+
+class HitReceiverStats {
+public:
+    /// Planes counted individually, others are counted together
+    static constexpr std::size_t N_PLANES { 256 };
+
+    explicit HitReceiverStats(int port);
+    ~HitReceiverStats();
+
+    // for safety, no copy- or move-semantics
+    HitReceiverStats(const HitReceiverStats& other) = delete;
+    HitReceiverStats& operator=(const HitReceiverStats& other) = delete;
+
+    inline int port() const { return port_; }
+
+    /// Counters of a plane, added on first use (receiving thread only).
+    PlaneCounters& plane(std::uint32_t plane_number)
+    {
+        const std::uint64_t key { plane_number + 1ull };
+        std::size_t idx { plane_number % N_PLANES };
+        for (std::size_t probe = 0; probe < N_PLANES; ++probe, idx = (idx + 1) % N_PLANES) {
+            PlaneCounters& counters { counters_->planes[idx] };
+            const std::uint64_t counters_key { counters.key.load(std::memory_order_relaxed) };
+            if (counters_key == key) {
+                return counters;
+            }
+            if (counters_key == 0) {
+                counters.key.store(key, std::memory_order_release);
+                return counters;
+            }
+        }
+        return counters_->other_planes;
+    }
+
+    /// Add to a counter (receiving thread only).
+    static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void addBad() { add(counters_->n_bad, 1); }
+    inline void addKernelDrops(std::uint64_t n) { add(counters_->n_kernel_drops, n); }
+
+    /// Record a sample of the receive queue (monitoring thread only).
+    void sampleQueue(std::uint64_t rx_queue, std::uint64_t rcvbuf);
+
+    /// Counts of all planes seen so far by plane number, and of the receiver, resetting the queue peak.
+    void read(std::map<std::uint32_t, PlaneCounts>& planes, PlaneCounts& other_planes, ReceiverCounts& receiver);
+
+private:
+    struct Counters {
+        PlaneCounters planes[N_PLANES];
+        PlaneCounters other_planes; ///< Planes which did not fit the table
+        alignas(64) std::atomic<std::uint64_t> n_bad; ///< Datagrams which could not be attributed to a plane
+        std::atomic<std::uint64_t> n_kernel_drops;
+        alignas(64) std::atomic<std::uint64_t> rx_queue_peak; ///< Written by the monitoring thread
+        std::atomic<std::uint64_t> rcvbuf;
+    };
+
+    int port_;
+    Counters* counters_; ///< Aligned to a cache line, which new does not guarantee in C++11
+};
+
+/// Rates (per second) of all receivers together
+struct HitReceiverRates {
+    double datagrams;
+    double hits;
+    double bad;
+    double gaps;
+    double missed;
+    double dropped;
+    double kernel_drops;
+    double late;
+    double discarded;
+    double queue_peak; ///< Largest fraction of a receive buffer in use
+};
+
+class HitReceiverStatsCollector : public AsyncComponent, protected Logging {
+public:
+    explicit HitReceiverStatsCollector(double interval_s);
+    virtual ~HitReceiverStatsCollector() = default;
+
+    /// Replace the receivers which are collected, e.g. when they are created anew.
+    void setReceivers(const std::vector<std::shared_ptr<HitReceiverStats>>& receivers);
+
+    /// Rates over the last interval.
+    HitReceiverRates rates() const;
+
+protected:
+    virtual void run() override;
+
+private:
+    struct Collected {
+        std::shared_ptr<HitReceiverStats> stats;
+        std::map<std::uint32_t, PlaneCounts> planes; ///< Counts at the last collection
+        PlaneCounts other_planes;
+        ReceiverCounts receiver;
+    };
+
+    std::chrono::milliseconds interval_;
+    mutable std::mutex mutex_;
+    std::vector<Collected> receivers_; ///< Taken under mutex_
+    HitReceiverRates rates_; ///< Taken under mutex_
+
+    void collect(double elapsed_s);
+};
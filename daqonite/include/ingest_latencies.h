@@ -0,0 +1,70 @@
+/**
+ * IngestLatencies - Latencies of hits on their way from the network into the run file
+ *
+ * Four stages are told apart. Per datagram: from its arrival at the socket, as stamped by
+ * the kernel, until it was decoded, and from then until the data slot of its spill was
+ * locked for its hits. Per spill: from the arrival of its last datagram until it was
+ * closed, which is dominated by the maturation period, and from then until it was sorted
+ * and written. The writer adds every spill it writes, and percentiles are taken over the
+ * spills of the current and the previous window, so they follow the last minutes only.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <util/latency_histogram.h>
+
+/// Percentiles of a single stage (µs)
+struct LatencyPercentiles {
+    double p50_us;
+    double p99_us;
+    double max_us;
+
+    static LatencyPercentiles of(const LatencyHistogram& histogram);
+};
+
+struct IngestLatencyPercentiles {
+    LatencyPercentiles arrival_to_decode; ///< Per datagram
+    LatencyPercentiles decode_to_slot; ///< Per datagram
+    LatencyPercentiles end_to_close; ///< Per spill
+    LatencyPercentiles close_to_written; ///< Per spill
+};
+
+class IngestLatencies {
+public:
+    explicit IngestLatencies(double window_s);
+    virtual ~IngestLatencies() = default;
+
+    // for safety, no copy- or move-semantics
+    IngestLatencies(const IngestLatencies& other) = delete;
+    IngestLatencies& operator=(const IngestLatencies& other) = delete;
+
+    /// Add the latencies of a written spill, per datagram and of the spill as a whole (ns, negative if unknown).
+    void record(const LatencyHistogram& arrival_to_decode, const LatencyHistogram& decode_to_slot,
+        std::int64_t end_to_close_ns, std::int64_t close_to_written_ns);
+
+    IngestLatencyPercentiles percentiles() const;
+
+private:
+    struct Window {
+        LatencyHistogram arrival_to_decode;
+        LatencyHistogram decode_to_slot;
+        LatencyHistogram end_to_close;
+        LatencyHistogram close_to_written;
+
+        void merge(const Window& other);
+        void clear();
+    };
+
+    std::chrono::milliseconds window_;
+    mutable std::mutex mutex_;
+    Window current_; ///< Taken under mutex_
+    Window previous_; ///< Taken under mutex_
+    std::chrono::steady_clock::time_point current_start_; ///< Taken under mutex_
+
+    /// Start a new window if the current one is over.
+    void rotate(std::chrono::steady_clock::time_point now);
+};
@@ -0,0 +1,87 @@
+/**
+ * RadixSorter - Parallel LSD radix sort of PMT hits by their integer timestamp.
+ *
+ * Unlike insert-sort followed by merge-sort, the cost of this algorithm does not
+ * depend on how disordered the input is. It is therefore used as an alternative
+ * for spills that arrive heavily out of order (e.g. after a network hiccup).
+ *
+ * Keys are 64-bit nanosecond timestamps, shifted by the earliest hit in the spill
+ * so that only the significant digits need to be sorted. Each pass builds
+ * per-thread histograms of one 11-bit digit, and then scatters the hits in
+ * parallel, each thread into its own precomputed output ranges. Worker threads are
+ * started along with the sorter and wait for the work of each pass, as starting
+ * threads for every pass would cost about as much as a pass over a small spill.
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <util/pmt_hit_queues.h>
+
+class RadixSorter {
+public:
+    explicit RadixSorter(std::size_t n_threads);
+    virtual ~RadixSorter();
+
+    // no copy semantics, workers refer to their sorter
+    RadixSorter(const RadixSorter& other) = delete;
+    RadixSorter& operator=(const RadixSorter& other) = delete;
+
+    /// Sort hits from all planes into a single time-sorted queue.
+    void sort(const PMTMultiPlaneHitQueue& input, PMTHitQueue& output);
+
+    /// Number of digit passes executed during the last call to `sort()`.
+    inline std::size_t lastPassCount() const { return n_passes_; }
+
+private:
+    static constexpr std::size_t DIGIT_BITS { 11 };
+    static constexpr std::size_t N_BUCKETS { 1 << DIGIT_BITS };
+    static constexpr std::uint64_t DIGIT_MASK { N_BUCKETS - 1 };
+
+    /// Minimum number of hits per thread. Splitting smaller inputs is not worth the thread overhead.
+    static constexpr std::size_t MIN_HITS_PER_THREAD { 1 << 16 };
+
+    struct Entry {
+        std::uint64_t key; ///< Timestamp in [ns], relative to the earliest hit in the spill
+        const PMTHit* hit; ///< Original hit, copied into output once sorted
+    };
+
+    using EntryArray = std::vector<Entry>;
+    using Histogram = std::array<std::size_t, N_BUCKETS>;
+
+    std::size_t n_threads_;
+    std::size_t n_passes_;
+
+    EntryArray entries_; ///< Scatter source, reused across spills to avoid reallocation
+    EntryArray scratch_; ///< Scatter destination, reused across spills to avoid reallocation
+    std::vector<Histogram> histograms_; ///< One histogram per thread, turned into scatter offsets in place
+
+    using Work = std::function<void(std::size_t, std::size_t, std::size_t)>;
+
+    std::vector<std::thread> workers_; ///< Worker i covers part i + 1 of the work, the calling thread part 0
+    std::mutex pool_mutex_;
+    std::condition_variable cv_work_; ///< Signals new work, or stopping
+    std::condition_variable cv_done_; ///< Signals that all workers are done with their part
+    const Work* work_; ///< Work of the current call to `parallelFor()`
+    std::size_t work_n_;
+    std::size_t work_threads_; ///< Number of threads sharing the current work, workers beyond it sit out
+    std::uint64_t work_generation_; ///< Incremented for every piece of work
+    std::size_t n_pending_; ///< Workers yet to finish their part of the current work
+    bool stopping_;
+
+    /// Run `work(thread_idx, begin, end)` on `n_threads` threads, each covering an equal part of [0, n).
+    void parallelFor(std::size_t n_threads, std::size_t n, const Work& work);
+
+    /// Body of a worker thread, which covers part `thread_idx` of every piece of work.
+    void runWorker(std::size_t thread_idx);
+
+    /// Sort `entries_` by one digit starting at `shift`. Returns false if the pass was skipped.
+    bool sortDigit(std::size_t n_threads, std::size_t shift);
+};
@@ -0,0 +1,146 @@
+/**
+ * RootDataRunFile - Writes run files as ROOT trees
+ *
+ * Author: Petr Mánek
+ * Contact: petr.manek.19@ucl.ac.uk
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <run_file/hit_columns.h>
+#include <run_file/layout.h>
+#include <spill_scheduling/spill.h>
+#include <spill_scheduling/tdu_signal.h>
+#include <util/annotation.h>
+#include <util/pmt_hit.h>
+
+#include "data_run_file.h"
+
+class RootDataRunFile : public DataRunFile {
+public:
+    explicit RootDataRunFile(std::string path, const DataRunFileSettings& settings);
+
+    void writeRunParametersAtStart(const RunParameters& params) override;
+    void writeRunParametersAtEnd(const RunParameters& params) override;
+    DataRunFileSpillStats writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits) override;
+    void writeSpillEvents(const std::vector<EventRecord>& events) override;
+    void writeChannelSummaries(const std::vector<ChannelSummaryRecord>& summaries) override;
+    void writeSpillSummary(const SpillSummaryRecord& summary) override;
+    bool isOpen() const override;
+    DataRunFileFlushStats flush() override;
+    void close() override;
+
+private:
+    DataRunFileSettings settings_;
+    std::unique_ptr<TFile> file_; ///< ROOT output TFile
+
+    // Write accounting
+    std::uint64_t last_bytes_written_;
+    std::uint64_t last_raw_bytes_;
+    std::uint64_t last_zip_bytes_;
+    void tuneTree(TTree* tree) const;
+    std::uint64_t rawBytes() const;
+    std::uint64_t zipBytes() const;
+
+    // Checkpoints
+    std::uint64_t checkpoint_pending_bytes_; ///< Uncompressed hit data filled since the last checkpoint
+    std::chrono::steady_clock::time_point checkpoint_time_; ///< Time of the last checkpoint
+    bool checkpointEnabled() const;
+    bool checkpointDue() const;
+
+    // Run parameters tree
+    TTree* run_params_;
+    mutable ULong64_t run_number_;
+    mutable UChar_t run_type_;
+    mutable utc_timestamp run_time_started_;
+    mutable utc_timestamp run_time_stopped_;
+    void createRunParams();
+
+    // Run parameters tree
+    TTree* spills_;
+    mutable ULong64_t spill_number_;
+    mutable tai_timestamp spill_time_started_;
+    mutable tai_timestamp spill_time_stopped_;
+    mutable ULong64_t spill_opt_hits_begin_;
+    mutable ULong64_t spill_opt_hits_end_;
+    mutable ULong64_t spill_opt_annotations_begin_;
+    mutable ULong64_t spill_opt_annotations_end_;
+    void createSpills();
+
+    // Optical hits, written in one of the layouts
+    std::uint64_t n_opt_hits_;
+
+    // Optical hits tree (per-hit layout)
+    TTree* opt_hits_;
+    mutable PMTHit hit_;
+    void createOptHits();
+
+    // Optical hit columns tree (columnar layout)
+    TTree* opt_hit_columns_;
+    UInt_t n_hit_columns_;
+    HitColumns hit_columns_;
+    void createOptHitColumns();
+    void bindOptHitColumns();
+
+    // Packed optical hits tree (packed layout)
+    TTree* opt_hits_packed_;
+    UInt_t n_hits_packed_;
+    UInt_t n_bytes_packed_;
+    std::vector<char> hits_packed_;
+    void createOptHitsPacked();
+
+    TTree* optHitsTree() const;
+
+    // Optical annotations tree
+    TTree* opt_annotations_;
+    mutable Annotation annotation_;
+    void createOptAnnotations();
+
+    // TDU signals tree
+    TTree* tdu_signals_;
+    mutable TDUSignal tdu_signal_;
+    void createTDUSignals();
+
+    // Events tree, created once the first events are written
+    TTree* events_;
+    EventRecord event_;
+    void createEvents();
+
+    // Channel summaries tree, created once the first summaries are written
+    TTree* channel_summaries_;
+    ChannelSummaryRecord channel_summary_;
+    void createChannelSummaries();
+
+    // Spill summaries tree, created once the first summary is written
+    TTree* spill_summaries_;
+    SpillSummaryRecord spill_summary_;
+    UInt_t spill_summary_n_planes_;
+    void createSpillSummaries();
+    void bindSpillSummaries();
+
+    // Index trees, mapping time buckets and planes to ranges of hits
+    TTree* time_index_;
+    ULong64_t time_bucket_; ///< Bucket number, i.e. TAI time [ns] divided by bucket width
+    ULong64_t time_bucket_ns_;
+    ULong64_t time_bucket_hits_begin_;
+    ULong64_t time_bucket_hits_end_;
+    TTree* plane_index_;
+    ULong64_t plane_index_spill_;
+    UInt_t plane_index_plane_;
+    ULong64_t plane_index_hits_begin_; ///< Global index of the first hit of the plane in the spill
+    ULong64_t plane_index_hits_end_; ///< Global index past the last hit of the plane in the spill
+    ULong64_t plane_index_n_hits_;
+    void createIndices();
+    void fillIndices(const PMTHitQueue& merged_hits, std::uint64_t spill_number, std::uint64_t first_hit);
+
+    /// All trees present in the file.
+    std::vector<TTree*> trees() const;
+};
@@ -0,0 +1,96 @@
+/**
+ * SegmentedDataRunFile - Splits run output into a sequence of files
+ *
+ * Spills are written to the current segment until it exceeds the configured size
+ * or age. Then a new segment takes over, while the previous one is closed on a
+ * background thread, so that rotation does not stall data taking. Segments are
+ * named after the run file with a "_partNNN" suffix and listed in a JSON manifest,
+ * which is updated whenever a segment is opened or closed. If a new segment cannot be
+ * opened, spills keep going to the current one and rotation is retried later.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <util/logging.h>
+
+#include "data_run_file.h"
+
+/// Entry of the run manifest.
+struct DataRunSegment {
+    std::string path {};
+    std::uint64_t first_spill {};
+    std::uint64_t last_spill {};
+    std::uint64_t n_spills {};
+    std::uint64_t n_hits {};
+    std::uint64_t bytes {}; ///< Size of the file once closed [B]
+    bool closed {};
+};
+
+class SegmentedDataRunFile : public DataRunFile, protected Logging {
+public:
+    explicit SegmentedDataRunFile(const std::string& path, const DataRunFileSettings& settings);
+    ~SegmentedDataRunFile() override;
+
+    void writeRunParametersAtStart(const RunParameters& params) override;
+    void writeRunParametersAtEnd(const RunParameters& params) override;
+    DataRunFileSpillStats writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits) override;
+    void writeSpillEvents(const std::vector<EventRecord>& events) override;
+    void writeChannelSummaries(const std::vector<ChannelSummaryRecord>& summaries) override;
+    void writeSpillSummary(const SpillSummaryRecord& summary) override;
+    bool isOpen() const override;
+    DataRunFileFlushStats flush() override;
+    void close() override;
+
+    /// Path of the segment with the given index.
+    static std::string segmentPath(const std::string& path, std::size_t segment_index);
+
+    /// Path of the manifest listing segments of the run.
+    static std::string manifestPath(const std::string& path);
+
+private:
+    DataRunFileSettings settings_;
+    std::string path_;
+    RunParameters run_params_;
+
+    // Current segment
+    std::unique_ptr<DataRunFile> segment_;
+    std::size_t segment_index_;
+    std::size_t segment_entry_; ///< Index of the segment in the manifest, which lists opened segments only
+    std::chrono::steady_clock::time_point segment_opened_;
+    std::chrono::steady_clock::time_point rotation_retry_; ///< No rotation before this time, after one failed
+    std::uint64_t segment_bytes_; ///< Bytes written to disk by the current segment
+    std::uint64_t closed_bytes_; ///< Bytes written to disk by previous segments
+
+    // Manifest, shared with closing threads
+    std::mutex segments_mutex_;
+    std::vector<DataRunSegment> segments_;
+    bool complete_;
+
+    struct ClosingThread {
+        std::thread thread;
+        std::size_t entry; ///< Manifest entry of the segment being closed
+    };
+    std::vector<ClosingThread> closing_threads_; ///< Only accessed by the writing thread
+
+    bool rotationDue() const;
+
+    /// Open a segment and add it to the manifest. nullptr if it cannot be opened, which is then left out.
+    std::unique_ptr<DataRunFile> openSegment(std::size_t segment_index, std::size_t& entry);
+
+    void rotate();
+    void closeSegment(std::unique_ptr<DataRunFile> file, std::size_t segment_index, std::size_t entry);
+
+    /// Join threads which have closed their segments already.
+    void joinClosedThreads();
+    void joinClosingThreads();
+
+    /// Rewrite manifest, the caller must hold `segments_mutex_`.
+    void writeManifest();
+};
@@ -0,0 +1,67 @@
+/**
+ * SocketBufferMonitor - Samples receive queues of hit receivers, growing their buffers
+ *
+ * How full every socket is gets read from /proc/net/udp, where sockets are found by
+ * their inode, and peaks are kept in the statistics of their receivers. In adaptive
+ * mode, a receive buffer which is found fuller than a threshold is grown, up to a limit.
+ * Growing beyond net.core.rmem_max needs CAP_NET_ADMIN, otherwise the buffer is capped.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <util/async_component.h>
+#include <util/logging.h>
+
+#include "hit_receiver_stats.h"
+
+struct SocketBufferSettings {
+    double sample_interval_s; ///< How often receive queues are sampled
+    bool adaptive; ///< Grow receive buffers which run full?
+    double grow_threshold; ///< Fraction of a buffer in use above which it is grown
+    double grow_factor; ///< Factor by which a buffer is grown at once
+    std::uint64_t max_size; ///< Largest size to which buffers are grown (bytes)
+
+    static SocketBufferSettings fromConfig();
+};
+
+struct MonitoredSocket {
+    int fd;
+    std::shared_ptr<HitReceiverStats> stats;
+};
+
+class SocketBufferMonitor : public AsyncComponent, protected Logging {
+public:
+    explicit SocketBufferMonitor(const SocketBufferSettings& settings);
+    virtual ~SocketBufferMonitor() = default;
+
+    /// Replace the sockets which are monitored. Must be emptied before the sockets are closed.
+    void setSockets(const std::vector<MonitoredSocket>& sockets);
+
+protected:
+    virtual void run() override;
+
+private:
+    struct Monitored {
+        int fd;
+        ino_t inode; ///< Identifies the socket in /proc/net/udp
+        std::shared_ptr<HitReceiverStats> stats;
+        bool capped; ///< Could the buffer not be grown any further?
+    };
+
+    SocketBufferSettings settings_;
+    std::mutex mutex_;
+    std::vector<Monitored> sockets_; ///< Taken under mutex_
+
+    void sample();
+
+    /// Grow the receive buffer of a socket, returns its new size.
+    std::uint64_t grow(Monitored& socket, std::uint64_t rcvbuf);
+};
@@ -0,0 +1,88 @@
+/**
+ * SpillHandoff - Bounded hand-off of sorted spills between the sort stage and the writer
+ *
+ * A fixed pool of buffers circulates between two threads. The sort stage acquires an
+ * empty buffer, fills it with a sorted spill and pushes it; the writer pops it, writes it
+ * out and releases it back into the pool. With two buffers, one spill is being sorted
+ * while the previous one is being written. Buffers are reused, so hit queues keep their
+ * capacity between spills. Time each side spends blocked is accumulated, showing which
+ * stage limits throughput. If the writer fails, it aborts the hand-off, so that the sort
+ * stage does not wait for buffers which will never be released.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <run_file/records.h>
+#include <spill_scheduling/spill.h>
+#include <util/latency_histogram.h>
+#include <util/pmt_hit_queues.h>
+
+/// Spill along with its time-sorted hits.
+struct SortedSpill {
+    SpillPtr spill {};
+    PMTHitQueue hits {};
+    std::vector<EventRecord> events {}; ///< Found by the event builder, if enabled
+    std::vector<ChannelSummaryRecord> channel_summaries {}; ///< One for every channel with hits
+    SpillSummaryRecord summary {}; ///< Data quality summary, completed by the writer
+    LatencyHistogram arrival_to_decode {}; ///< Merged from all data slots
+    LatencyHistogram decode_to_slot {}; ///< Merged from all data slots
+    std::int64_t last_arrival_ns {}; ///< When the latest datagram of the spill arrived, 0 if unknown
+};
+
+/// Snapshot of the hand-off state.
+struct SpillHandoffStats {
+    std::size_t capacity {}; ///< Number of buffers
+    std::size_t occupancy {}; ///< Number of sorted spills waiting for the writer
+    double producer_stall_ms {}; ///< Total time the sort stage waited for a free buffer
+    double consumer_stall_ms {}; ///< Total time the writer waited for a sorted spill
+};
+
+class SpillHandoff {
+public:
+    explicit SpillHandoff(std::size_t capacity);
+    virtual ~SpillHandoff();
+
+    /// Obtain an empty buffer, blocking while all of them are in use. nullptr once aborted.
+    std::unique_ptr<SortedSpill> acquire();
+
+    /// Pass a filled buffer to the writer.
+    void push(std::unique_ptr<SortedSpill> buffer);
+
+    /// Take the oldest filled buffer, waiting at most `timeout`. Returns false if there was none.
+    bool pop(std::unique_ptr<SortedSpill>& buffer, std::chrono::milliseconds timeout);
+
+    /// Return a written buffer into the pool.
+    void release(std::unique_ptr<SortedSpill> buffer);
+
+    /// Signal that no more spills will be pushed.
+    void close();
+
+    /// Signal that no more spills will be popped, e.g. because the writer failed.
+    void abort();
+
+    /// Closed, and all pushed spills were popped.
+    bool drained() const;
+
+    SpillHandoffStats stats() const;
+
+private:
+    const std::size_t capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_free_;
+    std::condition_variable cv_full_;
+    std::vector<std::unique_ptr<SortedSpill>> free_;
+    std::deque<std::unique_ptr<SortedSpill>> full_;
+    bool closed_;
+    bool aborted_;
+
+    std::chrono::steady_clock::duration producer_stall_;
+    std::chrono::steady_clock::duration consumer_stall_;
+};
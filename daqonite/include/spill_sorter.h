@@ -0,0 +1,81 @@
+/**
+ * SpillSorter - Turns per-plane hit queues of a closed spill into a single time-sorted queue.
+ *
+ * Two strategies are available. Planes that arrive (nearly) in order are pre-sorted with
+ * insert-sort and then combined by MergeSorter, which is close to O(n) in that case. Heavily
+ * disordered spills (e.g. after a network hiccup, or during flasher runs) would make insert-sort
+ * degrade towards O(n^2), so those are sorted by the RadixSorter instead. The strategy is picked
+ * automatically from a cheap estimate of the insert-sort cost: the average distance by which hits
+ * are displaced from their sorted positions.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <util/pmt_hit_queues.h>
+
+#include "merge_sorter.h"
+#include "radix_sorter.h"
+
+enum class SortStrategy : int {
+    InsertMerge,
+    Radix
+};
+
+/// Summary of the hits of a single plane, measured before sorting.
+struct PlaneSortStats {
+    std::uint32_t plane_number {};
+    std::size_t n_hits {};
+    std::size_t n_displaced {}; ///< Number of hits preceded by a later hit in the input
+    std::size_t n_gaps {}; ///< Number of intervals without hits longer than the gap threshold
+};
+
+/// Summary of a single sorting operation.
+struct SpillSortStats {
+    std::size_t n_planes {}; ///< Number of input queues
+    std::size_t n_hits {}; ///< Total number of sorted hits
+    std::size_t n_displaced {}; ///< Number of hits preceded by a later hit in the input
+    std::size_t displacement {}; ///< Upper bound on the number of insert-sort swaps
+    double disorder {}; ///< Average displacement per hit, i.e. `displacement / n_hits`
+    SortStrategy strategy { SortStrategy::InsertMerge }; ///< Which algorithm was used
+    std::size_t n_swaps {}; ///< Number of insert-sort swaps (zero for radix sort)
+    std::size_t n_radix_passes {}; ///< Number of radix digit passes (zero for insert-sort)
+    std::size_t n_gaps {}; ///< Total number of gaps in all planes
+    std::vector<PlaneSortStats> planes {}; ///< Breakdown by plane, in order of plane numbers
+};
+
+class SpillSorter {
+public:
+    explicit SpillSorter(double radix_disorder_threshold, std::size_t n_radix_threads, double gap_threshold_s = 0);
+    virtual ~SpillSorter() = default;
+
+    /// Sort hits from all planes, picking the strategy based on measured disorder.
+    /// Input queues may be modified in the process.
+    SpillSortStats sort(PMTMultiPlaneHitQueue& input, PMTHitQueue& output);
+
+    /// Sort hits from all planes with a specific strategy.
+    SpillSortStats sort(PMTMultiPlaneHitQueue& input, PMTHitQueue& output, SortStrategy strategy);
+
+    /// Estimate how far hits are displaced from their sorted positions. Costs a single O(n) scan,
+    /// and a binary search for every hit that is out of order. Returns the number of displaced hits.
+    /// The same scan counts gaps, i.e. intervals without hits longer than the gap threshold.
+    std::size_t estimateDisplacement(const PMTHitQueue& queue, std::size_t& displacement, std::size_t& n_gaps) const;
+
+    /// Implementation of conventional insert-sort algorithm used to pre-sort CLB queues.
+    static std::size_t insertSort(PMTHitQueue& queue) noexcept;
+
+    static const char* formatStrategy(SortStrategy strategy);
+
+private:
+    double radix_disorder_threshold_;
+    long double gap_threshold_s_; ///< Minimum gap between hits of a plane [s], 0 disables counting
+    MergeSorter merge_sorter_;
+    RadixSorter radix_sorter_;
+    mutable std::vector<long double> running_max_; ///< Scratch buffer for estimating displacement
+
+    SpillSortStats measure(const PMTMultiPlaneHitQueue& input) const;
+    void apply(PMTMultiPlaneHitQueue& input, PMTHitQueue& output, SpillSortStats& stats);
+};
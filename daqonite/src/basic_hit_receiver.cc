@@ -2,8 +2,13 @@
  * BasicHitReceiver - Common hit receiver implementation for optical data streams
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <mutex>
 
+#include <sys/socket.h>
+
 #include <boost/bind.hpp>
 
 #include <util/config.h>
@@ -12,6 +17,12 @@
 
 using boost::asio::ip::udp;
 
+/// Most annotations kept while no datagram is mined, e.g. between spills
+static constexpr std::size_t MAX_PENDING_ANNOTATIONS { 1024 };
+
+/// Datagrams read per wake-up at most, so that other sockets get their turn on the io_service threads
+static constexpr std::size_t MAX_DATAGRAMS_PER_WAKEUP { 64 };
+
 BasicHitReceiver::BasicHitReceiver(std::shared_ptr<boost::asio::io_service> io_service,
     std::shared_ptr<SpillSchedule> spill_schedule, int opt_port,
     std::size_t expected_header_size, std::size_t expected_hit_size,
@@ -26,12 +37,31 @@ BasicHitReceiver::BasicHitReceiver(std::shared_ptr<boost::asio::io_service> io_s
     , expected_hit_size_ { expected_hit_size }
     , plane_to_next_sequence_number_ {}
     , tolerate_seq_number_drops_ { tolerate_seq_number_drops }
+    , stats_ { new HitReceiverStats(opt_port) }
+    , n_kernel_drops_ { 0 }
+    , n_unattributed_drops_ { 0 }
+    , resync_kernel_drops_ { true }
+    , pending_annotations_ {}
+    , arrival_ns_ { 0 }
+    , decoded_ns_ { 0 }
 {
     setUnitName("BasicHitReceiver[{}]", opt_port);
 
     // Setup the sockets
     socket_optical_.set_option(udp::socket::receive_buffer_size { g_config.lookupI32("udp_buffer_size") });
     datagram_buffer_.resize(g_config.lookupI32("udp_buffer_size"));
+
+    // Have the kernel report how many datagrams the receive queue dropped.
+    const int enable { 1 };
+    if (::setsockopt(socket_optical_.native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) != 0) {
+        log(WARNING, "Kernel drops cannot be told from upstream loss, enabling SO_RXQ_OVFL failed: {}", std::strerror(errno));
+    }
+
+    // Have the kernel stamp datagrams as they arrive, from which ingest latencies are measured.
+    if (::setsockopt(socket_optical_.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0) {
+        log(WARNING, "Latencies exclude time in the receive queue, enabling SO_TIMESTAMPNS failed: {}", std::strerror(errno));
+    }
+    socket_optical_.non_blocking(true);
 }
 
 void BasicHitReceiver::startData()
@@ -40,6 +70,8 @@ void BasicHitReceiver::startData()
 
     // Reset sequence numbers before we start receiving hits
     plane_to_next_sequence_number_ = {};
+    n_unattributed_drops_ = 0;
+    resync_kernel_drops_ = true;
 
     mode_ = DataMode::Receiving;
     requestDatagram();
@@ -82,30 +114,80 @@ void BasicHitReceiver::stopRun()
 
 void BasicHitReceiver::requestDatagram()
 {
+    // Wait until a datagram is ready only, it is read by recvmsg() to get control messages as well.
     using namespace boost::asio::placeholders;
-    socket_optical_.async_receive(boost::asio::buffer(datagram_buffer_),
-        boost::bind(&BasicHitReceiver::receiveDatagram, this, error, bytes_transferred));
+    socket_optical_.async_receive(boost::asio::null_buffers(),
+        boost::bind(&BasicHitReceiver::receiveDatagram, this, error));
+}
+
+std::size_t BasicHitReceiver::readDatagram(boost::system::error_code& error)
+{
+    iovec iov { datagram_buffer_.data(), datagram_buffer_.size() };
+    union {
+        char buffer[CMSG_SPACE(sizeof(std::uint32_t)) + CMSG_SPACE(sizeof(timespec))];
+        cmsghdr align;
+    } control {};
+
+    msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    const ssize_t size { ::recvmsg(socket_optical_.native_handle(), &message, MSG_DONTWAIT) };
+    if (size < 0) {
+        error = boost::system::error_code { errno, boost::system::system_category() };
+        return 0;
+    }
+
+    // The running total is only attached once the queue has dropped anything.
+    std::uint32_t n_kernel_drops { n_kernel_drops_ };
+    arrival_ns_ = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            std::memcpy(&n_kernel_drops, CMSG_DATA(cmsg), sizeof(n_kernel_drops));
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec arrival {};
+            std::memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+            arrival_ns_ = static_cast<std::int64_t>(arrival.tv_sec) * 1000000000ll + arrival.tv_nsec;
+        }
+    }
+
+    if (resync_kernel_drops_) {
+        // Datagrams dropped while nobody was reading are not a loss.
+        n_kernel_drops_ = n_kernel_drops;
+        resync_kernel_drops_ = false;
+    } else if (n_kernel_drops != n_kernel_drops_) {
+        reportKernelDrops(n_kernel_drops);
+    }
+
+    return static_cast<std::size_t>(size);
 }
 
-void BasicHitReceiver::receiveDatagram(const boost::system::error_code& error, std::size_t size)
+void BasicHitReceiver::receiveDatagram(const boost::system::error_code& wait_error)
 {
-    bool have_data { true };
+    bool should_read { true };
     bool should_mine { true };
     bool should_request_more { true };
 
-    if (error) {
-        if (error.value() == boost::asio::error::operation_aborted && mode_ == DataMode::Idle) {
+    if (wait_error) {
+        if (wait_error.value() == boost::asio::error::operation_aborted && mode_ == DataMode::Idle) {
             /* Expected when the data is stopped. Do not clutter logs. */
         } else {
-            log(WARNING, "Dropping datagram due to socket failure: {} {}", error.value(), error.category().name());
+            log(WARNING, "Dropping datagram due to socket failure: {} {}", wait_error.value(), wait_error.category().name());
         }
 
-        have_data = false;
+        should_read = false;
     }
 
     switch (mode_) {
     case DataMode::Idle: // This must be a response to a request that we made earlier. Drop it.
         log(INFO, "Work on socket stopped.");
+        should_read = false;
         should_mine = false;
         should_request_more = false;
         break;
@@ -119,7 +201,17 @@ void BasicHitReceiver::receiveDatagram(const boost::system::error_code& error, s
         break;
     }
 
-    if (have_data) {
+    // Drain the queue before waiting again, a wait costs more system calls than the read itself.
+    for (std::size_t n_read = 0; should_read && n_read < MAX_DATAGRAMS_PER_WAKEUP; ++n_read) {
+        boost::system::error_code error {};
+        const std::size_t size { readDatagram(error) };
+        if (error) {
+            if (error != boost::asio::error::would_block) {
+                log(WARNING, "Dropping datagram due to socket failure: {} {}", error.value(), error.category().name());
+            }
+            break;
+        }
+
         checkAndProcessDatagram(datagram_buffer_.data(), size, should_mine);
     }
 
@@ -156,18 +248,20 @@ bool BasicHitReceiver::checkAndIncrementSequenceNumber(std::uint32_t plane_numbe
     auto next_seq_number_it { plane_to_next_sequence_number_.find(plane_number) };
     if (next_seq_number_it == plane_to_next_sequence_number_.end()) {
         // This is the first time we see this plane number, create a new entry for it.
-        std::tie(next_seq_number_it, std::ignore) = plane_to_next_sequence_number_.emplace(plane_number, seq_number);
+        std::tie(next_seq_number_it, std::ignore) = plane_to_next_sequence_number_.emplace(plane_number, PlaneSequence { seq_number, datagram_start_time });
     }
 
-    auto& next_seq_number { next_seq_number_it->second };
+    auto& next_seq_number { next_seq_number_it->second.next_seq_number };
     if (tolerate_seq_number_drops_) {
         // Allow the sequence number to drop only to zero.
         if (seq_number < next_seq_number && seq_number != 0) {
+            HitReceiverStats::add(stats_->plane(plane_number).n_late, 1);
             return false;
         }
     } else {
         // Do not allow drops at all.
         if (seq_number < next_seq_number) {
+            HitReceiverStats::add(stats_->plane(plane_number).n_late, 1);
             return false;
         }
     }
@@ -175,44 +269,77 @@ bool BasicHitReceiver::checkAndIncrementSequenceNumber(std::uint32_t plane_numbe
     if (seq_number > next_seq_number) {
         // We missed some datagrams. The gap ends at the start of this datagram.
         // This is not necessarily bad, we just take note of it and skip ahead.
-        reportDataStreamGap(datagram_start_time);
+        reportDataStreamGap(plane_number, seq_number - next_seq_number, next_seq_number_it->second.last_start_time, datagram_start_time);
     }
 
     next_seq_number = 1 + seq_number;
+    next_seq_number_it->second.last_start_time = datagram_start_time;
     return true;
 }
 
-void BasicHitReceiver::reportDataStreamGap(const tai_timestamp& gap_end)
+void BasicHitReceiver::reportDataStreamGap(std::uint32_t plane_number, std::uint32_t n_missed, const tai_timestamp& gap_start, const tai_timestamp& gap_end)
+{
+    // Datagrams dropped by our socket reappear as gaps of whichever planes they came from.
+    const std::uint32_t n_dropped { static_cast<std::uint32_t>(std::min<std::uint64_t>(n_missed, n_unattributed_drops_)) };
+    n_unattributed_drops_ -= n_dropped;
+    n_missed -= n_dropped;
+
+    PlaneCounters& counters { stats_->plane(plane_number) };
+    HitReceiverStats::add(counters.n_gaps, 1);
+    HitReceiverStats::add(counters.n_missed, n_missed);
+    HitReceiverStats::add(counters.n_dropped, n_dropped);
+
+    if (mode_ != DataMode::Mining || pending_annotations_.size() + 2 > MAX_PENDING_ANNOTATIONS) {
+        return;
+    }
+
+    if (n_dropped > 0) {
+        pending_annotations_.push_back(Annotation { AnnotationType::KERNEL_DROP, plane_number, 0, gap_start, gap_end });
+    }
+    if (n_missed > 0) {
+        pending_annotations_.push_back(Annotation { AnnotationType::SEQUENCE_GAP, plane_number, 0, gap_start, gap_end });
+    }
+}
+
+void BasicHitReceiver::reportKernelDrops(std::uint32_t n_kernel_drops)
 {
-    // TODO: implement me
+    // The kernel reports a running total, which wraps around.
+    const std::uint32_t n_new { n_kernel_drops - n_kernel_drops_ };
+    n_kernel_drops_ = n_kernel_drops;
+
+    stats_->addKernelDrops(n_new);
+    n_unattributed_drops_ += n_new;
 }
 
 void BasicHitReceiver::reportBadDatagram()
 {
-    // TODO: implement me
+    stats_->addBad();
 }
 
 void BasicHitReceiver::reportGoodDatagram(std::uint32_t plane_id, const tai_timestamp& start_time, const tai_timestamp& end_time, std::uint64_t n_hits)
 {
+    decoded_ns_ = realtimeNanosecs();
     spill_schedule_->updateLastApproxTimestamp(start_time);
 
-    // TODO: implement me
+    PlaneCounters& counters { stats_->plane(plane_id) };
+    HitReceiverStats::add(counters.n_datagrams, 1);
+    HitReceiverStats::add(counters.n_hits, n_hits);
 }
 
-SpillDataSlot* BasicHitReceiver::findAndLockDataSlot(const tai_timestamp& base_time)
+SpillDataSlot* BasicHitReceiver::findAndLockDataSlot(std::uint32_t plane_number, const tai_timestamp& base_time)
 {
     // TODO: perhaps use a more representative timestamp here instead?
     SpillDataSlot* slot { spill_schedule_->findDataSlot(base_time, data_slot_idx_) };
 
     if (!slot) {
         // Timestamp not matched to any open spill, discard datagram.
-        // TODO: devise a reporting mechanism for this
+        HitReceiverStats::add(stats_->plane(plane_number).n_discarded, 1);
         return nullptr;
     }
 
     if (slot->closed_for_writing) {
         // Inexpensive check before (potentially expensive) locking
-        // TODO: devise a reporting mechanism for this
+        HitReceiverStats::add(stats_->plane(plane_number).n_discarded, 1);
         return nullptr;
     }
 
@@ -221,10 +348,24 @@ SpillDataSlot* BasicHitReceiver::findAndLockDataSlot(const tai_timestamp& base_t
 
     if (slot->closed_for_writing) {
         // Have a spill, which has been closed but not yet removed from the schedule. Discard datagram.
-        // TODO: devise a reporting mechanism for this
         slot->mutex.unlock();
+        HitReceiverStats::add(stats_->plane(plane_number).n_discarded, 1);
         return nullptr;
     }
 
+    // The slot lock doubles as the lock of its latency histograms.
+    const std::int64_t locked_ns { realtimeNanosecs() };
+    if (arrival_ns_ != 0) {
+        slot->arrival_to_decode.record(decoded_ns_ - arrival_ns_);
+    }
+    slot->decode_to_slot.record(locked_ns - decoded_ns_);
+    slot->last_arrival_ns = std::max(slot->last_arrival_ns, arrival_ns_ != 0 ? arrival_ns_ : decoded_ns_);
+
+    // Gaps are annotated in the spill of the datagram which revealed them.
+    if (!pending_annotations_.empty()) {
+        slot->opt_annotation_queue.insert(slot->opt_annotation_queue.end(), pending_annotations_.begin(), pending_annotations_.end());
+        pending_annotations_.clear();
+    }
+
     return slot;
 }
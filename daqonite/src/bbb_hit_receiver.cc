@@ -65,7 +65,7 @@ void BBBHitReceiver::processDatagram(const char* datagram, std::size_t datagram_
 void BBBHitReceiver::mineHits(const opt_packet_hit_t* hits_begin, std::size_t n_hits, const tai_timestamp& base_time, std::uint32_t plane_number)
 {
     SpillDataSlot* found_slot {};
-    if (!(found_slot = findAndLockDataSlot(base_time))) {
+    if (!(found_slot = findAndLockDataSlot(plane_number, base_time))) {
         // Have no slot to store the hits, discard datagram.
         return;
     }
@@ -76,6 +76,7 @@ void BBBHitReceiver::mineHits(const opt_packet_hit_t* hits_begin, std::size_t n_
 
     // Find/create queue for this plane
     PMTHitQueue& event_queue { slot.opt_hit_queue.get_queue_for_writing(plane_number) };
+    PlaneHistograms& histograms { slot.opt_hit_histograms.plane(plane_number) };
 
     // Find the number of hits this packet contains and loop over them all
     event_queue.reserve(event_queue.size() + n_hits);
@@ -97,6 +98,8 @@ void BBBHitReceiver::mineHits(const opt_packet_hit_t* hits_begin, std::size_t n_
         dest_hit.cpu_trigger = 0 != (OPT_PACKET_HIT_CPU_TRIGGER_FLAG & src_hit.channel_and_flags);
 
         dest_hit.sort_key = dest_hit.timestamp.combined_secs();
+
+        histograms.fill(dest_hit.channel_number, dest_hit.tot, dest_hit.adc0);
     }
 }
 
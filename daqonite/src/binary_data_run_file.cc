@@ -0,0 +1,161 @@
+#include <chrono>
+#include <cstring>
+
+#include <util/pmt_hit_queues.h>
+
+#include "binary_data_run_file.h"
+
+using namespace binary_format;
+
+BinaryDataRunFile::BinaryDataRunFile(const std::string& path, const DataRunFileSettings& settings)
+    : DataRunFile {}
+    , settings_ { settings }
+    , writer_ {}
+    , index_ {}
+    , run_params_offset_ { 0 }
+    , columns_ {}
+    , payload_ {}
+    , compressed_ {}
+    , last_bytes_written_ { 0 }
+    , total_raw_bytes_ { 0 }
+    , total_zip_bytes_ { 0 }
+{
+    try {
+        writer_.reset(new DirectFileWriter { path, settings.binary_buffer_size, settings.binary_direct_io });
+    } catch (const std::exception&) {
+        // isOpen() reports the failure
+        return;
+    }
+
+    FileHeader header {};
+    header.magic = FILE_MAGIC;
+    header.version = VERSION;
+    writer_->write(&header, sizeof(header));
+}
+
+void BinaryDataRunFile::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    // Footer allows readers to find spills without scanning the file.
+    std::vector<char> index_payload(index_.size() * sizeof(SpillIndexEntry));
+    if (!index_.empty()) {
+        std::memcpy(index_payload.data(), index_.data(), index_payload.size());
+    }
+
+    FileTrailer trailer {};
+    trailer.index_offset = writeBlock(BlockType::SpillIndex, index_payload, false);
+    trailer.run_params_offset = run_params_offset_;
+    trailer.n_spills = index_.size();
+    trailer.magic = TRAILER_MAGIC;
+    writer_->write(&trailer, sizeof(trailer));
+
+    writer_->close();
+    writer_.reset();
+}
+
+DataRunFileFlushStats BinaryDataRunFile::flush()
+{
+    DataRunFileFlushStats stats {};
+    if (!isOpen()) {
+        return stats;
+    }
+
+    // Writes are cheap here, hence every call writes out all complete blocks.
+    const std::uint64_t bytes_written { writer_->bytesWritten() };
+    const auto start { std::chrono::steady_clock::now() };
+    writer_->flush();
+    const std::chrono::duration<double, std::milli> elapsed { std::chrono::steady_clock::now() - start };
+
+    // Idle calls write nothing, and are not worth reporting as checkpoints.
+    stats.checkpoint = writer_->bytesWritten() > bytes_written;
+    stats.duration_ms = elapsed.count();
+    stats.bytes_written = writer_->bytesWritten() - bytes_written;
+    return stats;
+}
+
+bool BinaryDataRunFile::isOpen() const
+{
+    return writer_ && writer_->isOpen();
+}
+
+std::uint64_t BinaryDataRunFile::writeBlock(BlockType type, const std::vector<char>& payload, bool compress, std::uint32_t flags)
+{
+    const std::uint64_t offset { writer_->offset() };
+
+    BlockHeader header {};
+    header.type = static_cast<std::uint32_t>(type);
+    header.flags = flags;
+    header.raw_size = payload.size();
+
+    // Blocks that do not shrink are stored as they are.
+    const std::vector<char>* stored { &payload };
+    if (compress && compressPayload(payload, compressed_, settings_.binary_compression_level)) {
+        header.flags |= BLOCK_FLAG_ZLIB;
+        stored = &compressed_;
+    }
+
+    header.stored_size = stored->size();
+    writer_->write(&header, sizeof(header));
+    writer_->write(stored->data(), stored->size());
+
+    total_raw_bytes_ += sizeof(header) + payload.size();
+    total_zip_bytes_ += sizeof(header) + stored->size();
+    return offset;
+}
+
+void BinaryDataRunFile::writeRunParams(BlockType type, const RunParameters& params)
+{
+    const RunParamsBlock block { encodeRunParams(params) };
+    payload_.resize(sizeof(block));
+    std::memcpy(payload_.data(), &block, sizeof(block));
+
+    run_params_offset_ = writeBlock(type, payload_, false);
+}
+
+void BinaryDataRunFile::writeRunParametersAtStart(const RunParameters& params)
+{
+    writeRunParams(BlockType::RunParamsStart, params);
+}
+
+void BinaryDataRunFile::writeRunParametersAtEnd(const RunParameters& params)
+{
+    writeRunParams(BlockType::RunParamsEnd, params);
+}
+
+DataRunFileSpillStats BinaryDataRunFile::writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits)
+{
+    SpillRecord record {};
+    record.number = spill->spill_number;
+    record.time_started = spill->start_time;
+    record.time_stopped = spill->end_time;
+
+    const std::uint64_t raw_bytes { total_raw_bytes_ };
+    const std::uint64_t zip_bytes { total_zip_bytes_ };
+
+    // transpose hits into columns and store them as a single block
+    const bool packed { settings_.hit_layout == HitLayout::Packed };
+    columns_.assign(merged_hits);
+    encodeSpill(record, columns_, payload_, packed);
+
+    SpillIndexEntry entry {};
+    entry.number = record.number;
+    entry.offset = writeBlock(BlockType::Spill, payload_, settings_.binary_compression_level > 0,
+        packed ? BLOCK_FLAG_PACKED_HITS : 0);
+    entry.n_hits = columns_.size();
+    entry.time_started_s = record.time_started.secs;
+    entry.time_started_ns = record.time_started.nanosecs;
+    index_.push_back(entry);
+
+    DataRunFileSpillStats stats {};
+    stats.total_bytes_written = writer_->bytesWritten();
+    stats.bytes_written = stats.total_bytes_written - last_bytes_written_;
+    stats.raw_bytes = total_raw_bytes_ - raw_bytes;
+    stats.zip_bytes = total_zip_bytes_ - zip_bytes;
+    stats.compression_ratio = total_zip_bytes_ > 0 ? static_cast<double>(total_raw_bytes_) / total_zip_bytes_ : 0.0;
+
+    last_bytes_written_ = stats.total_bytes_written;
+    return stats;
+}
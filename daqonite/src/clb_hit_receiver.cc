@@ -79,7 +79,7 @@ void CLBHitReceiver::processDatagram(const char* datagram, std::size_t datagram_
 void CLBHitReceiver::mineHits(const hit_t* hits_begin, std::size_t n_hits, const tai_timestamp& base_time, std::uint32_t plane_number)
 {
     SpillDataSlot* found_slot {};
-    if (!(found_slot = findAndLockDataSlot(base_time))) {
+    if (!(found_slot = findAndLockDataSlot(plane_number, base_time))) {
         // Have no slot to store the hits, discard datagram.
         return;
     }
@@ -90,6 +90,7 @@ void CLBHitReceiver::mineHits(const hit_t* hits_begin, std::size_t n_hits, const
 
     // Find/create a queue for this plane.
     PMTHitQueue& event_queue { slot.opt_hit_queue.get_queue_for_writing(plane_number) };
+    PlaneHistograms& histograms { slot.opt_hit_histograms.plane(plane_number) };
 
     // Enqueue all the hits!
     event_queue.reserve(event_queue.size() + n_hits);
@@ -110,6 +111,8 @@ void CLBHitReceiver::mineHits(const hit_t* hits_begin, std::size_t n_hits, const
         dest_hit.timestamp = calculateHitTime(src_hit, base_time);
 
         dest_hit.sort_key = dest_hit.timestamp.combined_secs();
+
+        histograms.fill(dest_hit.channel_number, dest_hit.tot, dest_hit.adc0);
     }
 }
 
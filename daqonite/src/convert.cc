@@ -0,0 +1,169 @@
+/**
+ * Program name: daqonite_convert - Converts run files from the native binary format to ROOT.
+ *
+ * Spills are read and decompressed by a pool of threads, while a single thread fills
+ * the ROOT trees in the original order. ROOT implicit multithreading is used to
+ * compress baskets in parallel.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+#include <TROOT.h>
+
+#include <run_file/binary_run_file_reader.h>
+
+#include "root_data_run_file.h"
+
+namespace exit_code {
+static constexpr int success = 0;
+static constexpr int failure = 1;
+}
+
+struct ConvertSettings {
+    std::vector<std::string> input_paths;
+    std::string output_directory;
+    std::size_t n_threads;
+    unsigned n_imt_threads;
+    std::string hit_layout;
+    std::string compression_algorithm;
+    int compression_level;
+};
+
+/// Spill decoded into the form accepted by DataRunFile.
+struct DecodedSpill {
+    SpillRecord record;
+    PMTHitQueue hits;
+};
+
+static DecodedSpill decodeSpill(const BinaryRunFileReader& reader, std::size_t spill_index)
+{
+    DecodedSpill decoded {};
+    HitColumns columns {};
+    reader.readSpill(spill_index, decoded.record, columns);
+    columns.append(0, columns.size(), decoded.hits);
+    return decoded;
+}
+
+static std::string outputPath(const ConvertSettings& settings, const std::string& input_path)
+{
+    std::string path { input_path };
+
+    const std::size_t slash { path.rfind('/') };
+    if (!settings.output_directory.empty()) {
+        path = fmt::format("{}/{}", settings.output_directory, slash == std::string::npos ? path : path.substr(slash + 1));
+    }
+
+    const std::string extension { fmt::format(".{}", run_file::runFileExtension(RunFileFormat::Binary)) };
+    if (path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        path.erase(path.size() - extension.size());
+    }
+
+    return fmt::format("{}.{}", path, run_file::runFileExtension(RunFileFormat::Root));
+}
+
+static void convert(const ConvertSettings& settings, const DataRunFileSettings& file_settings, const std::string& input_path)
+{
+    const BinaryRunFileReader reader { input_path };
+    const std::string output_path { outputPath(settings, input_path) };
+
+    if (!reader.isComplete()) {
+        fmt::print("Warning: '{}' was not closed properly, recovered {} spills\n", input_path, reader.index().size());
+    }
+
+    RootDataRunFile output { output_path, file_settings };
+    if (!output.isOpen()) {
+        throw std::runtime_error { fmt::format("Error opening file for writing: '{}'", output_path) };
+    }
+
+    output.writeRunParametersAtStart(reader.runParameters());
+
+    // Keep a window of spills being decoded ahead of the writer.
+    const std::size_t n_spills { reader.index().size() };
+    std::deque<std::future<DecodedSpill>> pending {};
+    std::size_t next_spill { 0 };
+    std::uint64_t n_hits { 0 };
+
+    for (std::size_t spill_index = 0; spill_index < n_spills; ++spill_index) {
+        while (next_spill < n_spills && pending.size() < settings.n_threads) {
+            pending.push_back(std::async(std::launch::async, decodeSpill, std::cref(reader), next_spill++));
+        }
+
+        DecodedSpill decoded { pending.front().get() };
+        pending.pop_front();
+
+        Spill spill {};
+        spill.spill_number = decoded.record.number;
+        spill.start_time = decoded.record.time_started;
+        spill.end_time = decoded.record.time_stopped;
+        output.writeSpill(&spill, decoded.hits);
+        n_hits += decoded.hits.size();
+    }
+
+    output.writeRunParametersAtEnd(reader.runParameters());
+    output.close();
+
+    fmt::print("Converted '{}' -> '{}' ({} spills, {} hits)\n", input_path, output_path, n_spills, n_hits);
+}
+
+int main(int argc, char* argv[])
+{
+    namespace opts = boost::program_options;
+
+    ConvertSettings settings {};
+
+    opts::options_description desc { "Options" };
+    desc.add_options()("help,h", "daqonite_convert - convert binary run files to ROOT")
+        ("input", opts::value<std::vector<std::string>>(&settings.input_paths)->required(), "Input files")
+        ("output-dir,o", opts::value<std::string>(&settings.output_directory)->default_value(""), "Output directory (defaults to that of input)")
+        ("threads,j", opts::value<std::size_t>(&settings.n_threads)->default_value(4), "Number of spills decoded in parallel")
+        ("imt-threads", opts::value<unsigned>(&settings.n_imt_threads)->default_value(4), "ROOT implicit multithreading pool size (0 disables)")
+        ("layout", opts::value<std::string>(&settings.hit_layout)->default_value("per_hit"), "Layout of optical hits (per_hit|columnar|packed)")
+        ("compression-algorithm", opts::value<std::string>(&settings.compression_algorithm)->default_value("LZ4"), "ROOT compression algorithm (ZLIB|LZMA|LZ4|ZSTD)")
+        ("compression-level", opts::value<int>(&settings.compression_level)->default_value(4), "ROOT compression level (0-9)");
+
+    opts::positional_options_description positional {};
+    positional.add("input", -1);
+
+    opts::variables_map vm {};
+    opts::store(opts::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return exit_code::success;
+    }
+
+    opts::notify(vm);
+
+    DataRunFileSettings file_settings {};
+    file_settings.format = RunFileFormat::Root;
+    file_settings.compression_algorithm = DataRunFileSettings::parseCompressionAlgorithm(settings.compression_algorithm);
+    file_settings.compression_level = settings.compression_level;
+    file_settings.hit_layout = run_file::parseHitLayout(settings.hit_layout);
+    file_settings.basket_sizes[run_file::OPT_HITS_TREE] = 1048576;
+    file_settings.basket_sizes[run_file::OPT_HIT_COLUMNS_TREE] = 8388608;
+    settings.n_threads = std::max<std::size_t>(settings.n_threads, 1);
+
+    if (settings.n_imt_threads > 0) {
+        ROOT::EnableImplicitMT(settings.n_imt_threads);
+    }
+
+    int status { exit_code::success };
+    for (const std::string& input_path : settings.input_paths) {
+        try {
+            convert(settings, file_settings, input_path);
+        } catch (const std::exception& ex) {
+            std::cerr << fmt::format("Failed to convert '{}': {}", input_path, ex.what()) << std::endl;
+            status = exit_code::failure;
+        }
+    }
+
+    return status;
+}
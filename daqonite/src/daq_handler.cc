@@ -3,6 +3,7 @@
  */
 
 #include <cstring>
+#include <vector>
 
 #include <util/config.h>
 #include <util/logging.h>
@@ -25,13 +26,18 @@ DAQHandler::DAQHandler()
     , spill_schedule_ { new SpillSchedule }
     , hit_receivers_ {}
     , scheduling_ { new SpillSchedulers }
+    , histogram_publisher_ { new HistogramPublisher(g_config.lookupString("bus.daqonite_histograms")) }
+    , receiver_stats_ { new HitReceiverStatsCollector(g_config.lookupDouble("receiver_stats_interval")) }
+    , socket_monitor_ { new SocketBufferMonitor(SocketBufferSettings::fromConfig()) }
+    , ingest_latencies_ { new IngestLatencies(g_config.lookupDouble("latency_window")) }
 {
     setUnitName("DAQHandler");
 }
 
 void DAQHandler::createHitReceivers()
 {
-    // Get rid of any previous receivers.
+    // Get rid of any previous receivers, which must not be monitored once their sockets close.
+    socket_monitor_->setSockets({});
     hit_receivers_.clear();
 
     // Setup the CLB handler (if required)
@@ -43,10 +49,23 @@ void DAQHandler::createHitReceivers()
     for (const int port : bbb_ports_) {
         hit_receivers_.emplace_back(new BBBHitReceiver(io_service_, spill_schedule_, port));
     }
+
+    std::vector<std::shared_ptr<HitReceiverStats>> stats {};
+    std::vector<MonitoredSocket> sockets {};
+    for (const auto& hit_receiver : hit_receivers_) {
+        stats.push_back(hit_receiver->stats());
+        sockets.push_back(MonitoredSocket { hit_receiver->socketHandle(), hit_receiver->stats() });
+    }
+    receiver_stats_->setReceivers(stats);
+    socket_monitor_->setSockets(sockets);
 }
 
 void DAQHandler::run()
 {
+    histogram_publisher_->runAsync();
+    receiver_stats_->runAsync();
+    socket_monitor_->runAsync();
+
     // Setup the thread group and call io_service.run() in each
     log(INFO, "Starting I/O service on {} threads", n_hit_threads_);
     for (std::size_t i = 0; i < n_hit_threads_; ++i) {
@@ -57,6 +76,15 @@ void DAQHandler::run()
     thread_group_.join_all();
     spill_schedule_->join();
 
+    socket_monitor_->notifyJoin();
+    socket_monitor_->join();
+
+    receiver_stats_->notifyJoin();
+    receiver_stats_->join();
+
+    histogram_publisher_->notifyJoin();
+    histogram_publisher_->join();
+
     log(INFO, "I/O service signing off.");
 }
 
@@ -100,7 +128,7 @@ void DAQHandler::handleStartRunCommand(RunType which)
 
     // Set the mode to data taking
     data_run_ = std::make_shared<DataRun>(which, output_directory_path_, scheduling_);
-    data_run_serialiser_ = std::make_shared<DataRunSerialiser>(data_run_);
+    data_run_serialiser_ = std::make_shared<DataRunSerialiser>(data_run_, histogram_publisher_, ingest_latencies_);
 
     data_run_->start();
     log(INFO, "Started data run: {}", data_run_->logDescription());
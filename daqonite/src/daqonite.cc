@@ -13,6 +13,8 @@
 
 #include <boost/program_options.hpp>
 
+#include <TROOT.h>
+
 #include <util/command_receiver.h>
 #include <util/config.h>
 #include <util/elastic_interface.h>
@@ -72,6 +74,16 @@ public:
         g_elastic.init(process_name);
         log(INFO, "Checking hard hats, high-vis, boots and gloves!");
 
+        // Run file segments are closed on background threads.
+        ROOT::EnableThreadSafety();
+
+        // Let ROOT compress baskets of run files in parallel.
+        const std::uint32_t n_imt_threads { g_config.lookupU32("run_file.n_imt_threads") };
+        if (n_imt_threads > 0) {
+            ROOT::EnableImplicitMT(n_imt_threads);
+            log(INFO, "ROOT implicit multithreading enabled with {} threads", n_imt_threads);
+        }
+
         {
             // Main entry point.
             std::shared_ptr<DAQHandler> daq_handler { new DAQHandler() };
@@ -8,6 +8,15 @@
 
 #include "daqonite_publisher.h"
 
+static DaqoniteStateMessage::LatencyPercentiles busPercentiles(const LatencyPercentiles& percentiles)
+{
+    return DaqoniteStateMessage::LatencyPercentiles {
+        static_cast<float>(percentiles.p50_us),
+        static_cast<float>(percentiles.p99_us),
+        static_cast<float>(percentiles.max_us),
+    };
+}
+
 DaqonitePublisher::DaqonitePublisher(std::shared_ptr<DAQHandler> daq_handler)
     : BusPublisher { g_config.lookupString("bus.daqonite") }
     , daq_handler_ { std::move(daq_handler) }
@@ -29,6 +38,23 @@ void DaqonitePublisher::publishStatus()
         message.Discriminator = DaqoniteStateMessage::Ready::Discriminator;
     }
 
+    const HitReceiverRates rates { daq_handler_->getReceiverRates() };
+    message.Receivers.Datagrams = static_cast<float>(rates.datagrams);
+    message.Receivers.Hits = static_cast<float>(rates.hits);
+    message.Receivers.BadDatagrams = static_cast<float>(rates.bad);
+    message.Receivers.Gaps = static_cast<float>(rates.gaps);
+    message.Receivers.MissedDatagrams = static_cast<float>(rates.missed);
+    message.Receivers.DroppedDatagrams = static_cast<float>(rates.dropped);
+    message.Receivers.KernelDrops = static_cast<float>(rates.kernel_drops);
+    message.Receivers.DiscardedDatagrams = static_cast<float>(rates.discarded);
+    message.Receivers.QueuePeak = static_cast<float>(rates.queue_peak);
+
+    const IngestLatencyPercentiles latencies { daq_handler_->getIngestLatencies() };
+    message.Latencies.ArrivalToDecode = busPercentiles(latencies.arrival_to_decode);
+    message.Latencies.DecodeToSlot = busPercentiles(latencies.decode_to_slot);
+    message.Latencies.EndToClose = busPercentiles(latencies.end_to_close);
+    message.Latencies.CloseToWritten = busPercentiles(latencies.close_to_written);
+
     std::lock_guard<std::mutex> lk { mtx_publish_queue_ };
     publish_queue_.emplace_back(std::move(message));
     cv_publish_queue_.notify_one();
@@ -5,6 +5,7 @@
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
+#include <run_file/layout.h>
 #include <util/config.h>
 #include <util/elastic_interface.h>
 
@@ -130,7 +131,9 @@ void DataRun::setOutputFileName()
     }
 
     // TODO: use filesystem path join here
-    output_file_path_ = fmt::format("{}/type{}_run{:05d}.root", output_directory_path_, run_type_no, number_);
+    const RunFileFormat format { run_file::parseRunFileFormat(g_config.lookupString("run_file.format")) };
+    output_file_path_ = fmt::format("{}/type{}_run{:05d}.{}", output_directory_path_, run_type_no, number_,
+        run_file::runFileExtension(format));
 }
 
 std::shared_ptr<BasicSpillScheduler> DataRun::getScheduler() const
@@ -150,3 +153,13 @@ std::shared_ptr<BasicSpillScheduler> DataRun::getScheduler() const
         return {};
     }
 }
+
+RunParameters DataRun::getParameters() const
+{
+    RunParameters params {};
+    params.number = number_;
+    params.type = static_cast<std::uint8_t>(type_);
+    params.time_started = pc_time_started_;
+    params.time_stopped = pc_time_stopped_;
+    return params;
+}
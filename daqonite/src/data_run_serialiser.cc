@@ -1,14 +1,31 @@
+#include <algorithm>
+
 #include <util/config.h>
+#include <util/elastic_interface.h>
 
 #include "data_run_file.h"
 #include "data_run_serialiser.h"
-#include "merge_sorter.h"
+#include "spill_sorter.h"
 
-DataRunSerialiser::DataRunSerialiser(const std::shared_ptr<DataRun>& data_run)
+DataRunSerialiser::DataRunSerialiser(const std::shared_ptr<DataRun>& data_run,
+    std::shared_ptr<HistogramPublisher> histogram_publisher,
+    std::shared_ptr<IngestLatencies> ingest_latencies)
     : Logging {}
     , AsyncComponent {}
     , data_run_ { data_run }
     , waiting_spills_ { g_config.lookupU32("max_serialiser_queue_size") }
+    , n_waiting_spills_ { 0 }
+    , max_waiting_spills_ { g_config.lookupU32("max_serialiser_queue_size") }
+    , radix_sort_disorder_threshold_ { g_config.lookupDouble("radix_sort_disorder_threshold") }
+    , n_radix_sort_threads_ { g_config.lookupU32("n_radix_sort_threads") }
+    , gap_threshold_s_ { g_config.lookupDouble("hit_gap_threshold") }
+    , pipeline_stats_interval_ { g_config.lookupDouble("pipeline_stats_interval") }
+    , event_builder_settings_ { EventBuilderSettings::fromConfig() }
+    , histogram_publisher_ { std::move(histogram_publisher) }
+    , ingest_latencies_ { std::move(ingest_latencies) }
+    , handoff_ { g_config.lookupU32("n_serialiser_buffers") }
+    , sort_busy_us_ { 0 }
+    , write_busy_us_ { 0 }
 {
     setUnitName("DataRunSerialiser");
 }
@@ -24,7 +41,28 @@ DataRunSerialiser::~DataRunSerialiser()
 
 bool DataRunSerialiser::serialiseSpill(SpillPtr spill)
 {
-    return waiting_spills_.push(spill);
+    if (!waiting_spills_.push(spill)) {
+        return false;
+    }
+
+    ++n_waiting_spills_;
+    return true;
+}
+
+SerialiserPipelineStats DataRunSerialiser::pipelineStats() const
+{
+    const SpillHandoffStats handoff_stats { handoff_.stats() };
+
+    SerialiserPipelineStats stats {};
+    stats.sort_queue_occupancy = n_waiting_spills_;
+    stats.sort_queue_capacity = max_waiting_spills_;
+    stats.sort_busy_ms = sort_busy_us_ / 1000.0;
+    stats.sort_stall_ms = handoff_stats.producer_stall_ms;
+    stats.write_queue_occupancy = handoff_stats.occupancy;
+    stats.write_queue_capacity = handoff_stats.capacity;
+    stats.write_busy_ms = write_busy_us_ / 1000.0;
+    stats.write_stall_ms = handoff_stats.consumer_stall_ms;
+    return stats;
 }
 
 void DataRunSerialiser::run()
@@ -35,17 +73,23 @@ void DataRunSerialiser::run()
     const std::string out_file_path { data_run_->getOutputFilePath() };
     log(INFO, "Run {} will be saved at: '{}'", data_run_->logDescription(), out_file_path);
 
-    DataRunFile out_file { out_file_path };
-    if (!out_file.isOpen()) {
+    std::unique_ptr<DataRunFile> out_file { DataRunFile::create(out_file_path, DataRunFileSettings::fromConfig()) };
+    if (!out_file->isOpen()) {
         log(ERROR, "Error opening file for writing: '{}'", out_file_path);
         return;
     }
 
-    out_file.writeRunParametersAtStart(data_run_);
-    out_file.flush();
+    out_file->writeRunParametersAtStart(data_run_->getParameters());
+    out_file->flush();
+
+    // From now on, the file belongs to the writer thread.
+    std::thread writer_thread { &DataRunSerialiser::writeSpills, this, std::move(out_file) };
+
+    SpillSorter sorter { radix_sort_disorder_threshold_, n_radix_sort_threads_, gap_threshold_s_ };
 
-    MergeSorter sorter {};
-    PMTHitQueue out_queue {};
+    // Only runs taking physics data may lose hits outside events.
+    EventBuilder event_builder { event_builder_settings_ };
+    const bool drop_hits { event_builder_settings_.drop_hits && data_run_->getType() == RunType::DataNormal };
     for (;;) {
         // Obtain a spill to process.
         bool have_spill { false };
@@ -54,11 +98,12 @@ void DataRunSerialiser::run()
         if (waiting_spills_.pop(current_spill)) {
             // If there's something to process, dequeue.
             have_spill = true;
+            --n_waiting_spills_;
         } else if (!running_) {
             // If not, and we're done, stop.
             break;
         } else {
-            // Sleep.
+            // Sleep, the writer thread takes care of checkpoints meanwhile.
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
         }
 
@@ -68,71 +113,363 @@ void DataRunSerialiser::run()
 
         // At this point, we always have a valid spill.
 
+        // Blocks while the writer still holds all buffers, i.e. when disk is the bottleneck.
+        std::unique_ptr<SortedSpill> sorted { handoff_.acquire() };
+        if (!sorted) {
+            log(ERROR, "Writer thread stopped, discarding spill {}", current_spill->spill_number);
+            delete current_spill;
+            continue;
+        }
+        const auto sort_start { std::chrono::steady_clock::now() };
+
         // Consolidate multi-queue by moving it into a single instance.
         PMTMultiPlaneHitQueue events {};
+        ChannelHistograms histograms {};
         for (std::size_t data_slot_idx = 0; data_slot_idx < current_spill->n_data_slots; ++data_slot_idx) {
             SpillDataSlot& slot { current_spill->data_slots[data_slot_idx] };
             PMTMultiPlaneHitQueue& slot_multiqueue { slot.opt_hit_queue };
             for (auto it = slot_multiqueue.begin(); it != slot_multiqueue.end(); ++it) {
                 events.emplace(it->first, std::move(it->second));
             }
+            histograms.merge(slot.opt_hit_histograms);
+            sorted->arrival_to_decode.merge(slot.arrival_to_decode);
+            sorted->decode_to_slot.merge(slot.decode_to_slot);
+            sorted->last_arrival_ns = std::max(sorted->last_arrival_ns, slot.last_arrival_ns);
         }
 
-        // TODO: consolidate annotation queues in the same way
+        // Annotations stay in their slots, the run file gathers them when the spill is written.
+
+        summariseChannels(current_spill, histograms, sorted->channel_summaries);
+        const auto merge_end { std::chrono::steady_clock::now() };
 
         log(INFO, "Processing spill {} (from {} planes)",
             current_spill->spill_number, events.size());
 
-        // Calculate complete timestamps & make sure sequence is sorted
-        std::size_t n_hits { 0 };
-        for (auto& key_value : events) {
-            PMTHitQueue& queue { key_value.second };
-            n_hits += queue.size();
+        // Make sure sequence is sorted, picking the algorithm based on how disordered it is.
+        const SpillSortStats sort_stats { sorter.sort(events, sorted->hits) };
+        const auto sort_end { std::chrono::steady_clock::now() };
+
+        // Summarise before the event builder gets a chance to drop hits.
+        summariseSpill(current_spill, sort_stats, histograms, *sorted);
 
-            // TODO: report disorder measure to backend
-            const std::size_t n_swaps = insertSort(queue);
-            log(INFO, "Plane {} ({} hits) required {} swaps to achieve time ordering", key_value.first, queue.size(), n_swaps);
+        if (sort_stats.n_hits > 0) {
+            log(INFO, "Sorted {} hits using {} ({} displaced hits, disorder {:.4f}, {} swaps, {} radix passes)",
+                sort_stats.n_hits, SpillSorter::formatStrategy(sort_stats.strategy), sort_stats.n_displaced,
+                sort_stats.disorder, sort_stats.n_swaps, sort_stats.n_radix_passes);
         }
 
-        out_queue.clear();
+        // Find coincidences in the sorted sequence.
+        if (event_builder_settings_.enabled) {
+            const EventBuilderStats event_stats { drop_hits ? event_builder.buildAndDrop(sorted->hits, sorted->events)
+                                                            : event_builder.build(sorted->hits, sorted->events) };
 
-        if (n_hits > 0) {
-            // Merge-sort hits.
-            log(INFO, "Merge-sorting {} hits", n_hits);
-            sorter.merge(events, out_queue);
+            log(INFO, "Built {} events from {} hits ({} hits in events, {} hits kept)",
+                event_stats.n_events, event_stats.n_hits, event_stats.n_event_hits, event_stats.n_kept_hits);
         }
 
-        // Write sorted events out.
-        out_file.writeSpill(current_spill, out_queue);
-        out_file.flush();
-        out_queue.clear();
+        const auto build_end { std::chrono::steady_clock::now() };
+        sorted->summary.merge_ms = std::chrono::duration<double, std::milli> { merge_end - sort_start }.count();
+        sorted->summary.sort_ms = std::chrono::duration<double, std::milli> { sort_end - merge_end }.count();
+        sorted->summary.build_ms = std::chrono::duration<double, std::milli> { build_end - sort_end }.count();
 
-        log(INFO, "Spill {} done and written", current_spill->spill_number);
-        delete current_spill;
-    }
+        sort_busy_us_ += std::chrono::duration_cast<std::chrono::microseconds>(build_end - sort_start).count();
 
-    out_file.writeRunParametersAtEnd(data_run_);
-    out_file.flush();
+        // Hand sorted events over to the writer.
+        sorted->spill = current_spill;
+        handoff_.push(std::move(sorted));
+    }
 
-    // Close output file.
-    out_file.close();
+    handoff_.close();
+    writer_thread.join();
 
     log(DEBUG, "Output thread signing off");
 }
 
-std::size_t DataRunSerialiser::insertSort(PMTHitQueue& queue) noexcept
+void DataRunSerialiser::summariseChannels(const SpillPtr spill, const ChannelHistograms& histograms,
+    std::vector<ChannelSummaryRecord>& summaries)
 {
-    // Just your conventional O(n^2) insert-sort implementation.
-    // Here utilized because insert-sort is actually O(n+k*n) for k-sorted sequences.
-    // Since event queue should already be sorted, insert-sort will frequently only scan it in O(n).
-
-    std::size_t n_swaps { 0 };
-    for (std::size_t i = 1; i < queue.size(); ++i) {
-        for (std::size_t j = i; j > 0 && queue[j - 1] > queue[j]; --j) {
-            std::swap(queue[j], queue[j - 1]);
-            ++n_swaps;
+    const double duration_s { static_cast<double>(spill->end_time.combined_secs() - spill->start_time.combined_secs()) };
+    if (histogram_publisher_) {
+        histogram_publisher_->publishSpill(data_run_->getNumber(), spill->spill_number, duration_s, histograms);
+    }
+
+    for (const auto& plane : histograms.planes()) {
+        for (std::size_t channel_number = 0; channel_number < PlaneHistograms::N_CHANNELS; ++channel_number) {
+            const ChannelHistogram& histogram { plane.second.channels[channel_number] };
+            if (histogram.n_hits == 0) {
+                continue;
+            }
+
+            ChannelSummaryRecord summary {};
+            summary.spill_number = spill->spill_number;
+            summary.plane_number = plane.first;
+            summary.channel_number = static_cast<std::uint8_t>(channel_number);
+            summary.n_hits = histogram.n_hits;
+            summary.rate_hz = duration_s > 0 ? histogram.n_hits / duration_s : 0.0;
+            summary.tot_mean = histogram.totMean();
+            summary.tot_rms = histogram.totRMS();
+            summary.adc0_mean = histogram.adc0Mean();
+            summary.adc0_rms = histogram.adc0RMS();
+            summaries.push_back(summary);
         }
     }
+}
+
+void DataRunSerialiser::summariseSpill(const SpillPtr spill, const SpillSortStats& sort_stats,
+    const ChannelHistograms& histograms, SortedSpill& sorted) const
+{
+    SpillSummaryRecord& summary { sorted.summary };
+    summary.spill_number = spill->spill_number;
+    summary.n_hits = sort_stats.n_hits;
+    summary.n_displaced = sort_stats.n_displaced;
+    summary.disorder = sort_stats.disorder;
+    summary.n_swaps = sort_stats.n_swaps;
+    summary.n_gaps = sort_stats.n_gaps;
+
+    if (!sorted.hits.empty()) {
+        summary.time_first = sorted.hits.front().timestamp;
+        summary.time_last = sorted.hits.back().timestamp;
+    }
+
+    const LatencyPercentiles arrival_to_decode { LatencyPercentiles::of(sorted.arrival_to_decode) };
+    summary.arrival_to_decode_p50_us = arrival_to_decode.p50_us;
+    summary.arrival_to_decode_p99_us = arrival_to_decode.p99_us;
+    summary.arrival_to_decode_max_us = arrival_to_decode.max_us;
+
+    const LatencyPercentiles decode_to_slot { LatencyPercentiles::of(sorted.decode_to_slot) };
+    summary.decode_to_slot_p50_us = decode_to_slot.p50_us;
+    summary.decode_to_slot_p99_us = decode_to_slot.p99_us;
+    summary.decode_to_slot_max_us = decode_to_slot.max_us;
+
+    for (const PlaneSortStats& plane : sort_stats.planes) {
+        std::uint32_t n_channels { 0 };
+        const auto histograms_it { histograms.planes().find(plane.plane_number) };
+        if (histograms_it != histograms.planes().end()) {
+            for (const ChannelHistogram& channel : histograms_it->second.channels) {
+                n_channels += channel.n_hits > 0;
+            }
+        }
+
+        summary.n_channels += n_channels;
+        summary.plane_number.push_back(plane.plane_number);
+        summary.plane_n_hits.push_back(plane.n_hits);
+        summary.plane_n_channels.push_back(n_channels);
+        summary.plane_n_displaced.push_back(plane.n_displaced);
+        summary.plane_n_gaps.push_back(plane.n_gaps);
+    }
+}
+
+void DataRunSerialiser::summariseLatencies(SortedSpill& sorted, std::int64_t written_time_ns)
+{
+    // Without arrival times, e.g. if the spill was never touched, its end is unknown.
+    const SpillPtr spill { sorted.spill };
+    const std::int64_t end_to_close_ns { sorted.last_arrival_ns != 0 ? spill->closed_time_ns - sorted.last_arrival_ns : -1 };
+    const std::int64_t close_to_written_ns { written_time_ns - spill->closed_time_ns };
+
+    sorted.summary.end_to_close_ms = end_to_close_ns >= 0 ? end_to_close_ns / 1e6 : 0.0;
+    sorted.summary.close_to_written_ms = close_to_written_ns / 1e6;
+
+    if (ingest_latencies_) {
+        ingest_latencies_->record(sorted.arrival_to_decode, sorted.decode_to_slot, end_to_close_ns, close_to_written_ns);
+    }
+}
+
+void DataRunSerialiser::writeSpills(std::unique_ptr<DataRunFile> out_file)
+{
+    log(DEBUG, "Writer thread up and running");
+
+    std::unique_ptr<SortedSpill> sorted {};
+    SerialiserPipelineInterval pipeline_interval {};
+    pipeline_interval.start = std::chrono::steady_clock::now();
+    pipeline_interval.at_start = pipelineStats();
+    try {
+        for (;;) {
+            if (!handoff_.pop(sorted, std::chrono::milliseconds(200))) {
+                if (handoff_.drained()) {
+                    break;
+                }
+
+                // Idle, giving time-based checkpoints a chance to save the last spills.
+                reportFlush(out_file->flush());
+                reportPipeline(pipeline_interval, false);
+                continue;
+            }
+
+            const auto write_start { std::chrono::steady_clock::now() };
+            const SpillPtr spill { sorted->spill };
+
+            // Write sorted events out.
+            const DataRunFileSpillStats write_stats { out_file->writeSpill(spill, sorted->hits) };
+            if (event_builder_settings_.enabled) {
+                out_file->writeSpillEvents(sorted->events);
+            }
+            out_file->writeChannelSummaries(sorted->channel_summaries);
 
-    return n_swaps;
-}
\ No newline at end of file
+            sorted->summary.write_ms = std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - write_start }.count();
+            summariseLatencies(*sorted, realtimeNanosecs());
+            out_file->writeSpillSummary(sorted->summary);
+            reportSpill(*sorted);
+
+            reportFlush(out_file->flush());
+
+            write_busy_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - write_start)
+                                  .count();
+
+            log(INFO, "Spill {} done and written ({} bytes to disk, {} bytes in total, compression ratio {:.2f})",
+                spill->spill_number, write_stats.bytes_written, write_stats.total_bytes_written,
+                write_stats.compression_ratio);
+
+            handoff_.release(std::move(sorted));
+            delete spill;
+
+            ++pipeline_interval.n_spills;
+            reportPipeline(pipeline_interval, false);
+        }
+
+        reportPipeline(pipeline_interval, true);
+
+        out_file->writeRunParametersAtEnd(data_run_->getParameters());
+
+        // Close output file. Thanks to checkpoints, this only writes data stored since the last one.
+        const auto close_start { std::chrono::steady_clock::now() };
+        out_file->close();
+        const std::chrono::duration<double, std::milli> close_duration { std::chrono::steady_clock::now() - close_start };
+        log(INFO, "Output file closed in {:.1f} ms", close_duration.count());
+    } catch (const std::exception& e) {
+        // The sort stage would otherwise wait for buffers forever.
+        log(ERROR, "Writer thread failed, discarding the remaining spills: {}", e.what());
+        if (sorted) {
+            delete sorted->spill;
+        }
+        handoff_.abort();
+    }
+
+    log(DEBUG, "Writer thread signing off");
+}
+
+void DataRunSerialiser::reportPipeline(SerialiserPipelineInterval& interval, bool final)
+{
+    const SerialiserPipelineStats stats { pipelineStats() };
+    interval.sort_queue_peak = std::max(interval.sort_queue_peak, stats.sort_queue_occupancy);
+    interval.write_queue_peak = std::max(interval.write_queue_peak, stats.write_queue_occupancy);
+
+    const auto now { std::chrono::steady_clock::now() };
+    const std::chrono::duration<double> elapsed { now - interval.start };
+    if (final ? interval.n_spills == 0 : elapsed < pipeline_stats_interval_) {
+        return;
+    }
+
+    // Busy and stall times are totals since the start of the run, report their increase.
+    const SerialiserPipelineStats& before { interval.at_start };
+    const double sort_busy_ms { stats.sort_busy_ms - before.sort_busy_ms };
+    const double sort_stall_ms { stats.sort_stall_ms - before.sort_stall_ms };
+    const double write_busy_ms { stats.write_busy_ms - before.write_busy_ms };
+    const double write_stall_ms { stats.write_stall_ms - before.write_stall_ms };
+
+    log(DEBUG, "Pipeline over {:.1f} s, {} spills written: sort queue peak {}/{}, sort {:.1f} ms busy, {:.1f} ms stalled; "
+               "write queue peak {}/{}, write {:.1f} ms busy, {:.1f} ms stalled",
+        elapsed.count(), interval.n_spills, interval.sort_queue_peak, stats.sort_queue_capacity, sort_busy_ms,
+        sort_stall_ms, interval.write_queue_peak, stats.write_queue_capacity, write_busy_ms, write_stall_ms);
+
+    Json::Value document {};
+    document["run"] = static_cast<Json::UInt64>(data_run_->getNumber());
+    document["interval_s"] = elapsed.count();
+    document["n_spills"] = static_cast<Json::UInt64>(interval.n_spills);
+    document["sort_queue_peak"] = static_cast<Json::UInt64>(interval.sort_queue_peak);
+    document["sort_busy_ms"] = sort_busy_ms;
+    document["sort_stall_ms"] = sort_stall_ms;
+    document["write_queue_peak"] = static_cast<Json::UInt64>(interval.write_queue_peak);
+    document["write_busy_ms"] = write_busy_ms;
+    document["write_stall_ms"] = write_stall_ms;
+    g_elastic.document("daqpipeline", document);
+
+    interval = SerialiserPipelineInterval {};
+    interval.start = now;
+    interval.at_start = stats;
+}
+
+void DataRunSerialiser::reportSpill(const SortedSpill& sorted)
+{
+    const SpillSummaryRecord& summary { sorted.summary };
+    const Json::UInt64 run_number { data_run_->getNumber() };
+
+    // The first document describes the spill as a whole, the rest break it down by plane.
+    std::vector<Json::Value> documents {};
+    documents.reserve(1 + summary.nPlanes());
+
+    Json::Value spill_document {};
+    spill_document["run"] = run_number;
+    spill_document["spill"] = static_cast<Json::UInt64>(summary.spill_number);
+    spill_document["n_hits"] = static_cast<Json::UInt64>(summary.n_hits);
+    spill_document["n_planes"] = static_cast<Json::UInt64>(summary.nPlanes());
+    spill_document["n_channels"] = summary.n_channels;
+    spill_document["n_displaced"] = static_cast<Json::UInt64>(summary.n_displaced);
+    spill_document["disorder"] = summary.disorder;
+    spill_document["n_swaps"] = static_cast<Json::UInt64>(summary.n_swaps);
+    spill_document["n_gaps"] = static_cast<Json::UInt64>(summary.n_gaps);
+    spill_document["tai_time_first"] = static_cast<double>(summary.time_first.combined_secs());
+    spill_document["tai_time_last"] = static_cast<double>(summary.time_last.combined_secs());
+    spill_document["merge_ms"] = summary.merge_ms;
+    spill_document["sort_ms"] = summary.sort_ms;
+    spill_document["build_ms"] = summary.build_ms;
+    spill_document["write_ms"] = summary.write_ms;
+    spill_document["arrival_to_decode_p50_us"] = summary.arrival_to_decode_p50_us;
+    spill_document["arrival_to_decode_p99_us"] = summary.arrival_to_decode_p99_us;
+    spill_document["arrival_to_decode_max_us"] = summary.arrival_to_decode_max_us;
+    spill_document["decode_to_slot_p50_us"] = summary.decode_to_slot_p50_us;
+    spill_document["decode_to_slot_p99_us"] = summary.decode_to_slot_p99_us;
+    spill_document["decode_to_slot_max_us"] = summary.decode_to_slot_max_us;
+    spill_document["end_to_close_ms"] = summary.end_to_close_ms;
+    spill_document["close_to_written_ms"] = summary.close_to_written_ms;
+    documents.push_back(std::move(spill_document));
+
+    for (std::size_t i = 0; i < summary.nPlanes(); ++i) {
+        Json::Value plane_document {};
+        plane_document["run"] = run_number;
+        plane_document["spill"] = static_cast<Json::UInt64>(summary.spill_number);
+        plane_document["plane"] = summary.plane_number[i];
+        plane_document["n_hits"] = static_cast<Json::UInt64>(summary.plane_n_hits[i]);
+        plane_document["n_channels"] = summary.plane_n_channels[i];
+        plane_document["n_displaced"] = static_cast<Json::UInt64>(summary.plane_n_displaced[i]);
+        plane_document["n_gaps"] = static_cast<Json::UInt64>(summary.plane_n_gaps[i]);
+        plane_document["channel_n_hits"] = Json::Value { Json::arrayValue };
+        documents.push_back(std::move(plane_document));
+    }
+
+    // Channel summaries are ordered by plane, like the summary itself.
+    std::size_t plane_idx { 0 };
+    for (const ChannelSummaryRecord& channel : sorted.channel_summaries) {
+        while (plane_idx < summary.nPlanes() && summary.plane_number[plane_idx] < channel.plane_number) {
+            ++plane_idx;
+        }
+        if (plane_idx == summary.nPlanes()) {
+            break;
+        }
+        if (summary.plane_number[plane_idx] != channel.plane_number) {
+            continue;
+        }
+
+        Json::Value channel_value {};
+        channel_value["channel"] = channel.channel_number;
+        channel_value["n_hits"] = channel.n_hits;
+        documents[1 + plane_idx]["channel_n_hits"].append(channel_value);
+    }
+
+    g_elastic.bulk("daqspill", std::move(documents));
+}
+
+void DataRunSerialiser::reportFlush(const DataRunFileFlushStats& stats)
+{
+    if (!stats.checkpoint) {
+        return;
+    }
+
+    log(DEBUG, "Checkpoint took {:.1f} ms ({} bytes written)", stats.duration_ms, stats.bytes_written);
+
+    Json::Value document {};
+    document["run"] = static_cast<Json::UInt64>(data_run_->getNumber());
+    document["duration_ms"] = stats.duration_ms;
+    document["bytes_written"] = static_cast<Json::UInt64>(stats.bytes_written);
+    g_elastic.document("daqcheckpoint", document);
+}
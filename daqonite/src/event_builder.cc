@@ -0,0 +1,210 @@
+#include <algorithm>
+
+#include <util/config.h>
+
+#include "event_builder.h"
+
+/// Number of channel slots reserved for every plane.
+static constexpr std::uint32_t CHANNELS_PER_PLANE { 256 };
+
+EventBuilderSettings EventBuilderSettings::fromConfig()
+{
+    EventBuilderSettings settings {};
+    settings.enabled = g_config.lookupBool("event_builder.enabled");
+    settings.window_ns = g_config.lookupU64("event_builder.window");
+    settings.min_hits = g_config.lookupU32("event_builder.min_hits");
+    settings.min_planes = g_config.lookupU32("event_builder.min_planes");
+    settings.min_channels = g_config.lookupU32("event_builder.min_channels");
+    settings.margin_ns = g_config.lookupU64("event_builder.margin");
+    settings.drop_hits = g_config.lookupBool("event_builder.drop_hits");
+    settings.noise_prescale = g_config.lookupU32("event_builder.noise_prescale");
+    settings.noise_slice_ns = g_config.lookupU64("event_builder.noise_slice");
+    return settings;
+}
+
+EventBuilder::EventBuilder(const EventBuilderSettings& settings)
+    : settings_ { settings }
+    , random_ { std::random_device {}() }
+    , times_ {}
+    , plane_indices_ {}
+    , channel_keys_ {}
+    , plane_counts_ {}
+    , channel_counts_ {}
+{
+    if (settings_.noise_slice_ns == 0) {
+        settings_.noise_slice_ns = 1;
+    }
+}
+
+void EventBuilder::indexHits(const PMTHitQueue& hits)
+{
+    plane_indices_.clear();
+
+    // Dense keys make multiplicities plain array lookups in the sliding window.
+    times_.resize(hits.size());
+    channel_keys_.resize(hits.size());
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+        const PMTHit& hit { hits[i] };
+        const auto plane { plane_indices_.emplace(hit.plane_number, static_cast<std::uint32_t>(plane_indices_.size())).first };
+
+        times_[i] = hit.timestamp.combined_nanosecs();
+        channel_keys_[i] = plane->second * CHANNELS_PER_PLANE + hit.channel_number;
+    }
+
+    plane_counts_.assign(plane_indices_.size(), 0);
+    channel_counts_.assign(plane_indices_.size() * CHANNELS_PER_PLANE, 0);
+}
+
+void EventBuilder::findEvents(std::vector<EventRecord>& events)
+{
+    std::uint32_t n_planes { 0 };
+    std::uint32_t n_channels { 0 };
+
+    const auto add = [&](std::size_t i) {
+        const std::uint32_t key { channel_keys_[i] };
+        n_planes += 0 == plane_counts_[key / CHANNELS_PER_PLANE]++;
+        n_channels += 0 == channel_counts_[key]++;
+    };
+    const auto remove = [&](std::size_t i) {
+        const std::uint32_t key { channel_keys_[i] };
+        n_planes -= 0 == --plane_counts_[key / CHANNELS_PER_PLANE];
+        n_channels -= 0 == --channel_counts_[key];
+    };
+
+    bool have_event { false };
+    EventRecord event {};
+
+    std::size_t lo { 0 };
+    for (std::size_t hi = 0; hi < times_.size(); ++hi) {
+        add(hi);
+
+        while (times_[hi] - times_[lo] > settings_.window_ns) {
+            remove(lo++);
+        }
+
+        if (hi + 1 - lo < settings_.min_hits || n_planes < settings_.min_planes || n_channels < settings_.min_channels) {
+            continue;
+        }
+
+        // Overlapping triggered windows belong to the same event.
+        if (have_event && lo <= event.opt_hits_end) {
+            event.opt_hits_end = hi + 1;
+            event.n_planes = std::max(event.n_planes, n_planes);
+            event.n_channels = std::max(event.n_channels, n_channels);
+        } else {
+            if (have_event) {
+                events.push_back(event);
+            }
+
+            event.opt_hits_begin = lo;
+            event.opt_hits_end = hi + 1;
+            event.n_planes = n_planes;
+            event.n_channels = n_channels;
+            have_event = true;
+        }
+    }
+
+    if (have_event) {
+        events.push_back(event);
+    }
+}
+
+void EventBuilder::extendEvents(const PMTHitQueue& hits, std::vector<EventRecord>& events) const
+{
+    std::size_t n_merged { 0 };
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        EventRecord event { events[i] };
+
+        if (settings_.margin_ns > 0) {
+            const std::uint64_t first { times_[event.opt_hits_begin] };
+            const std::uint64_t last { times_[event.opt_hits_end - 1] };
+            const std::uint64_t begin_time { first > settings_.margin_ns ? first - settings_.margin_ns : 0 };
+
+            event.opt_hits_begin = std::lower_bound(times_.begin(), times_.begin() + event.opt_hits_begin, begin_time) - times_.begin();
+            event.opt_hits_end = std::upper_bound(times_.begin() + event.opt_hits_end, times_.end(), last + settings_.margin_ns) - times_.begin();
+        }
+
+        // Margins may make neighbouring events overlap.
+        if (n_merged > 0 && event.opt_hits_begin <= events[n_merged - 1].opt_hits_end) {
+            EventRecord& previous { events[n_merged - 1] };
+            previous.opt_hits_end = std::max(previous.opt_hits_end, event.opt_hits_end);
+            previous.n_planes = std::max(previous.n_planes, event.n_planes);
+            previous.n_channels = std::max(previous.n_channels, event.n_channels);
+        } else {
+            events[n_merged++] = event;
+        }
+    }
+    events.resize(n_merged);
+
+    for (EventRecord& event : events) {
+        event.time_first = hits[event.opt_hits_begin].timestamp;
+        event.time_last = hits[event.opt_hits_end - 1].timestamp;
+    }
+}
+
+EventBuilderStats EventBuilder::build(const PMTHitQueue& hits, std::vector<EventRecord>& events)
+{
+    events.clear();
+
+    EventBuilderStats stats {};
+    stats.n_hits = hits.size();
+    stats.n_kept_hits = hits.size();
+
+    if (hits.empty()) {
+        return stats;
+    }
+
+    indexHits(hits);
+    findEvents(events);
+    extendEvents(hits, events);
+
+    stats.n_events = events.size();
+    for (const EventRecord& event : events) {
+        stats.n_event_hits += event.opt_hits_end - event.opt_hits_begin;
+    }
+
+    return stats;
+}
+
+EventBuilderStats EventBuilder::buildAndDrop(PMTHitQueue& hits, std::vector<EventRecord>& events)
+{
+    EventBuilderStats stats { build(hits, events) };
+
+    std::uint64_t slice { UINT64_MAX };
+    bool slice_kept { false };
+
+    std::size_t n_kept { 0 };
+    std::size_t event_idx { 0 };
+    std::uint64_t kept_begin { 0 };
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+        // Decide about noise sample slices as they come, whether or not they contain events.
+        const std::uint64_t hit_slice { times_[i] / settings_.noise_slice_ns };
+        if (hit_slice != slice) {
+            slice = hit_slice;
+            slice_kept = settings_.noise_prescale > 0 && random_() % settings_.noise_prescale == 0;
+        }
+
+        const bool in_event { event_idx < events.size() && i >= events[event_idx].opt_hits_begin };
+        if (in_event && i == events[event_idx].opt_hits_begin) {
+            kept_begin = n_kept;
+        }
+
+        if (in_event || slice_kept) {
+            if (n_kept != i) {
+                hits[n_kept] = std::move(hits[i]);
+            }
+            ++n_kept;
+        }
+
+        // Events refer to positions among the kept hits.
+        if (in_event && i + 1 == events[event_idx].opt_hits_end) {
+            events[event_idx].opt_hits_begin = kept_begin;
+            events[event_idx].opt_hits_end = n_kept;
+            ++event_idx;
+        }
+    }
+
+    hits.resize(n_kept);
+    stats.n_kept_hits = n_kept;
+    return stats;
+}
@@ -0,0 +1,34 @@
+#include <algorithm>
+
+#include "histogram_publisher.h"
+
+HistogramPublisher::HistogramPublisher(const std::string& bus_url)
+    : Publisher { bus_url }
+{
+    setUnitName("HistogramPublisher");
+}
+
+void HistogramPublisher::connected()
+{
+    log(INFO, "Publishing channel histograms to '{}'", bus_url());
+}
+
+void HistogramPublisher::disconnected(const nng::exception& e)
+{
+    log(ERROR, "Histogram bus caught error: {}: {}", e.who(), e.what());
+}
+
+void HistogramPublisher::publishSpill(std::uint64_t run_number, std::uint64_t spill_number, double duration_s,
+    const ChannelHistograms& histograms)
+{
+    for (const auto& plane : histograms.planes()) {
+        ChannelHistogramsMessage message {};
+        message.run_number = run_number;
+        message.spill_number = spill_number;
+        message.plane_number = plane.first;
+        message.duration_s = duration_s;
+        std::copy(plane.second.channels.begin(), plane.second.channels.end(), message.channels);
+
+        publish(std::move(message));
+    }
+}
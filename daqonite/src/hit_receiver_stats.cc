@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include <util/elastic_interface.h>
+
+#include "hit_receiver_stats.h"
+
+/// How often the collector checks whether it should stop
+static constexpr std::chrono::milliseconds STOP_CHECK_INTERVAL { 200 };
+
+static constexpr std::size_t CACHE_LINE_SIZE { 64 };
+
+HitReceiverStats::HitReceiverStats(int port)
+    : port_ { port }
+    , counters_ { nullptr }
+{
+    void* memory { nullptr };
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(Counters)) != 0) {
+        throw std::runtime_error { fmt::format("Failed to allocate {} bytes of hit receiver counters", sizeof(Counters)) };
+    }
+    counters_ = new (memory) Counters();
+}
+
+HitReceiverStats::~HitReceiverStats()
+{
+    counters_->~Counters();
+    std::free(counters_);
+}
+
+static PlaneCounts readCounters(const PlaneCounters& counters)
+{
+    return PlaneCounts {
+        counters.n_datagrams.load(std::memory_order_relaxed),
+        counters.n_hits.load(std::memory_order_relaxed),
+        counters.n_gaps.load(std::memory_order_relaxed),
+        counters.n_missed.load(std::memory_order_relaxed),
+        counters.n_dropped.load(std::memory_order_relaxed),
+        counters.n_late.load(std::memory_order_relaxed),
+        counters.n_discarded.load(std::memory_order_relaxed),
+    };
+}
+
+void HitReceiverStats::sampleQueue(std::uint64_t rx_queue, std::uint64_t rcvbuf)
+{
+    std::uint64_t peak { counters_->rx_queue_peak.load(std::memory_order_relaxed) };
+    while (rx_queue > peak && !counters_->rx_queue_peak.compare_exchange_weak(peak, rx_queue, std::memory_order_relaxed)) {
+    }
+    counters_->rcvbuf.store(rcvbuf, std::memory_order_relaxed);
+}
+
+void HitReceiverStats::read(std::map<std::uint32_t, PlaneCounts>& planes, PlaneCounts& other_planes, ReceiverCounts& receiver)
+{
+    planes.clear();
+    for (const PlaneCounters& counters : counters_->planes) {
+        const std::uint64_t key { counters.key.load(std::memory_order_acquire) };
+        if (key != 0) {
+            planes[static_cast<std::uint32_t>(key - 1)] = readCounters(counters);
+        }
+    }
+
+    other_planes = readCounters(counters_->other_planes);
+    receiver.n_bad = counters_->n_bad.load(std::memory_order_relaxed);
+    receiver.n_kernel_drops = counters_->n_kernel_drops.load(std::memory_order_relaxed);
+    receiver.rx_queue_peak = counters_->rx_queue_peak.exchange(0, std::memory_order_relaxed);
+    receiver.rcvbuf = counters_->rcvbuf.load(std::memory_order_relaxed);
+}
+
+HitReceiverStatsCollector::HitReceiverStatsCollector(double interval_s)
+    : AsyncComponent {}
+    , Logging {}
+    , interval_ { static_cast<std::int64_t>(1e3 * interval_s) }
+    , mutex_ {}
+    , receivers_ {}
+    , rates_ {}
+{
+    setUnitName("HitReceiverStatsCollector");
+
+    if (interval_.count() <= 0) {
+        throw std::runtime_error { fmt::format("Hit receiver statistics need a positive interval, got {} s", interval_s) };
+    }
+}
+
+void HitReceiverStatsCollector::setReceivers(const std::vector<std::shared_ptr<HitReceiverStats>>& receivers)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    // Counters of new receivers start at zero, as do the counts they are compared to.
+    receivers_.clear();
+    for (const auto& stats : receivers) {
+        receivers_.push_back(Collected { stats, {}, PlaneCounts {}, ReceiverCounts {} });
+    }
+}
+
+HitReceiverRates HitReceiverStatsCollector::rates() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    return rates_;
+}
+
+void HitReceiverStatsCollector::run()
+{
+    log(INFO, "Collecting hit receiver statistics every {} ms", interval_.count());
+
+    std::chrono::steady_clock::time_point last_collection { std::chrono::steady_clock::now() };
+    while (running_) {
+        std::this_thread::sleep_for(STOP_CHECK_INTERVAL);
+
+        const std::chrono::steady_clock::time_point now { std::chrono::steady_clock::now() };
+        if (now - last_collection >= interval_) {
+            collect(std::chrono::duration<double> { now - last_collection }.count());
+            last_collection = now;
+        }
+    }
+
+    log(INFO, "Hit receiver statistics collector finished");
+}
+
+/// Differences of counts, which are only ever incremented
+static PlaneCounts countsSince(const PlaneCounts& now, const PlaneCounts& before)
+{
+    return PlaneCounts {
+        now.n_datagrams - before.n_datagrams,
+        now.n_hits - before.n_hits,
+        now.n_gaps - before.n_gaps,
+        now.n_missed - before.n_missed,
+        now.n_dropped - before.n_dropped,
+        now.n_late - before.n_late,
+        now.n_discarded - before.n_discarded,
+    };
+}
+
+static void addCounts(PlaneCounts& total, const PlaneCounts& counts)
+{
+    total.n_datagrams += counts.n_datagrams;
+    total.n_hits += counts.n_hits;
+    total.n_gaps += counts.n_gaps;
+    total.n_missed += counts.n_missed;
+    total.n_dropped += counts.n_dropped;
+    total.n_late += counts.n_late;
+    total.n_discarded += counts.n_discarded;
+}
+
+static Json::Value ratesDocument(int port, std::int64_t plane, const PlaneCounts& counts, double elapsed_s)
+{
+    Json::Value document {};
+    document["port"] = port;
+    document["plane"] = static_cast<Json::Int64>(plane);
+    document["interval_s"] = elapsed_s;
+    document["datagram_rate"] = counts.n_datagrams / elapsed_s;
+    document["hit_rate"] = counts.n_hits / elapsed_s;
+    document["gap_rate"] = counts.n_gaps / elapsed_s;
+    document["missed_rate"] = counts.n_missed / elapsed_s;
+    document["dropped_rate"] = counts.n_dropped / elapsed_s;
+    document["late_rate"] = counts.n_late / elapsed_s;
+    document["discarded_rate"] = counts.n_discarded / elapsed_s;
+    return document;
+}
+
+void HitReceiverStatsCollector::collect(double elapsed_s)
+{
+    // One document per receiver (plane -1) carries its totals, the rest break them down by plane.
+    std::vector<Json::Value> documents {};
+    PlaneCounts total {};
+    std::uint64_t total_bad { 0 };
+    std::uint64_t total_kernel_drops { 0 };
+    double queue_peak { 0.0 };
+
+    std::map<std::uint32_t, PlaneCounts> planes {};
+    PlaneCounts other_planes {};
+    ReceiverCounts receiver_counts {};
+
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        for (Collected& receiver : receivers_) {
+            receiver.stats->read(planes, other_planes, receiver_counts);
+
+            PlaneCounts receiver_total { countsSince(other_planes, receiver.other_planes) };
+            for (const auto& plane : planes) {
+                const PlaneCounts counts { countsSince(plane.second, receiver.planes[plane.first]) };
+                if (counts.n_datagrams != 0 || counts.n_late != 0) {
+                    documents.push_back(ratesDocument(receiver.stats->port(), plane.first, counts, elapsed_s));
+                }
+                addCounts(receiver_total, counts);
+            }
+
+            const std::uint64_t n_bad { receiver_counts.n_bad - receiver.receiver.n_bad };
+            const std::uint64_t n_kernel_drops { receiver_counts.n_kernel_drops - receiver.receiver.n_kernel_drops };
+            const double receiver_queue_peak { receiver_counts.rcvbuf > 0 ? static_cast<double>(receiver_counts.rx_queue_peak) / receiver_counts.rcvbuf : 0.0 };
+            if (receiver_total.n_datagrams != 0 || n_bad != 0 || n_kernel_drops != 0) {
+                Json::Value document { ratesDocument(receiver.stats->port(), -1, receiver_total, elapsed_s) };
+                document["bad_rate"] = n_bad / elapsed_s;
+                document["kernel_drop_rate"] = n_kernel_drops / elapsed_s;
+                document["queue_peak"] = receiver_queue_peak;
+                document["rcvbuf"] = static_cast<Json::UInt64>(receiver_counts.rcvbuf);
+                documents.push_back(std::move(document));
+            }
+
+            addCounts(total, receiver_total);
+            total_bad += n_bad;
+            total_kernel_drops += n_kernel_drops;
+            queue_peak = std::max(queue_peak, receiver_queue_peak);
+
+            receiver.planes.swap(planes);
+            receiver.other_planes = other_planes;
+            receiver.receiver = receiver_counts;
+        }
+
+        rates_.datagrams = total.n_datagrams / elapsed_s;
+        rates_.hits = total.n_hits / elapsed_s;
+        rates_.bad = total_bad / elapsed_s;
+        rates_.gaps = total.n_gaps / elapsed_s;
+        rates_.missed = total.n_missed / elapsed_s;
+        rates_.dropped = total.n_dropped / elapsed_s;
+        rates_.kernel_drops = total_kernel_drops / elapsed_s;
+        rates_.late = total.n_late / elapsed_s;
+        rates_.discarded = total.n_discarded / elapsed_s;
+        rates_.queue_peak = queue_peak;
+    }
+
+    if (!documents.empty()) {
+        g_elastic.bulk("daqreceivers", std::move(documents));
+    }
+}
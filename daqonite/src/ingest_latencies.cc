@@ -0,0 +1,96 @@
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "ingest_latencies.h"
+
+LatencyPercentiles LatencyPercentiles::of(const LatencyHistogram& histogram)
+{
+    return LatencyPercentiles {
+        histogram.percentile(50.0) / 1e3,
+        histogram.percentile(99.0) / 1e3,
+        histogram.max() / 1e3,
+    };
+}
+
+void IngestLatencies::Window::merge(const Window& other)
+{
+    arrival_to_decode.merge(other.arrival_to_decode);
+    decode_to_slot.merge(other.decode_to_slot);
+    end_to_close.merge(other.end_to_close);
+    close_to_written.merge(other.close_to_written);
+}
+
+void IngestLatencies::Window::clear()
+{
+    arrival_to_decode.clear();
+    decode_to_slot.clear();
+    end_to_close.clear();
+    close_to_written.clear();
+}
+
+IngestLatencies::IngestLatencies(double window_s)
+    : window_ { static_cast<std::int64_t>(1e3 * window_s) }
+    , mutex_ {}
+    , current_ {}
+    , previous_ {}
+    , current_start_ { std::chrono::steady_clock::now() }
+{
+    if (window_.count() <= 0) {
+        throw std::runtime_error { fmt::format("Ingest latencies need a positive window, got {} s", window_s) };
+    }
+}
+
+void IngestLatencies::rotate(std::chrono::steady_clock::time_point now)
+{
+    if (now - current_start_ < window_) {
+        return;
+    }
+
+    // After a long pause, the previous window is just as stale as the current one.
+    if (now - current_start_ < 2 * window_) {
+        std::swap(previous_, current_);
+    } else {
+        previous_.clear();
+    }
+    current_.clear();
+    current_start_ = now;
+}
+
+void IngestLatencies::record(const LatencyHistogram& arrival_to_decode, const LatencyHistogram& decode_to_slot,
+    std::int64_t end_to_close_ns, std::int64_t close_to_written_ns)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    rotate(std::chrono::steady_clock::now());
+
+    current_.arrival_to_decode.merge(arrival_to_decode);
+    current_.decode_to_slot.merge(decode_to_slot);
+    if (end_to_close_ns >= 0) {
+        current_.end_to_close.record(end_to_close_ns);
+    }
+    if (close_to_written_ns >= 0) {
+        current_.close_to_written.record(close_to_written_ns);
+    }
+}
+
+IngestLatencyPercentiles IngestLatencies::percentiles() const
+{
+    Window merged {};
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        const std::chrono::steady_clock::time_point now { std::chrono::steady_clock::now() };
+        if (now - current_start_ < 2 * window_) {
+            merged = current_;
+            if (now - current_start_ < window_) {
+                merged.merge(previous_);
+            }
+        }
+    }
+
+    return IngestLatencyPercentiles {
+        LatencyPercentiles::of(merged.arrival_to_decode),
+        LatencyPercentiles::of(merged.decode_to_slot),
+        LatencyPercentiles::of(merged.end_to_close),
+        LatencyPercentiles::of(merged.close_to_written),
+    };
+}
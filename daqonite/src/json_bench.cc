@@ -0,0 +1,187 @@
+/**
+ * Program name: daqonite_json_bench - Compares JsonWriter with jsoncpp on monitoring documents.
+ *
+ * The monchannel and daqlog documents are built the way ElasticInterface builds them, and
+ * serialised the way the bulk indexer used to serialise Json::Value trees. Every document
+ * ends up in a std::string, as it does when it is queued for indexing. The output of both
+ * paths is parsed back with jsoncpp to check that they agree.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+#include <json/json.h>
+
+#include <util/json_writer.h>
+
+namespace exit_code {
+static constexpr int success = 0;
+static constexpr int mismatch = 1;
+}
+
+struct BenchSettings {
+    std::size_t n_documents;
+    std::size_t n_repeats;
+    std::size_t message_size;
+};
+
+/// Fields of a monchannel document, as received in monitoring packets
+struct ChannelSample {
+    long timestamp;
+    int pom;
+    int channel;
+    float rate;
+    bool veto;
+};
+
+static ChannelSample channelSample(std::size_t i)
+{
+    return ChannelSample { 1600000000000l + static_cast<long>(i), static_cast<int>(i / 30), static_cast<int>(i % 30),
+        1234.5f + 0.1f * (i % 30), i % 7 == 0 };
+}
+
+static std::string writeChannelJsoncpp(const Json::StreamWriterBuilder& builder, const ChannelSample& sample)
+{
+    Json::Value document {};
+    document["timestamp"] = static_cast<Json::Int64>(sample.timestamp);
+    document["pom"] = sample.pom;
+    document["channel"] = sample.channel;
+    document["eid"] = 0;
+    document["rate"]["rate"] = sample.rate;
+    document["rate"]["veto"] = sample.veto;
+    return Json::writeString(builder, document);
+}
+
+static std::string writeChannel(JsonWriter& document, const ChannelSample& sample)
+{
+    document.clear();
+    document.beginObject();
+    document.field("timestamp", sample.timestamp);
+    document.field("pom", sample.pom);
+    document.field("channel", sample.channel);
+    document.field("eid", 0);
+    document.beginObject("rate");
+    document.field("rate", sample.rate);
+    document.field("veto", sample.veto);
+    document.endObject();
+    document.endObject();
+    return document.str();
+}
+
+static std::string writeLogJsoncpp(const Json::StreamWriterBuilder& builder, long timestamp, const std::string& message)
+{
+    Json::Value document {};
+    document["timestamp"] = static_cast<Json::Int64>(timestamp);
+    document["process"] = "daqonite";
+    document["pid"] = 1234;
+    document["unit"] = "DataRunSerialiser";
+    document["severity"] = 1;
+    document["message"] = message;
+    return Json::writeString(builder, document);
+}
+
+static std::string writeLog(JsonWriter& document, long timestamp, const std::string& message)
+{
+    document.clear();
+    document.beginObject();
+    document.field("timestamp", timestamp);
+    document.field("process", "daqonite");
+    document.field("pid", 1234);
+    document.field("unit", "DataRunSerialiser");
+    document.field("severity", 1);
+    document.field("message", message);
+    document.endObject();
+    return document.str();
+}
+
+/// Time `write(i)` for all documents, returning the best time per document over all repetitions [ns].
+template <typename Write>
+static double benchmark(const BenchSettings& settings, const char* name, Write write)
+{
+    double best_ns { std::numeric_limits<double>::max() };
+    std::size_t n_bytes { 0 };
+    for (std::size_t repeat = 0; repeat < settings.n_repeats; ++repeat) {
+        n_bytes = 0;
+        const auto start { std::chrono::steady_clock::now() };
+        for (std::size_t i = 0; i < settings.n_documents; ++i) {
+            n_bytes += write(i).size();
+        }
+        const std::chrono::duration<double, std::nano> elapsed { std::chrono::steady_clock::now() - start };
+        best_ns = std::min(best_ns, elapsed.count() / settings.n_documents);
+    }
+
+    fmt::print("{:<24} documents: {:>9}  bytes/doc: {:>6.1f}  best: {:>8.1f} ns/doc\n",
+        name, settings.n_documents, static_cast<double>(n_bytes) / settings.n_documents, best_ns);
+    return best_ns;
+}
+
+static bool sameDocument(const std::string& a, const std::string& b)
+{
+    Json::CharReaderBuilder reader_builder {};
+    std::unique_ptr<Json::CharReader> reader { reader_builder.newCharReader() };
+
+    Json::Value a_value {};
+    Json::Value b_value {};
+    std::string errors {};
+    return reader->parse(a.data(), a.data() + a.size(), &a_value, &errors)
+        && reader->parse(b.data(), b.data() + b.size(), &b_value, &errors)
+        && a_value == b_value;
+}
+
+int main(int argc, char* argv[])
+{
+    namespace opts = boost::program_options;
+
+    BenchSettings settings {};
+
+    opts::options_description desc { "Options" };
+    desc.add_options()("help,h", "daqonite_json_bench - compare JsonWriter with jsoncpp on monitoring documents")
+        ("documents", opts::value<std::size_t>(&settings.n_documents)->default_value(300000), "Number of documents per repetition")
+        ("repeat", opts::value<std::size_t>(&settings.n_repeats)->default_value(5), "Number of repetitions")
+        ("message-size", opts::value<std::size_t>(&settings.message_size)->default_value(64), "Length of daqlog messages");
+
+    opts::variables_map vm {};
+    opts::store(opts::command_line_parser(argc, argv).options(desc).run(), vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return exit_code::success;
+    }
+
+    opts::notify(vm);
+
+    // Same settings as the bulk indexer.
+    Json::StreamWriterBuilder builder {};
+    builder["commentStyle"] = "None";
+    builder["indentation"] = "";
+
+    // Log messages contain quotes now and then, which need escaping.
+    std::string message { "Spill 1234 \"sorted\"\t" };
+    message.resize(std::max(message.size(), settings.message_size), 'x');
+
+    JsonWriter writer {};
+    if (!sameDocument(writeChannelJsoncpp(builder, channelSample(7)), writeChannel(writer, channelSample(7)))
+        || !sameDocument(writeLogJsoncpp(builder, 1600000000000l, message), writeLog(writer, 1600000000000l, message))) {
+        fmt::print("JsonWriter and jsoncpp documents differ\n");
+        return exit_code::mismatch;
+    }
+
+    const double channel_jsoncpp { benchmark(settings, "monchannel jsoncpp",
+        [&](std::size_t i) { return writeChannelJsoncpp(builder, channelSample(i)); }) };
+    const double channel_writer { benchmark(settings, "monchannel JsonWriter",
+        [&](std::size_t i) { return writeChannel(writer, channelSample(i)); }) };
+    const double log_jsoncpp { benchmark(settings, "daqlog jsoncpp",
+        [&](std::size_t i) { return writeLogJsoncpp(builder, 1600000000000l + static_cast<long>(i), message); }) };
+    const double log_writer { benchmark(settings, "daqlog JsonWriter",
+        [&](std::size_t i) { return writeLog(writer, 1600000000000l + static_cast<long>(i), message); }) };
+
+    fmt::print("speedup: monchannel {:.1f}x, daqlog {:.1f}x\n", channel_jsoncpp / channel_writer, log_jsoncpp / log_writer);
+
+    return exit_code::success;
+}
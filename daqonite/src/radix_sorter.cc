@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <limits>
+
+#include "radix_sorter.h"
+
+constexpr std::size_t RadixSorter::DIGIT_BITS;
+constexpr std::size_t RadixSorter::N_BUCKETS;
+constexpr std::uint64_t RadixSorter::DIGIT_MASK;
+constexpr std::size_t RadixSorter::MIN_HITS_PER_THREAD;
+
+RadixSorter::RadixSorter(std::size_t n_threads)
+    : n_threads_ { std::max<std::size_t>(1, n_threads) }
+    , n_passes_ { 0 }
+    , entries_ {}
+    , scratch_ {}
+    , histograms_ {}
+    , workers_ {}
+    , pool_mutex_ {}
+    , cv_work_ {}
+    , cv_done_ {}
+    , work_ { nullptr }
+    , work_n_ { 0 }
+    , work_threads_ { 0 }
+    , work_generation_ { 0 }
+    , n_pending_ { 0 }
+    , stopping_ { false }
+{
+    workers_.reserve(n_threads_ - 1);
+    for (std::size_t thread_idx = 1; thread_idx < n_threads_; ++thread_idx) {
+        workers_.emplace_back(&RadixSorter::runWorker, this, thread_idx);
+    }
+}
+
+RadixSorter::~RadixSorter()
+{
+    {
+        std::lock_guard<std::mutex> lock { pool_mutex_ };
+        stopping_ = true;
+    }
+
+    cv_work_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void RadixSorter::sort(const PMTMultiPlaneHitQueue& input, PMTHitQueue& output)
+{
+    n_passes_ = 0;
+    output.clear();
+
+    // Flatten all planes into a single array of keys, remembering the time range.
+    std::size_t n { 0 };
+    for (const auto& key_value : input) {
+        n += key_value.second.size();
+    }
+
+    if (n == 0) {
+        return;
+    }
+
+    entries_.resize(n);
+    scratch_.resize(n);
+
+    std::uint64_t min_key { std::numeric_limits<std::uint64_t>::max() };
+    std::uint64_t max_key { 0 };
+    auto out { entries_.begin() };
+    for (const auto& key_value : input) {
+        for (const PMTHit& hit : key_value.second) {
+            const std::uint64_t key { hit.timestamp.combined_nanosecs() };
+            min_key = std::min(min_key, key);
+            max_key = std::max(max_key, key);
+
+            out->key = key;
+            out->hit = &hit;
+            ++out;
+        }
+    }
+
+    // Decide on parallelism.
+    const std::size_t n_threads { std::max<std::size_t>(1, std::min(n_threads_, n / MIN_HITS_PER_THREAD)) };
+    histograms_.resize(n_threads);
+
+    // Shift keys to start at zero, so that we only sort digits which actually differ.
+    parallelFor(n_threads, n, [this, min_key](std::size_t, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            entries_[i].key -= min_key;
+        }
+    });
+
+    // Sort digits from the least significant one, skipping those that are the same for all hits.
+    const std::uint64_t range { max_key - min_key };
+    for (std::size_t shift = 0; shift < 64 && (range >> shift) != 0; shift += DIGIT_BITS) {
+        if (sortDigit(n_threads, shift)) {
+            ++n_passes_;
+        }
+    }
+
+    // Gather sorted hits.
+    output.resize(n);
+    parallelFor(n_threads, n, [this, &output](std::size_t, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            output[i] = *entries_[i].hit;
+        }
+    });
+}
+
+bool RadixSorter::sortDigit(std::size_t n_threads, std::size_t shift)
+{
+    const std::size_t n { entries_.size() };
+
+    // Each thread counts digit occurrences in its part of the input.
+    parallelFor(n_threads, n, [this, shift](std::size_t thread_idx, std::size_t begin, std::size_t end) {
+        Histogram& histogram { histograms_[thread_idx] };
+        histogram.fill(0);
+
+        for (std::size_t i = begin; i < end; ++i) {
+            ++histogram[(entries_[i].key >> shift) & DIGIT_MASK];
+        }
+    });
+
+    // Turn histograms into scatter offsets. Buckets are laid out in order, and within each bucket
+    // threads are laid out in order, which keeps the sort stable.
+    std::size_t offset { 0 };
+    for (std::size_t bucket = 0; bucket < N_BUCKETS; ++bucket) {
+        std::size_t bucket_total { 0 };
+        for (std::size_t thread_idx = 0; thread_idx < n_threads; ++thread_idx) {
+            bucket_total += histograms_[thread_idx][bucket];
+        }
+
+        if (bucket_total == n) {
+            // All keys share this digit, no need to move anything.
+            return false;
+        }
+
+        for (std::size_t thread_idx = 0; thread_idx < n_threads; ++thread_idx) {
+            std::size_t& count { histograms_[thread_idx][bucket] };
+            const std::size_t bucket_begin { offset };
+            offset += count;
+            count = bucket_begin;
+        }
+    }
+
+    // Each thread moves entries from its part of the input into its own reserved output ranges.
+    parallelFor(n_threads, n, [this, shift](std::size_t thread_idx, std::size_t begin, std::size_t end) {
+        Histogram& offsets { histograms_[thread_idx] };
+
+        for (std::size_t i = begin; i < end; ++i) {
+            const Entry& entry { entries_[i] };
+            scratch_[offsets[(entry.key >> shift) & DIGIT_MASK]++] = entry;
+        }
+    });
+
+    entries_.swap(scratch_);
+    return true;
+}
+
+void RadixSorter::parallelFor(std::size_t n_threads, std::size_t n, const Work& work)
+{
+    const std::size_t chunk_size { (n + n_threads - 1) / n_threads };
+
+    if (n_threads > 1) {
+        {
+            std::lock_guard<std::mutex> lock { pool_mutex_ };
+            work_ = &work;
+            work_n_ = n;
+            work_threads_ = n_threads;
+            n_pending_ = n_threads - 1;
+            ++work_generation_;
+        }
+
+        cv_work_.notify_all();
+    }
+
+    // The calling thread takes the first chunk.
+    work(0, 0, std::min(n, chunk_size));
+
+    if (n_threads > 1) {
+        std::unique_lock<std::mutex> lock { pool_mutex_ };
+        cv_done_.wait(lock, [this] { return n_pending_ == 0; });
+        work_ = nullptr;
+    }
+}
+
+void RadixSorter::runWorker(std::size_t thread_idx)
+{
+    std::uint64_t generation { 0 };
+    std::unique_lock<std::mutex> lock { pool_mutex_ };
+    for (;;) {
+        cv_work_.wait(lock, [this, generation] { return stopping_ || work_generation_ != generation; });
+        if (stopping_) {
+            return;
+        }
+
+        generation = work_generation_;
+        if (thread_idx >= work_threads_) {
+            // Not needed, the input is too small to be split this many ways.
+            continue;
+        }
+
+        const Work& work { *work_ };
+        const std::size_t chunk_size { (work_n_ + work_threads_ - 1) / work_threads_ };
+        const std::size_t begin { std::min(work_n_, thread_idx * chunk_size) };
+        const std::size_t end { std::min(work_n_, begin + chunk_size) };
+
+        lock.unlock();
+        work(thread_idx, begin, end);
+        lock.lock();
+
+        if (--n_pending_ == 0) {
+            cv_done_.notify_one();
+        }
+    }
+}
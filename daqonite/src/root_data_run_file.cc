@@ -0,0 +1,622 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <run_file/hit_codec.h>
+#include <util/pmt_hit_queues.h>
+
+#include "root_data_run_file.h"
+
+RootDataRunFile::RootDataRunFile(std::string path, const DataRunFileSettings& settings)
+    : DataRunFile {}
+    , settings_ { settings }
+    , file_ { TFile::Open(path.c_str(), "RECREATE", "",
+          ROOT::CompressionSettings(static_cast<ROOT::RCompressionSetting::EAlgorithm::EValues>(settings.compression_algorithm),
+              settings.compression_level)) }
+    , last_bytes_written_ { 0 }
+    , last_raw_bytes_ { 0 }
+    , last_zip_bytes_ { 0 }
+    , n_opt_hits_ { 0 }
+    , opt_hits_ { nullptr }
+    , opt_hit_columns_ { nullptr }
+    , n_hit_columns_ { 0 }
+    , opt_hits_packed_ { nullptr }
+    , n_hits_packed_ { 0 }
+    , n_bytes_packed_ { 0 }
+    , hits_packed_ {}
+    , checkpoint_pending_bytes_ { 0 }
+    , checkpoint_time_ { std::chrono::steady_clock::now() }
+    , events_ { nullptr }
+    , event_ {}
+    , channel_summaries_ { nullptr }
+    , channel_summary_ {}
+    , spill_summaries_ { nullptr }
+    , spill_summary_ {}
+    , spill_summary_n_planes_ { 0 }
+    , time_index_ { nullptr }
+    , plane_index_ { nullptr }
+{
+    createRunParams();
+    createSpills();
+
+    switch (settings_.hit_layout) {
+    case HitLayout::Columnar:
+        createOptHitColumns();
+        break;
+    case HitLayout::Packed:
+        createOptHitsPacked();
+        break;
+    case HitLayout::PerHit:
+    default:
+        createOptHits();
+        break;
+    }
+
+    createOptAnnotations();
+    createTDUSignals();
+
+    if (settings_.time_index_bucket_ns > 0) {
+        createIndices();
+    }
+}
+
+void RootDataRunFile::close()
+{
+    if (isOpen()) {
+        // Replace tree headers saved by checkpoints, only baskets filled since then are written here.
+        for (TTree* tree : trees()) {
+            tree->Write("", TObject::kOverwrite);
+        }
+
+        file_->Close();
+    }
+}
+
+bool RootDataRunFile::checkpointEnabled() const
+{
+    return settings_.checkpoint_bytes > 0 || settings_.checkpoint_interval_s > 0;
+}
+
+bool RootDataRunFile::checkpointDue() const
+{
+    if (settings_.checkpoint_bytes > 0 && checkpoint_pending_bytes_ >= settings_.checkpoint_bytes) {
+        return true;
+    }
+
+    const std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - checkpoint_time_ };
+    return settings_.checkpoint_interval_s > 0 && elapsed.count() >= settings_.checkpoint_interval_s;
+}
+
+DataRunFileFlushStats RootDataRunFile::flush()
+{
+    DataRunFileFlushStats stats {};
+    if (!isOpen() || !checkpointEnabled() || !checkpointDue()) {
+        return stats;
+    }
+
+    // Flush baskets of all trees and save their headers along with the file directory, so that
+    // everything filled so far can be read back even if the file is never closed.
+    const std::uint64_t bytes_written { static_cast<std::uint64_t>(file_->GetBytesWritten()) };
+    const auto start { std::chrono::steady_clock::now() };
+
+    for (TTree* tree : trees()) {
+        tree->AutoSave("SaveSelf FlushBaskets");
+    }
+
+    checkpoint_time_ = std::chrono::steady_clock::now();
+    checkpoint_pending_bytes_ = 0;
+
+    const std::chrono::duration<double, std::milli> elapsed { checkpoint_time_ - start };
+    stats.checkpoint = true;
+    stats.duration_ms = elapsed.count();
+    stats.bytes_written = file_->GetBytesWritten() - bytes_written;
+    return stats;
+}
+
+bool RootDataRunFile::isOpen() const
+{
+    return file_ && file_->IsOpen();
+}
+
+void RootDataRunFile::tuneTree(TTree* tree) const
+{
+    tree->SetAutoFlush(settings_.auto_flush);
+
+    // ROOT saves trees every 300 MB on its own, which is superseded by explicit checkpoints.
+    if (checkpointEnabled()) {
+        tree->SetAutoSave(0);
+    }
+
+    // Apply tree-wide basket sizes first, so that they can be overridden for individual branches.
+    const std::string tree_name { tree->GetName() };
+    const auto tree_it { settings_.basket_sizes.find(tree_name) };
+    if (tree_it != settings_.basket_sizes.end()) {
+        tree->SetBasketSize("*", tree_it->second);
+    }
+
+    const std::string branch_prefix { tree_name + "." };
+    for (const auto& key_value : settings_.basket_sizes) {
+        if (key_value.first.compare(0, branch_prefix.size(), branch_prefix) == 0) {
+            tree->SetBasketSize(key_value.first.substr(branch_prefix.size()).c_str(), key_value.second);
+        }
+    }
+}
+
+std::uint64_t RootDataRunFile::rawBytes() const
+{
+    return optHitsTree()->GetTotBytes() + opt_annotations_->GetTotBytes() + spills_->GetTotBytes();
+}
+
+std::uint64_t RootDataRunFile::zipBytes() const
+{
+    return optHitsTree()->GetZipBytes() + opt_annotations_->GetZipBytes() + spills_->GetZipBytes();
+}
+
+TTree* RootDataRunFile::optHitsTree() const
+{
+    if (opt_hit_columns_) {
+        return opt_hit_columns_;
+    }
+
+    return opt_hits_packed_ ? opt_hits_packed_ : opt_hits_;
+}
+
+std::vector<TTree*> RootDataRunFile::trees() const
+{
+    std::vector<TTree*> trees { run_params_, spills_, optHitsTree(), opt_annotations_, tdu_signals_ };
+    if (events_) {
+        trees.push_back(events_);
+    }
+    if (channel_summaries_) {
+        trees.push_back(channel_summaries_);
+    }
+    if (spill_summaries_) {
+        trees.push_back(spill_summaries_);
+    }
+    if (time_index_) {
+        trees.push_back(time_index_);
+        trees.push_back(plane_index_);
+    }
+    return trees;
+}
+
+void RootDataRunFile::createRunParams()
+{
+    run_params_ = new TTree(run_file::RUN_PARAMS_TREE, "Information about the run");
+    run_params_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    run_params_->Branch("number", &run_number_, "number/l");
+    run_params_->Branch("type", &run_type_, "type/b");
+    run_params_->Branch("utc_time_started_s", &run_time_started_.secs, "utc_time_started_s/l");
+    run_params_->Branch("utc_time_started_ns", &run_time_started_.nanosecs, "utc_time_started_ns/i");
+    run_params_->Branch("utc_time_stopped_s", &run_time_stopped_.secs, "utc_time_stopped_s/l");
+    run_params_->Branch("utc_time_stopped_ns", &run_time_stopped_.nanosecs, "utc_time_stopped_ns/i");
+
+    tuneTree(run_params_);
+}
+
+void RootDataRunFile::createSpills()
+{
+    spills_ = new TTree(run_file::SPILLS_TREE, "Sequence of spills scheduled during the run");
+    spills_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    spills_->Branch("number", &spill_number_, "number/l");
+    spills_->Branch("tai_time_started_s", &spill_time_started_.secs, "tai_time_started_s/l");
+    spills_->Branch("tai_time_started_ns", &spill_time_started_.nanosecs, "tai_time_started_ns/i");
+    spills_->Branch("tai_time_stopped_s", &spill_time_stopped_.secs, "tai_time_stopped_s/l");
+    spills_->Branch("tai_time_stopped_ns", &spill_time_stopped_.nanosecs, "tai_time_stopped_ns/i");
+    spills_->Branch("opt_hits_begin", &spill_opt_hits_begin_, "opt_hits_begin/l");
+    spills_->Branch("opt_hits_end", &spill_opt_hits_end_, "opt_hits_end/l");
+    spills_->Branch("opt_annotations_begin", &spill_opt_annotations_begin_, "opt_annotations_begin/l");
+    spills_->Branch("opt_annotations_end", &spill_opt_annotations_end_, "opt_annotations_end/l");
+
+    tuneTree(spills_);
+}
+
+void RootDataRunFile::createOptHits()
+{
+    opt_hits_ = new TTree(run_file::OPT_HITS_TREE, "Sequence of optical hits taken from all planes during multiple spills, guaranteed to be time-sorted within the scope of a single spill");
+    opt_hits_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    opt_hits_->Branch("plane_number", &hit_.plane_number, "plane_number/i");
+    opt_hits_->Branch("channel_number", &hit_.channel_number, "channel_number/b");
+    opt_hits_->Branch("tai_time_s", &hit_.timestamp.secs, "tai_time_s/l");
+    opt_hits_->Branch("tai_time_ns", &hit_.timestamp.nanosecs, "tai_time_ns/i");
+    opt_hits_->Branch("tot", &hit_.tot, "tot/s");
+    opt_hits_->Branch("adc0", &hit_.adc0, "adc0/s");
+    opt_hits_->Branch("cpu_trigger", &hit_.cpu_trigger, "cpu_trigger/O");
+
+    tuneTree(opt_hits_);
+}
+
+void RootDataRunFile::createOptHitColumns()
+{
+    opt_hit_columns_ = new TTree(run_file::OPT_HIT_COLUMNS_TREE, "Optical hits taken from all planes, one entry per spill with hits stored in array branches, guaranteed to be time-sorted within the entry");
+    opt_hit_columns_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    // Branches need valid addresses, actual buffers are bound before every fill.
+    hit_columns_.resize(1);
+
+    opt_hit_columns_->Branch("n_hits", &n_hit_columns_, "n_hits/i");
+    opt_hit_columns_->Branch("plane_number", hit_columns_.plane_number.data(), "plane_number[n_hits]/i");
+    opt_hit_columns_->Branch("channel_number", hit_columns_.channel_number.data(), "channel_number[n_hits]/b");
+    opt_hit_columns_->Branch("tai_time_s", hit_columns_.tai_time_s.data(), "tai_time_s[n_hits]/l");
+    opt_hit_columns_->Branch("tai_time_ns", hit_columns_.tai_time_ns.data(), "tai_time_ns[n_hits]/i");
+    opt_hit_columns_->Branch("tot", hit_columns_.tot.data(), "tot[n_hits]/s");
+    opt_hit_columns_->Branch("adc0", hit_columns_.adc0.data(), "adc0[n_hits]/s");
+    opt_hit_columns_->Branch("flags", hit_columns_.flags.data(), "flags[n_hits]/b");
+
+    tuneTree(opt_hit_columns_);
+}
+
+void RootDataRunFile::bindOptHitColumns()
+{
+    // Columns may have been reallocated since the previous spill.
+    opt_hit_columns_->SetBranchAddress("plane_number", hit_columns_.plane_number.data());
+    opt_hit_columns_->SetBranchAddress("channel_number", hit_columns_.channel_number.data());
+    opt_hit_columns_->SetBranchAddress("tai_time_s", hit_columns_.tai_time_s.data());
+    opt_hit_columns_->SetBranchAddress("tai_time_ns", hit_columns_.tai_time_ns.data());
+    opt_hit_columns_->SetBranchAddress("tot", hit_columns_.tot.data());
+    opt_hit_columns_->SetBranchAddress("adc0", hit_columns_.adc0.data());
+    opt_hit_columns_->SetBranchAddress("flags", hit_columns_.flags.data());
+}
+
+void RootDataRunFile::createOptHitsPacked()
+{
+    opt_hits_packed_ = new TTree(run_file::OPT_HITS_PACKED_TREE, "Optical hits taken from all planes, one entry per spill with hits encoded by hit_codec, guaranteed to be time-sorted within the entry");
+    opt_hits_packed_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    // Branches need valid addresses, the actual buffer is bound before every fill.
+    hits_packed_.resize(1);
+
+    opt_hits_packed_->Branch("n_hits", &n_hits_packed_, "n_hits/i");
+    opt_hits_packed_->Branch("n_bytes", &n_bytes_packed_, "n_bytes/i");
+    opt_hits_packed_->Branch("data", static_cast<void*>(hits_packed_.data()), "data[n_bytes]/b");
+
+    tuneTree(opt_hits_packed_);
+}
+
+void RootDataRunFile::createOptAnnotations()
+{
+    opt_annotations_ = new TTree(run_file::OPT_ANNOTATIONS_TREE, "Sequence of annotations of the optical hit data (containing information about gaps, dropped channels, etc.), guaranteed to be time-sorted within the scope of a single spill");
+    opt_annotations_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    opt_annotations_->Branch("type", &annotation_.type, "type/b");
+    opt_annotations_->Branch("plane_number", &annotation_.plane_number, "plane_number/i");
+    opt_annotations_->Branch("channel_number", &annotation_.channel_number, "plane_number/n");
+    opt_annotations_->Branch("tai_time_start_s", &annotation_.time_start.secs, "tai_time_start_s/l");
+    opt_annotations_->Branch("tai_time_start_ns", &annotation_.time_start.nanosecs, "tai_time_start_ns/i");
+    opt_annotations_->Branch("tai_time_end_s", &annotation_.time_end.secs, "tai_time_end_s/l");
+    opt_annotations_->Branch("tai_time_end_ns", &annotation_.time_end.nanosecs, "tai_time_end_ns/i");
+
+    tuneTree(opt_annotations_);
+}
+
+void RootDataRunFile::createTDUSignals()
+{
+    tdu_signals_ = new TTree(run_file::TDU_SIGNALS_TREE, "Sequence of Fermilab accelerator time signals received from the NOvA TDU during the run period");
+    tdu_signals_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    tdu_signals_->Branch("type", &tdu_signal_.type, "type/I");
+    tdu_signals_->Branch("nova_time", &tdu_signal_.nova_time, "type/l");
+    tdu_signals_->Branch("tai_time_s", &tdu_signal_.time.secs, "tai_time_start_s/l");
+    tdu_signals_->Branch("tai_time_ns", &tdu_signal_.time.nanosecs, "tai_time_start_ns/i");
+
+    tuneTree(tdu_signals_);
+}
+
+void RootDataRunFile::createEvents()
+{
+    events_ = new TTree(run_file::EVENTS_TREE, "Coincidences of optical hits found by the event builder, in order of spills");
+    events_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    events_->Branch("spill_number", &event_.spill_number, "spill_number/l");
+    events_->Branch("opt_hits_begin", &event_.opt_hits_begin, "opt_hits_begin/l");
+    events_->Branch("opt_hits_end", &event_.opt_hits_end, "opt_hits_end/l");
+    events_->Branch("n_planes", &event_.n_planes, "n_planes/i");
+    events_->Branch("n_channels", &event_.n_channels, "n_channels/i");
+    events_->Branch("tai_time_first_s", &event_.time_first.secs, "tai_time_first_s/l");
+    events_->Branch("tai_time_first_ns", &event_.time_first.nanosecs, "tai_time_first_ns/i");
+    events_->Branch("tai_time_last_s", &event_.time_last.secs, "tai_time_last_s/l");
+    events_->Branch("tai_time_last_ns", &event_.time_last.nanosecs, "tai_time_last_ns/i");
+
+    tuneTree(events_);
+}
+
+void RootDataRunFile::createChannelSummaries()
+{
+    channel_summaries_ = new TTree(run_file::CHANNEL_SUMMARIES_TREE, "Hit rates and spectra of optical channels, in order of spills");
+    channel_summaries_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    channel_summaries_->Branch("spill_number", &channel_summary_.spill_number, "spill_number/l");
+    channel_summaries_->Branch("plane_number", &channel_summary_.plane_number, "plane_number/i");
+    channel_summaries_->Branch("channel_number", &channel_summary_.channel_number, "channel_number/b");
+    channel_summaries_->Branch("n_hits", &channel_summary_.n_hits, "n_hits/i");
+    channel_summaries_->Branch("rate_hz", &channel_summary_.rate_hz, "rate_hz/D");
+    channel_summaries_->Branch("tot_mean", &channel_summary_.tot_mean, "tot_mean/D");
+    channel_summaries_->Branch("tot_rms", &channel_summary_.tot_rms, "tot_rms/D");
+    channel_summaries_->Branch("adc0_mean", &channel_summary_.adc0_mean, "adc0_mean/D");
+    channel_summaries_->Branch("adc0_rms", &channel_summary_.adc0_rms, "adc0_rms/D");
+
+    tuneTree(channel_summaries_);
+}
+
+void RootDataRunFile::createSpillSummaries()
+{
+    spill_summaries_ = new TTree(run_file::SPILL_SUMMARIES_TREE, "Data quality summaries of spills, with per-plane breakdowns in array branches");
+    spill_summaries_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    // Branches need valid addresses, actual buffers are bound before every fill.
+    spill_summary_.plane_number.resize(1);
+    spill_summary_.plane_n_hits.resize(1);
+    spill_summary_.plane_n_channels.resize(1);
+    spill_summary_.plane_n_displaced.resize(1);
+    spill_summary_.plane_n_gaps.resize(1);
+
+    spill_summaries_->Branch("spill_number", &spill_summary_.spill_number, "spill_number/l");
+    spill_summaries_->Branch("n_hits", &spill_summary_.n_hits, "n_hits/l");
+    spill_summaries_->Branch("n_channels", &spill_summary_.n_channels, "n_channels/i");
+    spill_summaries_->Branch("n_displaced", &spill_summary_.n_displaced, "n_displaced/l");
+    spill_summaries_->Branch("disorder", &spill_summary_.disorder, "disorder/D");
+    spill_summaries_->Branch("n_swaps", &spill_summary_.n_swaps, "n_swaps/l");
+    spill_summaries_->Branch("n_gaps", &spill_summary_.n_gaps, "n_gaps/l");
+    spill_summaries_->Branch("tai_time_first_s", &spill_summary_.time_first.secs, "tai_time_first_s/l");
+    spill_summaries_->Branch("tai_time_first_ns", &spill_summary_.time_first.nanosecs, "tai_time_first_ns/i");
+    spill_summaries_->Branch("tai_time_last_s", &spill_summary_.time_last.secs, "tai_time_last_s/l");
+    spill_summaries_->Branch("tai_time_last_ns", &spill_summary_.time_last.nanosecs, "tai_time_last_ns/i");
+    spill_summaries_->Branch("merge_ms", &spill_summary_.merge_ms, "merge_ms/D");
+    spill_summaries_->Branch("sort_ms", &spill_summary_.sort_ms, "sort_ms/D");
+    spill_summaries_->Branch("build_ms", &spill_summary_.build_ms, "build_ms/D");
+    spill_summaries_->Branch("write_ms", &spill_summary_.write_ms, "write_ms/D");
+    spill_summaries_->Branch("arrival_to_decode_p50_us", &spill_summary_.arrival_to_decode_p50_us, "arrival_to_decode_p50_us/D");
+    spill_summaries_->Branch("arrival_to_decode_p99_us", &spill_summary_.arrival_to_decode_p99_us, "arrival_to_decode_p99_us/D");
+    spill_summaries_->Branch("arrival_to_decode_max_us", &spill_summary_.arrival_to_decode_max_us, "arrival_to_decode_max_us/D");
+    spill_summaries_->Branch("decode_to_slot_p50_us", &spill_summary_.decode_to_slot_p50_us, "decode_to_slot_p50_us/D");
+    spill_summaries_->Branch("decode_to_slot_p99_us", &spill_summary_.decode_to_slot_p99_us, "decode_to_slot_p99_us/D");
+    spill_summaries_->Branch("decode_to_slot_max_us", &spill_summary_.decode_to_slot_max_us, "decode_to_slot_max_us/D");
+    spill_summaries_->Branch("end_to_close_ms", &spill_summary_.end_to_close_ms, "end_to_close_ms/D");
+    spill_summaries_->Branch("close_to_written_ms", &spill_summary_.close_to_written_ms, "close_to_written_ms/D");
+    spill_summaries_->Branch("n_planes", &spill_summary_n_planes_, "n_planes/i");
+    spill_summaries_->Branch("plane_number", spill_summary_.plane_number.data(), "plane_number[n_planes]/i");
+    spill_summaries_->Branch("plane_n_hits", spill_summary_.plane_n_hits.data(), "plane_n_hits[n_planes]/l");
+    spill_summaries_->Branch("plane_n_channels", spill_summary_.plane_n_channels.data(), "plane_n_channels[n_planes]/i");
+    spill_summaries_->Branch("plane_n_displaced", spill_summary_.plane_n_displaced.data(), "plane_n_displaced[n_planes]/l");
+    spill_summaries_->Branch("plane_n_gaps", spill_summary_.plane_n_gaps.data(), "plane_n_gaps[n_planes]/l");
+
+    tuneTree(spill_summaries_);
+}
+
+void RootDataRunFile::bindSpillSummaries()
+{
+    // Columns may have been reallocated since the previous spill.
+    spill_summaries_->SetBranchAddress("plane_number", spill_summary_.plane_number.data());
+    spill_summaries_->SetBranchAddress("plane_n_hits", spill_summary_.plane_n_hits.data());
+    spill_summaries_->SetBranchAddress("plane_n_channels", spill_summary_.plane_n_channels.data());
+    spill_summaries_->SetBranchAddress("plane_n_displaced", spill_summary_.plane_n_displaced.data());
+    spill_summaries_->SetBranchAddress("plane_n_gaps", spill_summary_.plane_n_gaps.data());
+}
+
+void RootDataRunFile::createIndices()
+{
+    time_index_ = new TTree(run_file::TIME_INDEX_TREE, "Ranges of optical hits falling into coarse time buckets, in order of spills");
+    time_index_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    time_index_->Branch("bucket", &time_bucket_, "bucket/l");
+    time_index_->Branch("bucket_ns", &time_bucket_ns_, "bucket_ns/l");
+    time_index_->Branch("opt_hits_begin", &time_bucket_hits_begin_, "opt_hits_begin/l");
+    time_index_->Branch("opt_hits_end", &time_bucket_hits_end_, "opt_hits_end/l");
+
+    tuneTree(time_index_);
+
+    plane_index_ = new TTree(run_file::PLANE_INDEX_TREE, "Ranges of optical hits containing individual planes in every spill");
+    plane_index_->SetDirectory(file_.get());
+    // from this point on, the TTree is owned by TFile
+
+    plane_index_->Branch("spill_number", &plane_index_spill_, "spill_number/l");
+    plane_index_->Branch("plane_number", &plane_index_plane_, "plane_number/i");
+    plane_index_->Branch("opt_hits_begin", &plane_index_hits_begin_, "opt_hits_begin/l");
+    plane_index_->Branch("opt_hits_end", &plane_index_hits_end_, "opt_hits_end/l");
+    plane_index_->Branch("n_hits", &plane_index_n_hits_, "n_hits/l");
+
+    tuneTree(plane_index_);
+}
+
+/// Range of hits of a single plane within a spill.
+struct PlaneRange {
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint64_t n_hits;
+};
+
+void RootDataRunFile::fillIndices(const PMTHitQueue& merged_hits, std::uint64_t spill_number, std::uint64_t first_hit)
+{
+    // Hits are time-sorted, hence every bucket is a contiguous range.
+    time_bucket_ns_ = settings_.time_index_bucket_ns;
+    std::map<std::uint32_t, PlaneRange> planes {};
+
+    std::size_t bucket_begin { 0 };
+    for (std::size_t i = 0; i < merged_hits.size(); ++i) {
+        const PMTHit& hit { merged_hits[i] };
+        const std::uint64_t bucket { hit.timestamp.combined_nanosecs() / time_bucket_ns_ };
+
+        if (i > 0 && bucket != time_bucket_) {
+            time_bucket_hits_begin_ = first_hit + bucket_begin;
+            time_bucket_hits_end_ = first_hit + i;
+            time_index_->Fill();
+            bucket_begin = i;
+        }
+        time_bucket_ = bucket;
+
+        auto it { planes.find(hit.plane_number) };
+        if (it == planes.end()) {
+            it = planes.emplace(hit.plane_number, PlaneRange { first_hit + i, 0, 0 }).first;
+        }
+        it->second.end = first_hit + i + 1;
+        ++it->second.n_hits;
+    }
+
+    if (!merged_hits.empty()) {
+        time_bucket_hits_begin_ = first_hit + bucket_begin;
+        time_bucket_hits_end_ = first_hit + merged_hits.size();
+        time_index_->Fill();
+    }
+
+    plane_index_spill_ = spill_number;
+    for (const auto& plane : planes) {
+        plane_index_plane_ = plane.first;
+        plane_index_hits_begin_ = plane.second.begin;
+        plane_index_hits_end_ = plane.second.end;
+        plane_index_n_hits_ = plane.second.n_hits;
+        plane_index_->Fill();
+    }
+}
+
+DataRunFileSpillStats RootDataRunFile::writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits)
+{
+    if (!isOpen()) {
+        return DataRunFileSpillStats {};
+    }
+
+    spill_number_ = spill->spill_number;
+    spill_time_started_ = spill->start_time;
+    spill_time_stopped_ = spill->end_time;
+    spill_opt_hits_begin_ = n_opt_hits_;
+
+    if (opt_hit_columns_) {
+        // transpose hits into columns and fill them all at once
+        hit_columns_.assign(merged_hits);
+        n_hit_columns_ = static_cast<UInt_t>(hit_columns_.size());
+        bindOptHitColumns();
+        opt_hit_columns_->Fill();
+    } else if (opt_hits_packed_) {
+        // transpose hits into columns and encode them into a single array
+        hit_columns_.assign(merged_hits);
+        hits_packed_.clear();
+        hit_codec::encode(hit_columns_, hits_packed_);
+        n_hits_packed_ = static_cast<UInt_t>(hit_columns_.size());
+        n_bytes_packed_ = static_cast<UInt_t>(hits_packed_.size());
+        opt_hits_packed_->SetBranchAddress("data", static_cast<void*>(hits_packed_.data()));
+        opt_hits_packed_->Fill();
+    } else {
+        // fill hits one by one
+        for (const PMTHit& src_hit : merged_hits) {
+            hit_ = src_hit;
+            opt_hits_->Fill();
+        }
+    }
+
+    if (time_index_) {
+        fillIndices(merged_hits, spill_number_, spill_opt_hits_begin_);
+    }
+
+    n_opt_hits_ += merged_hits.size();
+    checkpoint_pending_bytes_ += merged_hits.size() * HitColumns::BYTES_PER_HIT;
+    spill_opt_hits_end_ = n_opt_hits_;
+
+    spill_opt_annotations_begin_ = opt_annotations_->GetEntries();
+
+    // Gather annotations of all slots, which are time-sorted within the spill.
+    std::vector<Annotation> annotations {};
+    for (std::size_t data_slot_idx = 0; data_slot_idx < spill->n_data_slots; ++data_slot_idx) {
+        const AnnotationQueue& slot_annotations { spill->data_slots[data_slot_idx].opt_annotation_queue };
+        annotations.insert(annotations.end(), slot_annotations.begin(), slot_annotations.end());
+    }
+    std::stable_sort(annotations.begin(), annotations.end(), [](const Annotation& a, const Annotation& b) {
+        return a.time_start < b.time_start;
+    });
+    for (const Annotation& annotation : annotations) {
+        annotation_ = annotation;
+        opt_annotations_->Fill();
+    }
+
+    spill_opt_annotations_end_ = opt_annotations_->GetEntries();
+    spills_->Fill();
+
+    // Account for data that made it to disk. Since baskets are flushed only once full,
+    // this happens in bursts, and the numbers need to be interpreted over several spills.
+    DataRunFileSpillStats stats {};
+    stats.total_bytes_written = file_->GetBytesWritten();
+    stats.bytes_written = stats.total_bytes_written - last_bytes_written_;
+
+    const std::uint64_t raw_bytes { rawBytes() };
+    const std::uint64_t zip_bytes { zipBytes() };
+    stats.raw_bytes = raw_bytes - last_raw_bytes_;
+    stats.zip_bytes = zip_bytes - last_zip_bytes_;
+    stats.compression_ratio = zip_bytes > 0 ? static_cast<double>(raw_bytes) / zip_bytes : 0.0;
+
+    last_bytes_written_ = stats.total_bytes_written;
+    last_raw_bytes_ = raw_bytes;
+    last_zip_bytes_ = zip_bytes;
+
+    return stats;
+}
+
+void RootDataRunFile::writeSpillEvents(const std::vector<EventRecord>& events)
+{
+    if (!events_) {
+        createEvents();
+    }
+
+    // Hit ranges become global, like those in the spills tree.
+    for (const EventRecord& event : events) {
+        event_ = event;
+        event_.spill_number = spill_number_;
+        event_.opt_hits_begin += spill_opt_hits_begin_;
+        event_.opt_hits_end += spill_opt_hits_begin_;
+        events_->Fill();
+    }
+}
+
+void RootDataRunFile::writeChannelSummaries(const std::vector<ChannelSummaryRecord>& summaries)
+{
+    if (!channel_summaries_) {
+        createChannelSummaries();
+    }
+
+    for (const ChannelSummaryRecord& summary : summaries) {
+        channel_summary_ = summary;
+        channel_summaries_->Fill();
+    }
+}
+
+void RootDataRunFile::writeSpillSummary(const SpillSummaryRecord& summary)
+{
+    if (!spill_summaries_) {
+        createSpillSummaries();
+    }
+
+    spill_summary_ = summary;
+    spill_summary_n_planes_ = static_cast<UInt_t>(spill_summary_.nPlanes());
+    bindSpillSummaries();
+    spill_summaries_->Fill();
+}
+
+void RootDataRunFile::writeRunParametersAtStart(const RunParameters& params)
+{
+    // TODO: write configuration
+}
+
+void RootDataRunFile::writeRunParametersAtEnd(const RunParameters& params)
+{
+    run_number_ = params.number;
+    run_type_ = params.type;
+    run_time_started_ = params.time_started;
+    run_time_stopped_ = params.time_stopped;
+
+    // TODO: write hit counts, etc.
+
+    // TODO: write spill signals
+
+    run_params_->Fill();
+}
@@ -0,0 +1,320 @@
+#include <cstdio>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include <json/json.h>
+
+#include <util/pmt_hit_queues.h>
+
+#include "segmented_data_run_file.h"
+
+/// How long spills keep going to the current segment after a new one failed to open
+static constexpr std::chrono::seconds ROTATION_RETRY_INTERVAL { 60 };
+
+/// Split path into the part before the extension and the extension (including the dot).
+static std::pair<std::string, std::string> splitExtension(const std::string& path)
+{
+    const std::size_t slash { path.rfind('/') };
+    const std::size_t dot { path.rfind('.') };
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return { path, "" };
+    }
+
+    return { path.substr(0, dot), path.substr(dot) };
+}
+
+static std::string baseName(const std::string& path)
+{
+    const std::size_t slash { path.rfind('/') };
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+SegmentedDataRunFile::SegmentedDataRunFile(const std::string& path, const DataRunFileSettings& settings)
+    : DataRunFile {}
+    , Logging {}
+    , settings_ { settings }
+    , path_ { path }
+    , run_params_ {}
+    , segment_ {}
+    , segment_index_ { 0 }
+    , segment_entry_ { 0 }
+    , segment_opened_ { std::chrono::steady_clock::now() }
+    , rotation_retry_ {}
+    , segment_bytes_ { 0 }
+    , closed_bytes_ { 0 }
+    , segments_mutex_ {}
+    , segments_ {}
+    , complete_ { false }
+    , closing_threads_ {}
+{
+    setUnitName("SegmentedDataRunFile");
+
+    // If the first segment cannot be opened, isOpen() reports the failure.
+    segment_ = openSegment(segment_index_, segment_entry_);
+}
+
+SegmentedDataRunFile::~SegmentedDataRunFile()
+{
+    joinClosingThreads();
+}
+
+std::string SegmentedDataRunFile::segmentPath(const std::string& path, std::size_t segment_index)
+{
+    const auto parts { splitExtension(path) };
+    return fmt::format("{}_part{:03d}{}", parts.first, segment_index, parts.second);
+}
+
+std::string SegmentedDataRunFile::manifestPath(const std::string& path)
+{
+    return fmt::format("{}.manifest.json", splitExtension(path).first);
+}
+
+std::unique_ptr<DataRunFile> SegmentedDataRunFile::openSegment(std::size_t segment_index, std::size_t& entry)
+{
+    const std::string path { segmentPath(path_, segment_index) };
+    std::unique_ptr<DataRunFile> file { DataRunFile::createFile(path, settings_) };
+    if (!file->isOpen()) {
+        log(ERROR, "Error opening segment for writing: '{}'", path);
+        return nullptr;
+    }
+
+    DataRunSegment segment {};
+    segment.path = baseName(path);
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    entry = segments_.size();
+    segments_.push_back(segment);
+    writeManifest();
+    return file;
+}
+
+bool SegmentedDataRunFile::rotationDue() const
+{
+    if (std::chrono::steady_clock::now() < rotation_retry_) {
+        return false;
+    }
+
+    if (settings_.rotate_bytes > 0 && segment_bytes_ >= settings_.rotate_bytes) {
+        return true;
+    }
+
+    const std::chrono::duration<double> age { std::chrono::steady_clock::now() - segment_opened_ };
+    return settings_.rotate_interval_s > 0 && age.count() >= settings_.rotate_interval_s;
+}
+
+void SegmentedDataRunFile::rotate()
+{
+    joinClosedThreads();
+
+    // The next segment is opened first, so that the current one can take further spills if it fails.
+    std::size_t next_entry { 0 };
+    std::unique_ptr<DataRunFile> next { openSegment(segment_index_ + 1, next_entry) };
+    if (!next) {
+        rotation_retry_ = std::chrono::steady_clock::now() + ROTATION_RETRY_INTERVAL;
+        log(WARNING, "Continuing with segment '{}', rotation will be retried in {} s",
+            segmentPath(path_, segment_index_), ROTATION_RETRY_INTERVAL.count());
+        return;
+    }
+
+    // Run parameters are small, hence they are written here rather than on the closing thread.
+    segment_->writeRunParametersAtEnd(run_params_);
+    closed_bytes_ += segment_bytes_;
+
+    std::thread closing_thread { &SegmentedDataRunFile::closeSegment, this, std::move(segment_), segment_index_, segment_entry_ };
+    closing_threads_.push_back(ClosingThread { std::move(closing_thread), segment_entry_ });
+
+    segment_ = std::move(next);
+    ++segment_index_;
+    segment_entry_ = next_entry;
+    segment_opened_ = std::chrono::steady_clock::now();
+    segment_bytes_ = 0;
+    log(INFO, "Continuing with segment '{}'", segmentPath(path_, segment_index_));
+
+    segment_->writeRunParametersAtStart(run_params_);
+}
+
+void SegmentedDataRunFile::closeSegment(std::unique_ptr<DataRunFile> file, std::size_t segment_index, std::size_t entry)
+{
+    const std::string path { segmentPath(path_, segment_index) };
+
+    const auto start { std::chrono::steady_clock::now() };
+    file->close();
+    file.reset();
+    const std::chrono::duration<double, std::milli> elapsed { std::chrono::steady_clock::now() - start };
+
+    struct stat file_stat {};
+    const std::uint64_t bytes { ::stat(path.c_str(), &file_stat) == 0 ? static_cast<std::uint64_t>(file_stat.st_size) : 0 };
+    log(INFO, "Segment '{}' closed in {:.1f} ms ({} bytes)", path, elapsed.count(), bytes);
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    segments_[entry].bytes = bytes;
+    segments_[entry].closed = true;
+    writeManifest();
+}
+
+void SegmentedDataRunFile::joinClosedThreads()
+{
+    // A segment is marked closed as the last thing its thread does, so joining it does not block.
+    std::vector<bool> closed {};
+    {
+        std::lock_guard<std::mutex> lock { segments_mutex_ };
+        for (const ClosingThread& closing : closing_threads_) {
+            closed.push_back(segments_[closing.entry].closed);
+        }
+    }
+
+    std::size_t n_kept { 0 };
+    for (std::size_t i = 0; i < closing_threads_.size(); ++i) {
+        if (closed[i]) {
+            closing_threads_[i].thread.join();
+        } else {
+            if (n_kept != i) {
+                // Assigning to a joinable thread, even itself, would terminate.
+                closing_threads_[n_kept] = std::move(closing_threads_[i]);
+            }
+            ++n_kept;
+        }
+    }
+    closing_threads_.resize(n_kept);
+}
+
+void SegmentedDataRunFile::joinClosingThreads()
+{
+    for (ClosingThread& closing : closing_threads_) {
+        if (closing.thread.joinable()) {
+            closing.thread.join();
+        }
+    }
+
+    closing_threads_.clear();
+}
+
+void SegmentedDataRunFile::writeRunParametersAtStart(const RunParameters& params)
+{
+    segment_->writeRunParametersAtStart(params);
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    run_params_ = params;
+    writeManifest();
+}
+
+void SegmentedDataRunFile::writeRunParametersAtEnd(const RunParameters& params)
+{
+    segment_->writeRunParametersAtEnd(params);
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    run_params_ = params;
+}
+
+DataRunFileSpillStats SegmentedDataRunFile::writeSpill(const SpillPtr spill, const PMTHitQueue& merged_hits)
+{
+    // Spills are never split between segments.
+    if (rotationDue()) {
+        rotate();
+    }
+
+    DataRunFileSpillStats stats { segment_->writeSpill(spill, merged_hits) };
+    segment_bytes_ = stats.total_bytes_written;
+    stats.total_bytes_written += closed_bytes_;
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    DataRunSegment& segment { segments_[segment_entry_] };
+    if (segment.n_spills == 0) {
+        segment.first_spill = spill->spill_number;
+    }
+    segment.last_spill = spill->spill_number;
+    segment.n_hits += merged_hits.size();
+    ++segment.n_spills;
+
+    return stats;
+}
+
+void SegmentedDataRunFile::writeSpillEvents(const std::vector<EventRecord>& events)
+{
+    // Rotation happens only before spills, hence events always follow their spill.
+    segment_->writeSpillEvents(events);
+}
+
+void SegmentedDataRunFile::writeChannelSummaries(const std::vector<ChannelSummaryRecord>& summaries)
+{
+    segment_->writeChannelSummaries(summaries);
+}
+
+void SegmentedDataRunFile::writeSpillSummary(const SpillSummaryRecord& summary)
+{
+    segment_->writeSpillSummary(summary);
+}
+
+bool SegmentedDataRunFile::isOpen() const
+{
+    return segment_ && segment_->isOpen();
+}
+
+DataRunFileFlushStats SegmentedDataRunFile::flush()
+{
+    return segment_->flush();
+}
+
+void SegmentedDataRunFile::close()
+{
+    if (!isOpen()) {
+        joinClosingThreads();
+        return;
+    }
+
+    // The last segment is closed synchronously, but it is no larger than any other.
+    segment_->close();
+    segment_.reset();
+
+    joinClosingThreads();
+
+    struct stat file_stat {};
+    const std::string path { segmentPath(path_, segment_index_) };
+    const std::uint64_t bytes { ::stat(path.c_str(), &file_stat) == 0 ? static_cast<std::uint64_t>(file_stat.st_size) : 0 };
+
+    std::lock_guard<std::mutex> lock { segments_mutex_ };
+    segments_[segment_entry_].bytes = bytes;
+    segments_[segment_entry_].closed = true;
+    complete_ = true;
+    writeManifest();
+}
+
+void SegmentedDataRunFile::writeManifest()
+{
+    Json::Value manifest {};
+    manifest["run"] = static_cast<Json::UInt64>(run_params_.number);
+    manifest["type"] = run_params_.type;
+    manifest["format"] = run_file::formatRunFileFormat(settings_.format);
+    manifest["complete"] = complete_;
+    manifest["segments"] = Json::Value { Json::arrayValue };
+
+    for (const DataRunSegment& segment : segments_) {
+        Json::Value entry {};
+        entry["path"] = segment.path;
+        entry["first_spill"] = static_cast<Json::UInt64>(segment.first_spill);
+        entry["last_spill"] = static_cast<Json::UInt64>(segment.last_spill);
+        entry["n_spills"] = static_cast<Json::UInt64>(segment.n_spills);
+        entry["n_hits"] = static_cast<Json::UInt64>(segment.n_hits);
+        entry["bytes"] = static_cast<Json::UInt64>(segment.bytes);
+        entry["closed"] = segment.closed;
+        manifest["segments"].append(entry);
+    }
+
+    // Replace the manifest atomically, so that readers never see it half-written.
+    const std::string path { manifestPath(path_) };
+    const std::string temp_path { path + ".tmp" };
+    {
+        std::ofstream file { temp_path };
+        Json::StreamWriterBuilder builder {};
+        file << Json::writeString(builder, manifest) << std::endl;
+        if (!file) {
+            log(WARNING, "Failed to write run manifest: '{}'", temp_path);
+            return;
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        log(WARNING, "Failed to replace run manifest: '{}'", path);
+    }
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <util/config.h>
+
+#include "socket_buffer_monitor.h"
+
+SocketBufferSettings SocketBufferSettings::fromConfig()
+{
+    SocketBufferSettings settings {};
+    settings.sample_interval_s = g_config.lookupDouble("socket_buffers.sample_interval");
+    settings.adaptive = g_config.lookupBool("socket_buffers.adaptive");
+    settings.grow_threshold = g_config.lookupDouble("socket_buffers.grow_threshold");
+    settings.grow_factor = g_config.lookupDouble("socket_buffers.grow_factor");
+    settings.max_size = g_config.lookupU64("socket_buffers.max_size");
+
+    if (settings.sample_interval_s <= 0.0) {
+        throw std::runtime_error { fmt::format("Socket buffers need a positive sample interval, got {} s", settings.sample_interval_s) };
+    }
+    if (settings.adaptive && settings.grow_factor <= 1.0) {
+        throw std::runtime_error { fmt::format("Socket buffers need a grow factor above 1, got {}", settings.grow_factor) };
+    }
+
+    return settings;
+}
+
+SocketBufferMonitor::SocketBufferMonitor(const SocketBufferSettings& settings)
+    : AsyncComponent {}
+    , Logging {}
+    , settings_ { settings }
+    , mutex_ {}
+    , sockets_ {}
+{
+    setUnitName("SocketBufferMonitor");
+}
+
+void SocketBufferMonitor::setSockets(const std::vector<MonitoredSocket>& sockets)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    sockets_.clear();
+    for (const MonitoredSocket& socket : sockets) {
+        struct stat socket_stat {};
+        if (::fstat(socket.fd, &socket_stat) != 0) {
+            log(WARNING, "Cannot monitor socket of port {}: {}", socket.stats->port(), std::strerror(errno));
+            continue;
+        }
+        sockets_.push_back(Monitored { socket.fd, socket_stat.st_ino, socket.stats, false });
+    }
+}
+
+void SocketBufferMonitor::run()
+{
+    log(INFO, "Sampling receive queues every {} s{}", settings_.sample_interval_s,
+        settings_.adaptive ? fmt::format(", growing buffers fuller than {} up to {} bytes", settings_.grow_threshold, settings_.max_size) : "");
+
+    const std::chrono::microseconds interval { static_cast<std::int64_t>(1e6 * settings_.sample_interval_s) };
+    while (running_) {
+        sample();
+        std::this_thread::sleep_for(interval);
+    }
+
+    log(INFO, "Socket buffer monitor finished");
+}
+
+/// Bytes in the receive queues of all UDP sockets by inode, as listed in /proc/net/udp
+static void readReceiveQueues(std::unordered_map<ino_t, std::uint64_t>& rx_queues)
+{
+    rx_queues.clear();
+
+    std::ifstream file { "/proc/net/udp" };
+    std::string line {};
+    std::getline(file, line); // header
+
+    while (std::getline(file, line)) {
+        // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode ...
+        unsigned long rx_queue { 0 };
+        unsigned long inode { 0 };
+        if (std::sscanf(line.c_str(), " %*u: %*x:%*x %*x:%*x %*x %*x:%lx %*x:%*x %*x %*u %*u %lu", &rx_queue, &inode) == 2) {
+            rx_queues[static_cast<ino_t>(inode)] = rx_queue;
+        }
+    }
+}
+
+/// Size of the receive buffer, which the kernel compares with the memory in the queue
+static std::uint64_t receiveBufferSize(int fd)
+{
+    int size { 0 };
+    socklen_t size_length { sizeof(size) };
+    if (::getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &size_length) != 0) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(size);
+}
+
+void SocketBufferMonitor::sample()
+{
+    std::unordered_map<ino_t, std::uint64_t> rx_queues {};
+    readReceiveQueues(rx_queues);
+
+    std::lock_guard<std::mutex> lock { mutex_ };
+    for (Monitored& socket : sockets_) {
+        const auto rx_queue_it { rx_queues.find(socket.inode) };
+        if (rx_queue_it == rx_queues.end()) {
+            continue;
+        }
+
+        const std::uint64_t rx_queue { rx_queue_it->second };
+        std::uint64_t rcvbuf { receiveBufferSize(socket.fd) };
+        if (settings_.adaptive && !socket.capped && rcvbuf > 0 && rx_queue > settings_.grow_threshold * rcvbuf) {
+            rcvbuf = grow(socket, rcvbuf);
+        }
+
+        socket.stats->sampleQueue(rx_queue, rcvbuf);
+    }
+}
+
+std::uint64_t SocketBufferMonitor::grow(Monitored& socket, std::uint64_t rcvbuf)
+{
+    const std::uint64_t target { std::min(settings_.max_size, static_cast<std::uint64_t>(settings_.grow_factor * rcvbuf)) };
+    if (target <= rcvbuf) {
+        socket.capped = true;
+        log(WARNING, "Receive buffer of port {} runs full at its limit of {} bytes", socket.stats->port(), rcvbuf);
+        return rcvbuf;
+    }
+
+    // The kernel doubles the requested size to account for its bookkeeping, and reports the doubled size.
+    const int requested { static_cast<int>(std::min<std::uint64_t>(target / 2, std::numeric_limits<int>::max())) };
+    if (::setsockopt(socket.fd, SOL_SOCKET, SO_RCVBUFFORCE, &requested, sizeof(requested)) != 0) {
+        // Without CAP_NET_ADMIN, the size is capped by net.core.rmem_max.
+        ::setsockopt(socket.fd, SOL_SOCKET, SO_RCVBUF, &requested, sizeof(requested));
+    }
+
+    const std::uint64_t grown { receiveBufferSize(socket.fd) };
+    if (grown <= rcvbuf) {
+        socket.capped = true;
+        log(WARNING, "Receive buffer of port {} runs full but cannot grow beyond {} bytes, raise net.core.rmem_max",
+            socket.stats->port(), rcvbuf);
+        return rcvbuf;
+    }
+
+    log(INFO, "Receive buffer of port {} grown from {} to {} bytes", socket.stats->port(), rcvbuf, grown);
+    return grown;
+}
@@ -0,0 +1,183 @@
+/**
+ * Program name: daqonite_sort_bench - Compares spill sorting strategies on synthetic data.
+ *
+ * Hits are generated the way hit receivers store them: every plane produces datagrams
+ * covering consecutive time windows, each datagram containing time-sorted hits from
+ * all channels of the plane. Disorder is introduced by delivering some datagrams late
+ * (as after a network hiccup), and flasher bursts can be added on top of dark noise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+#include "spill_sorter.h"
+
+namespace exit_code {
+static constexpr int success = 0;
+}
+
+struct BenchSettings {
+    std::size_t n_planes;
+    std::size_t n_channels;
+    double spill_duration_s;
+    double window_duration_s;
+    double channel_rate_hz;
+    double late_fraction;
+    double flasher_rate_hz;
+    std::size_t flasher_hits;
+    std::size_t n_threads;
+    std::size_t n_repeats;
+    unsigned seed;
+};
+
+static void generateSpill(const BenchSettings& settings, PMTMultiPlaneHitQueue& spill)
+{
+    std::mt19937_64 rng { settings.seed };
+    std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
+    std::uniform_int_distribution<std::uint32_t> channel_dist { 0, static_cast<std::uint32_t>(settings.n_channels - 1) };
+    std::uniform_int_distribution<std::uint16_t> tot_dist { 0, 255 };
+
+    const std::uint64_t base_secs { 1600000000 };
+    const auto window_ns { static_cast<std::uint64_t>(1e9 * settings.window_duration_s) };
+    const auto n_windows { static_cast<std::size_t>(settings.spill_duration_s / settings.window_duration_s) };
+    std::poisson_distribution<std::size_t> dark_hits { settings.channel_rate_hz * settings.n_channels * settings.window_duration_s };
+    std::poisson_distribution<std::size_t> flashes { settings.flasher_rate_hz * settings.window_duration_s };
+
+    spill.clear();
+    for (std::size_t plane = 0; plane < settings.n_planes; ++plane) {
+        PMTHitQueue& queue { spill.get_queue_for_writing(static_cast<std::uint32_t>(plane)) };
+
+        std::vector<PMTHitQueue> datagrams(n_windows);
+        for (std::size_t window = 0; window < n_windows; ++window) {
+            PMTHitQueue& datagram { datagrams[window] };
+            std::vector<std::uint64_t> offsets {};
+
+            std::size_t n_hits { dark_hits(rng) };
+            for (std::size_t i = 0; i < n_hits; ++i) {
+                offsets.push_back(static_cast<std::uint64_t>(uniform(rng) * window_ns));
+            }
+
+            // Flasher bursts fire many channels within a few nanoseconds.
+            for (std::size_t flash = flashes(rng); flash > 0; --flash) {
+                const auto flash_ns { static_cast<std::uint64_t>(uniform(rng) * window_ns) };
+                for (std::size_t i = 0; i < settings.flasher_hits; ++i) {
+                    offsets.push_back(std::min(window_ns - 1, flash_ns + static_cast<std::uint64_t>(10 * uniform(rng))));
+                }
+            }
+
+            // Hits within datagrams are ordered.
+            std::sort(offsets.begin(), offsets.end());
+            for (const std::uint64_t offset : offsets) {
+                const std::uint64_t ns { window * window_ns + offset };
+
+                PMTHit hit {};
+                hit.plane_number = static_cast<std::uint32_t>(plane);
+                hit.channel_number = static_cast<std::uint8_t>(channel_dist(rng));
+                hit.timestamp = tai_timestamp { base_secs, static_cast<std::uint32_t>(ns % 1000000000) };
+                hit.timestamp.secs += ns / 1000000000;
+                hit.tot = tot_dist(rng);
+                hit.sort_key = hit.timestamp.combined_secs();
+                datagram.push_back(hit);
+            }
+        }
+
+        // Deliver some datagrams late, i.e. after a random number of subsequent datagrams.
+        std::vector<std::size_t> order(n_windows);
+        for (std::size_t window = 0; window < n_windows; ++window) {
+            order[window] = window;
+        }
+
+        for (std::size_t window = 0; window + 1 < n_windows; ++window) {
+            if (uniform(rng) < settings.late_fraction) {
+                std::uniform_int_distribution<std::size_t> delay { 1, std::min<std::size_t>(50, n_windows - window - 1) };
+                std::swap(order[window], order[window + delay(rng)]);
+            }
+        }
+
+        for (const std::size_t window : order) {
+            queue.insert(queue.end(), datagrams[window].begin(), datagrams[window].end());
+        }
+    }
+}
+
+static bool isSorted(const PMTHitQueue& queue)
+{
+    for (std::size_t i = 1; i < queue.size(); ++i) {
+        if (queue[i - 1] > queue[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void benchmark(const BenchSettings& settings, const PMTMultiPlaneHitQueue& spill, SortStrategy strategy)
+{
+    SpillSorter sorter { 0, settings.n_threads };
+    PMTHitQueue output {};
+    SpillSortStats stats {};
+
+    double best_ms { std::numeric_limits<double>::max() };
+    double total_ms { 0 };
+    for (std::size_t repeat = 0; repeat < settings.n_repeats; ++repeat) {
+        // Sorting modifies input, hence every repetition needs a fresh copy.
+        PMTMultiPlaneHitQueue input { spill };
+
+        const auto start { std::chrono::steady_clock::now() };
+        stats = sorter.sort(input, output, strategy);
+        const std::chrono::duration<double, std::milli> elapsed { std::chrono::steady_clock::now() - start };
+
+        best_ms = std::min(best_ms, elapsed.count());
+        total_ms += elapsed.count();
+    }
+
+    fmt::print("{:<26} hits: {:>10}  disorder: {:>9.3f}  best: {:>9.2f} ms  mean: {:>9.2f} ms  rate: {:>7.2f} Mhit/s  sorted: {}\n",
+        SpillSorter::formatStrategy(strategy), stats.n_hits, stats.disorder, best_ms, total_ms / settings.n_repeats,
+        1e-3 * stats.n_hits / best_ms, isSorted(output) ? "yes" : "NO");
+}
+
+int main(int argc, char* argv[])
+{
+    namespace opts = boost::program_options;
+
+    BenchSettings settings {};
+
+    opts::options_description desc { "Options" };
+    desc.add_options()("help,h", "daqonite_sort_bench - compare spill sorting strategies")
+        ("planes", opts::value<std::size_t>(&settings.n_planes)->default_value(16), "Number of planes")
+        ("channels", opts::value<std::size_t>(&settings.n_channels)->default_value(30), "Number of channels per plane")
+        ("duration", opts::value<double>(&settings.spill_duration_s)->default_value(1.0), "Spill duration [s]")
+        ("window", opts::value<double>(&settings.window_duration_s)->default_value(0.01), "Datagram window duration [s]")
+        ("rate", opts::value<double>(&settings.channel_rate_hz)->default_value(5000), "Dark rate per channel [Hz]")
+        ("late", opts::value<double>(&settings.late_fraction)->default_value(0.0), "Fraction of datagrams delivered late")
+        ("flasher-rate", opts::value<double>(&settings.flasher_rate_hz)->default_value(0), "Flasher bursts per plane [Hz]")
+        ("flasher-hits", opts::value<std::size_t>(&settings.flasher_hits)->default_value(500), "Hits per flasher burst")
+        ("threads", opts::value<std::size_t>(&settings.n_threads)->default_value(4), "Radix sort threads")
+        ("repeat", opts::value<std::size_t>(&settings.n_repeats)->default_value(5), "Number of repetitions")
+        ("seed", opts::value<unsigned>(&settings.seed)->default_value(42), "Random seed");
+
+    opts::variables_map vm {};
+    opts::store(opts::command_line_parser(argc, argv).options(desc).run(), vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return exit_code::success;
+    }
+
+    opts::notify(vm);
+
+    PMTMultiPlaneHitQueue spill {};
+    generateSpill(settings, spill);
+
+    benchmark(settings, spill, SortStrategy::InsertMerge);
+    benchmark(settings, spill, SortStrategy::Radix);
+
+    return exit_code::success;
+}
@@ -0,0 +1,127 @@
+#include "spill_handoff.h"
+
+SpillHandoff::SpillHandoff(std::size_t capacity)
+    : capacity_ { capacity > 0 ? capacity : 1 }
+    , mutex_ {}
+    , cv_free_ {}
+    , cv_full_ {}
+    , free_ {}
+    , full_ {}
+    , closed_ { false }
+    , aborted_ { false }
+    , producer_stall_ {}
+    , consumer_stall_ {}
+{
+    for (std::size_t i = 0; i < capacity_; ++i) {
+        free_.emplace_back(new SortedSpill {});
+    }
+}
+
+SpillHandoff::~SpillHandoff()
+{
+    // Spills are owned by their buffers until written.
+    for (std::unique_ptr<SortedSpill>& buffer : full_) {
+        delete buffer->spill;
+    }
+}
+
+std::unique_ptr<SortedSpill> SpillHandoff::acquire()
+{
+    std::unique_lock<std::mutex> lock { mutex_ };
+
+    const auto start { std::chrono::steady_clock::now() };
+    cv_free_.wait(lock, [this] { return !free_.empty() || aborted_; });
+    producer_stall_ += std::chrono::steady_clock::now() - start;
+
+    if (aborted_) {
+        return nullptr;
+    }
+
+    std::unique_ptr<SortedSpill> buffer { std::move(free_.back()) };
+    free_.pop_back();
+    return buffer;
+}
+
+void SpillHandoff::push(std::unique_ptr<SortedSpill> buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        full_.push_back(std::move(buffer));
+    }
+
+    cv_full_.notify_one();
+}
+
+bool SpillHandoff::pop(std::unique_ptr<SortedSpill>& buffer, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock { mutex_ };
+
+    const auto start { std::chrono::steady_clock::now() };
+    cv_full_.wait_for(lock, timeout, [this] { return !full_.empty() || closed_; });
+    consumer_stall_ += std::chrono::steady_clock::now() - start;
+
+    if (full_.empty()) {
+        return false;
+    }
+
+    buffer = std::move(full_.front());
+    full_.pop_front();
+    return true;
+}
+
+void SpillHandoff::release(std::unique_ptr<SortedSpill> buffer)
+{
+    buffer->spill = nullptr;
+    buffer->hits.clear();
+    buffer->events.clear();
+    buffer->channel_summaries.clear();
+    buffer->summary = SpillSummaryRecord {};
+    buffer->arrival_to_decode.clear();
+    buffer->decode_to_slot.clear();
+    buffer->last_arrival_ns = 0;
+
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        free_.push_back(std::move(buffer));
+    }
+
+    cv_free_.notify_one();
+}
+
+void SpillHandoff::close()
+{
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        closed_ = true;
+    }
+
+    cv_full_.notify_all();
+}
+
+void SpillHandoff::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        aborted_ = true;
+    }
+
+    cv_free_.notify_all();
+}
+
+bool SpillHandoff::drained() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    return closed_ && full_.empty();
+}
+
+SpillHandoffStats SpillHandoff::stats() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    SpillHandoffStats stats {};
+    stats.capacity = capacity_;
+    stats.occupancy = full_.size();
+    stats.producer_stall_ms = std::chrono::duration<double, std::milli> { producer_stall_ }.count();
+    stats.consumer_stall_ms = std::chrono::duration<double, std::milli> { consumer_stall_ }.count();
+    return stats;
+}
@@ -85,6 +85,7 @@ void SpillSchedule::closeSpill(SpillPtr spill)
     }
 
     // At this point, no thread should be writing data to any of the queues.
+    spill->closed_time_ns = realtimeNanosecs();
 
     if (!spill->started) {
         log(DEBUG, "Spill {} not started at the time of closing.", spill->spill_number);
@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "spill_sorter.h"
+
+SpillSorter::SpillSorter(double radix_disorder_threshold, std::size_t n_radix_threads, double gap_threshold_s)
+    : radix_disorder_threshold_ { radix_disorder_threshold }
+    , gap_threshold_s_ { gap_threshold_s }
+    , merge_sorter_ {}
+    , radix_sorter_ { n_radix_threads }
+    , running_max_ {}
+{
+}
+
+SpillSortStats SpillSorter::sort(PMTMultiPlaneHitQueue& input, PMTHitQueue& output)
+{
+    SpillSortStats stats { measure(input) };
+    stats.strategy = stats.disorder > radix_disorder_threshold_ ? SortStrategy::Radix : SortStrategy::InsertMerge;
+
+    apply(input, output, stats);
+    return stats;
+}
+
+SpillSortStats SpillSorter::sort(PMTMultiPlaneHitQueue& input, PMTHitQueue& output, SortStrategy strategy)
+{
+    SpillSortStats stats { measure(input) };
+    stats.strategy = strategy;
+
+    apply(input, output, stats);
+    return stats;
+}
+
+void SpillSorter::apply(PMTMultiPlaneHitQueue& input, PMTHitQueue& output, SpillSortStats& stats)
+{
+    output.clear();
+
+    if (stats.n_hits == 0) {
+        return;
+    }
+
+    switch (stats.strategy) {
+    case SortStrategy::InsertMerge:
+        // Make sure every plane is sorted, then merge-sort planes together.
+        for (auto& key_value : input) {
+            stats.n_swaps += insertSort(key_value.second);
+        }
+
+        merge_sorter_.merge(input, output);
+        break;
+
+    case SortStrategy::Radix:
+        radix_sorter_.sort(input, output);
+        stats.n_radix_passes = radix_sorter_.lastPassCount();
+        break;
+    }
+}
+
+SpillSortStats SpillSorter::measure(const PMTMultiPlaneHitQueue& input) const
+{
+    SpillSortStats stats {};
+    stats.n_planes = input.size();
+
+    stats.planes.reserve(input.size());
+
+    for (const auto& key_value : input) {
+        PlaneSortStats plane {};
+        plane.plane_number = key_value.first;
+        plane.n_hits = key_value.second.size();
+        plane.n_displaced = estimateDisplacement(key_value.second, stats.displacement, plane.n_gaps);
+
+        stats.n_hits += plane.n_hits;
+        stats.n_displaced += plane.n_displaced;
+        stats.n_gaps += plane.n_gaps;
+        stats.planes.push_back(plane);
+    }
+
+    std::sort(stats.planes.begin(), stats.planes.end(), [](const PlaneSortStats& a, const PlaneSortStats& b) {
+        return a.plane_number < b.plane_number;
+    });
+
+    if (stats.n_hits > 0) {
+        stats.disorder = static_cast<double>(stats.displacement) / stats.n_hits;
+    }
+
+    return stats;
+}
+
+std::size_t SpillSorter::estimateDisplacement(const PMTHitQueue& queue, std::size_t& displacement, std::size_t& n_gaps) const
+{
+    // Insert-sort moves every hit past all preceding hits which are later than it. Those all
+    // come after the first position at which the running maximum exceeds the hit, which we can
+    // find by binary search since the running maximum never decreases. The distance to that
+    // position is an upper bound on the number of swaps needed for the hit.
+    running_max_.resize(queue.size());
+
+    std::size_t n_displaced { 0 };
+    long double running_max { 0 };
+    for (std::size_t i = 0; i < queue.size(); ++i) {
+        const long double key { queue[i].sort_key };
+
+        if (i > 0 && key < running_max) {
+            const auto first_later { std::upper_bound(running_max_.cbegin(), running_max_.cbegin() + i, key) };
+            displacement += static_cast<std::size_t>(running_max_.cbegin() + i - first_later);
+            ++n_displaced;
+        } else {
+            // Hits out of order never open a gap, they fall inside an interval already covered.
+            if (i > 0 && gap_threshold_s_ > 0 && key - running_max > gap_threshold_s_) {
+                ++n_gaps;
+            }
+            running_max = key;
+        }
+
+        running_max_[i] = running_max;
+    }
+
+    return n_displaced;
+}
+
+std::size_t SpillSorter::insertSort(PMTHitQueue& queue) noexcept
+{
+    // Just your conventional O(n^2) insert-sort implementation.
+    // Here utilized because insert-sort is actually O(n+k*n) for k-sorted sequences.
+    // Since event queue should already be sorted, insert-sort will frequently only scan it in O(n).
+
+    std::size_t n_swaps { 0 };
+    for (std::size_t i = 1; i < queue.size(); ++i) {
+        for (std::size_t j = i; j > 0 && queue[j - 1] > queue[j]; --j) {
+            std::swap(queue[j], queue[j - 1]);
+            ++n_swaps;
+        }
+    }
+
+    return n_swaps;
+}
+
+const char* SpillSorter::formatStrategy(SortStrategy strategy)
+{
+    switch (strategy) {
+    case SortStrategy::InsertMerge:
+        return "insert-sort + merge-sort";
+    case SortStrategy::Radix:
+        return "radix sort";
+    default:
+        return "unknown";
+    }
+}
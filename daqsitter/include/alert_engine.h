@@ -0,0 +1,96 @@
+/**
+ * AlertEngine - Checks the monitoring stream against alert rules as packets arrive
+ *
+ * Every packet is checked per channel (rate too low or too high, veto held on) and per POM
+ * (sync lost, temperature or humidity too high). Rules have hysteresis twice over: a value
+ * must go beyond the "raise" threshold to raise an alert and back beyond the "clear" one
+ * to clear it, and either must hold for a while before the alert changes state. Changes
+ * are logged and published once, and state per channel is a few bytes updated in place, so
+ * nothing is queried from elasticsearch.
+ *
+ * Not thread-safe, packets are expected to be checked by a single socket handler at a time.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include <util/elastic_interface.h>
+#include <util/logging.h>
+
+#include "alert_publisher.h"
+
+struct AlertThreshold {
+    bool enabled; ///< Is the rule checked at all?
+    double raise; ///< The alert is raised once values reach this one
+    double clear; ///< The alert is cleared once values are back to this one
+};
+
+struct AlertEngineSettings {
+    std::int64_t raise_after_ms { 0 }; ///< How long a rule must be broken before its alert is raised
+    std::int64_t clear_after_ms { 0 }; ///< How long a rule must be kept before its alert is cleared
+    AlertThreshold rate_low {}; ///< Channel rates (Hz)
+    AlertThreshold rate_high {};
+    AlertThreshold temperature_high {}; ///< POM temperature (Celsius)
+    AlertThreshold humidity_high {}; ///< POM humidity (%RH)
+    bool veto { false }; ///< Alert on vetoes held on
+    bool sync { false }; ///< Alert on loss of timing
+
+    /// Read settings from the "alerts" section of the configuration.
+    static AlertEngineSettings fromConfig();
+};
+
+class AlertEngine : protected Logging {
+public:
+    /// Environmental rules are only checked if the source has sensors (CLBs but not BBBs).
+    AlertEngine(const AlertEngineSettings& settings, bool environment, std::shared_ptr<AlertPublisher> publisher);
+
+    /// Check a decoded packet.
+    void check(const pom_data& pom, const channel_data& channels);
+
+    /// Check a packet which is not decoded, as it has no valid timestamp.
+    void checkUnsynced(int pom);
+
+private:
+    struct Condition {
+        bool active; ///< Is the alert raised?
+        bool pending; ///< Has the alert been about to change state since since_ms?
+        std::int64_t since_ms;
+    };
+
+    struct ChannelState {
+        Condition rate_low;
+        Condition rate_high;
+        Condition veto;
+    };
+
+    struct PomState {
+        Condition sync;
+        Condition temperature_high;
+        Condition humidity_high;
+        std::array<ChannelState, 30> channels;
+    };
+
+    AlertEngineSettings settings_;
+    bool environment_;
+    std::shared_ptr<AlertPublisher> publisher_;
+    std::unordered_map<int, PomState> poms_;
+
+    /**
+     * Advance a condition by one observation, given whether it is beyond the raise and the
+     * clear threshold. Returns true if the alert changed state.
+     */
+    bool update(Condition& condition, bool beyond_raise, bool beyond_clear, std::int64_t now_ms) const;
+
+    /// Check a value against a threshold, which is broken upwards if high is set.
+    void checkThreshold(Condition& condition, const AlertThreshold& threshold, bool high, double value,
+        AlertKind kind, int pom, int channel, std::int64_t now_ms);
+
+    void checkSync(PomState& state, int pom, bool sync, std::int64_t now_ms);
+
+    /// Log and publish a change of state.
+    void changed(AlertKind kind, int pom, int channel, bool raised, double value);
+};
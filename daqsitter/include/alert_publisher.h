@@ -0,0 +1,47 @@
+/**
+ * AlertPublisher - Publishes alerts raised and cleared by daqsitter's alert engines
+ *
+ * One message is sent whenever an alert changes state, never once per packet. Subscribers
+ * can therefore follow the current state of every alert from the messages alone.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <util/publisher.h>
+
+enum class AlertKind : std::uint32_t {
+    RateLow = 0, ///< Channel rate too low, e.g. dead PMT
+    RateHigh = 1, ///< Channel rate too high, e.g. hot PMT
+    Veto = 2, ///< High-rate veto of a channel held on
+    SyncLost = 3, ///< POM lost White Rabbit timing, its timestamps are invalid
+    TemperatureHigh = 4,
+    HumidityHigh = 5
+};
+
+/// Readable name of an alert, for logs
+const char* alertName(AlertKind kind);
+
+struct AlertMessage {
+    const char Zero = '\0'; ///< The first bit must be '\0' otherwise NNG pub/sub discards the message.
+    std::int64_t timestamp; ///< When the alert changed state (ms since epoch, clock of daqsitter)
+    std::uint32_t pom; ///< POM, or plane number of BBB alerts
+    std::int32_t channel; ///< -1 for alerts of a whole POM
+    AlertKind kind;
+    std::uint8_t raised; ///< 1 if the alert was raised, 0 if it was cleared
+    double value; ///< Last value observed before the change
+};
+
+class AlertPublisher : public Publisher<AlertMessage> {
+protected:
+    void connected() override;
+    void disconnected(const nng::exception& e) override;
+
+public:
+    explicit AlertPublisher(const std::string& bus_url);
+    virtual ~AlertPublisher() = default;
+
+    /// Queue a change of state of an alert for publishing.
+    void publishAlert(AlertKind kind, int pom, int channel, bool raised, double value);
+};
@@ -0,0 +1,91 @@
+/**
+ * MonitoringAggregator - Downsamples CLB monitoring packets before they are sent to elasticsearch
+ *
+ * Every packet is accumulated per POM and channel into one or more tiers of fixed-length
+ * windows (e.g. 1 s and 1 min). Windows are aligned to packet timestamps. Once a packet
+ * past the end of the current window arrives, the window is closed and a single document
+ * per POM (into "monpom_<tier>") and per channel (into "monchannel_<tier>") is sent. These
+ * hold the minimum, maximum, mean and last rate and the fraction of vetoed packets. Unlike
+ * random sampling, every packet counts towards the aggregates. Mean rates of tiers kept in
+ * the time series store are appended to it as well, whether elasticsearch is used or not.
+ *
+ * Not thread-safe, packets are expected to be added by a single socket handler at a time.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <util/elastic_interface.h>
+#include <util/logging.h>
+
+#include "time_series_store.h"
+
+struct MonitoringWindow {
+    std::string name; ///< Suffix of the indices documents are sent to
+    std::uint64_t length_ms; ///< Length of every window
+};
+
+struct MonitoringAggregatorSettings {
+    std::vector<MonitoringWindow> windows {}; ///< Tiers of windows, each aggregated separately
+
+    /// Read settings from the "aggregation_windows" section of the configuration.
+    static MonitoringAggregatorSettings fromConfig();
+};
+
+class MonitoringAggregator : protected Logging {
+public:
+    /// Aggregates are sent to elasticsearch if save_elastic is set, and to the store if it is not null.
+    MonitoringAggregator(const MonitoringAggregatorSettings& settings, bool save_elastic, TimeSeriesStore* store);
+
+    /// Accumulate a packet, sending aggregates of windows it closes.
+    void add(const pom_data& pom, const channel_data& channels);
+
+    /// Send aggregates of all windows open so far, e.g. before exiting.
+    void flush();
+
+private:
+    struct ChannelAggregate {
+        float rate_min;
+        float rate_max;
+        double rate_sum;
+        float rate_last;
+        std::uint32_t n_veto;
+    };
+
+    struct PomAggregate {
+        std::uint32_t n_packets;
+        std::uint32_t n_sync;
+        double temperature_sum;
+        double humidity_sum;
+        short temperature_last;
+        short humidity_last;
+        int n_channels;
+        std::array<ChannelAggregate, 30> channels;
+    };
+
+    struct Tier {
+        MonitoringWindow window;
+        std::string pom_index;
+        std::string channel_index;
+        std::uint64_t start_ms; ///< Start of the window being accumulated
+        std::map<int, PomAggregate> poms;
+        TimeSeriesTier* time_series; ///< Where mean rates are stored, if the window is stored
+    };
+
+    bool save_elastic_;
+    std::vector<Tier> tiers_;
+
+    /// Send documents of all POMs in the window, store their rates and clear it.
+    void emit(Tier& tier);
+
+    /// Append mean rates of all POMs in the window to the time series store.
+    void store(const Tier& tier);
+
+    /// Send documents of all POMs in the window to elasticsearch.
+    void send(const Tier& tier);
+};
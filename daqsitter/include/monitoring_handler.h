@@ -1,29 +1,50 @@
 /**
  * MonitoringHandler - Reads monitoring packets and forwards them to elasticsearch or file
  *
+ * CLB and BBB monitoring packets are received by pools of threads, each with its own socket
+ * bound to the port (SO_REUSEPORT), so that the kernel spreads POMs and planes across them.
+ * Each thread receives batches of datagrams with recvmmsg() into its own buffers, decodes
+ * them into the common pom_data/channel_data records, and aggregates them without sharing
+ * any state. Packets sampled for the ROOT file are passed through a lock-free queue to a
+ * single thread, which owns the trees. Aggregates are sent to elasticsearch and appended to
+ * the time series store, and every packet is checked against alert rules.
+ *
  * Author: Josh Tingey
  * Contact: j.tingey.16@ucl.ac.uk
  */
 
 #pragma once
 
+#include <atomic>
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <set>
 #include <string>
+#include <vector>
+
+#include <sys/socket.h>
 
-#include <boost/asio.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <boost/thread.hpp>
 
 #include <TFile.h>
 #include <TTree.h>
 
+#include <bbb/packets.h>
 #include <clb/data_structs.h>
 #include <clb/header_structs.h>
 #include <util/command_receiver.h>
 #include <util/elastic_interface.h>
 #include <util/logging.h>
 
+#include "alert_engine.h"
+#include "alert_publisher.h"
+#include "monitoring_aggregator.h"
+#include "time_series_store.h"
+
 #define BUFFERSIZE 10000
 
 #define CLBMONPORT 56017
@@ -35,7 +56,8 @@ class MonitoringHandler : public CommandHandler, protected Logging {
 public:
     /// Create a MonitoringHandler
     MonitoringHandler(std::string config_file, bool save_elastic,
-                     bool save_file, float sample_frac);
+                     bool save_file, float sample_frac,
+                     std::shared_ptr<TimeSeriesStore> time_series);
 
     /// Destroy a MonitoringHandler
     virtual ~MonitoringHandler() = default;
@@ -75,43 +97,82 @@ private:
 		 */
     void setupTree();
 
-    // Work/Handle the CLB monitoring socket
-    void workCLBSocket();
-    void handleCLBSocket(boost::system::error_code const &error, std::size_t size);
-
-    // Work/Handle the BBB monitoring socket
-    void workBBBSocket();
-    void handleBBBSocket(boost::system::error_code const &error, std::size_t size);
-
-    /// run() io_service in a new thread
-    void runThread();
+    /// Origin of monitoring packets
+    enum class Source {
+        CLB,
+        BBB
+    };
+
+    /// Everything a receiving thread works with, owned by that thread alone
+    struct Receiver {
+        Source source;
+        int socket; ///< Socket bound to the monitoring port, shared with other receivers
+        std::vector<char> buffers; ///< Receive buffers for a batch of datagrams
+        std::vector<iovec> iovecs;
+        std::vector<mmsghdr> messages;
+        std::minstd_rand random; ///< Chooses packets saved to ROOT file
+        std::unique_ptr<MonitoringAggregator> aggregator;
+        std::unique_ptr<AlertEngine> alerts;
+    };
+
+    /// Packet sampled for the ROOT file
+    struct FileEntry {
+        Source source;
+        pom_data pom;
+        channel_data channels;
+    };
+
+    /// Open a socket for packets from the source and allocate buffers of a receiver.
+    std::unique_ptr<Receiver> createReceiver(Source source, int index);
+
+    /// Body of the receiving threads.
+    void receive(Receiver* receiver);
+
+    /// Decode a single CLB monitoring packet.
+    void handleCLBPacket(Receiver& receiver, const char* packet, std::size_t size);
+
+    /// Decode a single BBB monitoring packet.
+    void handleBBBPacket(Receiver& receiver, const char* packet, std::size_t size);
+
+    /// Check a decoded packet for alerts, and save it to ROOT file, elasticsearch and the time series store.
+    void forward(Receiver& receiver, const pom_data& pom, const channel_data& channels);
+
+    /// Body of the thread writing the ROOT file.
+    void writeFile();
 
     // settings
     bool save_elastic_; ///< Save data to elasticsearch
     bool save_file_;    ///< Save data to ROOT file
-    float sample_frac_; ///< Fraction of monitoring data to keep
-    int n_threads_;     ///< Number of threads to use for monitoring
+    float sample_frac_; ///< Fraction of monitoring data to save to ROOT file
+    int n_threads_;     ///< Number of threads receiving packets on each port
+    std::size_t batch_size_; ///< Maximum number of datagrams received at once
+    std::shared_ptr<TimeSeriesStore> time_series_; ///< Local store of aggregated rates
+    bool aggregate_; ///< Aggregates are either sent to elasticsearch or stored
 
     // Running mode
     bool mode_; ///< false = Not Running, True = Running
     RunType run_type_;
 
-    // io_service
-    std::shared_ptr<boost::asio::io_service> io_service_; ///< BOOST io_service. The heart of everything
+    std::atomic_bool running_; ///< Cleared on exit to stop all threads
+
     boost::thread_group thread_group_;   ///< Group of threads to read packets
 
     // ROOT file
     TFile *file_;     ///< Output ROOT file for saving monitoring data
     TTree *clb_tree_; ///< ROOT TTree to store CLB monitoring data
-
-    // CLB Socket
-    boost::asio::ip::udp::socket clb_socket_;                 ///< Socket to send CLB monitoring data to
-    char clb_buffer_[BUFFERSIZE] __attribute__((aligned(8))); ///< CLB monitoring socket buffer
-
-    pom_data pom_data_;
+    TTree *bbb_tree_; ///< ROOT TTree to store BBB monitoring data
+
+    // Receiving
+    std::vector<std::unique_ptr<Receiver>> receivers_;
+    std::atomic<int> n_active_receivers_; ///< Receivers still running, the file is written until all stop
+    MonitoringAggregatorSettings aggregator_settings_; ///< Settings of the aggregator of every receiver
+    std::set<int> raw_poms_; ///< POMs whose packets are also sent to elasticsearch as they are
+    AlertEngineSettings alert_settings_; ///< Settings of the alert engine of every receiver
+    std::shared_ptr<AlertPublisher> alert_publisher_; ///< Publishes alerts of all receivers
+
+    // ROOT file writing
+    boost::lockfree::queue<FileEntry> file_queue_; ///< Packets waiting to be written to ROOT file
+    std::atomic<std::uint64_t> n_file_dropped_; ///< Packets not written as the queue was full
+    pom_data pom_data_; ///< Branch buffers of the trees, used by the writing thread only
     channel_data channel_data_;
-
-    // BBB Socket
-    boost::asio::ip::udp::socket bbb_socket_;                 ///< Socket to send BBB monitoring data to
-    char bbb_buffer_[BUFFERSIZE] __attribute__((aligned(8))); ///< BBB monitoring socket buffer
 };
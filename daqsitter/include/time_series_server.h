@@ -0,0 +1,57 @@
+/**
+ * TimeSeriesServer - Answers queries of the embedded time series store over nng (REQ/REP)
+ *
+ * A request is a single TimeSeriesQueryMessage. The reply is a TimeSeriesReplyHeader
+ * followed by n_buckets TimeSeriesBucket records, all in the byte order of this machine.
+ * Queries are answered from local files only, so they keep working while elasticsearch
+ * or the network beyond this machine is down.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <util/async_component.h>
+#include <util/logging.h>
+
+#include "time_series_store.h"
+
+struct TimeSeriesQueryMessage {
+    std::uint32_t pom;
+    std::uint32_t channel;
+    std::int64_t start_ms; ///< First timestamp included (ms since epoch)
+    std::int64_t end_ms; ///< First timestamp not included anymore
+    std::int64_t step_ms; ///< Length of buckets, 0 for stored points as they are
+};
+
+struct TimeSeriesReplyHeader {
+    enum Status : std::uint32_t {
+        Ok = 0,
+        BadRequest = 1, ///< Request of the wrong size or with an empty range
+        NotStored = 2 ///< No window is stored
+    };
+
+    std::uint32_t status;
+    std::uint32_t n_buckets;
+    std::uint64_t window_ms; ///< Window of the tier the buckets were computed from
+    std::uint32_t truncated; ///< Non-zero if buckets past n_buckets were left out
+    std::uint32_t reserved;
+};
+
+class TimeSeriesServer : public AsyncComponent, protected Logging {
+public:
+    TimeSeriesServer(std::shared_ptr<const TimeSeriesStore> store, const std::string& url);
+    virtual ~TimeSeriesServer() = default;
+
+protected:
+    virtual void run() override;
+
+private:
+    std::shared_ptr<const TimeSeriesStore> store_;
+    std::string url_;
+
+    /// Build the reply to a request.
+    void answer(const void* request, std::size_t size, std::string& reply) const;
+};
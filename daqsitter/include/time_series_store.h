@@ -0,0 +1,133 @@
+/**
+ * TimeSeriesStore - Embedded store of per-channel rates, kept on local disk
+ *
+ * Mean channel rates of every aggregation window (see MonitoringAggregator) are stored in
+ * a tier named after the window, so that they can be queried while elasticsearch is down
+ * or unreachable. Each tier is a file of fixed-size blocks, memory-mapped and used as a
+ * ring: once all blocks are used the oldest one is overwritten, so the size of the file
+ * sets the retention of the tier. A block holds points of a single (pom, channel) series,
+ * compressed the way Gorilla does: timestamps as deltas of deltas, values XOR-ed with the
+ * previous one. Points are only ever appended, and a block header is updated after the
+ * bits of a point are written, so the index of blocks can be rebuilt from the headers when
+ * the file is opened again.
+ *
+ * Tiers are thread-safe, every append and query locks the tier.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <util/logging.h>
+
+struct TimeSeriesPoint {
+    std::int64_t timestamp; ///< Start of the window (ms since epoch)
+    float value;
+};
+
+/// Points of a series downsampled to a fixed step
+struct TimeSeriesBucket {
+    std::int64_t timestamp; ///< Start of the bucket (ms since epoch), a multiple of the step
+    float mean;
+    float min;
+    float max;
+    std::uint32_t n_points;
+};
+
+struct TimeSeriesTierSettings {
+    std::string name; ///< Name of the aggregation window stored
+    std::uint64_t window_ms; ///< Length of the aggregation window
+    std::uint64_t size; ///< Size of the file (bytes), which bounds retention
+};
+
+struct TimeSeriesStoreSettings {
+    std::string directory {}; ///< Where files of the tiers are kept
+    std::vector<TimeSeriesTierSettings> tiers {};
+
+    /// Read settings from the "time_series" and "aggregation_windows" sections of the configuration.
+    static TimeSeriesStoreSettings fromConfig();
+};
+
+class TimeSeriesTier : protected Logging {
+public:
+    TimeSeriesTier(const std::string& path, const TimeSeriesTierSettings& settings);
+    ~TimeSeriesTier();
+
+    // for safety, no copy- or move-semantics
+    TimeSeriesTier(const TimeSeriesTier& other) = delete;
+    TimeSeriesTier& operator=(const TimeSeriesTier& other) = delete;
+
+    const std::string& name() const { return settings_.name; }
+    std::uint64_t windowMs() const { return settings_.window_ms; }
+
+    /// Append the value of every channel of a POM at a timestamp.
+    void append(std::uint32_t pom, std::int64_t timestamp, const float* values, int n_channels);
+
+    /// Collect points of a series in [start, end), in the order they were appended.
+    void query(std::uint32_t pom, std::uint32_t channel, std::int64_t start, std::int64_t end,
+        std::vector<TimeSeriesPoint>& points) const;
+
+private:
+    struct BlockHeader;
+
+    /// State needed to append to the open block of a series
+    struct Encoder {
+        std::uint32_t block;
+        std::int64_t timestamp; ///< Previous timestamp
+        std::int64_t delta; ///< Previous difference of timestamps
+        std::uint32_t value; ///< Bits of the previous value
+        int leading; ///< Leading zeros of the previous meaningful XOR bits, -1 before there are any
+        int trailing;
+    };
+
+    TimeSeriesTierSettings settings_;
+    int fd_;
+    char* data_; ///< Mapping of the whole file
+    std::uint32_t n_blocks_;
+    std::uint32_t next_block_; ///< Block overwritten next, the oldest one once the ring has wrapped
+    std::uint64_t sequence_; ///< Sequence number of the block allocated last
+
+    std::unordered_map<std::uint64_t, std::deque<std::uint32_t>> series_blocks_; ///< Blocks of every series, oldest first
+    std::unordered_map<std::uint64_t, Encoder> encoders_; ///< Series with an open block
+    mutable std::mutex mutex_;
+
+    BlockHeader* header(std::uint32_t block) const;
+    std::uint8_t* payload(std::uint32_t block) const;
+
+    /// Rebuild the index from the headers of blocks in use.
+    void recover();
+
+    /// Take over the oldest block for a series, and start encoding into it.
+    Encoder& allocate(std::uint64_t key, std::uint32_t pom, std::uint32_t channel);
+
+    void appendPoint(std::uint64_t key, std::uint32_t pom, std::uint32_t channel, std::int64_t timestamp, float value);
+    void decode(std::uint32_t block, std::int64_t start, std::int64_t end, std::vector<TimeSeriesPoint>& points) const;
+};
+
+class TimeSeriesStore {
+public:
+    explicit TimeSeriesStore(const TimeSeriesStoreSettings& settings);
+
+    /// Is no window stored at all?
+    bool empty() const { return tiers_.empty(); }
+
+    /// Tier storing the window of the given name, nullptr if it is not stored.
+    TimeSeriesTier* tier(const std::string& name) const;
+
+    /**
+     * Downsample a series in [start, end) to buckets of step ms, using the coarsest tier
+     * whose window is not longer than the step. A step of 0 returns the points of the
+     * finest tier as they are. Returns the window of the tier used, 0 if there is none.
+     */
+    std::uint64_t query(std::uint32_t pom, std::uint32_t channel, std::int64_t start, std::int64_t end,
+        std::int64_t step, std::vector<TimeSeriesBucket>& buckets) const;
+
+private:
+    std::vector<std::unique_ptr<TimeSeriesTier>> tiers_; ///< Ordered from the finest window
+};
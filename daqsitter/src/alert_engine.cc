@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <util/config.h>
+
+#include "alert_engine.h"
+
+/// Read a rule of the "alerts" section, which is disabled if it is left out.
+static AlertThreshold thresholdFromConfig(const std::string& name, bool high)
+{
+    const std::string path { "alerts." + name };
+    if (!g_config.exists(path.c_str())) {
+        return AlertThreshold { false, 0.0, 0.0 };
+    }
+
+    const AlertThreshold threshold { true, g_config.lookupDouble((path + ".raise").c_str()), g_config.lookupDouble((path + ".clear").c_str()) };
+    if (high ? threshold.clear > threshold.raise : threshold.clear < threshold.raise) {
+        throw std::runtime_error(fmt::format("Alert '{}' would be cleared at {} before it is raised at {}", name, threshold.clear, threshold.raise));
+    }
+
+    return threshold;
+}
+
+AlertEngineSettings AlertEngineSettings::fromConfig()
+{
+    AlertEngineSettings settings {};
+    settings.raise_after_ms = static_cast<std::int64_t>(1e3 * g_config.lookupDouble("alerts.raise_after"));
+    settings.clear_after_ms = static_cast<std::int64_t>(1e3 * g_config.lookupDouble("alerts.clear_after"));
+    settings.rate_low = thresholdFromConfig("rate_low", false);
+    settings.rate_high = thresholdFromConfig("rate_high", true);
+    settings.temperature_high = thresholdFromConfig("temperature_high", true);
+    settings.humidity_high = thresholdFromConfig("humidity_high", true);
+    settings.veto = g_config.lookupBool("alerts.veto");
+    settings.sync = g_config.lookupBool("alerts.sync");
+
+    return settings;
+}
+
+/// Time used for persistence of rules, packet timestamps cannot be trusted without sync
+static std::int64_t monotonicMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AlertEngine::AlertEngine(const AlertEngineSettings& settings, bool environment, std::shared_ptr<AlertPublisher> publisher)
+    : Logging {}
+    , settings_ { settings }
+    , environment_ { environment }
+    , publisher_ { std::move(publisher) }
+    , poms_ {}
+{
+    setUnitName("AlertEngine");
+}
+
+void AlertEngine::check(const pom_data& pom, const channel_data& channels)
+{
+    const std::int64_t now_ms { monotonicMs() };
+    PomState& state { poms_[pom.pom] };
+
+    checkSync(state, pom.pom, pom.sync, now_ms);
+
+    if (environment_) {
+        checkThreshold(state.temperature_high, settings_.temperature_high, true, pom.temperature,
+            AlertKind::TemperatureHigh, pom.pom, -1, now_ms);
+        checkThreshold(state.humidity_high, settings_.humidity_high, true, pom.humidity,
+            AlertKind::HumidityHigh, pom.pom, -1, now_ms);
+    }
+
+    const int n_channels { std::min(channels.n_channels, static_cast<int>(state.channels.size())) };
+    for (int i = 0; i < n_channels; ++i) {
+        ChannelState& channel { state.channels[i] };
+        const double rate { channels.rate[i] };
+
+        checkThreshold(channel.rate_low, settings_.rate_low, false, rate, AlertKind::RateLow, pom.pom, i, now_ms);
+        checkThreshold(channel.rate_high, settings_.rate_high, true, rate, AlertKind::RateHigh, pom.pom, i, now_ms);
+
+        if (settings_.veto) {
+            const bool veto { channels.veto[i] };
+            if (update(channel.veto, veto, !veto, now_ms)) {
+                changed(AlertKind::Veto, pom.pom, i, channel.veto.active, veto ? 1.0 : 0.0);
+            }
+        }
+    }
+}
+
+void AlertEngine::checkUnsynced(int pom)
+{
+    checkSync(poms_[pom], pom, false, monotonicMs());
+}
+
+void AlertEngine::checkSync(PomState& state, int pom, bool sync, std::int64_t now_ms)
+{
+    if (settings_.sync && update(state.sync, !sync, sync, now_ms)) {
+        changed(AlertKind::SyncLost, pom, -1, state.sync.active, sync ? 1.0 : 0.0);
+    }
+}
+
+bool AlertEngine::update(Condition& condition, bool beyond_raise, bool beyond_clear, std::int64_t now_ms) const
+{
+    // Observations between both thresholds restart the wait, as do ones going back.
+    const bool changing { condition.active ? beyond_clear : beyond_raise };
+    if (!changing) {
+        condition.pending = false;
+        return false;
+    }
+
+    if (!condition.pending) {
+        condition.pending = true;
+        condition.since_ms = now_ms;
+    }
+
+    if (now_ms - condition.since_ms < (condition.active ? settings_.clear_after_ms : settings_.raise_after_ms)) {
+        return false;
+    }
+
+    condition.active = !condition.active;
+    condition.pending = false;
+    return true;
+}
+
+void AlertEngine::checkThreshold(Condition& condition, const AlertThreshold& threshold, bool high, double value,
+    AlertKind kind, int pom, int channel, std::int64_t now_ms)
+{
+    if (!threshold.enabled) {
+        return;
+    }
+
+    const bool beyond_raise { high ? value >= threshold.raise : value <= threshold.raise };
+    const bool beyond_clear { high ? value <= threshold.clear : value >= threshold.clear };
+    if (update(condition, beyond_raise, beyond_clear, now_ms)) {
+        changed(kind, pom, channel, condition.active, value);
+    }
+}
+
+void AlertEngine::changed(AlertKind kind, int pom, int channel, bool raised, double value)
+{
+    if (channel < 0) {
+        log(raised ? WARNING : INFO, "POM {}: {} alert {} at {}", pom, alertName(kind), raised ? "raised" : "cleared", value);
+    } else {
+        log(raised ? WARNING : INFO, "POM {} channel {}: {} alert {} at {}", pom, channel, alertName(kind), raised ? "raised" : "cleared", value);
+    }
+
+    if (publisher_) {
+        publisher_->publishAlert(kind, pom, channel, raised, value);
+    }
+}
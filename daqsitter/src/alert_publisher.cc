@@ -0,0 +1,52 @@
+#include <chrono>
+
+#include "alert_publisher.h"
+
+const char* alertName(AlertKind kind)
+{
+    switch (kind) {
+    case AlertKind::RateLow:
+        return "rate low";
+    case AlertKind::RateHigh:
+        return "rate high";
+    case AlertKind::Veto:
+        return "veto held";
+    case AlertKind::SyncLost:
+        return "sync lost";
+    case AlertKind::TemperatureHigh:
+        return "temperature high";
+    case AlertKind::HumidityHigh:
+        return "humidity high";
+    }
+
+    return "unknown";
+}
+
+AlertPublisher::AlertPublisher(const std::string& bus_url)
+    : Publisher { bus_url }
+{
+    setUnitName("AlertPublisher");
+}
+
+void AlertPublisher::connected()
+{
+    log(INFO, "Publishing alerts to '{}'", bus_url());
+}
+
+void AlertPublisher::disconnected(const nng::exception& e)
+{
+    log(ERROR, "Alert bus caught error: {}: {}", e.who(), e.what());
+}
+
+void AlertPublisher::publishAlert(AlertKind kind, int pom, int channel, bool raised, double value)
+{
+    AlertMessage message {};
+    message.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    message.pom = static_cast<std::uint32_t>(pom);
+    message.channel = channel;
+    message.kind = kind;
+    message.raised = raised ? 1 : 0;
+    message.value = value;
+
+    publish(std::move(message));
+}
@@ -9,6 +9,8 @@
 
 #include "daqsitter_publisher.h"
 #include "monitoring_handler.h"
+#include "time_series_server.h"
+#include "time_series_store.h"
 #include "util/command_receiver.h"
 #include "util/signal_receiver.h"
 #include "util/singleton_process.h"
@@ -44,7 +46,7 @@ public:
 
         // Argument handling
         boost::program_options::options_description desc("Options");
-        desc.add_options()("help,h", "DAQsitter...")("elastic", "Save monitoring data to elasticsearch")("file", "Save monitoring data to ROOT file")("config,c", boost::program_options::value<std::string>(&config), "Configuration file (../data/config.opt)")("sample", boost::program_options::value<float>(&sample_frac), "Fraction of packets to use (0.01)");
+        desc.add_options()("help,h", "DAQsitter...")("elastic", "Save monitoring data to elasticsearch")("file", "Save monitoring data to ROOT file")("config,c", boost::program_options::value<std::string>(&config), "Configuration file (../data/config.opt)")("sample", boost::program_options::value<float>(&sample_frac), "Fraction of packets saved to ROOT file (0.001)");
 
         try {
             boost::program_options::variables_map vm;
@@ -74,7 +76,8 @@ public:
 
         {
             // Main entry point.
-            std::shared_ptr<MonitoringHandler> mon_handler { new MonitoringHandler(config, elastic, file, sample_frac) };
+            std::shared_ptr<TimeSeriesStore> time_series { new TimeSeriesStore(TimeSeriesStoreSettings::fromConfig()) };
+            std::shared_ptr<MonitoringHandler> mon_handler { new MonitoringHandler(config, elastic, file, sample_frac, time_series) };
             std::shared_ptr<DaqsitterPublisher> bus_publisher { new DaqsitterPublisher(mon_handler) };
 
             std::unique_ptr<SignalReceiver> signal_receiver { new SignalReceiver };
@@ -85,9 +88,14 @@ public:
             cmd_receiver->setHandler(mon_handler);
             cmd_receiver->runAsync();
 
+            std::unique_ptr<TimeSeriesServer> time_series_server { new TimeSeriesServer(time_series, g_config.lookupString("bus.daqsitter_time_series")) };
+            time_series_server->runAsync();
+
             bus_publisher->runAsync();
             mon_handler->run();
 
+            time_series_server->notifyJoin();
+            time_series_server->join();
             bus_publisher->join();
             cmd_receiver->join();
             signal_receiver->join();
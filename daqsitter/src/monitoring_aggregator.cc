@@ -0,0 +1,162 @@
+#include <algorithm>
+
+#include <util/config.h>
+#include <util/json_writer.h>
+
+#include "monitoring_aggregator.h"
+
+MonitoringAggregatorSettings MonitoringAggregatorSettings::fromConfig()
+{
+    MonitoringAggregatorSettings settings {};
+    for (const std::string& name : g_config.lookupNames("aggregation_windows")) {
+        const std::string path { "aggregation_windows." + name };
+        const double length_s { g_config.lookupDouble(path.c_str()) };
+        settings.windows.push_back(MonitoringWindow { name, static_cast<std::uint64_t>(1e3 * length_s) });
+    }
+
+    return settings;
+}
+
+MonitoringAggregator::MonitoringAggregator(const MonitoringAggregatorSettings& settings, bool save_elastic, TimeSeriesStore* store)
+    : Logging {}
+    , save_elastic_ { save_elastic }
+    , tiers_ {}
+{
+    setUnitName("MonitoringAggregator");
+
+    for (const MonitoringWindow& window : settings.windows) {
+        if (window.length_ms == 0) {
+            throw std::runtime_error(fmt::format("Aggregation window '{}' must be at least 1 ms long", window.name));
+        }
+
+        Tier tier {};
+        tier.window = window;
+        tier.pom_index = "monpom_" + window.name;
+        tier.channel_index = "monchannel_" + window.name;
+        tier.start_ms = 0;
+        tier.time_series = store ? store->tier(window.name) : nullptr;
+        tiers_.push_back(std::move(tier));
+
+        log(INFO, "Aggregating monitoring over {} ms windows into '{}' and '{}'",
+            window.length_ms, tiers_.back().pom_index, tiers_.back().channel_index);
+    }
+}
+
+void MonitoringAggregator::add(const pom_data& pom, const channel_data& channels)
+{
+    const std::uint64_t timestamp { static_cast<std::uint64_t>(pom.timestamp) };
+
+    for (Tier& tier : tiers_) {
+        // Late packets of a closed window are counted towards the current one.
+        if (timestamp >= tier.start_ms + tier.window.length_ms) {
+            emit(tier);
+            tier.start_ms = timestamp - timestamp % tier.window.length_ms;
+        }
+
+        auto it { tier.poms.find(pom.pom) };
+        if (it == tier.poms.end()) {
+            it = tier.poms.emplace(pom.pom, PomAggregate {}).first;
+        }
+
+        PomAggregate& aggregate { it->second };
+        const bool first { aggregate.n_packets++ == 0 };
+        aggregate.n_sync += pom.sync ? 1 : 0;
+        aggregate.temperature_sum += pom.temperature;
+        aggregate.humidity_sum += pom.humidity;
+        aggregate.temperature_last = pom.temperature;
+        aggregate.humidity_last = pom.humidity;
+        aggregate.n_channels = std::min(channels.n_channels, static_cast<int>(aggregate.channels.size()));
+
+        for (int i = 0; i < aggregate.n_channels; ++i) {
+            ChannelAggregate& channel { aggregate.channels[i] };
+            const float rate { channels.rate[i] };
+
+            channel.rate_min = first ? rate : std::min(channel.rate_min, rate);
+            channel.rate_max = first ? rate : std::max(channel.rate_max, rate);
+            channel.rate_sum += rate;
+            channel.rate_last = rate;
+            channel.n_veto += channels.veto[i] ? 1 : 0;
+        }
+    }
+}
+
+void MonitoringAggregator::flush()
+{
+    for (Tier& tier : tiers_) {
+        emit(tier);
+    }
+}
+
+void MonitoringAggregator::emit(Tier& tier)
+{
+    if (tier.time_series) {
+        store(tier);
+    }
+
+    if (save_elastic_) {
+        send(tier);
+    }
+
+    tier.poms.clear();
+}
+
+void MonitoringAggregator::store(const Tier& tier)
+{
+    std::array<float, 30> rates {};
+    for (const auto& pom_aggregate : tier.poms) {
+        const PomAggregate& aggregate { pom_aggregate.second };
+        for (int i = 0; i < aggregate.n_channels; ++i) {
+            rates[i] = static_cast<float>(aggregate.channels[i].rate_sum / aggregate.n_packets);
+        }
+
+        tier.time_series->append(static_cast<std::uint32_t>(pom_aggregate.first), static_cast<std::int64_t>(tier.start_ms),
+            rates.data(), aggregate.n_channels);
+    }
+}
+
+void MonitoringAggregator::send(const Tier& tier)
+{
+    const double window_s { tier.window.length_ms / 1e3 };
+
+    // A single writer is reused, its buffer does not need to grow again
+    JsonWriter document;
+    for (const auto& pom_aggregate : tier.poms) {
+        const PomAggregate& aggregate { pom_aggregate.second };
+        const double n_packets { static_cast<double>(aggregate.n_packets) };
+
+        document.clear();
+        document.beginObject();
+        document.field("timestamp", static_cast<std::int64_t>(tier.start_ms)); // start of the window
+        document.field("window", window_s);
+        document.field("pom", pom_aggregate.first);
+        document.field("n_packets", static_cast<std::int64_t>(aggregate.n_packets));
+        document.field("temperature", aggregate.temperature_sum / n_packets);
+        document.field("temperature_last", aggregate.temperature_last);
+        document.field("humidity", aggregate.humidity_sum / n_packets);
+        document.field("humidity_last", aggregate.humidity_last);
+        document.field("sync", aggregate.n_sync / n_packets); // fraction of packets time synced
+        document.endObject();
+        g_elastic.serialised(tier.pom_index, document);
+
+        for (int i = 0; i < aggregate.n_channels; ++i) {
+            const ChannelAggregate& channel { aggregate.channels[i] };
+
+            document.clear();
+            document.beginObject();
+            document.field("timestamp", static_cast<std::int64_t>(tier.start_ms));
+            document.field("window", window_s);
+            document.field("pom", pom_aggregate.first);
+            document.field("channel", i);
+            document.field("eid", 0);
+            document.beginObject("rate");
+            document.field("min", channel.rate_min);
+            document.field("max", channel.rate_max);
+            document.field("mean", channel.rate_sum / n_packets);
+            document.field("last", channel.rate_last);
+            document.field("veto", channel.n_veto / n_packets); // fraction of packets vetoed
+            document.endObject();
+            document.endObject();
+            g_elastic.serialised(tier.channel_index, document);
+        }
+    }
+}
@@ -2,25 +2,103 @@
  * MonitoringHandler - Reads monitoring packets and forwards them to elasticsearch or file
  */
 
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <boost/bind.hpp>
+
+#include <util/config.h>
+
 #include "monitoring_handler.h"
 
+/// Maximum number of sampled packets waiting to be written to ROOT file
+static constexpr std::size_t FILE_QUEUE_SIZE { 16384 };
+
+/// How long receivers block at most, before checking whether they should stop
+static constexpr long RECEIVE_TIMEOUT_US { 100000 };
+
+/// Number of channels of a BBB plane
+static constexpr std::size_t BBB_N_CHANNELS { 16 };
+
+/**
+ * Convert hit counters of a window to rates, multiplying them by a scale
+ * Counters are assumed to stay below 2^52 (far beyond any realistic window), so that
+ * they are exactly representable as doubles.
+ */
+static void countersToRates(const std::uint64_t* counters, std::size_t n, double scale, float* rates)
+{
+    std::size_t i { 0 };
+
+#ifdef __SSE2__
+    const std::size_t n_vectorised { n - n % 4 };
+    // SSE2 cannot convert 64-bit integers, instead the counter is placed in the mantissa of
+    // a double with exponent 52, which equals 2^52 + counter. Two counters at a time.
+    const __m128i exponent_bits { _mm_set1_epi64x(0x4330000000000000) };
+    const __m128d exponent { _mm_set1_pd(4503599627370496.0) };
+    const __m128d scale_pd { _mm_set1_pd(scale) };
+
+    for (; i < n_vectorised; i += 4) {
+        const __m128i low_counters { _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + i)) };
+        const __m128i high_counters { _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + i + 2)) };
+
+        const __m128d low { _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(low_counters, exponent_bits)), exponent) };
+        const __m128d high { _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(high_counters, exponent_bits)), exponent) };
+
+        const __m128 low_rates { _mm_cvtpd_ps(_mm_mul_pd(low, scale_pd)) };
+        const __m128 high_rates { _mm_cvtpd_ps(_mm_mul_pd(high, scale_pd)) };
+        _mm_storeu_ps(rates + i, _mm_movelh_ps(low_rates, high_rates));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        rates[i] = static_cast<float>(counters[i] * scale);
+    }
+}
+
 /// Create a MonitoringHandler
 MonitoringHandler::MonitoringHandler(std::string config_file, bool save_elastic,
-    bool save_file, float sample_frac)
+    bool save_file, float sample_frac, std::shared_ptr<TimeSeriesStore> time_series)
     : Logging {}
     , save_elastic_(save_elastic)
     , save_file_(save_file)
     , sample_frac_(sample_frac)
-    , n_threads_(4)
+    , n_threads_ { g_config.lookupI32("n_receiver_threads") }
+    , batch_size_ { g_config.lookupU32("receive_batch_size") }
+    , time_series_ { std::move(time_series) }
+    , aggregate_ { save_elastic || !time_series_->empty() }
     , mode_(false)
-    , io_service_ { new boost::asio::io_service }
-    , clb_socket_(*io_service_, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), CLBMONPORT))
-    , bbb_socket_(*io_service_, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), BBBMONPORT))
+    , running_ { true }
+    , file_ { nullptr }
+    , clb_tree_ { nullptr }
+    , bbb_tree_ { nullptr }
+    , receivers_ {}
+    , n_active_receivers_ { 0 }
+    , aggregator_settings_ { MonitoringAggregatorSettings::fromConfig() }
+    , raw_poms_ {}
+    , alert_settings_ { AlertEngineSettings::fromConfig() }
+    , alert_publisher_ { new AlertPublisher(g_config.lookupString("bus.daqsitter_alerts")) }
+    , file_queue_ { FILE_QUEUE_SIZE }
+    , n_file_dropped_ { 0 }
+    , pom_data_ {}
+    , channel_data_ {}
 {
     setUnitName("MonitoringHandler");
 
-    // Initialise the random number generator
-    srand((unsigned)time(NULL));
+    if (n_threads_ < 1 || batch_size_ < 1) {
+        throw std::runtime_error(fmt::format("MonitoringHandler needs at least one receiver thread and batch size of one, got {} and {}",
+            n_threads_, batch_size_));
+    }
+
+    for (const std::uint32_t pom : g_config.lookupU32Array("raw_poms")) {
+        raw_poms_.insert(static_cast<int>(pom));
+    }
 
     if (save_file_) {
         // Open the monitoring file to save data to
@@ -36,28 +114,38 @@ MonitoringHandler::MonitoringHandler(std::string config_file, bool save_elastic,
         setupTree();
     }
 
-    // Setup CLB socket
-    boost::asio::ip::udp::socket::receive_buffer_size option_clb(33554432);
-    clb_socket_.set_option(option_clb);
-    workCLBSocket();
-
-    // Setup BBB socket
-    boost::asio::ip::udp::socket::receive_buffer_size option_bbb(33554432);
-    bbb_socket_.set_option(option_bbb);
-    workBBBSocket();
+    // Setup CLB and BBB sockets, one per receiving thread
+    for (int i = 0; i < n_threads_; ++i) {
+        receivers_.push_back(createReceiver(Source::CLB, i));
+        receivers_.push_back(createReceiver(Source::BBB, i));
+    }
 }
 
 void MonitoringHandler::run()
 {
-    // Setup the thread group and call io_service.run() in each
-    log(INFO, "Monitoring Handler starting I/O service on {} threads", n_threads_);
-    for (int i = 0; i < n_threads_; ++i) {
-        thread_group_.create_thread(boost::bind(&MonitoringHandler::runThread, this));
+    // Setup the thread group, receiving packets on each socket
+    log(INFO, "Monitoring Handler receiving CLB and BBB packets on {} threads each", n_threads_);
+    alert_publisher_->runAsync();
+
+    n_active_receivers_ = static_cast<int>(receivers_.size());
+    for (const std::unique_ptr<Receiver>& receiver : receivers_) {
+        thread_group_.create_thread(boost::bind(&MonitoringHandler::receive, this, receiver.get()));
+    }
+
+    if (save_file_) {
+        thread_group_.create_thread(boost::bind(&MonitoringHandler::writeFile, this));
     }
 
     // Wait for all the threads to finish
     thread_group_.join_all();
 
+    for (const std::unique_ptr<Receiver>& receiver : receivers_) {
+        ::close(receiver->socket);
+    }
+
+    alert_publisher_->notifyJoin();
+    alert_publisher_->join();
+
     log(INFO, "Monitoring Handler finished.");
 }
 
@@ -80,132 +168,263 @@ void MonitoringHandler::setupTree()
 {
     if (file_ != NULL) {
         clb_tree_ = new TTree("clb_tree", "clb_tree");
-        if (!clb_tree_) {
-            log(FATAL, "MonitoringHandler Could not create 'clb_tree'");
-            throw std::runtime_error("MonitoringHandler Could not create 'clb_tree'");
+        bbb_tree_ = new TTree("bbb_tree", "bbb_tree");
+        if (!clb_tree_ || !bbb_tree_) {
+            log(FATAL, "MonitoringHandler Could not create 'clb_tree' and 'bbb_tree'");
+            throw std::runtime_error("MonitoringHandler Could not create 'clb_tree' and 'bbb_tree'");
         }
     } else {
         log(FATAL, "MonitoringHandler Could not create 'clb_tree' as TFile does not exist");
         throw std::runtime_error("MonitoringHandler Could not create 'clb_tree' as TFile does not exist");
     }
 
-    clb_tree_->Branch("timestamp", &pom_data_.timestamp, "pom_data_.timestamp/l");
-    clb_tree_->Branch("pom", &pom_data_.pom, "pom_data_.pom/i");
-    clb_tree_->Branch("temperature", &pom_data_.temperature, "pom_data_.temperature/s");
-    clb_tree_->Branch("humidity", &pom_data_.humidity, "pom_data_.humidity/s");
-    clb_tree_->Branch("sync", &pom_data_.sync, "pom_data_.sync/b");
-    clb_tree_->Branch("rate", &channel_data_.rate, "channel_data_.rate[30]/f");
-    clb_tree_->Branch("veto", &channel_data_.veto, "channel_data_.veto[32]/b");
+    // Both trees hold the same records, filled from the same buffers
+    for (TTree* tree : { clb_tree_, bbb_tree_ }) {
+        tree->Branch("timestamp", &pom_data_.timestamp, "pom_data_.timestamp/l");
+        tree->Branch("pom", &pom_data_.pom, "pom_data_.pom/i");
+        tree->Branch("temperature", &pom_data_.temperature, "pom_data_.temperature/s");
+        tree->Branch("humidity", &pom_data_.humidity, "pom_data_.humidity/s");
+        tree->Branch("sync", &pom_data_.sync, "pom_data_.sync/b");
+        tree->Branch("rate", &channel_data_.rate, "channel_data_.rate[30]/f");
+        tree->Branch("veto", &channel_data_.veto, "channel_data_.veto[32]/b");
+    }
 }
 
-// Work/Handle the CLB monitoring socket
-void MonitoringHandler::workCLBSocket()
+std::unique_ptr<MonitoringHandler::Receiver> MonitoringHandler::createReceiver(Source source, int index)
 {
-    clb_socket_.async_receive(boost::asio::buffer(&clb_buffer_[0], BUFFERSIZE),
-        boost::bind(&MonitoringHandler::handleCLBSocket, this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
-}
+    std::unique_ptr<Receiver> receiver { new Receiver {} };
+    receiver->source = source;
 
-void MonitoringHandler::handleCLBSocket(boost::system::error_code const& error, std::size_t size) // ~30 microseconds
-{
+    const int port { source == Source::CLB ? CLBMONPORT : BBBMONPORT };
 
-    if (!error) {
+    receiver->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (receiver->socket < 0) {
+        throw std::runtime_error(fmt::format("MonitoringHandler Could not create socket: {}", std::strerror(errno)));
+    }
 
-        // Shall we skip this packet?
-        if (((float)rand() / RAND_MAX) > sample_frac_) {
-            workCLBSocket();
-            return;
-        }
+    // All receivers bind the same port, the kernel hashes every POM (or plane) to one of them
+    const int reuse { 1 };
+    const int buffer_size { 33554432 };
+    const timeval timeout { 0, RECEIVE_TIMEOUT_US };
+
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (::setsockopt(receiver->socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0
+        || ::setsockopt(receiver->socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)) != 0
+        || ::setsockopt(receiver->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+        || ::bind(receiver->socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const int error { errno };
+        ::close(receiver->socket);
+        throw std::runtime_error(fmt::format("MonitoringHandler Could not set up socket on port {}: {}",
+            port, std::strerror(error)));
+    }
 
-        // Check the packet is of the correct size
-        if (size != clb_mon_size) {
-            log(WARNING, "MonitoringHandler CLB socket invalid packet size");
-            workCLBSocket();
-            return;
-        }
+    // Every datagram of a batch has a buffer of its own
+    receiver->buffers.resize(batch_size_ * BUFFERSIZE);
+    receiver->iovecs.resize(batch_size_);
+    receiver->messages.resize(batch_size_);
+    for (std::size_t i = 0; i < batch_size_; ++i) {
+        receiver->iovecs[i].iov_base = &receiver->buffers[i * BUFFERSIZE];
+        receiver->iovecs[i].iov_len = BUFFERSIZE;
+
+        std::memset(&receiver->messages[i], 0, sizeof(mmsghdr));
+        receiver->messages[i].msg_hdr.msg_iov = &receiver->iovecs[i];
+        receiver->messages[i].msg_hdr.msg_iovlen = 1;
+    }
 
-        // Cast the beggining of the packet to the CLBCommonHeader
-        CLBCommonHeader const& header = *static_cast<CLBCommonHeader const*>(static_cast<void const*>(&clb_buffer_[0]));
+    receiver->random.seed(std::random_device {}() + index);
+    receiver->aggregator.reset(new MonitoringAggregator(aggregator_settings_, save_elastic_, time_series_.get()));
+    receiver->alerts.reset(new AlertEngine(alert_settings_, source == Source::CLB, alert_publisher_));
 
-        // Check the type of the packet is monitoring from the CLBCommonHeader
-        if (getType(header).first != MONI) {
-            log(WARNING, "MonitoringHandler CLB socket incorrect packet type (expected {}, got {})", getType(header).first, MONI);
-            workCLBSocket();
-            return;
-        }
+    return receiver;
+}
 
-        // If we don't have a valid timestamp, just don't record the packets
-        if (!validTimeStamp(header)) {
-            workCLBSocket();
-            return;
+void MonitoringHandler::receive(Receiver* receiver)
+{
+    const char* name { receiver->source == Source::CLB ? "CLB" : "BBB" };
+
+    while (running_) {
+        // Blocks until at least one datagram arrives, or the timeout expires
+        const int n_messages { ::recvmmsg(receiver->socket, receiver->messages.data(), receiver->messages.size(), MSG_WAITFORONE, nullptr) };
+        if (n_messages < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log(WARNING, "MonitoringHandler {} socket receive error: {}", name, std::strerror(errno));
+            }
+            continue;
         }
 
-        // Cast the next section of the packet to the monitoring hits
-        MONHits const& hits = *static_cast<MONHits const*>(static_cast<void const*>(&clb_buffer_[0] + sizeof(CLBCommonHeader)));
-
-        // Cast the next section of the packet to the SCData struct
-        SCData const& scData = *static_cast<SCData const*>(static_cast<void const*>(&clb_buffer_[0] + sizeof(CLBCommonHeader) + sizeof(MONHits)));
-
-        // Fill the mon_data
-        pom_data_.timestamp = header.timeStamp().inMilliSeconds();
-        pom_data_.pom = header.pomIdentifier();
-        pom_data_.temperature = scData.temp();
-        pom_data_.humidity = scData.humidity();
-        pom_data_.sync = validTimeStamp(header);
-
-        // Fill the rate_data
-        channel_data_.timestamp = header.timeStamp().inMilliSeconds();
-        channel_data_.pom = header.pomIdentifier();
-        channel_data_.veto = hits.vetoBitset();
-        float rate_scale = 1000000 / scData.duration(); // Window length in microseconds
-        for (int i = 0; i < 30; ++i) {
-            channel_data_.rate[i] = (float)hits.hit(i) * rate_scale;
+        for (int i = 0; i < n_messages; ++i) {
+            const mmsghdr& message { receiver->messages[i] };
+            if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+                log(WARNING, "MonitoringHandler {} socket invalid packet size", name);
+                continue;
+            }
+
+            const char* packet { static_cast<const char*>(receiver->iovecs[i].iov_base) };
+            if (receiver->source == Source::CLB) {
+                handleCLBPacket(*receiver, packet, message.msg_len);
+            } else {
+                handleBBBPacket(*receiver, packet, message.msg_len);
+            }
         }
+    }
 
-        // If we are saving to ROOT file, fill the TTree
-        if (save_file_ && clb_tree_ != NULL) {
-            clb_tree_->Fill();
-        }
+    // Send windows which are still open
+    if (aggregate_) {
+        receiver->aggregator->flush();
+    }
 
-        // Save the monitoring data to elasticsearch
-        if (save_elastic_) {
-            g_elastic.pom(pom_data_);
-            g_elastic.channel(channel_data_);
-        }
-    } else {
-        log(WARNING, "MonitoringHandler CLB socket packet error");
+    --n_active_receivers_;
+}
+
+void MonitoringHandler::handleCLBPacket(Receiver& receiver, const char* packet, std::size_t size) // ~30 microseconds
+{
+    // Check the packet is of the correct size
+    if (size != clb_mon_size) {
+        log(WARNING, "MonitoringHandler CLB socket invalid packet size");
+        return;
+    }
+
+    // Cast the beggining of the packet to the CLBCommonHeader
+    CLBCommonHeader const& header = *static_cast<CLBCommonHeader const*>(static_cast<void const*>(packet));
+
+    // Check the type of the packet is monitoring from the CLBCommonHeader
+    if (getType(header).first != MONI) {
+        log(WARNING, "MonitoringHandler CLB socket incorrect packet type (expected {}, got {})", getType(header).first, MONI);
+        return;
+    }
+
+    // If we don't have a valid timestamp, just don't record the packets
+    if (!validTimeStamp(header)) {
+        receiver.alerts->checkUnsynced(header.pomIdentifier());
+        return;
+    }
+
+    // Cast the next section of the packet to the monitoring hits
+    MONHits const& hits = *static_cast<MONHits const*>(static_cast<void const*>(packet + sizeof(CLBCommonHeader)));
+
+    // Cast the next section of the packet to the SCData struct
+    SCData const& scData = *static_cast<SCData const*>(static_cast<void const*>(packet + sizeof(CLBCommonHeader) + sizeof(MONHits)));
+
+    // Fill the mon_data, decoded on this thread's stack
+    pom_data pom {};
+    pom.timestamp = header.timeStamp().inMilliSeconds();
+    pom.pom = header.pomIdentifier();
+    pom.temperature = scData.temp();
+    pom.humidity = scData.humidity();
+    pom.sync = validTimeStamp(header);
+
+    // Fill the rate_data
+    channel_data channels {};
+    channels.timestamp = header.timeStamp().inMilliSeconds();
+    channels.pom = header.pomIdentifier();
+    channels.veto = hits.vetoBitset();
+    channels.n_channels = 30;
+    float rate_scale = 1000000 / scData.duration(); // Window length in microseconds
+    for (int i = 0; i < 30; ++i) {
+        channels.rate[i] = (float)hits.hit(i) * rate_scale;
     }
 
-    workCLBSocket();
+    forward(receiver, pom, channels);
 }
 
-// Work/Handle the BBB monitoring socket
-void MonitoringHandler::workBBBSocket()
+void MonitoringHandler::handleBBBPacket(Receiver& receiver, const char* packet, std::size_t size)
 {
-    bbb_socket_.async_receive(boost::asio::buffer(&bbb_buffer_[0], BUFFERSIZE),
-        boost::bind(&MonitoringHandler::handleBBBSocket, this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+    // Check the packet is of the correct size
+    if (size != sizeof(mon_packet_t)) {
+        log(WARNING, "MonitoringHandler BBB socket invalid packet size (expected {} bytes, got {})", sizeof(mon_packet_t), size);
+        return;
+    }
+
+    const mon_packet_t& mon_packet { *reinterpret_cast<const mon_packet_t*>(packet) };
+    const packet_common_header_t& header { mon_packet.header.common };
+    const mon_packet_payload_t& payload { mon_packet.payload };
+
+    // Check the type of the packet is monitoring
+    if (header.packet_type != UDP_PACKET_TYPE_MONITORING) {
+        log(WARNING, "MonitoringHandler BBB socket incorrect packet type (expected {}, got {})",
+            UDP_PACKET_TYPE_MONITORING, header.packet_type);
+        return;
+    }
+
+    // Without a window, rates cannot be calculated
+    if (header.window_size == 0) {
+        return;
+    }
+
+    // Planes take the place of POMs, BBBs have no environmental sensors
+    const long timestamp { static_cast<long>(1000 * header.window_start.secs + header.window_start.nanosecs / 1000000) };
+
+    pom_data pom {};
+    pom.timestamp = timestamp;
+    pom.pom = header.plane_number;
+    pom.sync = header.window_start.secs != 0;
+
+    channel_data channels {};
+    channels.timestamp = timestamp;
+    channels.pom = header.plane_number;
+    channels.veto = payload.high_rate_veto;
+    channels.n_channels = BBB_N_CHANNELS;
+    countersToRates(payload.n_opt_hits, BBB_N_CHANNELS, 1e9 / header.window_size, channels.rate.data()); // Window length in nanoseconds
+
+    forward(receiver, pom, channels);
 }
 
-void MonitoringHandler::handleBBBSocket(boost::system::error_code const& error, std::size_t size)
+void MonitoringHandler::forward(Receiver& receiver, const pom_data& pom, const channel_data& channels)
 {
-    if (!error) {
-        // Shall we skip this packet?
-        if (((float)rand() / RAND_MAX) > sample_frac_) {
-            workBBBSocket();
-            return;
+    receiver.alerts->check(pom, channels);
+
+    // If we are saving to ROOT file, pass a sample of packets to the writing thread
+    if (save_file_ && std::uniform_real_distribution<float> {}(receiver.random) < sample_frac_) {
+        if (!file_queue_.bounded_push(FileEntry { receiver.source, pom, channels })) {
+            ++n_file_dropped_;
         }
-    } else {
-        log(WARNING, "MonitoringHandler BBB socket packet error");
     }
-    workBBBSocket();
+
+    // Save the monitoring data to elasticsearch and the store, aggregated over windows
+    if (aggregate_) {
+        receiver.aggregator->add(pom, channels);
+    }
+
+    if (save_elastic_ && raw_poms_.count(pom.pom) != 0) {
+        g_elastic.pom(pom);
+        g_elastic.channel(channels);
+    }
 }
 
-void MonitoringHandler::runThread()
+void MonitoringHandler::writeFile()
 {
-    io_service_->run();
+    for (;;) {
+        // Sampled first, so that packets queued before the last receiver stopped are still written
+        const bool stopping { n_active_receivers_ == 0 };
+
+        FileEntry entry {};
+        bool written { false };
+        while (file_queue_.pop(entry)) {
+            pom_data_ = entry.pom;
+            channel_data_ = entry.channels;
+            (entry.source == Source::CLB ? clb_tree_ : bbb_tree_)->Fill();
+            written = true;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (!written) {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        }
+    }
+
+    if (n_file_dropped_ > 0) {
+        log(WARNING, "MonitoringHandler dropped {} packets, which could not be written to file in time", n_file_dropped_);
+    }
+
+    file_->Write();
+    file_->Close();
 }
 
 void MonitoringHandler::handleConfigCommand(std::string config_file)
@@ -252,5 +471,5 @@ void MonitoringHandler::handleStopRunCommand()
 void MonitoringHandler::handleExitCommand()
 {
     log(INFO, "DAQsitter: Exit");
-    io_service_->stop();
+    running_ = false;
 }
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <nngpp/nngpp.h>
+#include <nngpp/protocol/rep0.h>
+
+#include "time_series_server.h"
+
+/// Most buckets in a single reply, longer answers are truncated
+static constexpr std::size_t MAX_BUCKETS { 100000 };
+
+TimeSeriesServer::TimeSeriesServer(std::shared_ptr<const TimeSeriesStore> store, const std::string& url)
+    : AsyncComponent {}
+    , Logging {}
+    , store_ { std::move(store) }
+    , url_ { url }
+{
+    setUnitName("TimeSeriesServer");
+}
+
+void TimeSeriesServer::run()
+{
+    log(INFO, "TimeSeriesServer answering queries on {}", url_);
+
+    std::string reply {};
+    while (running_) {
+        try {
+            auto sock = nng::rep::open();
+            nng::set_opt_recv_timeout(sock, 200);
+            sock.listen(url_.c_str());
+
+            while (running_) {
+                nng::buffer request {};
+                try {
+                    request = sock.recv();
+                } catch (const nng::exception& e) {
+                    switch (e.get_error()) {
+                    case nng::error::timedout:
+                        continue;
+                    default:
+                        throw;
+                    }
+                }
+
+                answer(request.data(), request.size(), reply);
+                sock.send(nng::view { reply.data(), reply.size() });
+            }
+        } catch (const nng::exception& e) {
+            log(ERROR, "TimeSeriesServer caught error: {}, listening again in 2 seconds", e.what());
+            std::this_thread::sleep_for(std::chrono::seconds(2));
+        }
+    }
+
+    log(INFO, "TimeSeriesServer finished");
+}
+
+void TimeSeriesServer::answer(const void* request, std::size_t size, std::string& reply) const
+{
+    TimeSeriesReplyHeader header {};
+    std::vector<TimeSeriesBucket> buckets {};
+
+    TimeSeriesQueryMessage query {};
+    if (size != sizeof(query)) {
+        header.status = TimeSeriesReplyHeader::BadRequest;
+    } else {
+        std::memcpy(&query, request, sizeof(query));
+        if (query.end_ms <= query.start_ms || query.step_ms < 0) {
+            header.status = TimeSeriesReplyHeader::BadRequest;
+        } else {
+            header.window_ms = store_->query(query.pom, query.channel, query.start_ms, query.end_ms, query.step_ms, buckets);
+            header.status = header.window_ms == 0 ? TimeSeriesReplyHeader::NotStored : TimeSeriesReplyHeader::Ok;
+        }
+    }
+
+    header.truncated = buckets.size() > MAX_BUCKETS ? 1 : 0;
+    header.n_buckets = static_cast<std::uint32_t>(std::min(buckets.size(), MAX_BUCKETS));
+
+    reply.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    reply.append(reinterpret_cast<const char*>(buckets.data()), header.n_buckets * sizeof(TimeSeriesBucket));
+}
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <util/config.h>
+
+#include "time_series_store.h"
+
+/// Size of a block, header included
+static constexpr std::uint32_t BLOCK_SIZE { 4096 };
+static constexpr std::uint32_t HEADER_SIZE { 64 };
+static constexpr std::uint32_t PAYLOAD_BITS { (BLOCK_SIZE - HEADER_SIZE) * 8 };
+
+/// Marks blocks in use, so that blocks of a new (zero-filled) file are recognised as free
+static constexpr std::uint32_t BLOCK_MAGIC { 0x54534231 }; // "TSB1"
+
+/// Most bits a single point can take: a 64-bit delta of deltas and a 32-bit XOR with its header
+static constexpr std::uint32_t MAX_POINT_BITS { 4 + 64 + 2 + 5 + 5 + 32 };
+
+struct TimeSeriesTier::BlockHeader {
+    std::uint32_t magic;
+    std::uint32_t pom;
+    std::uint32_t channel;
+    std::uint32_t n_points;
+    std::uint64_t sequence; ///< Order in which blocks were allocated
+    std::int64_t min_timestamp;
+    std::int64_t max_timestamp;
+    std::uint32_t n_bits; ///< Length of the compressed points in the payload
+    std::uint32_t reserved[5];
+};
+
+static std::uint64_t seriesKey(std::uint32_t pom, std::uint32_t channel)
+{
+    return (static_cast<std::uint64_t>(pom) << 32) | channel;
+}
+
+/// Append the lowest n_bits of a value, most significant first, to a zero-filled bit stream.
+static void writeBits(std::uint8_t* data, std::uint32_t& position, std::uint64_t value, int n_bits)
+{
+    while (n_bits > 0) {
+        const int free_bits { 8 - static_cast<int>(position % 8) };
+        const int n { std::min(free_bits, n_bits) };
+        const std::uint64_t chunk { (value >> (n_bits - n)) & ((1u << n) - 1) };
+        data[position / 8] |= static_cast<std::uint8_t>(chunk << (free_bits - n));
+        position += n;
+        n_bits -= n;
+    }
+}
+
+static std::uint64_t readBits(const std::uint8_t* data, std::uint32_t& position, int n_bits)
+{
+    std::uint64_t value { 0 };
+    while (n_bits > 0) {
+        const int available_bits { 8 - static_cast<int>(position % 8) };
+        const int n { std::min(available_bits, n_bits) };
+        const std::uint64_t chunk { (data[position / 8] >> (available_bits - n)) & ((1u << n) - 1) };
+        value = (value << n) | chunk;
+        position += n;
+        n_bits -= n;
+    }
+
+    return value;
+}
+
+static std::uint32_t floatBits(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(std::uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void makeDirectories(const std::string& path)
+{
+    for (std::size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            const std::string prefix { path.substr(0, i) };
+            if (::mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                throw std::runtime_error(fmt::format("Cannot create time series directory '{}': {}", prefix, std::strerror(errno)));
+            }
+        }
+    }
+}
+
+TimeSeriesStoreSettings TimeSeriesStoreSettings::fromConfig()
+{
+    TimeSeriesStoreSettings settings {};
+    settings.directory = g_config.lookupString("time_series.directory");
+
+    for (const std::string& name : g_config.lookupNames("time_series.retention")) {
+        const std::string window_path { "aggregation_windows." + name };
+        if (!g_config.exists(window_path.c_str())) {
+            throw std::runtime_error(fmt::format("Time series retention set for '{}', which is not an aggregation window", name));
+        }
+
+        const std::string size_path { "time_series.retention." + name };
+        const double length_s { g_config.lookupDouble(window_path.c_str()) };
+        const std::uint64_t size_mib { g_config.lookupU64(size_path.c_str()) };
+        settings.tiers.push_back(TimeSeriesTierSettings { name, static_cast<std::uint64_t>(1e3 * length_s), size_mib << 20 });
+    }
+
+    return settings;
+}
+
+TimeSeriesTier::TimeSeriesTier(const std::string& path, const TimeSeriesTierSettings& settings)
+    : Logging {}
+    , settings_ { settings }
+    , fd_ { -1 }
+    , data_ { nullptr }
+    , n_blocks_ { static_cast<std::uint32_t>(std::min<std::uint64_t>(settings.size / BLOCK_SIZE, std::numeric_limits<std::uint32_t>::max())) }
+    , next_block_ { 0 }
+    , sequence_ { 0 }
+    , series_blocks_ {}
+    , encoders_ {}
+    , mutex_ {}
+{
+    static_assert(sizeof(BlockHeader) == HEADER_SIZE, "Layout of block headers must not change, it is stored");
+    setUnitName("TimeSeriesTier");
+
+    if (n_blocks_ < 2) {
+        throw std::runtime_error(fmt::format("Time series of '{}' need at least {} bytes", settings_.name, 2 * BLOCK_SIZE));
+    }
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error(fmt::format("Cannot open time series file '{}': {}", path, std::strerror(errno)));
+    }
+
+    // Growing or shrinking the file keeps the blocks which still fit, new ones read as free.
+    const std::size_t file_size { static_cast<std::size_t>(n_blocks_) * BLOCK_SIZE };
+    if (::ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+        const int error { errno };
+        ::close(fd_);
+        throw std::runtime_error(fmt::format("Cannot resize time series file '{}': {}", path, std::strerror(error)));
+    }
+
+    void* data { ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0) };
+    if (data == MAP_FAILED) {
+        const int error { errno };
+        ::close(fd_);
+        throw std::runtime_error(fmt::format("Cannot map time series file '{}': {}", path, std::strerror(error)));
+    }
+    data_ = static_cast<char*>(data);
+
+    recover();
+
+    log(INFO, "Storing '{}' rates in {} ({} blocks, {} series recovered)",
+        settings_.name, path, n_blocks_, series_blocks_.size());
+}
+
+TimeSeriesTier::~TimeSeriesTier()
+{
+    ::munmap(data_, static_cast<std::size_t>(n_blocks_) * BLOCK_SIZE);
+    ::close(fd_);
+}
+
+TimeSeriesTier::BlockHeader* TimeSeriesTier::header(std::uint32_t block) const
+{
+    return reinterpret_cast<BlockHeader*>(data_ + static_cast<std::size_t>(block) * BLOCK_SIZE);
+}
+
+std::uint8_t* TimeSeriesTier::payload(std::uint32_t block) const
+{
+    return reinterpret_cast<std::uint8_t*>(data_ + static_cast<std::size_t>(block) * BLOCK_SIZE + HEADER_SIZE);
+}
+
+void TimeSeriesTier::recover()
+{
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> used_blocks {};
+    for (std::uint32_t block = 0; block < n_blocks_; ++block) {
+        if (header(block)->magic == BLOCK_MAGIC) {
+            used_blocks.emplace_back(header(block)->sequence, block);
+        }
+    }
+
+    // Blocks which were open are not appended to again, new points go to new blocks.
+    std::sort(used_blocks.begin(), used_blocks.end());
+    for (const auto& used_block : used_blocks) {
+        const BlockHeader* block_header { header(used_block.second) };
+        series_blocks_[seriesKey(block_header->pom, block_header->channel)].push_back(used_block.second);
+    }
+
+    if (!used_blocks.empty()) {
+        sequence_ = used_blocks.back().first;
+        next_block_ = (used_blocks.back().second + 1) % n_blocks_;
+    }
+}
+
+TimeSeriesTier::Encoder& TimeSeriesTier::allocate(std::uint64_t key, std::uint32_t pom, std::uint32_t channel)
+{
+    const std::uint32_t block { next_block_ };
+    next_block_ = (next_block_ + 1) % n_blocks_;
+
+    // Drop the block from the series it held, it is that series' oldest one.
+    BlockHeader* block_header { header(block) };
+    if (block_header->magic == BLOCK_MAGIC) {
+        const std::uint64_t old_key { seriesKey(block_header->pom, block_header->channel) };
+        auto blocks { series_blocks_.find(old_key) };
+        if (blocks != series_blocks_.end()) {
+            blocks->second.erase(std::remove(blocks->second.begin(), blocks->second.end(), block), blocks->second.end());
+            if (blocks->second.empty()) {
+                series_blocks_.erase(blocks);
+            }
+        }
+
+        auto encoder { encoders_.find(old_key) };
+        if (encoder != encoders_.end() && encoder->second.block == block) {
+            encoders_.erase(encoder);
+        }
+    }
+
+    std::memset(block_header, 0, BLOCK_SIZE);
+    block_header->pom = pom;
+    block_header->channel = channel;
+    block_header->sequence = ++sequence_;
+    block_header->min_timestamp = std::numeric_limits<std::int64_t>::max();
+    block_header->max_timestamp = std::numeric_limits<std::int64_t>::min();
+    block_header->magic = BLOCK_MAGIC;
+    series_blocks_[key].push_back(block);
+
+    Encoder& encoder { encoders_[key] };
+    encoder = Encoder { block, 0, 0, 0, -1, 0 };
+    return encoder;
+}
+
+void TimeSeriesTier::append(std::uint32_t pom, std::int64_t timestamp, const float* values, int n_channels)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    for (int channel = 0; channel < n_channels; ++channel) {
+        const std::uint32_t channel_index { static_cast<std::uint32_t>(channel) };
+        appendPoint(seriesKey(pom, channel_index), pom, channel_index, timestamp, values[channel]);
+    }
+}
+
+void TimeSeriesTier::appendPoint(std::uint64_t key, std::uint32_t pom, std::uint32_t channel, std::int64_t timestamp, float value)
+{
+    auto it { encoders_.find(key) };
+    Encoder* encoder { it == encoders_.end() ? nullptr : &it->second };
+    if (encoder && header(encoder->block)->n_bits + MAX_POINT_BITS > PAYLOAD_BITS) {
+        encoder = nullptr;
+    }
+
+    BlockHeader* block_header { nullptr };
+    std::uint32_t position { 0 };
+    const std::uint32_t bits { floatBits(value) };
+
+    if (!encoder) {
+        encoder = &allocate(key, pom, channel);
+        block_header = header(encoder->block);
+
+        // The first point of a block is stored as it is.
+        writeBits(payload(encoder->block), position, static_cast<std::uint64_t>(timestamp), 64);
+        writeBits(payload(encoder->block), position, bits, 32);
+    } else {
+        block_header = header(encoder->block);
+        position = block_header->n_bits;
+        std::uint8_t* data { payload(encoder->block) };
+
+        // Windows have a fixed length, so deltas of deltas are mostly zero.
+        const std::int64_t delta { timestamp - encoder->timestamp };
+        const std::int64_t delta_of_delta { delta - encoder->delta };
+        encoder->delta = delta;
+        if (delta_of_delta == 0) {
+            writeBits(data, position, 0x0, 1);
+        } else if (delta_of_delta >= -63 && delta_of_delta <= 64) {
+            writeBits(data, position, 0x2, 2);
+            writeBits(data, position, static_cast<std::uint64_t>(delta_of_delta + 63), 7);
+        } else if (delta_of_delta >= -255 && delta_of_delta <= 256) {
+            writeBits(data, position, 0x6, 3);
+            writeBits(data, position, static_cast<std::uint64_t>(delta_of_delta + 255), 9);
+        } else if (delta_of_delta >= -2047 && delta_of_delta <= 2048) {
+            writeBits(data, position, 0xe, 4);
+            writeBits(data, position, static_cast<std::uint64_t>(delta_of_delta + 2047), 12);
+        } else {
+            writeBits(data, position, 0xf, 4);
+            writeBits(data, position, static_cast<std::uint64_t>(delta_of_delta), 64);
+        }
+
+        // Consecutive rates share sign, exponent and leading mantissa bits, which XOR to zero.
+        const std::uint32_t difference { bits ^ encoder->value };
+        if (difference == 0) {
+            writeBits(data, position, 0x0, 1);
+        } else {
+            const int leading { std::min(__builtin_clz(difference), 31) };
+            const int trailing { __builtin_ctz(difference) };
+            if (encoder->leading >= 0 && leading >= encoder->leading && trailing >= encoder->trailing) {
+                const int n_meaningful { 32 - encoder->leading - encoder->trailing };
+                writeBits(data, position, 0x2, 2);
+                writeBits(data, position, difference >> encoder->trailing, n_meaningful);
+            } else {
+                const int n_meaningful { 32 - leading - trailing };
+                writeBits(data, position, 0x3, 2);
+                writeBits(data, position, static_cast<std::uint64_t>(leading), 5);
+                writeBits(data, position, static_cast<std::uint64_t>(n_meaningful - 1), 5);
+                writeBits(data, position, difference >> trailing, n_meaningful);
+                encoder->leading = leading;
+                encoder->trailing = trailing;
+            }
+        }
+    }
+
+    encoder->timestamp = timestamp;
+    encoder->value = bits;
+
+    // Publish the point only once its bits are written.
+    block_header->min_timestamp = std::min(block_header->min_timestamp, timestamp);
+    block_header->max_timestamp = std::max(block_header->max_timestamp, timestamp);
+    block_header->n_bits = position;
+    ++block_header->n_points;
+}
+
+void TimeSeriesTier::query(std::uint32_t pom, std::uint32_t channel, std::int64_t start, std::int64_t end,
+    std::vector<TimeSeriesPoint>& points) const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    auto blocks { series_blocks_.find(seriesKey(pom, channel)) };
+    if (blocks == series_blocks_.end()) {
+        return;
+    }
+
+    for (const std::uint32_t block : blocks->second) {
+        const BlockHeader* block_header { header(block) };
+        if (block_header->n_points != 0 && block_header->max_timestamp >= start && block_header->min_timestamp < end) {
+            decode(block, start, end, points);
+        }
+    }
+}
+
+void TimeSeriesTier::decode(std::uint32_t block, std::int64_t start, std::int64_t end, std::vector<TimeSeriesPoint>& points) const
+{
+    const BlockHeader* block_header { header(block) };
+    const std::uint8_t* data { payload(block) };
+    std::uint32_t position { 0 };
+
+    std::int64_t timestamp { static_cast<std::int64_t>(readBits(data, position, 64)) };
+    std::uint32_t bits { static_cast<std::uint32_t>(readBits(data, position, 32)) };
+    std::int64_t delta { 0 };
+    int leading { -1 };
+    int trailing { 0 };
+
+    for (std::uint32_t i = 0; i < block_header->n_points; ++i) {
+        if (i != 0) {
+            std::int64_t delta_of_delta { 0 };
+            if (readBits(data, position, 1) != 0) {
+                if (readBits(data, position, 1) == 0) {
+                    delta_of_delta = static_cast<std::int64_t>(readBits(data, position, 7)) - 63;
+                } else if (readBits(data, position, 1) == 0) {
+                    delta_of_delta = static_cast<std::int64_t>(readBits(data, position, 9)) - 255;
+                } else if (readBits(data, position, 1) == 0) {
+                    delta_of_delta = static_cast<std::int64_t>(readBits(data, position, 12)) - 2047;
+                } else {
+                    delta_of_delta = static_cast<std::int64_t>(readBits(data, position, 64));
+                }
+            }
+            delta += delta_of_delta;
+            timestamp += delta;
+
+            if (readBits(data, position, 1) != 0) {
+                if (readBits(data, position, 1) != 0) {
+                    leading = static_cast<int>(readBits(data, position, 5));
+                    trailing = 32 - leading - static_cast<int>(readBits(data, position, 5) + 1);
+                }
+                bits ^= static_cast<std::uint32_t>(readBits(data, position, 32 - leading - trailing)) << trailing;
+            }
+        }
+
+        if (timestamp >= start && timestamp < end) {
+            points.push_back(TimeSeriesPoint { timestamp, bitsFloat(bits) });
+        }
+    }
+}
+
+TimeSeriesStore::TimeSeriesStore(const TimeSeriesStoreSettings& settings)
+    : tiers_ {}
+{
+    if (!settings.tiers.empty()) {
+        makeDirectories(settings.directory);
+    }
+
+    for (const TimeSeriesTierSettings& tier : settings.tiers) {
+        const std::string path { fmt::format("{}/{}.tsdb", settings.directory, tier.name) };
+        tiers_.emplace_back(new TimeSeriesTier(path, tier));
+    }
+
+    std::sort(tiers_.begin(), tiers_.end(), [](const std::unique_ptr<TimeSeriesTier>& a, const std::unique_ptr<TimeSeriesTier>& b) {
+        return a->windowMs() < b->windowMs();
+    });
+}
+
+TimeSeriesTier* TimeSeriesStore::tier(const std::string& name) const
+{
+    for (const std::unique_ptr<TimeSeriesTier>& tier : tiers_) {
+        if (tier->name() == name) {
+            return tier.get();
+        }
+    }
+
+    return nullptr;
+}
+
+std::uint64_t TimeSeriesStore::query(std::uint32_t pom, std::uint32_t channel, std::int64_t start, std::int64_t end,
+    std::int64_t step, std::vector<TimeSeriesBucket>& buckets) const
+{
+    if (tiers_.empty()) {
+        return 0;
+    }
+
+    const TimeSeriesTier* tier { tiers_.front().get() };
+    for (const std::unique_ptr<TimeSeriesTier>& candidate : tiers_) {
+        if (step > 0 && candidate->windowMs() <= static_cast<std::uint64_t>(step)) {
+            tier = candidate.get();
+        }
+    }
+
+    std::vector<TimeSeriesPoint> points {};
+    tier->query(pom, channel, start, end, points);
+
+    for (const TimeSeriesPoint& point : points) {
+        std::int64_t timestamp { point.timestamp };
+        if (step > 0) {
+            // Floor towards negative infinity, so buckets line up across queries.
+            const std::int64_t remainder { timestamp % step };
+            timestamp -= remainder < 0 ? remainder + step : remainder;
+        }
+
+        if (buckets.empty() || buckets.back().timestamp != timestamp) {
+            buckets.push_back(TimeSeriesBucket { timestamp, point.value, point.value, point.value, 1 });
+            continue;
+        }
+
+        // Means of windows are weighted equally, windows have the same length.
+        TimeSeriesBucket& bucket { buckets.back() };
+        ++bucket.n_points;
+        bucket.mean += (point.value - bucket.mean) / static_cast<float>(bucket.n_points);
+        bucket.min = std::min(bucket.min, point.value);
+        bucket.max = std::max(bucket.max, point.value);
+    }
+
+    return tier->windowMs();
+}
@@ -0,0 +1,120 @@
+/**
+ * BinaryFormat - Native binary format of CHIPS run files
+ *
+ * The format is designed to be written at disk bandwidth by a single thread, and
+ * is converted into the ROOT layout offline. A file is a sequence of blocks:
+ *
+ *   FileHeader
+ *   BlockHeader + payload   (RunParamsStart)
+ *   BlockHeader + payload   (Spill, repeated)
+ *   BlockHeader + payload   (RunParamsEnd)
+ *   BlockHeader + payload   (SpillIndex)
+ *   FileTrailer
+ *
+ * Every block is prefixed by its length, so that files with a missing footer (e.g.
+ * after a crash) can still be recovered by scanning. Spill payloads contain a
+ * SpillBlockHeader followed by the hit columns, each stored contiguously in the order
+ * of HitColumns, or encoded by hit_codec if the block is flagged as packed. Payloads
+ * can be compressed with zlib block by block. All integers are stored in little-endian
+ * byte order.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "hit_columns.h"
+#include "records.h"
+
+namespace binary_format {
+
+static constexpr std::uint64_t FILE_MAGIC { 0x4e55525350494843 }; ///< "CHIPSRUN"
+static constexpr std::uint64_t TRAILER_MAGIC { 0x444e455350494843 }; ///< "CHIPSEND"
+static constexpr std::uint32_t VERSION { 1 };
+
+enum class BlockType : std::uint32_t {
+    RunParamsStart = 1,
+    RunParamsEnd = 2,
+    Spill = 3,
+    SpillIndex = 4
+};
+
+/// Bits of BlockHeader::flags.
+static constexpr std::uint32_t BLOCK_FLAG_ZLIB { 1 << 0 };
+static constexpr std::uint32_t BLOCK_FLAG_PACKED_HITS { 1 << 1 }; ///< Spill hits encoded by hit_codec
+
+struct FileHeader {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 16, "Unexpected padding in FileHeader");
+
+struct BlockHeader {
+    std::uint32_t type; ///< BlockType
+    std::uint32_t flags;
+    std::uint64_t stored_size; ///< Size of the payload that follows [B]
+    std::uint64_t raw_size; ///< Size of the payload after decompression [B]
+};
+static_assert(sizeof(BlockHeader) == 24, "Unexpected padding in BlockHeader");
+
+struct RunParamsBlock {
+    std::uint64_t number;
+    std::uint64_t time_started_s;
+    std::uint64_t time_stopped_s;
+    std::uint32_t time_started_ns;
+    std::uint32_t time_stopped_ns;
+    std::uint32_t type;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(RunParamsBlock) == 40, "Unexpected padding in RunParamsBlock");
+
+struct SpillBlockHeader {
+    std::uint64_t number;
+    std::uint64_t time_started_s;
+    std::uint64_t time_stopped_s;
+    std::uint32_t time_started_ns;
+    std::uint32_t time_stopped_ns;
+    std::uint64_t n_hits;
+};
+static_assert(sizeof(SpillBlockHeader) == 40, "Unexpected padding in SpillBlockHeader");
+
+/// Entry of the SpillIndex block, one per spill.
+struct SpillIndexEntry {
+    std::uint64_t number;
+    std::uint64_t offset; ///< Position of the spill's BlockHeader in the file [B]
+    std::uint64_t n_hits;
+    std::uint64_t time_started_s;
+    std::uint32_t time_started_ns;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(SpillIndexEntry) == 40, "Unexpected padding in SpillIndexEntry");
+
+struct FileTrailer {
+    std::uint64_t index_offset; ///< Position of the SpillIndex BlockHeader in the file [B]
+    std::uint64_t run_params_offset; ///< Position of the RunParamsEnd BlockHeader in the file [B]
+    std::uint64_t n_spills;
+    std::uint64_t magic;
+};
+static_assert(sizeof(FileTrailer) == 32, "Unexpected padding in FileTrailer");
+
+/// Size of all hit columns of a single hit [B].
+static constexpr std::size_t HIT_COLUMNS_SIZE { HitColumns::BYTES_PER_HIT };
+
+RunParamsBlock encodeRunParams(const RunParameters& params);
+RunParameters decodeRunParams(const RunParamsBlock& block);
+
+/// Serialise spill header and columns (packed by hit_codec if requested) into an uncompressed payload.
+void encodeSpill(const SpillRecord& record, const HitColumns& columns, std::vector<char>& payload, bool packed = false);
+
+/// Deserialise uncompressed payload. Hit ranges of the record are left untouched.
+void decodeSpill(const std::vector<char>& payload, SpillRecord& record, HitColumns& columns, bool packed = false);
+
+/// Compress payload with zlib. Returns false if it did not shrink, leaving `output` unspecified.
+bool compressPayload(const std::vector<char>& input, std::vector<char>& output, int level);
+
+/// Decompress payload into a buffer of the expected raw size.
+void decompressPayload(const char* input, std::size_t input_size, std::vector<char>& output, std::size_t raw_size);
+
+}
@@ -0,0 +1,50 @@
+/**
+ * BinaryRunFileReader - Reader of run files in the native binary format
+ *
+ * Spills are located using the footer index. If the footer is missing (e.g. because
+ * DAQonite did not close the file), the index is rebuilt by scanning the blocks.
+ * Spills can be read concurrently from multiple threads.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binary_format.h"
+#include "hit_columns.h"
+#include "records.h"
+
+class BinaryRunFileReader {
+public:
+    explicit BinaryRunFileReader(const std::string& path);
+    ~BinaryRunFileReader();
+
+    // no copy semantics
+    BinaryRunFileReader(const BinaryRunFileReader& other) = delete;
+    BinaryRunFileReader& operator=(const BinaryRunFileReader& other) = delete;
+
+    /// Run parameters from the end of the run if available, otherwise from its start.
+    inline const RunParameters& runParameters() const { return run_params_; }
+
+    /// False if the file was not closed properly and had to be recovered.
+    inline bool isComplete() const { return complete_; }
+
+    inline const std::vector<binary_format::SpillIndexEntry>& index() const { return index_; }
+
+    /// Read spill by its position in the index. Hit ranges of the record are left untouched.
+    void readSpill(std::size_t spill_index, SpillRecord& record, HitColumns& columns) const;
+
+private:
+    int fd_;
+    std::uint64_t file_size_;
+    bool complete_;
+    RunParameters run_params_;
+    std::vector<binary_format::SpillIndexEntry> index_;
+
+    bool readFooter();
+    void scanBlocks();
+    bool readBlock(std::uint64_t offset, binary_format::BlockHeader& header, std::vector<char>& payload) const;
+    void readExactly(std::uint64_t offset, void* data, std::size_t size) const;
+};
@@ -0,0 +1,53 @@
+/**
+ * DirectFileWriter - Sequential file output in large aligned chunks
+ *
+ * Data is accumulated in a buffer and written out only in multiples of the block
+ * size, which allows the file to be opened with O_DIRECT, bypassing the page cache.
+ * If the file system does not support O_DIRECT, regular buffered I/O is used instead.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class DirectFileWriter {
+public:
+    static constexpr std::size_t ALIGNMENT { 4096 }; ///< Block size required by O_DIRECT
+
+    /// Open the file for writing, truncating it. Buffer size is rounded up to a multiple of ALIGNMENT.
+    explicit DirectFileWriter(const std::string& path, std::size_t buffer_size, bool direct_io);
+    ~DirectFileWriter();
+
+    // no copy semantics
+    DirectFileWriter(const DirectFileWriter& other) = delete;
+    DirectFileWriter& operator=(const DirectFileWriter& other) = delete;
+
+    inline bool isOpen() const { return fd_ >= 0; }
+    inline bool isDirect() const { return direct_; }
+
+    /// Logical size of the file, including data still held in the buffer [B].
+    inline std::uint64_t offset() const { return file_offset_ + buffer_fill_; }
+
+    /// Number of bytes written to disk so far [B].
+    inline std::uint64_t bytesWritten() const { return file_offset_; }
+
+    /// Append data to the file.
+    void write(const void* data, std::size_t size);
+
+    /// Write out all complete blocks in the buffer.
+    void flush();
+
+    /// Write out remaining data and close the file.
+    void close();
+
+private:
+    int fd_;
+    bool direct_;
+    char* buffer_;
+    std::size_t buffer_size_;
+    std::size_t buffer_fill_;
+    std::uint64_t file_offset_;
+
+    void writeOut(std::size_t size);
+};
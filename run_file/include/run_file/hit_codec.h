@@ -0,0 +1,45 @@
+/**
+ * HitCodec - Compact encoding of the optical hits of a single spill
+ *
+ * Most of a plain hit column is redundant: seconds hardly change within a spill, only a
+ * few dozen planes exist, and consecutive hits are close in time. The encoding stores
+ *
+ *   - a header with the base time (first hit) and a dictionary of plane numbers,
+ *   - times as zigzag varints of the differences (or differences of differences,
+ *     whichever is smaller for the spill) of nanoseconds since the base time,
+ *   - plane index, channel, ToT, ADC and flags bit-packed with per-spill widths.
+ *
+ * Hits typically take 3-5 B instead of HitColumns::BYTES_PER_HIT, before any
+ * general-purpose compression. Encoding is lossless for any valid timestamps
+ * (nanoseconds below a second), including unsorted hits. All integers are stored in little-endian byte order.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "hit_columns.h"
+
+namespace hit_codec {
+
+static constexpr std::uint8_t VERSION { 1 };
+
+/// How timestamps are differenced.
+enum class TimeEncoding : std::uint8_t {
+    Delta = 1, ///< t[i] - t[i-1]
+    DeltaOfDelta = 2 ///< (t[i] - t[i-1]) - (t[i-1] - t[i-2])
+};
+
+/// Encode hits and append them to `output`.
+void encode(const HitColumns& columns, std::vector<char>& output);
+
+/// Decode hits produced by encode(), replacing contents of `columns`.
+void decode(const char* data, std::size_t size, HitColumns& columns);
+
+inline void decode(const std::vector<char>& data, HitColumns& columns)
+{
+    decode(data.data(), data.size(), columns);
+}
+
+}
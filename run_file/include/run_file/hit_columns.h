@@ -0,0 +1,42 @@
+/**
+ * HitColumns - Optical hits of a single spill in structure-of-arrays layout.
+ *
+ * Every field of PMTHit is stored in a contiguous array of its own, which allows to write
+ * an entire spill at once instead of hit by hit, and compresses better since values of the
+ * same kind end up next to each other.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <util/pmt_hit_queues.h>
+
+struct HitColumns {
+    std::vector<std::uint32_t> plane_number {};
+    std::vector<std::uint8_t> channel_number {};
+    std::vector<std::uint64_t> tai_time_s {};
+    std::vector<std::uint32_t> tai_time_ns {};
+    std::vector<std::uint16_t> tot {};
+    std::vector<std::uint16_t> adc0 {};
+    std::vector<std::uint8_t> flags {}; ///< Bitmap, see `run_file::HIT_FLAG_*`
+
+    /// Size of all columns of a single hit [B].
+    static constexpr std::size_t BYTES_PER_HIT { 4 + 1 + 8 + 4 + 2 + 2 + 1 };
+
+    /// Number of hits.
+    inline std::size_t size() const { return plane_number.size(); }
+
+    /// Resize all columns at once.
+    void resize(std::size_t n_hits);
+
+    /// Replace contents with a sequence of hits.
+    void assign(const PMTHitQueue& hits);
+
+    /// Reconstruct a single hit.
+    void get(std::size_t index, PMTHit& hit) const;
+
+    /// Reconstruct hits in [begin, end) and append them to a queue.
+    void append(std::size_t begin, std::size_t end, PMTHitQueue& output) const;
+};
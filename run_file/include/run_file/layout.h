@@ -0,0 +1,54 @@
+/**
+ * Layout - Names and variants of the data structures stored in CHIPS run files.
+ *
+ * Shared by DAQonite, which writes run files, and by offline readers.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/// How optical hits are laid out in the run file.
+enum class HitLayout : int {
+    PerHit, ///< Tree "opt_hits", one entry per hit (array-of-structures)
+    Columnar, ///< Tree "opt_hit_columns", one entry per spill with array branches (structure-of-arrays)
+    Packed ///< Tree "opt_hits_packed", one entry per spill with hits encoded by hit_codec in a byte array
+};
+
+/// Container format of run files.
+enum class RunFileFormat : int {
+    Root, ///< ROOT file with trees, readable by RunFileReader
+    Binary ///< Native format (see binary_format.h), converted to ROOT offline by daqonite_convert
+};
+
+namespace run_file {
+static constexpr const char* RUN_PARAMS_TREE { "run_params" };
+static constexpr const char* SPILLS_TREE { "spills" };
+static constexpr const char* OPT_HITS_TREE { "opt_hits" };
+static constexpr const char* OPT_HIT_COLUMNS_TREE { "opt_hit_columns" };
+static constexpr const char* OPT_HITS_PACKED_TREE { "opt_hits_packed" };
+static constexpr const char* OPT_ANNOTATIONS_TREE { "opt_annotations" };
+static constexpr const char* TDU_SIGNALS_TREE { "tdu_signals" };
+static constexpr const char* EVENTS_TREE { "events" };
+static constexpr const char* TIME_INDEX_TREE { "opt_hits_time_index" };
+static constexpr const char* PLANE_INDEX_TREE { "opt_hits_plane_index" };
+static constexpr const char* CHANNEL_SUMMARIES_TREE { "channel_summaries" };
+static constexpr const char* SPILL_SUMMARIES_TREE { "spill_summaries" };
+
+/// Bits of the `flags` column in the columnar layout.
+static constexpr std::uint8_t HIT_FLAG_CPU_TRIGGER { 1 << 0 };
+
+/// Parse layout name (per_hit|columnar|packed).
+HitLayout parseHitLayout(const std::string& name);
+
+const char* formatHitLayout(HitLayout layout);
+
+/// Parse format name (root|binary).
+RunFileFormat parseRunFileFormat(const std::string& name);
+
+const char* formatRunFileFormat(RunFileFormat format);
+
+/// File name extension (without the dot) of run files in the given format.
+const char* runFileExtension(RunFileFormat format);
+}
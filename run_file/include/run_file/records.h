@@ -0,0 +1,104 @@
+/**
+ * Records - Plain descriptions of runs and spills, independent of the format of the run file.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <util/timestamp.h>
+
+/// Information about the run as a whole.
+struct RunParameters {
+    std::uint64_t number {};
+    std::uint8_t type {}; ///< Numeric value of RunType
+    utc_timestamp time_started {};
+    utc_timestamp time_stopped {};
+};
+
+/// Single entry of the "spills" tree.
+struct SpillRecord {
+    std::uint64_t number {};
+    tai_timestamp time_started {};
+    tai_timestamp time_stopped {};
+    std::uint64_t opt_hits_begin {}; ///< Global index of the first hit
+    std::uint64_t opt_hits_end {}; ///< Global index past the last hit
+    std::uint64_t opt_annotations_begin {};
+    std::uint64_t opt_annotations_end {};
+
+    inline std::uint64_t nHits() const { return opt_hits_end - opt_hits_begin; }
+};
+
+/// Single entry of the time index, a range of hits within a time bucket of a spill.
+struct TimeIndexEntry {
+    std::uint64_t bucket {}; ///< TAI time [ns] divided by bucket width
+    std::uint64_t opt_hits_begin {};
+    std::uint64_t opt_hits_end {};
+};
+
+/// Single entry of the plane index, a range of hits containing a plane within a spill.
+struct PlaneIndexEntry {
+    std::uint64_t spill_number {};
+    std::uint32_t plane_number {};
+    std::uint64_t opt_hits_begin {};
+    std::uint64_t opt_hits_end {};
+    std::uint64_t n_hits {};
+};
+
+/// Coincidence of hits found by the event builder.
+struct EventRecord {
+    std::uint64_t spill_number {};
+    std::uint64_t opt_hits_begin {}; ///< Index of the first hit (within the spill while building, global once stored)
+    std::uint64_t opt_hits_end {}; ///< Index past the last hit
+    std::uint32_t n_planes {}; ///< Number of distinct planes in the triggering window
+    std::uint32_t n_channels {}; ///< Number of distinct channels in the triggering window
+    tai_timestamp time_first {};
+    tai_timestamp time_last {};
+};
+
+/// Hit rate and spectra summary of a single channel within a spill.
+struct ChannelSummaryRecord {
+    std::uint64_t spill_number {};
+    std::uint32_t plane_number {};
+    std::uint8_t channel_number {};
+    std::uint32_t n_hits {};
+    double rate_hz {}; ///< Hits per second of spill duration
+    double tot_mean {};
+    double tot_rms {};
+    double adc0_mean {}; ///< Zero for channels without ADC0
+    double adc0_rms {};
+};
+
+/// Data quality summary of a spill, with per-plane breakdowns stored as parallel columns.
+struct SpillSummaryRecord {
+    std::uint64_t spill_number {};
+    std::uint64_t n_hits {};
+    std::uint32_t n_channels {}; ///< Number of (plane, channel) pairs with hits
+    std::uint64_t n_displaced {}; ///< Number of hits received out of order
+    double disorder {}; ///< Average displacement of hits from their sorted positions
+    std::uint64_t n_swaps {};
+    std::uint64_t n_gaps {}; ///< Number of intervals without hits from a plane
+    tai_timestamp time_first {}; ///< Time of the earliest hit
+    tai_timestamp time_last {}; ///< Time of the latest hit
+    double merge_ms {}; ///< Time spent consolidating data slots
+    double sort_ms {};
+    double build_ms {}; ///< Time spent building events
+    double write_ms {}; ///< Time spent storing the spill, excluding checkpoints
+    double arrival_to_decode_p50_us {}; ///< Time datagrams spent in the receive queue and being decoded
+    double arrival_to_decode_p99_us {};
+    double arrival_to_decode_max_us {};
+    double decode_to_slot_p50_us {}; ///< Time datagrams waited for the data slot after being decoded
+    double decode_to_slot_p99_us {};
+    double decode_to_slot_max_us {};
+    double end_to_close_ms {}; ///< From the arrival of the last datagram until the spill was closed
+    double close_to_written_ms {}; ///< From closing until the spill was sorted and written
+
+    std::vector<std::uint32_t> plane_number {};
+    std::vector<std::uint64_t> plane_n_hits {};
+    std::vector<std::uint32_t> plane_n_channels {};
+    std::vector<std::uint64_t> plane_n_displaced {};
+    std::vector<std::uint64_t> plane_n_gaps {};
+
+    inline std::size_t nPlanes() const { return plane_number.size(); }
+};
@@ -0,0 +1,96 @@
+/**
+ * RunFileReader - Reader of CHIPS run files
+ *
+ * Provides a uniform per-hit view of optical hits regardless of the layout
+ * used by DAQonite when the file was written. Hits are addressed by their
+ * global index, as referenced by the "spills" tree. If the file contains
+ * index trees, time windows and planes are located without scanning.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <util/pmt_hit_queues.h>
+
+#include "hit_columns.h"
+#include "layout.h"
+#include "records.h"
+
+class RunFileReader {
+public:
+    explicit RunFileReader(const std::string& path);
+
+    // no copy semantics
+    RunFileReader(const RunFileReader& other) = delete;
+    RunFileReader& operator=(const RunFileReader& other) = delete;
+
+    inline HitLayout hitLayout() const { return layout_; }
+    inline const std::vector<SpillRecord>& spills() const { return spills_; }
+    std::uint64_t nHits() const;
+
+    /// Read a single hit by its global index.
+    void readHit(std::uint64_t index, PMTHit& hit);
+
+    /// Read hits with global indices in [begin, end) and append them to a queue.
+    void readHits(std::uint64_t begin, std::uint64_t end, PMTHitQueue& output);
+
+    /// Read all hits of a spill (by its position in the "spills" tree) and append them to a queue.
+    void readSpillHits(std::size_t spill_index, PMTHitQueue& output);
+
+    /// Events found by the event builder, empty if it was not enabled.
+    inline const std::vector<EventRecord>& events() const { return events_; }
+
+    /// Does the file contain time and plane indices?
+    inline bool hasIndex() const { return bucket_ns_ > 0; }
+
+    /// Read hits with time in [begin, end) and append them to a queue, in order of spills.
+    void readTimeWindow(const tai_timestamp& begin, const tai_timestamp& end, PMTHitQueue& output);
+
+    /// Read hits of a single plane within a spill (by its position in the "spills" tree).
+    void readSpillPlaneHits(std::size_t spill_index, std::uint32_t plane_number, PMTHitQueue& output);
+
+private:
+    std::unique_ptr<TFile> file_;
+    HitLayout layout_;
+    std::vector<SpillRecord> spills_;
+    void readSpills();
+
+    // Per-hit layout
+    TTree* opt_hits_;
+    PMTHit hit_;
+    void bindOptHits();
+
+    // Columnar and packed layouts, columns of the most recently accessed spill are cached
+    TTree* opt_hit_columns_;
+    TTree* opt_hits_packed_;
+    UInt_t n_column_hits_; ///< Bound to the size branch, read before the arrays are sized
+    UInt_t n_packed_bytes_; ///< Bound to the size branch, read before the buffer is sized
+    std::vector<char> packed_;
+    HitColumns columns_;
+    std::size_t columns_spill_;
+    void loadColumns(std::size_t spill_index);
+    void loadPackedColumns(std::size_t spill_index);
+
+    /// Find spill containing hit with the given global index.
+    std::size_t findSpill(std::uint64_t index) const;
+
+    std::vector<EventRecord> events_;
+    void readEvents();
+
+    // Indices, loaded into memory at once
+    std::uint64_t bucket_ns_;
+    std::vector<TimeIndexEntry> time_index_; ///< Sorted by bucket
+    std::vector<PlaneIndexEntry> plane_index_; ///< Sorted by spill and plane
+    void readIndices();
+
+    /// Read hits in [begin, end) and append those matching a predicate.
+    template <typename Predicate>
+    void readHitsIf(std::uint64_t begin, std::uint64_t end, PMTHitQueue& output, Predicate predicate);
+};
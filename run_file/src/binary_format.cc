@@ -0,0 +1,156 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+#include "binary_format.h"
+#include "hit_codec.h"
+
+namespace binary_format {
+
+RunParamsBlock encodeRunParams(const RunParameters& params)
+{
+    RunParamsBlock block {};
+    block.number = params.number;
+    block.time_started_s = params.time_started.secs;
+    block.time_started_ns = params.time_started.nanosecs;
+    block.time_stopped_s = params.time_stopped.secs;
+    block.time_stopped_ns = params.time_stopped.nanosecs;
+    block.type = params.type;
+    return block;
+}
+
+RunParameters decodeRunParams(const RunParamsBlock& block)
+{
+    RunParameters params {};
+    params.number = block.number;
+    params.time_started.secs = block.time_started_s;
+    params.time_started.nanosecs = block.time_started_ns;
+    params.time_stopped.secs = block.time_stopped_s;
+    params.time_stopped.nanosecs = block.time_stopped_ns;
+    params.type = static_cast<std::uint8_t>(block.type);
+    return params;
+}
+
+template <typename T>
+static char* putColumn(char* dst, const std::vector<T>& column)
+{
+    const std::size_t size { column.size() * sizeof(T) };
+    if (size > 0) {
+        std::memcpy(dst, column.data(), size);
+    }
+    return dst + size;
+}
+
+template <typename T>
+static const char* getColumn(const char* src, std::vector<T>& column)
+{
+    const std::size_t size { column.size() * sizeof(T) };
+    if (size > 0) {
+        std::memcpy(column.data(), src, size);
+    }
+    return src + size;
+}
+
+void encodeSpill(const SpillRecord& record, const HitColumns& columns, std::vector<char>& payload, bool packed)
+{
+    SpillBlockHeader header {};
+    header.number = record.number;
+    header.time_started_s = record.time_started.secs;
+    header.time_started_ns = record.time_started.nanosecs;
+    header.time_stopped_s = record.time_stopped.secs;
+    header.time_stopped_ns = record.time_stopped.nanosecs;
+    header.n_hits = columns.size();
+
+    if (packed) {
+        payload.resize(sizeof(header));
+        std::memcpy(payload.data(), &header, sizeof(header));
+        hit_codec::encode(columns, payload);
+        return;
+    }
+
+    payload.resize(sizeof(header) + columns.size() * HIT_COLUMNS_SIZE);
+
+    char* dst { payload.data() };
+    std::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+
+    dst = putColumn(dst, columns.plane_number);
+    dst = putColumn(dst, columns.channel_number);
+    dst = putColumn(dst, columns.tai_time_s);
+    dst = putColumn(dst, columns.tai_time_ns);
+    dst = putColumn(dst, columns.tot);
+    dst = putColumn(dst, columns.adc0);
+    putColumn(dst, columns.flags);
+}
+
+void decodeSpill(const std::vector<char>& payload, SpillRecord& record, HitColumns& columns, bool packed)
+{
+    SpillBlockHeader header {};
+    if (payload.size() < sizeof(header)) {
+        throw std::runtime_error { "Truncated spill block" };
+    }
+
+    const char* src { payload.data() };
+    std::memcpy(&header, src, sizeof(header));
+    src += sizeof(header);
+
+    record.number = header.number;
+    record.time_started.secs = header.time_started_s;
+    record.time_started.nanosecs = header.time_started_ns;
+    record.time_stopped.secs = header.time_stopped_s;
+    record.time_stopped.nanosecs = header.time_stopped_ns;
+
+    if (packed) {
+        hit_codec::decode(src, payload.size() - sizeof(header), columns);
+        if (columns.size() != header.n_hits) {
+            throw std::runtime_error { fmt::format("Spill {} contains {} hits, expected {}",
+                header.number, columns.size(), header.n_hits) };
+        }
+        return;
+    }
+
+    if (payload.size() != sizeof(header) + header.n_hits * HIT_COLUMNS_SIZE) {
+        throw std::runtime_error { fmt::format("Spill {} has {} bytes of payload, expected {}",
+            header.number, payload.size(), sizeof(header) + header.n_hits * HIT_COLUMNS_SIZE) };
+    }
+
+    columns.resize(header.n_hits);
+    src = getColumn(src, columns.plane_number);
+    src = getColumn(src, columns.channel_number);
+    src = getColumn(src, columns.tai_time_s);
+    src = getColumn(src, columns.tai_time_ns);
+    src = getColumn(src, columns.tot);
+    src = getColumn(src, columns.adc0);
+    getColumn(src, columns.flags);
+}
+
+bool compressPayload(const std::vector<char>& input, std::vector<char>& output, int level)
+{
+    uLongf output_size { compressBound(input.size()) };
+    output.resize(output_size);
+
+    const int status { compress2(reinterpret_cast<Bytef*>(output.data()), &output_size,
+        reinterpret_cast<const Bytef*>(input.data()), input.size(), level) };
+    if (status != Z_OK) {
+        throw std::runtime_error { fmt::format("Failed to compress block (zlib error {})", status) };
+    }
+
+    output.resize(output_size);
+    return output_size < input.size();
+}
+
+void decompressPayload(const char* input, std::size_t input_size, std::vector<char>& output, std::size_t raw_size)
+{
+    uLongf output_size { raw_size };
+    output.resize(raw_size);
+
+    const int status { uncompress(reinterpret_cast<Bytef*>(output.data()), &output_size,
+        reinterpret_cast<const Bytef*>(input), input_size) };
+    if (status != Z_OK || output_size != raw_size) {
+        throw std::runtime_error { fmt::format("Failed to decompress block (zlib error {})", status) };
+    }
+}
+
+}
@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "binary_run_file_reader.h"
+
+using namespace binary_format;
+
+BinaryRunFileReader::BinaryRunFileReader(const std::string& path)
+    : fd_ { ::open(path.c_str(), O_RDONLY) }
+    , file_size_ { 0 }
+    , complete_ { false }
+    , run_params_ {}
+    , index_ {}
+{
+    if (fd_ < 0) {
+        throw std::runtime_error { fmt::format("Failed to open '{}': {}", path, std::strerror(errno)) };
+    }
+
+    try {
+        struct stat file_stat {};
+        if (::fstat(fd_, &file_stat) != 0) {
+            throw std::runtime_error { fmt::format("Failed to stat '{}': {}", path, std::strerror(errno)) };
+        }
+        file_size_ = static_cast<std::uint64_t>(file_stat.st_size);
+
+        FileHeader header {};
+        if (file_size_ < sizeof(header)) {
+            throw std::runtime_error { fmt::format("Not a CHIPS run file: '{}'", path) };
+        }
+
+        readExactly(0, &header, sizeof(header));
+        if (header.magic != FILE_MAGIC || header.version != VERSION) {
+            throw std::runtime_error { fmt::format("Not a CHIPS run file (version {}): '{}'", VERSION, path) };
+        }
+
+        complete_ = readFooter();
+        if (!complete_) {
+            scanBlocks();
+        }
+    } catch (const std::exception&) {
+        // the destructor is not called if the constructor throws
+        ::close(fd_);
+        throw;
+    }
+}
+
+BinaryRunFileReader::~BinaryRunFileReader()
+{
+    ::close(fd_);
+}
+
+bool BinaryRunFileReader::readFooter()
+{
+    FileTrailer trailer {};
+    if (file_size_ < sizeof(FileHeader) + sizeof(trailer)) {
+        return false;
+    }
+
+    readExactly(file_size_ - sizeof(trailer), &trailer, sizeof(trailer));
+    if (trailer.magic != TRAILER_MAGIC) {
+        return false;
+    }
+
+    BlockHeader block {};
+    std::vector<char> payload {};
+    if (!readBlock(trailer.index_offset, block, payload) || block.type != static_cast<std::uint32_t>(BlockType::SpillIndex)
+        || payload.size() != trailer.n_spills * sizeof(SpillIndexEntry)) {
+        return false;
+    }
+
+    index_.resize(trailer.n_spills);
+    if (!payload.empty()) {
+        std::memcpy(index_.data(), payload.data(), payload.size());
+    }
+
+    if (!readBlock(trailer.run_params_offset, block, payload) || payload.size() != sizeof(RunParamsBlock)) {
+        return false;
+    }
+
+    RunParamsBlock params {};
+    std::memcpy(&params, payload.data(), sizeof(params));
+    run_params_ = decodeRunParams(params);
+    return true;
+}
+
+void BinaryRunFileReader::scanBlocks()
+{
+    index_.clear();
+
+    BlockHeader block {};
+    std::vector<char> payload {};
+    std::uint64_t offset { sizeof(FileHeader) };
+    while (true) {
+        // Recover up to the last good block, the rest may have been torn when DAQonite died.
+        try {
+            if (!readBlock(offset, block, payload)) {
+                break;
+            }
+        } catch (const std::runtime_error&) {
+            break;
+        }
+
+        switch (static_cast<BlockType>(block.type)) {
+        case BlockType::RunParamsStart:
+        case BlockType::RunParamsEnd:
+            if (payload.size() == sizeof(RunParamsBlock)) {
+                RunParamsBlock params {};
+                std::memcpy(&params, payload.data(), sizeof(params));
+                run_params_ = decodeRunParams(params);
+            }
+            break;
+        case BlockType::Spill:
+            if (payload.size() >= sizeof(SpillBlockHeader)) {
+                SpillBlockHeader spill {};
+                std::memcpy(&spill, payload.data(), sizeof(spill));
+
+                SpillIndexEntry entry {};
+                entry.number = spill.number;
+                entry.offset = offset;
+                entry.n_hits = spill.n_hits;
+                entry.time_started_s = spill.time_started_s;
+                entry.time_started_ns = spill.time_started_ns;
+                index_.push_back(entry);
+            }
+            break;
+        default:
+            break;
+        }
+
+        offset += sizeof(block) + block.stored_size;
+    }
+}
+
+bool BinaryRunFileReader::readBlock(std::uint64_t offset, BlockHeader& header, std::vector<char>& payload) const
+{
+    if (offset + sizeof(header) > file_size_) {
+        return false;
+    }
+
+    readExactly(offset, &header, sizeof(header));
+    if (offset + sizeof(header) + header.stored_size > file_size_) {
+        return false;
+    }
+
+    if (header.flags & BLOCK_FLAG_ZLIB) {
+        std::vector<char> stored(header.stored_size);
+        readExactly(offset + sizeof(header), stored.data(), stored.size());
+        decompressPayload(stored.data(), stored.size(), payload, header.raw_size);
+    } else {
+        payload.resize(header.stored_size);
+        readExactly(offset + sizeof(header), payload.data(), payload.size());
+    }
+
+    return true;
+}
+
+void BinaryRunFileReader::readExactly(std::uint64_t offset, void* data, std::size_t size) const
+{
+    char* dst { static_cast<char*>(data) };
+    while (size > 0) {
+        const ssize_t status { ::pread(fd_, dst, size, static_cast<off_t>(offset)) };
+        if (status < 0 && errno == EINTR) {
+            continue;
+        } else if (status <= 0) {
+            throw std::runtime_error { fmt::format("Failed to read run file at offset {}", offset) };
+        }
+
+        dst += status;
+        offset += static_cast<std::uint64_t>(status);
+        size -= static_cast<std::size_t>(status);
+    }
+}
+
+void BinaryRunFileReader::readSpill(std::size_t spill_index, SpillRecord& record, HitColumns& columns) const
+{
+    const SpillIndexEntry& entry { index_.at(spill_index) };
+
+    BlockHeader block {};
+    std::vector<char> payload {};
+    if (!readBlock(entry.offset, block, payload) || block.type != static_cast<std::uint32_t>(BlockType::Spill)) {
+        throw std::runtime_error { fmt::format("Spill {} not found at offset {}", entry.number, entry.offset) };
+    }
+
+    decodeSpill(payload, record, columns, block.flags & BLOCK_FLAG_PACKED_HITS);
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "direct_file_writer.h"
+
+constexpr std::size_t DirectFileWriter::ALIGNMENT;
+
+DirectFileWriter::DirectFileWriter(const std::string& path, std::size_t buffer_size, bool direct_io)
+    : fd_ { -1 }
+    , direct_ { false }
+    , buffer_ { nullptr }
+    , buffer_size_ { (std::max<std::size_t>(buffer_size, ALIGNMENT) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT }
+    , buffer_fill_ { 0 }
+    , file_offset_ { 0 }
+{
+    const int flags { O_WRONLY | O_CREAT | O_TRUNC };
+    const mode_t mode { 0644 };
+
+    if (direct_io) {
+        fd_ = ::open(path.c_str(), flags | O_DIRECT, mode);
+        direct_ = fd_ >= 0;
+    }
+
+    if (fd_ < 0) {
+        // Either not requested or not supported by the file system (EINVAL).
+        fd_ = ::open(path.c_str(), flags, mode);
+    }
+
+    if (fd_ < 0) {
+        throw std::runtime_error { fmt::format("Failed to open '{}' for writing: {}", path, std::strerror(errno)) };
+    }
+
+    // O_DIRECT requires memory aligned to the block size.
+    void* buffer { nullptr };
+    if (posix_memalign(&buffer, ALIGNMENT, buffer_size_) != 0) {
+        ::close(fd_);
+        throw std::runtime_error { fmt::format("Failed to allocate {} bytes of output buffer", buffer_size_) };
+    }
+    buffer_ = static_cast<char*>(buffer);
+}
+
+DirectFileWriter::~DirectFileWriter()
+{
+    try {
+        close();
+    } catch (const std::exception&) {
+        // nothing we can do at this point
+    }
+
+    std::free(buffer_);
+}
+
+void DirectFileWriter::write(const void* data, std::size_t size)
+{
+    const char* src { static_cast<const char*>(data) };
+    while (size > 0) {
+        const std::size_t n_bytes { std::min(size, buffer_size_ - buffer_fill_) };
+        std::memcpy(buffer_ + buffer_fill_, src, n_bytes);
+        buffer_fill_ += n_bytes;
+        src += n_bytes;
+        size -= n_bytes;
+
+        if (buffer_fill_ == buffer_size_) {
+            writeOut(buffer_size_);
+        }
+    }
+}
+
+void DirectFileWriter::flush()
+{
+    writeOut(buffer_fill_ / ALIGNMENT * ALIGNMENT);
+}
+
+void DirectFileWriter::close()
+{
+    if (fd_ < 0) {
+        return;
+    }
+
+    // The last block has to be padded to satisfy O_DIRECT, and the padding removed afterwards.
+    const std::uint64_t file_size { offset() };
+    const std::size_t padded_size { (buffer_fill_ + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT };
+    std::memset(buffer_ + buffer_fill_, 0, padded_size - buffer_fill_);
+    buffer_fill_ = padded_size;
+
+    // The descriptor is closed whatever happens, the destructor would otherwise leak it.
+    try {
+        writeOut(padded_size);
+        if (::ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+            throw std::runtime_error { fmt::format("Failed to truncate output file: {}", std::strerror(errno)) };
+        }
+    } catch (const std::exception&) {
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+    file_offset_ = file_size;
+}
+
+void DirectFileWriter::writeOut(std::size_t size)
+{
+    std::size_t n_written { 0 };
+    while (n_written < size) {
+        const ssize_t status { ::write(fd_, buffer_ + n_written, size - n_written) };
+        if (status < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error { fmt::format("Failed to write output file: {}", std::strerror(errno)) };
+        }
+        n_written += static_cast<std::size_t>(status);
+    }
+
+    file_offset_ += size;
+    buffer_fill_ -= size;
+    if (buffer_fill_ > 0) {
+        std::memmove(buffer_, buffer_ + size, buffer_fill_);
+    }
+}
@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "hit_codec.h"
+
+namespace hit_codec {
+
+static constexpr std::uint64_t NANOSECS_PER_SEC { 1000000000 };
+
+/// Number of bits needed to store values up to `max_value`.
+static std::uint8_t bitWidth(std::uint64_t max_value)
+{
+    std::uint8_t width { 0 };
+    while (max_value > 0) {
+        ++width;
+        max_value >>= 1;
+    }
+    return width;
+}
+
+static std::uint64_t zigzag(std::uint64_t value)
+{
+    return (value << 1) ^ static_cast<std::uint64_t>(static_cast<std::int64_t>(value) >> 63);
+}
+
+static std::uint64_t unzigzag(std::uint64_t value)
+{
+    return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+static std::size_t varintSize(std::uint64_t value)
+{
+    std::size_t size { 1 };
+    while (value >= 0x80) {
+        ++size;
+        value >>= 7;
+    }
+    return size;
+}
+
+static void putVarint(std::vector<char>& output, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        output.push_back(static_cast<char>(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+/// Sequential reader, which throws rather than reading past the end.
+class ByteReader {
+public:
+    ByteReader(const char* data, std::size_t size)
+        : data_ { reinterpret_cast<const std::uint8_t*>(data) }
+        , end_ { data_ + size }
+    {
+    }
+
+    std::uint8_t byte()
+    {
+        if (data_ == end_) {
+            throw std::runtime_error { "Truncated hit encoding" };
+        }
+        return *data_++;
+    }
+
+    std::uint64_t varint()
+    {
+        std::uint64_t value { 0 };
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const std::uint8_t b { byte() };
+            value |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error { "Malformed varint in hit encoding" };
+    }
+
+    std::size_t remaining() const { return static_cast<std::size_t>(end_ - data_); }
+    const std::uint8_t* position() const { return data_; }
+
+private:
+    const std::uint8_t* data_;
+    const std::uint8_t* end_;
+};
+
+/// Packs fields of up to 32 bits, least significant bit first.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<char>& output)
+        : output_ { output }
+        , buffer_ { 0 }
+        , n_bits_ { 0 }
+    {
+    }
+
+    void put(std::uint32_t value, std::uint8_t width)
+    {
+        buffer_ |= static_cast<std::uint64_t>(value) << n_bits_;
+        n_bits_ += width;
+        while (n_bits_ >= 8) {
+            output_.push_back(static_cast<char>(buffer_ & 0xFF));
+            buffer_ >>= 8;
+            n_bits_ -= 8;
+        }
+    }
+
+    void finish()
+    {
+        if (n_bits_ > 0) {
+            output_.push_back(static_cast<char>(buffer_ & 0xFF));
+        }
+        buffer_ = 0;
+        n_bits_ = 0;
+    }
+
+private:
+    std::vector<char>& output_;
+    std::uint64_t buffer_;
+    unsigned n_bits_;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const std::uint8_t* data)
+        : data_ { data }
+        , buffer_ { 0 }
+        , n_bits_ { 0 }
+    {
+    }
+
+    std::uint32_t get(std::uint8_t width)
+    {
+        while (n_bits_ < width) {
+            buffer_ |= static_cast<std::uint64_t>(*data_++) << n_bits_;
+            n_bits_ += 8;
+        }
+
+        const std::uint32_t value { static_cast<std::uint32_t>(buffer_ & ((std::uint64_t { 1 } << width) - 1)) };
+        buffer_ >>= width;
+        n_bits_ -= width;
+        return value;
+    }
+
+private:
+    const std::uint8_t* data_;
+    std::uint64_t buffer_;
+    unsigned n_bits_;
+};
+
+void encode(const HitColumns& columns, std::vector<char>& output)
+{
+    const std::size_t n_hits { columns.size() };
+
+    const std::uint64_t base_s { n_hits > 0 ? columns.tai_time_s[0] : 0 };
+    const std::uint64_t base_ns { n_hits > 0 ? columns.tai_time_ns[0] : 0 };
+
+    // Plane dictionary, sorted to allow a binary search.
+    std::vector<std::uint32_t> planes { columns.plane_number };
+    std::sort(planes.begin(), planes.end());
+    planes.erase(std::unique(planes.begin(), planes.end()), planes.end());
+
+    std::uint8_t max_channel { 0 };
+    std::uint16_t max_tot { 0 };
+    std::uint16_t max_adc0 { 0 };
+    std::uint8_t max_flags { 0 };
+    for (std::size_t i = 0; i < n_hits; ++i) {
+        max_channel = std::max(max_channel, columns.channel_number[i]);
+        max_tot = std::max(max_tot, columns.tot[i]);
+        max_adc0 = std::max(max_adc0, columns.adc0[i]);
+        max_flags = std::max(max_flags, columns.flags[i]);
+    }
+
+    // Nanoseconds since the base time, with modular arithmetic, so that any input round-trips.
+    std::vector<std::uint64_t> times(n_hits);
+    for (std::size_t i = 0; i < n_hits; ++i) {
+        times[i] = (columns.tai_time_s[i] - base_s) * NANOSECS_PER_SEC + columns.tai_time_ns[i] - base_ns;
+    }
+
+    // Delta-of-delta wins for regular sequences, plain deltas for random arrivals.
+    std::size_t delta_size { 0 };
+    std::size_t dod_size { 0 };
+    for (std::size_t i = 1; i < n_hits; ++i) {
+        const std::uint64_t delta { times[i] - times[i - 1] };
+        const std::uint64_t previous_delta { i > 1 ? times[i - 1] - times[i - 2] : 0 };
+        delta_size += varintSize(zigzag(delta));
+        dod_size += varintSize(zigzag(delta - previous_delta));
+    }
+    const TimeEncoding time_encoding { dod_size < delta_size ? TimeEncoding::DeltaOfDelta : TimeEncoding::Delta };
+
+    const std::uint8_t plane_bits { bitWidth(planes.empty() ? 0 : planes.size() - 1) };
+    const std::uint8_t channel_bits { bitWidth(max_channel) };
+    const std::uint8_t tot_bits { bitWidth(max_tot) };
+    const std::uint8_t adc0_bits { bitWidth(max_adc0) };
+    const std::uint8_t flags_bits { bitWidth(max_flags) };
+    const std::size_t bits_per_hit { static_cast<std::size_t>(plane_bits) + channel_bits + tot_bits + adc0_bits + flags_bits };
+
+    output.reserve(output.size() + 64 + planes.size() * 2 + std::min(delta_size, dod_size) + (n_hits * bits_per_hit + 7) / 8);
+
+    // Header
+    output.push_back(static_cast<char>(VERSION));
+    output.push_back(static_cast<char>(time_encoding));
+    output.push_back(static_cast<char>(plane_bits));
+    output.push_back(static_cast<char>(channel_bits));
+    output.push_back(static_cast<char>(tot_bits));
+    output.push_back(static_cast<char>(adc0_bits));
+    output.push_back(static_cast<char>(flags_bits));
+    putVarint(output, n_hits);
+    putVarint(output, base_s);
+    putVarint(output, base_ns);
+
+    putVarint(output, planes.size());
+    std::uint32_t previous_plane { 0 };
+    for (const std::uint32_t plane : planes) {
+        putVarint(output, plane - previous_plane);
+        previous_plane = plane;
+    }
+
+    // Times (the first hit is at the base time)
+    for (std::size_t i = 1; i < n_hits; ++i) {
+        const std::uint64_t delta { times[i] - times[i - 1] };
+        if (time_encoding == TimeEncoding::DeltaOfDelta) {
+            const std::uint64_t previous_delta { i > 1 ? times[i - 1] - times[i - 2] : 0 };
+            putVarint(output, zigzag(delta - previous_delta));
+        } else {
+            putVarint(output, zigzag(delta));
+        }
+    }
+
+    // Bit-packed fields
+    BitWriter writer { output };
+    for (std::size_t i = 0; i < n_hits; ++i) {
+        const auto plane { std::lower_bound(planes.begin(), planes.end(), columns.plane_number[i]) };
+        writer.put(static_cast<std::uint32_t>(plane - planes.begin()), plane_bits);
+        writer.put(columns.channel_number[i], channel_bits);
+        writer.put(columns.tot[i], tot_bits);
+        writer.put(columns.adc0[i], adc0_bits);
+        writer.put(columns.flags[i], flags_bits);
+    }
+    writer.finish();
+}
+
+void decode(const char* data, std::size_t size, HitColumns& columns)
+{
+    ByteReader reader { data, size };
+
+    const std::uint8_t version { reader.byte() };
+    if (version != VERSION) {
+        throw std::runtime_error { fmt::format("Unsupported hit encoding version {}", version) };
+    }
+
+    const TimeEncoding time_encoding { static_cast<TimeEncoding>(reader.byte()) };
+    if (time_encoding != TimeEncoding::Delta && time_encoding != TimeEncoding::DeltaOfDelta) {
+        throw std::runtime_error { fmt::format("Unknown time encoding {}", static_cast<int>(time_encoding)) };
+    }
+
+    const std::uint8_t plane_bits { reader.byte() };
+    const std::uint8_t channel_bits { reader.byte() };
+    const std::uint8_t tot_bits { reader.byte() };
+    const std::uint8_t adc0_bits { reader.byte() };
+    const std::uint8_t flags_bits { reader.byte() };
+    if (plane_bits > 32 || channel_bits > 8 || tot_bits > 16 || adc0_bits > 16 || flags_bits > 8) {
+        throw std::runtime_error { "Invalid field widths in hit encoding" };
+    }
+
+    const std::uint64_t n_hits { reader.varint() };
+    const std::uint64_t base_s { reader.varint() };
+    const std::uint64_t base_ns { reader.varint() };
+
+    // Every hit but the first takes at least a byte of time differences.
+    if (n_hits > 0 && n_hits - 1 > reader.remaining()) {
+        throw std::runtime_error { fmt::format("Hit encoding of {} bytes cannot hold {} hits", size, n_hits) };
+    }
+
+    const std::uint64_t n_planes { reader.varint() };
+    if (n_planes > reader.remaining()) {
+        throw std::runtime_error { "Truncated plane dictionary in hit encoding" };
+    }
+
+    std::vector<std::uint32_t> planes(n_planes);
+    std::uint32_t plane { 0 };
+    for (std::uint64_t i = 0; i < n_planes; ++i) {
+        plane += static_cast<std::uint32_t>(reader.varint());
+        planes[i] = plane;
+    }
+
+    columns.resize(n_hits);
+
+    std::uint64_t time { 0 };
+    std::uint64_t delta { 0 };
+    for (std::uint64_t i = 0; i < n_hits; ++i) {
+        if (i > 0) {
+            const std::uint64_t value { unzigzag(reader.varint()) };
+            delta = time_encoding == TimeEncoding::DeltaOfDelta ? delta + value : value;
+            time += delta;
+        }
+
+        // Signed, since unsorted hits may precede the base time.
+        const std::int64_t offset_ns { static_cast<std::int64_t>(time + base_ns) };
+        std::int64_t secs { offset_ns / static_cast<std::int64_t>(NANOSECS_PER_SEC) };
+        std::int64_t nanosecs { offset_ns % static_cast<std::int64_t>(NANOSECS_PER_SEC) };
+        if (nanosecs < 0) {
+            --secs;
+            nanosecs += NANOSECS_PER_SEC;
+        }
+
+        columns.tai_time_s[i] = base_s + static_cast<std::uint64_t>(secs);
+        columns.tai_time_ns[i] = static_cast<std::uint32_t>(nanosecs);
+    }
+
+    const std::size_t bits_per_hit { static_cast<std::size_t>(plane_bits) + channel_bits + tot_bits + adc0_bits + flags_bits };
+    const std::size_t packed_size { (n_hits * bits_per_hit + 7) / 8 };
+    if (reader.remaining() != packed_size) {
+        throw std::runtime_error { fmt::format("Hit encoding has {} bytes of packed fields, expected {}",
+            reader.remaining(), packed_size) };
+    }
+
+    BitReader bits { reader.position() };
+    for (std::uint64_t i = 0; i < n_hits; ++i) {
+        const std::uint32_t plane_index { bits.get(plane_bits) };
+        if (plane_index >= planes.size()) {
+            throw std::runtime_error { fmt::format("Plane index {} out of dictionary range", plane_index) };
+        }
+
+        columns.plane_number[i] = planes[plane_index];
+        columns.channel_number[i] = static_cast<std::uint8_t>(bits.get(channel_bits));
+        columns.tot[i] = static_cast<std::uint16_t>(bits.get(tot_bits));
+        columns.adc0[i] = static_cast<std::uint16_t>(bits.get(adc0_bits));
+        columns.flags[i] = static_cast<std::uint8_t>(bits.get(flags_bits));
+    }
+}
+
+}
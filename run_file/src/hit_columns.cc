@@ -0,0 +1,51 @@
+#include "hit_columns.h"
+#include "layout.h"
+
+void HitColumns::resize(std::size_t n_hits)
+{
+    plane_number.resize(n_hits);
+    channel_number.resize(n_hits);
+    tai_time_s.resize(n_hits);
+    tai_time_ns.resize(n_hits);
+    tot.resize(n_hits);
+    adc0.resize(n_hits);
+    flags.resize(n_hits);
+}
+
+void HitColumns::assign(const PMTHitQueue& hits)
+{
+    const std::size_t n_hits { hits.size() };
+    resize(n_hits);
+
+    for (std::size_t i = 0; i < n_hits; ++i) {
+        const PMTHit& hit { hits[i] };
+        plane_number[i] = hit.plane_number;
+        channel_number[i] = hit.channel_number;
+        tai_time_s[i] = hit.timestamp.secs;
+        tai_time_ns[i] = hit.timestamp.nanosecs;
+        tot[i] = hit.tot;
+        adc0[i] = hit.adc0;
+        flags[i] = hit.cpu_trigger ? run_file::HIT_FLAG_CPU_TRIGGER : 0;
+    }
+}
+
+void HitColumns::get(std::size_t index, PMTHit& hit) const
+{
+    hit.plane_number = plane_number[index];
+    hit.channel_number = channel_number[index];
+    hit.timestamp.secs = tai_time_s[index];
+    hit.timestamp.nanosecs = tai_time_ns[index];
+    hit.tot = tot[index];
+    hit.adc0 = adc0[index];
+    hit.cpu_trigger = 0 != (flags[index] & run_file::HIT_FLAG_CPU_TRIGGER);
+    hit.sort_key = hit.timestamp.combined_secs();
+}
+
+void HitColumns::append(std::size_t begin, std::size_t end, PMTHitQueue& output) const
+{
+    output.reserve(output.size() + (end - begin));
+    for (std::size_t i = begin; i < end; ++i) {
+        output.emplace_back();
+        get(i, output.back());
+    }
+}
@@ -0,0 +1,70 @@
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "layout.h"
+
+namespace run_file {
+
+HitLayout parseHitLayout(const std::string& name)
+{
+    if (name == "per_hit") {
+        return HitLayout::PerHit;
+    } else if (name == "columnar") {
+        return HitLayout::Columnar;
+    } else if (name == "packed") {
+        return HitLayout::Packed;
+    }
+
+    throw std::runtime_error { fmt::format("Unknown hit layout: '{}'", name) };
+}
+
+const char* formatHitLayout(HitLayout layout)
+{
+    switch (layout) {
+    case HitLayout::PerHit:
+        return "per_hit";
+    case HitLayout::Columnar:
+        return "columnar";
+    case HitLayout::Packed:
+        return "packed";
+    default:
+        return "unknown";
+    }
+}
+
+RunFileFormat parseRunFileFormat(const std::string& name)
+{
+    if (name == "root") {
+        return RunFileFormat::Root;
+    } else if (name == "binary") {
+        return RunFileFormat::Binary;
+    }
+
+    throw std::runtime_error { fmt::format("Unknown run file format: '{}'", name) };
+}
+
+const char* formatRunFileFormat(RunFileFormat format)
+{
+    switch (format) {
+    case RunFileFormat::Root:
+        return "root";
+    case RunFileFormat::Binary:
+        return "binary";
+    default:
+        return "unknown";
+    }
+}
+
+const char* runFileExtension(RunFileFormat format)
+{
+    switch (format) {
+    case RunFileFormat::Binary:
+        return "chipsrun";
+    case RunFileFormat::Root:
+    default:
+        return "root";
+    }
+}
+
+}
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "hit_codec.h"
+#include "run_file_reader.h"
+
+RunFileReader::RunFileReader(const std::string& path)
+    : file_ { TFile::Open(path.c_str(), "READ") }
+    , layout_ { HitLayout::PerHit }
+    , spills_ {}
+    , opt_hits_ { nullptr }
+    , hit_ {}
+    , opt_hit_columns_ { nullptr }
+    , opt_hits_packed_ { nullptr }
+    , n_column_hits_ { 0 }
+    , n_packed_bytes_ { 0 }
+    , packed_ {}
+    , columns_ {}
+    , columns_spill_ { SIZE_MAX }
+    , events_ {}
+    , bucket_ns_ { 0 }
+    , time_index_ {}
+    , plane_index_ {}
+{
+    if (!file_ || !file_->IsOpen() || file_->IsZombie()) {
+        throw std::runtime_error { fmt::format("Failed to open run file: '{}'", path) };
+    }
+
+    // Layout is recognised by the trees present in the file.
+    file_->GetObject(run_file::OPT_HIT_COLUMNS_TREE, opt_hit_columns_);
+    file_->GetObject(run_file::OPT_HITS_PACKED_TREE, opt_hits_packed_);
+    file_->GetObject(run_file::OPT_HITS_TREE, opt_hits_);
+
+    if (opt_hit_columns_) {
+        layout_ = HitLayout::Columnar;
+        opt_hit_columns_->SetBranchAddress("n_hits", &n_column_hits_);
+    } else if (opt_hits_packed_) {
+        layout_ = HitLayout::Packed;
+        opt_hits_packed_->SetBranchAddress("n_bytes", &n_packed_bytes_);
+    } else if (opt_hits_) {
+        layout_ = HitLayout::PerHit;
+        bindOptHits();
+    } else {
+        throw std::runtime_error { fmt::format("Run file contains no optical hits: '{}'", path) };
+    }
+
+    readSpills();
+    readEvents();
+    readIndices();
+}
+
+void RunFileReader::readSpills()
+{
+    TTree* tree { nullptr };
+    file_->GetObject(run_file::SPILLS_TREE, tree);
+    if (!tree) {
+        throw std::runtime_error { "Run file contains no spills tree" };
+    }
+
+    SpillRecord record {};
+    tree->SetBranchAddress("number", &record.number);
+    tree->SetBranchAddress("tai_time_started_s", &record.time_started.secs);
+    tree->SetBranchAddress("tai_time_started_ns", &record.time_started.nanosecs);
+    tree->SetBranchAddress("tai_time_stopped_s", &record.time_stopped.secs);
+    tree->SetBranchAddress("tai_time_stopped_ns", &record.time_stopped.nanosecs);
+    tree->SetBranchAddress("opt_hits_begin", &record.opt_hits_begin);
+    tree->SetBranchAddress("opt_hits_end", &record.opt_hits_end);
+    tree->SetBranchAddress("opt_annotations_begin", &record.opt_annotations_begin);
+    tree->SetBranchAddress("opt_annotations_end", &record.opt_annotations_end);
+
+    const Long64_t n_spills { tree->GetEntries() };
+    spills_.reserve(n_spills);
+    for (Long64_t i = 0; i < n_spills; ++i) {
+        tree->GetEntry(i);
+        spills_.push_back(record);
+    }
+}
+
+void RunFileReader::bindOptHits()
+{
+    opt_hits_->SetBranchAddress("plane_number", &hit_.plane_number);
+    opt_hits_->SetBranchAddress("channel_number", &hit_.channel_number);
+    opt_hits_->SetBranchAddress("tai_time_s", &hit_.timestamp.secs);
+    opt_hits_->SetBranchAddress("tai_time_ns", &hit_.timestamp.nanosecs);
+    opt_hits_->SetBranchAddress("tot", &hit_.tot);
+    opt_hits_->SetBranchAddress("adc0", &hit_.adc0);
+    opt_hits_->SetBranchAddress("cpu_trigger", &hit_.cpu_trigger);
+}
+
+std::uint64_t RunFileReader::nHits() const
+{
+    if (layout_ == HitLayout::PerHit) {
+        return opt_hits_->GetEntries();
+    }
+
+    return spills_.empty() ? 0 : spills_.back().opt_hits_end;
+}
+
+std::size_t RunFileReader::findSpill(std::uint64_t index) const
+{
+    // Spills are stored in order, hence their hit ranges are ascending.
+    const auto it { std::upper_bound(spills_.begin(), spills_.end(), index,
+        [](std::uint64_t value, const SpillRecord& spill) { return value < spill.opt_hits_end; }) };
+
+    if (it == spills_.end() || index < it->opt_hits_begin) {
+        throw std::out_of_range { fmt::format("Hit index {} is out of range", index) };
+    }
+
+    return static_cast<std::size_t>(it - spills_.begin());
+}
+
+void RunFileReader::loadColumns(std::size_t spill_index)
+{
+    if (spill_index == columns_spill_) {
+        return;
+    }
+
+    if (layout_ == HitLayout::Packed) {
+        loadPackedColumns(spill_index);
+        return;
+    }
+
+    // Size of the arrays is read and checked first, so that they can hold the whole entry.
+    columns_spill_ = SIZE_MAX;
+    opt_hit_columns_->GetBranch("n_hits")->GetEntry(static_cast<Long64_t>(spill_index));
+    if (n_column_hits_ != spills_[spill_index].nHits()) {
+        throw std::runtime_error { fmt::format("Spill {} contains {} hits, expected {}",
+            spills_[spill_index].number, n_column_hits_, spills_[spill_index].nHits()) };
+    }
+
+    columns_.resize(n_column_hits_);
+    opt_hit_columns_->SetBranchAddress("plane_number", columns_.plane_number.data());
+    opt_hit_columns_->SetBranchAddress("channel_number", columns_.channel_number.data());
+    opt_hit_columns_->SetBranchAddress("tai_time_s", columns_.tai_time_s.data());
+    opt_hit_columns_->SetBranchAddress("tai_time_ns", columns_.tai_time_ns.data());
+    opt_hit_columns_->SetBranchAddress("tot", columns_.tot.data());
+    opt_hit_columns_->SetBranchAddress("adc0", columns_.adc0.data());
+    opt_hit_columns_->SetBranchAddress("flags", columns_.flags.data());
+    opt_hit_columns_->GetEntry(static_cast<Long64_t>(spill_index));
+
+    columns_spill_ = spill_index;
+}
+
+void RunFileReader::loadPackedColumns(std::size_t spill_index)
+{
+    // Size of the array is read first, so that the buffer can hold the whole entry.
+    opt_hits_packed_->GetBranch("n_bytes")->GetEntry(static_cast<Long64_t>(spill_index));
+
+    packed_.resize(n_packed_bytes_);
+    opt_hits_packed_->SetBranchAddress("data", static_cast<void*>(packed_.data()));
+    opt_hits_packed_->GetBranch("data")->GetEntry(static_cast<Long64_t>(spill_index));
+
+    columns_spill_ = SIZE_MAX;
+    hit_codec::decode(packed_, columns_);
+
+    if (columns_.size() != spills_[spill_index].nHits()) {
+        throw std::runtime_error { fmt::format("Spill {} contains {} hits, expected {}",
+            spills_[spill_index].number, columns_.size(), spills_[spill_index].nHits()) };
+    }
+
+    columns_spill_ = spill_index;
+}
+
+void RunFileReader::readHit(std::uint64_t index, PMTHit& hit)
+{
+    if (layout_ == HitLayout::PerHit) {
+        opt_hits_->GetEntry(static_cast<Long64_t>(index));
+        hit = hit_;
+        hit.sort_key = hit.timestamp.combined_secs();
+        return;
+    }
+
+    const std::size_t spill_index { findSpill(index) };
+    loadColumns(spill_index);
+    columns_.get(index - spills_[spill_index].opt_hits_begin, hit);
+}
+
+void RunFileReader::readHits(std::uint64_t begin, std::uint64_t end, PMTHitQueue& output)
+{
+    if (layout_ == HitLayout::PerHit) {
+        output.reserve(output.size() + (end - begin));
+        for (std::uint64_t index = begin; index < end; ++index) {
+            output.emplace_back();
+            readHit(index, output.back());
+        }
+        return;
+    }
+
+    // Copy whole spans of columns, one spill at a time.
+    while (begin < end) {
+        const std::size_t spill_index { findSpill(begin) };
+        const SpillRecord& spill { spills_[spill_index] };
+        loadColumns(spill_index);
+
+        const std::uint64_t spill_end { std::min(end, spill.opt_hits_end) };
+        columns_.append(begin - spill.opt_hits_begin, spill_end - spill.opt_hits_begin, output);
+        begin = spill_end;
+    }
+}
+
+void RunFileReader::readSpillHits(std::size_t spill_index, PMTHitQueue& output)
+{
+    const SpillRecord& spill { spills_.at(spill_index) };
+    readHits(spill.opt_hits_begin, spill.opt_hits_end, output);
+}
+
+void RunFileReader::readEvents()
+{
+    TTree* tree { nullptr };
+    file_->GetObject(run_file::EVENTS_TREE, tree);
+    if (!tree) {
+        return;
+    }
+
+    EventRecord record {};
+    tree->SetBranchAddress("spill_number", &record.spill_number);
+    tree->SetBranchAddress("opt_hits_begin", &record.opt_hits_begin);
+    tree->SetBranchAddress("opt_hits_end", &record.opt_hits_end);
+    tree->SetBranchAddress("n_planes", &record.n_planes);
+    tree->SetBranchAddress("n_channels", &record.n_channels);
+    tree->SetBranchAddress("tai_time_first_s", &record.time_first.secs);
+    tree->SetBranchAddress("tai_time_first_ns", &record.time_first.nanosecs);
+    tree->SetBranchAddress("tai_time_last_s", &record.time_last.secs);
+    tree->SetBranchAddress("tai_time_last_ns", &record.time_last.nanosecs);
+
+    const Long64_t n_events { tree->GetEntries() };
+    events_.reserve(n_events);
+    for (Long64_t i = 0; i < n_events; ++i) {
+        tree->GetEntry(i);
+        events_.push_back(record);
+    }
+}
+
+void RunFileReader::readIndices()
+{
+    TTree* time_tree { nullptr };
+    TTree* plane_tree { nullptr };
+    file_->GetObject(run_file::TIME_INDEX_TREE, time_tree);
+    file_->GetObject(run_file::PLANE_INDEX_TREE, plane_tree);
+    if (!time_tree || !plane_tree || time_tree->GetEntries() == 0) {
+        return;
+    }
+
+    TimeIndexEntry time_entry {};
+    ULong64_t bucket_ns { 0 };
+    time_tree->SetBranchAddress("bucket", &time_entry.bucket);
+    time_tree->SetBranchAddress("bucket_ns", &bucket_ns);
+    time_tree->SetBranchAddress("opt_hits_begin", &time_entry.opt_hits_begin);
+    time_tree->SetBranchAddress("opt_hits_end", &time_entry.opt_hits_end);
+
+    const Long64_t n_buckets { time_tree->GetEntries() };
+    time_index_.reserve(n_buckets);
+    for (Long64_t i = 0; i < n_buckets; ++i) {
+        time_tree->GetEntry(i);
+        time_index_.push_back(time_entry);
+    }
+
+    // Buckets are sorted within spills, but the same bucket may appear in two adjacent spills.
+    std::stable_sort(time_index_.begin(), time_index_.end(),
+        [](const TimeIndexEntry& lhs, const TimeIndexEntry& rhs) { return lhs.bucket < rhs.bucket; });
+
+    PlaneIndexEntry plane_entry {};
+    plane_tree->SetBranchAddress("spill_number", &plane_entry.spill_number);
+    plane_tree->SetBranchAddress("plane_number", &plane_entry.plane_number);
+    plane_tree->SetBranchAddress("opt_hits_begin", &plane_entry.opt_hits_begin);
+    plane_tree->SetBranchAddress("opt_hits_end", &plane_entry.opt_hits_end);
+    plane_tree->SetBranchAddress("n_hits", &plane_entry.n_hits);
+
+    const Long64_t n_planes { plane_tree->GetEntries() };
+    plane_index_.reserve(n_planes);
+    for (Long64_t i = 0; i < n_planes; ++i) {
+        plane_tree->GetEntry(i);
+        plane_index_.push_back(plane_entry);
+    }
+
+    bucket_ns_ = bucket_ns;
+}
+
+template <typename Predicate>
+void RunFileReader::readHitsIf(std::uint64_t begin, std::uint64_t end, PMTHitQueue& output, Predicate predicate)
+{
+    const std::size_t n_hits { output.size() };
+    readHits(begin, end, output);
+    output.erase(std::remove_if(output.begin() + n_hits, output.end(),
+                     [&predicate](const PMTHit& hit) { return !predicate(hit); }),
+        output.end());
+}
+
+void RunFileReader::readTimeWindow(const tai_timestamp& begin, const tai_timestamp& end, PMTHitQueue& output)
+{
+    const std::uint64_t begin_ns { begin.combined_nanosecs() };
+    const std::uint64_t end_ns { end.combined_nanosecs() };
+    if (end_ns <= begin_ns) {
+        return;
+    }
+
+    const auto in_window = [begin_ns, end_ns](const PMTHit& hit) {
+        const std::uint64_t ns { hit.timestamp.combined_nanosecs() };
+        return ns >= begin_ns && ns < end_ns;
+    };
+
+    // Collect hit ranges of all overlapping buckets, merging adjacent ones.
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges {};
+    if (hasIndex()) {
+        const std::uint64_t first_bucket { begin_ns / bucket_ns_ };
+        const std::uint64_t last_bucket { (end_ns - 1) / bucket_ns_ };
+
+        auto it { std::lower_bound(time_index_.begin(), time_index_.end(), first_bucket,
+            [](const TimeIndexEntry& entry, std::uint64_t bucket) { return entry.bucket < bucket; }) };
+        for (; it != time_index_.end() && it->bucket <= last_bucket; ++it) {
+            ranges.emplace_back(it->opt_hits_begin, it->opt_hits_end);
+        }
+    } else {
+        // Without index, fall back to all spills overlapping the window.
+        for (const SpillRecord& spill : spills_) {
+            if (spill.time_started.combined_nanosecs() < end_ns && spill.time_stopped.combined_nanosecs() >= begin_ns) {
+                ranges.emplace_back(spill.opt_hits_begin, spill.opt_hits_end);
+            }
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    std::size_t n_merged { 0 };
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+        if (n_merged > 0 && ranges[i].first <= ranges[n_merged - 1].second) {
+            ranges[n_merged - 1].second = std::max(ranges[n_merged - 1].second, ranges[i].second);
+        } else {
+            ranges[n_merged++] = ranges[i];
+        }
+    }
+    ranges.resize(n_merged);
+
+    for (const auto& range : ranges) {
+        readHitsIf(range.first, range.second, output, in_window);
+    }
+}
+
+void RunFileReader::readSpillPlaneHits(std::size_t spill_index, std::uint32_t plane_number, PMTHitQueue& output)
+{
+    const SpillRecord& spill { spills_.at(spill_index) };
+    const auto on_plane = [plane_number](const PMTHit& hit) { return hit.plane_number == plane_number; };
+
+    if (!hasIndex()) {
+        readHitsIf(spill.opt_hits_begin, spill.opt_hits_end, output, on_plane);
+        return;
+    }
+
+    const auto it { std::lower_bound(plane_index_.begin(), plane_index_.end(), std::make_pair(spill.number, plane_number),
+        [](const PlaneIndexEntry& entry, const std::pair<std::uint64_t, std::uint32_t>& key) {
+            return std::make_pair(entry.spill_number, entry.plane_number) < key;
+        }) };
+
+    if (it != plane_index_.end() && it->spill_number == spill.number && it->plane_number == plane_number) {
+        readHitsIf(it->opt_hits_begin, it->opt_hits_end, output, on_plane);
+    }
+}
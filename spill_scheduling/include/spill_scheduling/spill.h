@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <spill_scheduling/spill_data_slot.h>
@@ -35,6 +36,7 @@ struct Spill {
     bool created; ///< Was the spill just created by the scheduler and needs DS allocation?
     bool started; ///< Was the spill "touched" by any data taking thread?
     utc_timestamp last_updated_time; ///< Time of last "touch"
+    std::int64_t closed_time_ns; ///< When the spill was closed for writing (ns since the epoch, arrival clock)
 
     SpillDataSlot* data_slots; ///< Multiple data slots, one for each hit receiver
     std::size_t n_data_slots; ///< Number of valid items in `data_slots`
@@ -46,6 +48,7 @@ struct Spill {
         , created { true }
         , started {}
         , last_updated_time {}
+        , closed_time_ns {}
         , data_slots {}
         , n_data_slots {}
     {
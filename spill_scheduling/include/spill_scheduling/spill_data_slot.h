@@ -1,9 +1,12 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <mutex>
 
 #include <util/annotation_queues.h>
+#include <util/channel_histograms.h>
+#include <util/latency_histogram.h>
 #include <util/pmt_hit_queues.h>
 
 struct SpillDataSlot {
@@ -12,12 +15,20 @@ struct SpillDataSlot {
 
     PMTMultiPlaneHitQueue opt_hit_queue; ///< Optical hits, grouped by plane numbers.
     AnnotationQueue opt_annotation_queue; ///< Annotations, all together
+    ChannelHistograms opt_hit_histograms; ///< Hit rate, ToT and ADC0 spectra of every channel
+    LatencyHistogram arrival_to_decode; ///< Time datagrams spent in the socket and being decoded (ns)
+    LatencyHistogram decode_to_slot; ///< Time datagrams waited for the slot after being decoded (ns)
+    std::int64_t last_arrival_ns; ///< When the latest datagram stored in the slot arrived (ns since the epoch)
 
     explicit SpillDataSlot()
         : mutex {}
         , closed_for_writing { false }
         , opt_hit_queue {}
         , opt_annotation_queue {}
+        , opt_hit_histograms {}
+        , arrival_to_decode {}
+        , decode_to_slot {}
+        , last_arrival_ns { 0 }
     {
     }
 
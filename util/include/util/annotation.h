@@ -5,7 +5,9 @@
 #include <util/timestamp.h>
 
 enum class AnnotationType : std::uint8_t {
-    DROPPED_CHANNEL = 1
+    DROPPED_CHANNEL = 1,
+    SEQUENCE_GAP = 2, ///< Datagrams of a plane lost before reaching this machine
+    KERNEL_DROP = 3 ///< Datagrams of a plane dropped by the receive queue of our socket
 };
 
 struct Annotation {
@@ -0,0 +1,87 @@
+/**
+ * ChannelHistograms - Fixed-bin histograms of optical hits per plane and channel
+ *
+ * Hit receivers fill the histograms of their own spill data slot while decoding, so
+ * no synchronisation is needed beyond the slot lock they already hold. Planes are
+ * looked up once per datagram, after which every hit costs an array index and a few
+ * increments. Histograms of all slots are merged once per spill by the serialiser.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+
+#include <util/pmt_hit.h>
+
+/// Hit count, ToT and ADC0 spectra of a single channel.
+struct ChannelHistogram {
+    static constexpr std::size_t N_TOT_BINS { 32 };
+    static constexpr std::uint32_t TOT_BIN_WIDTH { 8 }; ///< [ns], the last bin holds overflows
+    static constexpr std::size_t N_ADC0_BINS { 32 };
+    static constexpr std::uint32_t ADC0_BIN_WIDTH { 128 }; ///< the last bin holds overflows
+
+    std::uint32_t n_hits;
+    std::uint32_t n_adc0; ///< Number of hits with ADC0 (Madison planes only)
+    std::uint64_t tot_sum;
+    std::uint64_t tot_sum2;
+    std::uint64_t adc0_sum;
+    std::uint64_t adc0_sum2;
+    std::uint32_t tot[N_TOT_BINS];
+    std::uint32_t adc0[N_ADC0_BINS];
+
+    inline void fill(std::uint16_t hit_tot, std::uint16_t hit_adc0)
+    {
+        ++n_hits;
+        tot_sum += hit_tot;
+        tot_sum2 += static_cast<std::uint32_t>(hit_tot) * hit_tot;
+        ++tot[std::min<std::size_t>(hit_tot / TOT_BIN_WIDTH, N_TOT_BINS - 1)];
+
+        if (hit_adc0 != PMTHit::NO_ADC0) {
+            ++n_adc0;
+            adc0_sum += hit_adc0;
+            adc0_sum2 += static_cast<std::uint32_t>(hit_adc0) * hit_adc0;
+            ++adc0[std::min<std::size_t>(hit_adc0 / ADC0_BIN_WIDTH, N_ADC0_BINS - 1)];
+        }
+    }
+
+    void merge(const ChannelHistogram& other);
+
+    double totMean() const;
+    double totRMS() const;
+    double adc0Mean() const;
+    double adc0RMS() const;
+};
+
+/// Histograms of all channels of a plane.
+struct PlaneHistograms {
+    /// Channels are masked to this range, which covers both CLB and BBB planes.
+    static constexpr std::size_t N_CHANNELS { 32 };
+
+    std::array<ChannelHistogram, N_CHANNELS> channels;
+
+    inline void fill(std::uint8_t channel_number, std::uint16_t tot, std::uint16_t adc0)
+    {
+        channels[channel_number & (N_CHANNELS - 1)].fill(tot, adc0);
+    }
+};
+
+class ChannelHistograms {
+public:
+    using PlaneMap = std::map<std::uint32_t, PlaneHistograms>;
+
+    /// Histograms of a plane, created empty on first access.
+    PlaneHistograms& plane(std::uint32_t plane_number);
+
+    /// Add counts of other histograms into these.
+    void merge(const ChannelHistograms& other);
+
+    void clear();
+
+    inline const PlaneMap& planes() const { return planes_; }
+
+private:
+    PlaneMap planes_;
+};
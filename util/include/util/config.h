@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <fmt/format.h>
 #include <libconfig.h++>
@@ -22,6 +23,15 @@ public:
 
     std::string lookupString(const char* path) const { return lookup<const char*>(path); }
 
+    /// True if the key is present (useful for optional settings).
+    bool exists(const char* path) const;
+
+    /// Names of all settings contained in a group.
+    std::vector<std::string> lookupNames(const char* path) const;
+
+    /// Elements of an array or list of integers.
+    std::vector<std::uint32_t> lookupU32Array(const char* path) const;
+
 private:
     std::string cfg_file_path_;
     bool loaded_;
@@ -121,6 +121,34 @@ struct DaqoniteStateMessage {
         Ready pReady;
         Running pRunning;
     } Payload;
+
+    /// Rates (per second) of all hit receivers together, over the last statistics interval
+    struct ReceiverRates {
+        float Datagrams;
+        float Hits;
+        float BadDatagrams; ///< Malformed, of the wrong type or late
+        float Gaps; ///< Jumps in sequence numbers
+        float MissedDatagrams; ///< Datagrams skipped by the jumps, lost upstream
+        float DroppedDatagrams; ///< Datagrams skipped by the jumps, dropped by our sockets
+        float KernelDrops; ///< Datagrams dropped by receive queues, as counted by the kernel
+        float DiscardedDatagrams; ///< Datagrams which did not match any open spill
+        float QueuePeak; ///< Largest fraction of a receive buffer in use
+    } Receivers;
+
+    /// Median, 99th percentile and maximum (µs) of a stage of ingest
+    struct LatencyPercentiles {
+        float P50;
+        float P99;
+        float Max;
+    };
+
+    /// Ingest latencies of the spills written over the last one to two latency windows
+    struct IngestLatencies {
+        LatencyPercentiles ArrivalToDecode; ///< Per datagram, time in the receive queue and being decoded
+        LatencyPercentiles DecodeToSlot; ///< Per datagram, time waiting for the data slot
+        LatencyPercentiles EndToClose; ///< Per spill, from its last datagram until it was closed
+        LatencyPercentiles CloseToWritten; ///< Per spill, time being sorted and written
+    } Latencies;
 };
 
 struct DaqontrolStateMessage {
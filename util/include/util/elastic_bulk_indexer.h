@@ -0,0 +1,140 @@
+/**
+ * ElasticBulkIndexer - Batches documents into bulk requests over a persistent connection
+ *
+ * Producers push documents into a bounded lock-free queue, which never blocks them. When
+ * the queue is full, documents are rejected and counted instead. A single flusher thread
+ * drains the queue, groups documents by index and sends them in one `_bulk` request once
+ * enough of them are pending, or once the oldest one has waited long enough. The flusher
+ * keeps its client for its whole life, so consecutive requests reuse the same keep-alive
+ * connection rather than opening a new one for every document.
+ *
+ * When elasticsearch is down, or too slow to keep the queue from filling up, documents go
+ * to a local ElasticSpool instead. Requests are then suspended for a retry interval, so
+ * that producers are never held up by HTTP timeouts. Once requests succeed again, a
+ * replayer thread drains the spool through the bulk path at a limited rate.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/lockfree/queue.hpp>
+#include <elasticlient/client.h>
+#include <json/json.h>
+
+#include <util/elastic_spool.h>
+#include <util/logging.h>
+
+struct ElasticBulkIndexerSettings {
+    std::size_t queue_size { 65536 }; ///< Maximum number of documents waiting to be sent
+    std::size_t bulk_size { 1000 }; ///< Send once this many documents are pending
+    std::chrono::milliseconds bulk_interval { 1000 }; ///< Send once the oldest pending document is this old
+    std::chrono::milliseconds stats_interval { 10000 }; ///< How often to index own metrics, 0 disables
+    std::chrono::milliseconds retry_interval { 5000 }; ///< How long to spool documents after a failed request
+    ElasticSpoolSettings spool {}; ///< Where to keep documents while elasticsearch is unreachable
+    double replay_rate { 1000 }; ///< Maximum rate of replaying spooled documents [1/s]
+
+    /// Read settings from the "elastic_search" section of the configuration.
+    static ElasticBulkIndexerSettings fromConfig();
+};
+
+/// Metrics of the indexing pipeline.
+struct ElasticBulkIndexerStats {
+    std::size_t queue_depth {}; ///< Documents waiting in the queue
+    std::uint64_t n_indexed {}; ///< Documents accepted by elasticsearch
+    std::uint64_t n_rejected {}; ///< Documents dropped because the queue was full and could not be spooled
+    std::uint64_t n_failed {}; ///< Documents refused by elasticsearch, or lost with a failed request
+    std::uint64_t n_requests {}; ///< Bulk requests sent
+    std::uint64_t n_spooled {}; ///< Documents written to the spool
+    std::uint64_t n_replayed {}; ///< Spooled documents accepted by elasticsearch
+    std::uint64_t spool_bytes {}; ///< Size of the spool on disk
+    double last_flush_ms {}; ///< Duration of the latest bulk request
+    double max_flush_ms {}; ///< Duration of the slowest bulk request
+};
+
+class ElasticBulkIndexer : protected Logging {
+public:
+    /// Start the flusher thread, sending requests to the given elasticsearch nodes. Each process
+    /// spools into a subdirectory of the spool directory named after it.
+    explicit ElasticBulkIndexer(const ElasticBulkIndexerSettings& settings, const std::vector<std::string>& hosts,
+        const std::string& process_name);
+
+    /// Send (or spool) all queued documents and stop the flusher thread.
+    ~ElasticBulkIndexer();
+
+    // no copy semantics
+    ElasticBulkIndexer(const ElasticBulkIndexer& other) = delete;
+    ElasticBulkIndexer& operator=(const ElasticBulkIndexer& other) = delete;
+
+    /// Queue a document for indexing, or spool it if the queue is full. Returns false if it was dropped.
+    /// The document is serialised by the caller.
+    bool add(const std::string& index, const Json::Value& document);
+
+    /// Queue a document serialised already, e.g. by a JsonWriter.
+    bool addSerialised(const std::string& index, std::string document);
+
+    ElasticBulkIndexerStats stats() const;
+
+private:
+    struct PendingDocument {
+        std::string index;
+        std::string document; ///< Serialised JSON document
+    };
+
+    /// Serialised documents, keyed by index.
+    using Batch = std::map<std::string, std::vector<std::string>>;
+
+    ElasticBulkIndexerSettings settings_;
+    std::vector<std::string> hosts_;
+    std::string process_name_;
+    Json::StreamWriterBuilder builder_;
+
+    boost::lockfree::queue<PendingDocument*> queue_;
+    std::atomic<std::size_t> queue_depth_;
+    std::atomic_bool running_;
+    std::thread flusher_thread_;
+
+    // Spooling while elasticsearch is unreachable
+    std::unique_ptr<ElasticSpool> spool_; ///< Null if spooling is disabled
+    std::atomic_bool outage_; ///< Did the latest request fail?
+    std::chrono::steady_clock::time_point retry_time_; ///< When the flusher tries sending again
+    std::thread replayer_thread_;
+
+    // Metrics
+    std::atomic<std::uint64_t> n_indexed_;
+    std::atomic<std::uint64_t> n_rejected_;
+    std::atomic<std::uint64_t> n_failed_;
+    std::atomic<std::uint64_t> n_requests_;
+    std::atomic<std::uint64_t> n_spooled_;
+    std::atomic<std::uint64_t> n_replayed_;
+    std::atomic<std::uint64_t> last_flush_us_;
+    std::atomic<std::uint64_t> max_flush_us_;
+
+    /// Body of the flusher thread.
+    void run();
+
+    /// Body of the replayer thread.
+    void replay();
+
+    /// Send a batch in a single bulk request, or spool it during outages, and clear it.
+    void flush(elasticlient::Client& client, Batch& batch, std::size_t& n_pending);
+
+    /// Send documents in a single bulk request. Returns the number of documents refused
+    /// by elasticsearch, or throws if the request as a whole failed.
+    std::size_t send(elasticlient::Client& client, const std::string& body);
+
+    /// Append a bulk action line and a document to a request body.
+    static void appendAction(std::string& body, const std::string& index, const std::string& document);
+
+    /// Count documents refused by elasticsearch, given the response to a bulk request.
+    std::size_t countFailed(const std::string& response);
+
+    /// Queue a document with the metrics of the pipeline.
+    void addStats();
+};
@@ -15,6 +15,7 @@
 #include <string>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #include <cpr/cpr.h>
 #include <cpr/response.h>
@@ -27,6 +28,8 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include <util/elastic_bulk_indexer.h>
+#include <util/json_writer.h>
 #include <util/logging.h>
 #include <util/timestamp.h>
 
@@ -51,11 +54,9 @@ struct channel_data {
     int pom;
     std::array<float, 30> rate;
     std::bitset<32> veto;
+    int n_channels; ///< Number of channels used, 30 for CLBs and 16 for BBBs
 };
 
-#define MAX_LOG_RATE 100
-#define MAX_ELASTIC_ATTEMPTS 1
-
 /// Callback for elasticlient logs
 inline void elasticlientCallback(elasticlient::LogLevel logLevel, const std::string& msg)
 {
@@ -105,6 +106,15 @@ public:
      */
     void document(std::string index, Json::Value document);
 
+    /**
+     * Adds bulkWork() work to indexing io_service
+     * Timestamp is added when called to maintain ordering
+     * Takes ~20 microseconds
+     * @param index         name of the elasticsearch index
+     * @param documents     Json::Value documents indexed by a single bulk request
+     */
+    void bulk(std::string index, std::vector<Json::Value> documents);
+
     /**
      * Adds valueWork() work to indexing io_service
      * Timestamp is added when called to maintain ordering
@@ -128,6 +138,14 @@ public:
      */
     void channel(channel_data data);
 
+    /**
+     * Adds serialisedWork() work to indexing io_service, copying the document out of the writer
+     * Takes a few microseconds, as the post takes a lock and copies the document into its handler
+     * @param index         name of the elasticsearch index
+     * @param writer        writer holding the complete JSON document
+     */
+    void serialised(const std::string& index, const JsonWriter& writer);
+
     /**
      * Adds runWork() work to indexing io_service
      * Takes ~20 microseconds
@@ -136,6 +154,9 @@ public:
      */
     void run(int run_num, int run_type);
 
+    /// Metrics of the bulk indexing pipeline, empty before init()
+    ElasticBulkIndexerStats bulkStats() const;
+
 private:
     /**
      * Indexes "daqlog" document to elasticsearch database
@@ -161,6 +182,21 @@ private:
      */
     void documentWork(std::string name, Json::Value document, long timestamp);
 
+    /**
+     * Queues JSON documents for indexing to elasticsearch database
+     * @param index         name of the elasticsearch index
+     * @param documents     Json::Value documents ready to be indexed
+     * @param timestamp     timestamp when work was posted
+     */
+    void bulkWork(std::string name, std::vector<Json::Value> documents, long timestamp);
+
+    /**
+     * Queues a document serialised by a JsonWriter for bulk indexing to elasticsearch database
+     * @param index         name of the elasticsearch index
+     * @param document      complete JSON document
+     */
+    void serialisedWork(std::string index, std::string document);
+
     /**
      * Indexes value to elasticsearch database
      * @param index         name of the elasticsearch index
@@ -176,8 +212,7 @@ private:
     void pomWork(pom_data data);
 
     /**
-     * Indexes "monchannel" document to elasticsearch
-     * Takes ~100000 microseconds
+     * Queues "monchannel" documents for indexing to elasticsearch
      * @param rates         channel monitoring data
      */
     void channelWork(channel_data data);
@@ -193,17 +228,22 @@ private:
     /// Calls run() in an indexing thread
     void runThread();
 
-    /// Checks if we need to suppress this log
-    bool suppress();
-
     /**
-     * Indexes a single document to elasticsearch
-     * Takes ~75000 microseconds
+     * Queues a single document for bulk indexing to elasticsearch
+     * Takes a few microseconds, dropping the document if the queue is full
      * @param index         name of index
      * @param document      JSON document
      */
     void index(std::string index, Json::Value document);
 
+    /**
+     * Queues a single document written by a JsonWriter for bulk indexing to elasticsearch
+     * Used for the fixed-schema documents, which skip building a Json::Value tree
+     * @param index         name of index
+     * @param writer        writer holding the complete JSON document
+     */
+    void index(const std::string& index, const JsonWriter& writer);
+
     /**
      * Initialise file logging
      * Opens a logging file and writes reason for switching
@@ -239,10 +279,11 @@ private:
     log_mode mode_; ///< Logging mode {ELASTIC, FILE_LOG}
     std::vector<std::string> client_list_; ///< List of elasticsearch clients
     Json::StreamWriterBuilder builder_; ///< Json writer to stream json value to string
+    std::unique_ptr<ElasticBulkIndexer> bulk_indexer_; ///< Sends queued documents in bulk requests
 
     // Indexing
     boost::asio::io_service index_service_; ///< Indexing io_service
-    boost::asio::io_service::work index_work_; ///< Work for the indexing io_service
+    std::unique_ptr<boost::asio::io_service::work> index_work_; ///< Keeps the indexing io_service running until stop_and_join()
     boost::thread_group index_threads_; ///< Group of indexing threads to do the work
     boost::mutex work_mutex_; ///< Mutex for work inside indexing io_service
 
@@ -250,10 +291,6 @@ private:
     std::string process_name_; ///< Process name for using in log messages
     int pid_; ///< Process pid for using in log messages
     std::string file_name_; ///< file name used when in FILE_LOG mode
-
-    // Log suppression
-    int log_counter_; ///< Log counter
-    std::chrono::time_point<std::chrono::system_clock> timer_start_; ///< Suppression window start time
 };
 
 extern ElasticInterface g_elastic; ///< Global instance of this class
@@ -0,0 +1,88 @@
+/**
+ * ElasticSpool - Durable local queue of documents that could not be sent to elasticsearch
+ *
+ * Documents are appended to segment files in a spool directory. Each is a record framed by
+ * its length and CRC-32, so that records torn by a crash are detected when read back. Only
+ * the newest segment is ever written, and a new one is started once it reaches its size
+ * limit. Records are read back in order, starting from the oldest segment, and segments
+ * are deleted once all of their records have been replayed. The replay position is saved
+ * with every commit, hence a crash can at most replay a single batch twice. The total size
+ * of all segments is bounded; documents that do not fit are dropped and counted.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <util/logging.h>
+
+struct ElasticSpoolSettings {
+    std::string directory {}; ///< Where segments are stored, empty disables spooling
+    std::uint64_t segment_bytes { 67108864 }; ///< Start a new segment once the current one exceeds N bytes
+    std::uint64_t max_bytes { 1073741824 }; ///< Maximum total size of all segments
+};
+
+struct ElasticSpoolRecord {
+    std::string index;
+    std::string document; ///< Serialised JSON document
+};
+
+/// Position of a record within the spool.
+struct ElasticSpoolPosition {
+    std::uint64_t segment; ///< Sequence number of the segment
+    std::uint64_t offset; ///< Byte offset within the segment
+};
+
+class ElasticSpool : protected Logging {
+public:
+    /// Open the spool directory, picking up segments left over by previous processes.
+    explicit ElasticSpool(const ElasticSpoolSettings& settings);
+    ~ElasticSpool();
+
+    // no copy semantics
+    ElasticSpool(const ElasticSpool& other) = delete;
+    ElasticSpool& operator=(const ElasticSpool& other) = delete;
+
+    /// Append a document. Returns false if it was dropped for lack of space.
+    bool append(const std::string& index, const std::string& document);
+
+    /// Read up to `max_records` records following the replay position, without consuming them.
+    /// Returns the position past the last record read, to be committed once they are replayed.
+    ElasticSpoolPosition read(std::size_t max_records, std::vector<ElasticSpoolRecord>& records);
+
+    /// Mark all records before the position as replayed, deleting segments no longer needed.
+    void commit(const ElasticSpoolPosition& position);
+
+    /// Are all records replayed?
+    bool empty() const;
+
+    /// Total size of all segments [B].
+    std::uint64_t bytes() const;
+
+    /// Number of documents dropped for lack of space, or lost in torn segments.
+    std::uint64_t nDropped() const;
+
+private:
+    ElasticSpoolSettings settings_;
+    mutable std::mutex mutex_;
+
+    std::map<std::uint64_t, std::uint64_t> segments_; ///< Size of every segment, keyed by sequence number
+    int write_fd_; ///< Descriptor of the newest segment, opened on first append
+    ElasticSpoolPosition position_; ///< Replay position
+    std::uint64_t total_bytes_;
+    std::uint64_t n_dropped_;
+
+    std::string segmentPath(std::uint64_t segment) const;
+    std::string positionPath() const;
+
+    void scanSegments();
+    void openSegment(std::uint64_t segment);
+    void closeSegment();
+    void loadPosition();
+    void savePosition();
+    bool emptyUnlocked() const;
+};
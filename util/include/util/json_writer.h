@@ -0,0 +1,55 @@
+/**
+ * JsonWriter - Streams flat JSON documents straight into a reusable buffer
+ *
+ * Meant for fixed-schema documents produced at high rates, where building a Json::Value
+ * tree would allocate for every field. Fields are written in the order they are added,
+ * without whitespace. Small documents fit in the inline storage of the buffer, so that
+ * writing them does not touch the heap at all.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fmt/format.h>
+
+class JsonWriter {
+public:
+    explicit JsonWriter();
+
+    /// Start a new document, discarding the current one.
+    void clear();
+
+    /// Open the top-level object, or a nested object under a key.
+    void beginObject();
+    void beginObject(const char* key);
+    void endObject();
+
+    void field(const char* key, std::int64_t value);
+    void field(const char* key, double value);
+    void field(const char* key, bool value);
+    void field(const char* key, const std::string& value) { stringField(key, value.data(), value.data() + value.size()); }
+
+    // Disambiguate narrower integers, which would otherwise convert to double or bool.
+    void field(const char* key, int value) { field(key, static_cast<std::int64_t>(value)); }
+    void field(const char* key, float value) { field(key, static_cast<double>(value)); }
+    void field(const char* key, const char* value) { stringField(key, value, value + std::strlen(value)); }
+
+    const char* data() const { return buffer_.data(); }
+    std::size_t size() const { return buffer_.size(); }
+
+    /// Copy of the document written so far.
+    std::string str() const { return std::string { buffer_.data(), buffer_.size() }; }
+
+private:
+    fmt::memory_buffer buffer_;
+    bool needs_comma_; ///< Has the current object got a field already?
+
+    void key(const char* key);
+    void stringField(const char* key, const char* begin, const char* end);
+    void append(const char* begin, const char* end) { buffer_.append(begin, end); }
+    void append(char c) { buffer_.push_back(c); }
+    void appendEscaped(const char* begin, const char* end);
+};
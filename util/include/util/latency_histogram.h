@@ -0,0 +1,76 @@
+/**
+ * LatencyHistogram - Log-linear histogram of latencies, in the manner of HdrHistogram
+ *
+ * Every power of two is split into SUB_BUCKETS linear buckets, so that any recorded value
+ * is known to within 1 / SUB_BUCKETS of itself (about 3 %) over the whole range, from
+ * nanoseconds to an hour. Recording costs a count of leading zeros and an increment, and
+ * histograms of different threads are merged by adding up their buckets.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+
+/// Current time on the clock which the kernel stamps arriving datagrams with (ns since the epoch)
+inline std::int64_t realtimeNanosecs()
+{
+    timespec now {};
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000ll + now.tv_nsec;
+}
+
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS { 5 };
+    static constexpr std::uint64_t SUB_BUCKETS { 1ull << SUB_BUCKET_BITS };
+    static constexpr unsigned MAX_BITS { 42 }; ///< Values from 2^42 ns (73 minutes) on are counted as the largest one
+    static constexpr std::size_t N_BUCKETS { (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS };
+
+    LatencyHistogram();
+
+    /// Count a latency (ns), negative ones (e.g. after a clock step) as zero.
+    inline void record(std::int64_t value_ns)
+    {
+        const std::uint64_t value { value_ns > 0 ? static_cast<std::uint64_t>(value_ns) : 0 };
+        ++buckets_[bucketIndex(value)];
+        ++count_;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    inline std::uint64_t count() const { return count_; }
+    inline std::uint64_t max() const { return max_; }
+
+    /// Smallest latency (ns) which at least `percent` of the counted ones do not exceed, 0 if empty.
+    std::uint64_t percentile(double percent) const;
+
+private:
+    std::array<std::uint64_t, N_BUCKETS> buckets_;
+    std::uint64_t count_;
+    std::uint64_t max_; ///< Exact, unlike values derived from buckets
+
+    /// Values below 2 * SUB_BUCKETS have buckets of their own, larger ones share them with their neighbours.
+    static inline std::size_t bucketIndex(std::uint64_t value)
+    {
+        if (value < 2 * SUB_BUCKETS) {
+            return static_cast<std::size_t>(value);
+        }
+
+        const unsigned msb { 63u - static_cast<unsigned>(__builtin_clzll(value)) };
+        if (msb >= MAX_BITS) {
+            return N_BUCKETS - 1;
+        }
+
+        const unsigned shift { msb - SUB_BUCKET_BITS };
+        return static_cast<std::size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS));
+    }
+
+    /// Largest value counted in a bucket.
+    static std::uint64_t bucketUpperBound(std::size_t idx);
+};
@@ -0,0 +1,126 @@
+/**
+ * Rate limits of log messages, per unit and per call site of every unit
+ *
+ * Each Logging object has a bucket shared by all of its messages, and every call site of
+ * a unit (identified by the unit name and its format string literal) has its own one in a
+ * table shared by all threads. Sites are never removed, but units created anew, e.g. for
+ * every run, find the sites of their predecessors by name, so the table stays bounded by the
+ * code. Buckets are single atomics and the table is filled in without a lock, so units only
+ * ever contend with themselves. Messages a bucket turns away are counted per call site, and
+ * the counts are logged periodically instead of the messages.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <util/log_ring.h>
+
+/// Average interval between messages, and how far ahead of it a burst may get (ns)
+struct LogLimit {
+    std::int64_t interval_ns;
+    std::int64_t capacity_ns;
+};
+
+/**
+ * Token bucket, implemented as a generic cell rate algorithm: a message costs one interval
+ * and is let through unless the bucket would then be filled past its capacity. The bucket
+ * is a single time, that at which it has drained completely.
+ */
+class LogBucket {
+public:
+    LogBucket()
+        : drained_at_ns_ { 0 }
+    {
+    }
+
+    // Copies of units start with an empty bucket of their own.
+    LogBucket(const LogBucket&)
+        : drained_at_ns_ { 0 }
+    {
+    }
+
+    LogBucket& operator=(const LogBucket&) { return *this; }
+
+    /// Let a message through, returns false if it exceeds the limit.
+    bool take(std::int64_t now_ns, const LogLimit& limit)
+    {
+        std::int64_t drained_at { drained_at_ns_.load(std::memory_order_relaxed) };
+        while (true) {
+            const std::int64_t filled_at { std::max(drained_at, now_ns) + limit.interval_ns };
+            if (filled_at - now_ns > limit.capacity_ns) {
+                return false;
+            }
+            if (drained_at_ns_.compare_exchange_weak(drained_at, filled_at, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+private:
+    std::atomic<std::int64_t> drained_at_ns_;
+};
+
+struct LogSite {
+    std::atomic<std::uint64_t> key; ///< Hash of unit name and format string, 0 while free
+    std::atomic_bool ready; ///< Are the fields below filled in?
+    std::uint64_t unit_hash; ///< Hash of the full unit name, which may be truncated below
+    const char* format; ///< Format string literal of the site
+    char unit_name[LogRecord::UNIT_SIZE]; ///< Unit name, truncated
+    Severity level;
+    bool to_es; ///< Are its messages sent to Elasticsearch?
+    LogBucket bucket;
+    std::atomic<std::uint64_t> n_suppressed; ///< Messages turned away since they were last reported
+};
+
+class LogSites {
+public:
+    static constexpr std::size_t N_SITES { 4096 };
+
+    explicit LogSites();
+
+    // for safety, no copy- or move-semantics
+    LogSites(const LogSites& other) = delete;
+    LogSites& operator=(const LogSites& other) = delete;
+
+    /// Hash identifying a unit by its name.
+    static std::uint64_t hashUnitName(const std::string& unit_name);
+
+    /// Site of a call of a unit, added on first use. nullptr if the table is full.
+    LogSite* find(std::uint64_t unit_hash, const char* format, const std::string& unit_name, Severity level, bool to_es);
+
+    /// Call a function on every site in use, e.g. to report suppressed messages.
+    template <typename Function>
+    void forEach(Function function)
+    {
+        for (std::size_t i = 0; i < N_SITES; ++i) {
+            if (sites_[i].ready.load(std::memory_order_acquire)) {
+                function(sites_[i]);
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<LogSite[]> sites_;
+};
+
+namespace log_detail {
+
+/// Format strings which are literals identify their call site, others do not.
+template <std::size_t N>
+const char* siteOf(const char (&format_str)[N])
+{
+    return format_str;
+}
+
+template <typename S>
+const char* siteOf(const S&)
+{
+    return nullptr;
+}
+
+}
@@ -0,0 +1,259 @@
+/**
+ * LogRing - Queue of log records written by a single thread and read by the logging thread
+ *
+ * A record keeps the format string and a copy of the arguments of a log call, so that the
+ * message is only formatted by the consumer. Arguments which are trivially copyable are
+ * kept as they are, and strings are copied into the record. Calls with other arguments, or
+ * too long to fit a record, are formatted by the caller instead and the record owns the
+ * message. Rings are single-producer single-consumer, so that neither side takes a lock.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+/// Enum for describing the different logging severity levels
+enum Severity {
+    TRACE,
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    FATAL
+};
+
+struct LogRecord {
+    static constexpr std::size_t UNIT_SIZE { 48 };
+    static constexpr std::size_t DATA_SIZE { 176 };
+
+    std::uint64_t sequence; ///< Order of the call across all threads
+    /// Appends the message to a buffer, or nullptr if data holds an owned std::string*
+    void (*format)(const LogRecord& record, fmt::memory_buffer& out);
+    const char* format_str; ///< String literal of the call
+    Severity level;
+    bool to_es;
+    char unit[UNIT_SIZE]; ///< Unit name, truncated
+    alignas(8) char data[DATA_SIZE]; ///< Arguments, followed by characters of their strings
+};
+
+namespace log_detail {
+
+template <std::size_t... I>
+struct IndexSequence {
+};
+
+template <std::size_t N, std::size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {
+};
+
+template <std::size_t... I>
+struct MakeIndexSequence<0, I...> {
+    using type = IndexSequence<I...>;
+};
+
+/// Characters of a string argument, kept after the arguments of a record
+struct StringRef {
+    std::uint16_t offset;
+    std::uint16_t size;
+};
+
+/// Appends characters of strings to a record, past its arguments
+struct StringWriter {
+    LogRecord& record;
+    std::size_t position;
+
+    StringRef write(const char* data, std::size_t size)
+    {
+        std::memcpy(record.data + position, data, size);
+        const StringRef ref { static_cast<std::uint16_t>(position), static_cast<std::uint16_t>(size) };
+        position += size;
+        return ref;
+    }
+};
+
+/// How an argument of type T is kept in a record until it is formatted
+template <typename T, typename Enable = void>
+struct Stored {
+    static constexpr bool deferrable { std::is_trivially_copyable<T>::value && std::is_copy_constructible<T>::value && !std::is_array<T>::value };
+    using type = T;
+    static std::size_t stringSize(const T&) { return 0; }
+    static type store(const T& value, StringWriter&) { return value; }
+    static const T& load(const type& stored, const LogRecord&) { return stored; }
+};
+
+// Pointers other than C strings could dangle before they are formatted, but their value is safe to keep.
+template <typename T>
+struct Stored<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static constexpr bool deferrable { true };
+    using type = const void*;
+    static std::size_t stringSize(T*) { return 0; }
+    static type store(T* value, StringWriter&) { return value; }
+    static type load(type stored, const LogRecord&) { return stored; }
+};
+
+template <typename T>
+struct StoredString {
+    static constexpr bool deferrable { true };
+    using type = StringRef;
+    static fmt::string_view load(StringRef stored, const LogRecord& record) { return fmt::string_view { record.data + stored.offset, stored.size }; }
+};
+
+template <>
+struct Stored<std::string> : StoredString<std::string> {
+    static std::size_t stringSize(const std::string& value) { return value.size(); }
+    static StringRef store(const std::string& value, StringWriter& writer) { return writer.write(value.data(), value.size()); }
+};
+
+template <>
+struct Stored<const char*> : StoredString<const char*> {
+    static std::size_t stringSize(const char* value) { return std::strlen(value); }
+    static StringRef store(const char* value, StringWriter& writer) { return writer.write(value, std::strlen(value)); }
+};
+
+template <>
+struct Stored<char*> : Stored<const char*> {
+};
+
+template <std::size_t N>
+struct Stored<char[N]> : Stored<const char*> {
+};
+
+template <>
+struct Stored<fmt::string_view> : StoredString<fmt::string_view> {
+    static std::size_t stringSize(fmt::string_view value) { return value.size(); }
+    static StringRef store(fmt::string_view value, StringWriter& writer) { return writer.write(value.data(), value.size()); }
+};
+
+template <typename... Args>
+struct AllDeferrable;
+
+template <>
+struct AllDeferrable<> {
+    static constexpr bool value { true };
+};
+
+template <typename T, typename... Args>
+struct AllDeferrable<T, Args...> {
+    static constexpr bool value { Stored<T>::deferrable && AllDeferrable<Args...>::value };
+};
+
+inline std::size_t stringSizes()
+{
+    return 0;
+}
+
+template <typename T, typename... Args>
+std::size_t stringSizes(const T& value, const Args&... args)
+{
+    return Stored<T>::stringSize(value) + stringSizes(args...);
+}
+
+template <typename... Args, std::size_t... I>
+void formatStored(const LogRecord& record, fmt::memory_buffer& out, IndexSequence<I...>)
+{
+    using Tuple = std::tuple<typename Stored<Args>::type...>;
+    const Tuple& stored { *reinterpret_cast<const Tuple*>(record.data) };
+    fmt::format_to(std::back_inserter(out), record.format_str, Stored<Args>::load(std::get<I>(stored), record)...);
+}
+
+template <typename... Args>
+void formatRecord(const LogRecord& record, fmt::memory_buffer& out)
+{
+    formatStored<Args...>(record, out, typename MakeIndexSequence<sizeof...(Args)>::type {});
+}
+
+/**
+ * Keep the arguments of a call in a record, formatting them later. Returns false if they
+ * do not fit and the message must be formatted right away.
+ */
+template <std::size_t N, typename... Args>
+typename std::enable_if<AllDeferrable<Args...>::value, bool>::type
+defer(LogRecord& record, const char (&format_str)[N], const Args&... args)
+{
+    using Tuple = std::tuple<typename Stored<Args>::type...>;
+    static_assert(std::is_trivially_destructible<Tuple>::value, "Records are never destroyed");
+    if (sizeof(Tuple) + stringSizes(args...) > LogRecord::DATA_SIZE) {
+        return false;
+    }
+
+    StringWriter writer { record, sizeof(Tuple) };
+    new (record.data) Tuple { Stored<Args>::store(args, writer)... };
+    record.format = &formatRecord<Args...>;
+    record.format_str = format_str;
+    return true;
+}
+
+/// Format strings which are not literals may not outlive the call, nor may other arguments.
+template <typename S, typename... Args>
+bool defer(LogRecord&, const S&, const Args&...)
+{
+    return false;
+}
+
+}
+
+class LogRing {
+public:
+    static constexpr std::size_t N_RECORDS { 1024 };
+
+    explicit LogRing();
+
+    // for safety, no copy- or move-semantics
+    LogRing(const LogRing& other) = delete;
+    LogRing& operator=(const LogRing& other) = delete;
+
+    /// Record to fill in next, nullptr if the ring is full (producer only).
+    LogRecord* reserve()
+    {
+        const std::size_t tail { tail_.load(std::memory_order_relaxed) };
+        if (tail - head_.load(std::memory_order_acquire) == N_RECORDS) {
+            return nullptr;
+        }
+        return &records_[tail % N_RECORDS];
+    }
+
+    /// Hand the reserved record over to the consumer, returns its position (producer only).
+    std::size_t commit()
+    {
+        const std::size_t tail { tail_.load(std::memory_order_relaxed) + 1 };
+        tail_.store(tail, std::memory_order_release);
+        return tail;
+    }
+
+    /// Oldest record not read yet, nullptr if there is none (consumer only).
+    const LogRecord* front() const
+    {
+        const std::size_t head { head_.load(std::memory_order_relaxed) };
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &records_[head % N_RECORDS];
+    }
+
+    /// Release the record returned by front() (consumer only).
+    void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /// Have all records up to a position returned by commit() been read?
+    bool consumed(std::size_t position) const { return head_.load(std::memory_order_acquire) >= position; }
+
+    /// Mark the ring as left behind by its thread, it is dropped once empty.
+    void abandon() { abandoned_ = true; }
+    bool abandoned() const { return abandoned_; }
+
+private:
+    std::unique_ptr<LogRecord[]> records_;
+    alignas(64) std::atomic<std::size_t> head_; ///< Position read next by the consumer
+    alignas(64) std::atomic<std::size_t> tail_; ///< Position written next by the producer
+    std::atomic_bool abandoned_;
+};
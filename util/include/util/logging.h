@@ -1,33 +1,49 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
-/// Enum for describing the different logging severity levels
-enum Severity {
-    TRACE,
-    DEBUG,
-    INFO,
-    WARNING,
-    ERROR,
-    FATAL
-};
+#include <util/log_rate_limit.h>
+#include <util/log_ring.h>
 
 static std::string severityToString(Severity level);
 static Severity severityFromString(const std::string& str);
 
 class Logging;
 
+/**
+ * LoggingMultiplexer - Writes log messages to stderr and elasticsearch from a background thread
+ *
+ * Callers only check the severity, then queue the call into a ring of their own thread
+ * without taking a lock. The logging thread merges the rings in the order calls were made,
+ * formats the messages and writes them out. Messages below WARNING are dropped (and counted)
+ * if a ring is full, more severe ones wait for space, and FATAL ones until they are written.
+ *
+ * Before being queued, messages are rate-limited per call site and per unit (see
+ * log_rate_limit.h). ERROR messages are only limited per call site, so that a noisy unit
+ * cannot hide a different error, and FATAL ones are never limited.
+ */
 class LoggingMultiplexer {
 public:
     LoggingMultiplexer(const LoggingMultiplexer&) = delete;
     void operator=(const LoggingMultiplexer&) = delete;
 
+    ~LoggingMultiplexer();
+
     static void init();
 
+    /// Is a message of this severity written anywhere? Nothing is formatted otherwise.
+    static bool enabled(Severity level) { return level >= min_severity_.load(std::memory_order_acquire); }
+
     void log(Severity level, const std::string& unit_name, const std::string& message);
     void logWithoutES(Severity level, const std::string& unit_name, const std::string& message);
 
@@ -36,6 +52,41 @@ private:
 
     void configure();
 
+    /// Is a message within the rate limits of its call site and unit? Counts it otherwise.
+    bool admit(Severity level, bool to_es, LogBucket& unit_bucket, std::uint64_t unit_hash, const std::string& unit_name, const char* format);
+
+    /// Queue a call, keeping its arguments to be formatted by the logging thread if possible.
+    template <typename S, typename... Args>
+    void push(Severity level, bool to_es, const std::string& unit_name, const S& format_str, const Args&... args)
+    {
+        LogRecord* record { reserve(level, to_es, unit_name) };
+        if (!record) {
+            return;
+        }
+
+        if (!log_detail::defer(*record, format_str, args...)) {
+            record->format = nullptr;
+            new (record->data) std::string* { new std::string { fmt::format(format_str, args...) } };
+        }
+
+        commit(level);
+    }
+
+    /// Ring of the calling thread, registered on first use.
+    LogRing& threadRing();
+
+    /// Record to fill in by the calling thread, nullptr if the message is dropped.
+    LogRecord* reserve(Severity level, bool to_es, const std::string& unit_name);
+    void commit(Severity level);
+
+    /// Body of the logging thread.
+    void consume();
+    void write(const LogRecord& record, fmt::memory_buffer& message, fmt::memory_buffer& lines);
+    void output(Severity level, bool to_es, const char* unit_name, fmt::string_view message, fmt::memory_buffer& lines);
+
+    /// Log the number of messages suppressed at every call site since the last summary.
+    void summariseSuppressed(fmt::memory_buffer& lines);
+
     static LoggingMultiplexer& getInstance()
     {
         // Guaranteed to be destroyed.
@@ -44,17 +95,32 @@ private:
         return instance;
     }
 
-    bool configured_;
+    static std::atomic<int> min_severity_; ///< Least severity written anywhere, above FATAL until configured
 
     bool stderr_enabled_;
     Severity stderr_min_severity_;
-    std::mutex stderr_mutex_;
-    void logToStderr(Severity level, const std::string& unit_name, const std::string& message);
 
     bool es_enabled_;
     Severity es_min_severity_;
     void logToES(Severity level, const std::string& unit_name, const std::string& message);
 
+    std::atomic<std::uint64_t> sequence_; ///< Sequence number of the next call
+    std::atomic<std::uint64_t> n_dropped_; ///< Messages dropped as their ring was full
+
+    LogLimit site_limit_;
+    LogLimit unit_limit_;
+    std::chrono::nanoseconds summary_interval_; ///< How often suppressed messages are reported
+    LogSites sites_;
+    std::atomic<std::uint64_t> n_suppressed_unknown_; ///< Messages suppressed without a known call site
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<LogRing>> rings_; ///< Rings of all threads which logged, taken under rings_mutex_
+
+    std::atomic_bool running_;
+    std::thread consumer_;
+    std::thread::id consumer_id_; ///< The logging thread never waits for itself
+    std::mutex consumer_mutex_;
+    std::condition_variable consumer_cv_;
+
     friend class Logging;
 };
 
@@ -74,16 +140,22 @@ protected:
     template <typename S, typename... Args>
     inline void log(Severity level, const S& format_str, const Args&... args)
     {
-        LoggingMultiplexer::getInstance().log(level, unit_name_, fmt::format(format_str, args...));
+        if (LoggingMultiplexer::enabled(level) && LoggingMultiplexer::getInstance().admit(level, true, bucket_, unit_hash_, unit_name_, log_detail::siteOf(format_str))) {
+            LoggingMultiplexer::getInstance().push(level, true, unit_name_, format_str, args...);
+        }
     }
     template <typename S, typename... Args>
     inline void logWithoutES(Severity level, const S& format_str, const Args&... args)
     {
-        LoggingMultiplexer::getInstance().logWithoutES(level, unit_name_, fmt::format(format_str, args...));
+        if (LoggingMultiplexer::enabled(level) && LoggingMultiplexer::getInstance().admit(level, false, bucket_, unit_hash_, unit_name_, log_detail::siteOf(format_str))) {
+            LoggingMultiplexer::getInstance().push(level, false, unit_name_, format_str, args...);
+        }
     }
 
 private:
     std::string unit_name_;
+    std::uint64_t unit_hash_; ///< Identifies the call sites of the unit across instances
+    LogBucket bucket_; ///< Rate limit of all messages of the unit
 
     void setUnitName(std::string&& unit_name);
 };
\ No newline at end of file
@@ -27,6 +27,10 @@ struct tai_timestamp {
     /// NOTE: This should be considered lossy since the return value may drop some bits.
     long double combined_secs() const;
 
+    /// Put both fields together to form an integer number of nanoseconds (e.g. for radix sorting).
+    /// Unlike `combined_secs()`, this is lossless for all times before the year 2554.
+    std::uint64_t combined_nanosecs() const;
+
     /// True if both fields are zero.
     bool empty() const;
 
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <cstring>
+
+#include "channel_histograms.h"
+
+void ChannelHistogram::merge(const ChannelHistogram& other)
+{
+    n_hits += other.n_hits;
+    n_adc0 += other.n_adc0;
+    tot_sum += other.tot_sum;
+    tot_sum2 += other.tot_sum2;
+    adc0_sum += other.adc0_sum;
+    adc0_sum2 += other.adc0_sum2;
+
+    for (std::size_t i = 0; i < N_TOT_BINS; ++i) {
+        tot[i] += other.tot[i];
+    }
+
+    for (std::size_t i = 0; i < N_ADC0_BINS; ++i) {
+        adc0[i] += other.adc0[i];
+    }
+}
+
+static double mean(std::uint64_t sum, std::uint32_t n)
+{
+    return n > 0 ? static_cast<double>(sum) / n : 0.0;
+}
+
+static double rms(std::uint64_t sum, std::uint64_t sum2, std::uint32_t n)
+{
+    if (n == 0) {
+        return 0.0;
+    }
+
+    const double m { static_cast<double>(sum) / n };
+    return std::sqrt(std::max(0.0, static_cast<double>(sum2) / n - m * m));
+}
+
+double ChannelHistogram::totMean() const
+{
+    return mean(tot_sum, n_hits);
+}
+
+double ChannelHistogram::totRMS() const
+{
+    return rms(tot_sum, tot_sum2, n_hits);
+}
+
+double ChannelHistogram::adc0Mean() const
+{
+    return mean(adc0_sum, n_adc0);
+}
+
+double ChannelHistogram::adc0RMS() const
+{
+    return rms(adc0_sum, adc0_sum2, n_adc0);
+}
+
+PlaneHistograms& ChannelHistograms::plane(std::uint32_t plane_number)
+{
+    auto it { planes_.find(plane_number) };
+    if (it == planes_.end()) {
+        // Histograms are plain counters, start them from zero.
+        it = planes_.emplace(plane_number, PlaneHistograms {}).first;
+        std::memset(&it->second, 0, sizeof(PlaneHistograms));
+    }
+
+    return it->second;
+}
+
+void ChannelHistograms::merge(const ChannelHistograms& other)
+{
+    for (const auto& other_plane : other.planes_) {
+        PlaneHistograms& histograms { plane(other_plane.first) };
+        for (std::size_t i = 0; i < PlaneHistograms::N_CHANNELS; ++i) {
+            histograms.channels[i].merge(other_plane.second.channels[i]);
+        }
+    }
+}
+
+void ChannelHistograms::clear()
+{
+    planes_.clear();
+}
@@ -26,6 +26,60 @@ void Config::init(const std::string& process_name)
     }
 }
 
+bool Config::exists(const char* path) const
+{
+    if (!loaded_) {
+        throw std::runtime_error { fmt::format("Attempted to read key '{}' before configuration was loaded.", path) };
+    }
+
+    return cfg_.exists(path);
+}
+
+std::vector<std::string> Config::lookupNames(const char* path) const
+{
+    if (!loaded_) {
+        throw std::runtime_error { fmt::format("Attempted to read key '{}' before configuration was loaded.", path) };
+    }
+
+    try {
+        const libconfig::Setting& group { cfg_.lookup(path) };
+
+        std::vector<std::string> names {};
+        for (int i = 0; i < group.getLength(); ++i) {
+            const char* name { group[i].getName() };
+            if (name != nullptr) {
+                names.emplace_back(name);
+            }
+        }
+
+        return names;
+    } catch (const libconfig::SettingNotFoundException& ex) {
+        throw std::runtime_error { fmt::format("Missing configuration key '{}' in {}", ex.getPath(), cfg_file_path_) };
+    }
+}
+
+std::vector<std::uint32_t> Config::lookupU32Array(const char* path) const
+{
+    if (!loaded_) {
+        throw std::runtime_error { fmt::format("Attempted to read key '{}' before configuration was loaded.", path) };
+    }
+
+    try {
+        const libconfig::Setting& array { cfg_.lookup(path) };
+
+        std::vector<std::uint32_t> values {};
+        for (int i = 0; i < array.getLength(); ++i) {
+            values.push_back(static_cast<std::uint32_t>(static_cast<int>(array[i])));
+        }
+
+        return values;
+    } catch (const libconfig::SettingNotFoundException& ex) {
+        throw std::runtime_error { fmt::format("Missing configuration key '{}' in {}", ex.getPath(), cfg_file_path_) };
+    } catch (const libconfig::SettingTypeException& ex) {
+        throw std::runtime_error { fmt::format("Configuration key '{}' in {} is not an array of integers", ex.getPath(), cfg_file_path_) };
+    }
+}
+
 std::string Config::determineConfigDirectory()
 {
     static const std::string env_var_name { "CHIPS_DIST_CONFIG_PATH" };
@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <memory>
+
+#include <util/config.h>
+#include <util/timestamp.h>
+
+#include <fmt/format.h>
+
+#include "elastic_bulk_indexer.h"
+
+/// How long the flusher sleeps when there is nothing to do.
+static constexpr std::chrono::milliseconds POLL_INTERVAL { 10 };
+
+/// How long the replayer sleeps when the spool is empty.
+static constexpr std::chrono::milliseconds REPLAY_POLL_INTERVAL { 100 };
+
+ElasticBulkIndexerSettings ElasticBulkIndexerSettings::fromConfig()
+{
+    ElasticBulkIndexerSettings settings {};
+    settings.queue_size = g_config.lookupU32("elastic_search.queue_size");
+    settings.bulk_size = g_config.lookupU32("elastic_search.bulk_size");
+    settings.bulk_interval = std::chrono::milliseconds { static_cast<long>(1e3 * g_config.lookupDouble("elastic_search.bulk_interval")) };
+    settings.stats_interval = std::chrono::milliseconds { static_cast<long>(1e3 * g_config.lookupDouble("elastic_search.stats_interval")) };
+    settings.retry_interval = std::chrono::milliseconds { static_cast<long>(1e3 * g_config.lookupDouble("elastic_search.retry_interval")) };
+    settings.spool.directory = g_config.lookupString("elastic_search.spool_directory");
+    settings.spool.segment_bytes = g_config.lookupU64("elastic_search.spool_segment_size");
+    settings.spool.max_bytes = g_config.lookupU64("elastic_search.spool_size");
+    settings.replay_rate = g_config.lookupDouble("elastic_search.replay_rate");
+    return settings;
+}
+
+ElasticBulkIndexer::ElasticBulkIndexer(const ElasticBulkIndexerSettings& settings, const std::vector<std::string>& hosts,
+    const std::string& process_name)
+    : Logging {}
+    , settings_ { settings }
+    , hosts_ { hosts }
+    , process_name_ { process_name }
+    , builder_ {}
+    , queue_ { settings.queue_size }
+    , queue_depth_ { 0 }
+    , running_ { true }
+    , flusher_thread_ {}
+    , spool_ {}
+    , outage_ { false }
+    , retry_time_ {}
+    , replayer_thread_ {}
+    , n_indexed_ { 0 }
+    , n_rejected_ { 0 }
+    , n_failed_ { 0 }
+    , n_requests_ { 0 }
+    , n_spooled_ { 0 }
+    , n_replayed_ { 0 }
+    , last_flush_us_ { 0 }
+    , max_flush_us_ { 0 }
+{
+    setUnitName("ElasticBulkIndexer");
+
+    if (settings_.bulk_size == 0) {
+        settings_.bulk_size = 1;
+    }
+    settings_.replay_rate = std::max(settings_.replay_rate, 1.0);
+
+    builder_["commentStyle"] = "None";
+    builder_["indentation"] = "";
+
+    if (!settings_.spool.directory.empty()) {
+        // Processes must not share segments, name the subdirectory after the executable.
+        ElasticSpoolSettings spool_settings { settings_.spool };
+        spool_settings.directory += "/" + process_name.substr(process_name.find_last_of('/') + 1);
+
+        try {
+            spool_.reset(new ElasticSpool(spool_settings));
+        } catch (const std::runtime_error& e) {
+            logWithoutES(ERROR, "Spooling disabled: {}", e.what());
+        }
+    }
+
+    flusher_thread_ = std::thread { &ElasticBulkIndexer::run, this };
+    if (spool_) {
+        replayer_thread_ = std::thread { &ElasticBulkIndexer::replay, this };
+    }
+}
+
+ElasticBulkIndexer::~ElasticBulkIndexer()
+{
+    running_ = false;
+    flusher_thread_.join();
+    if (replayer_thread_.joinable()) {
+        replayer_thread_.join();
+    }
+
+    // Anything pushed after the flusher has finished is lost.
+    PendingDocument* pending {};
+    while (queue_.pop(pending)) {
+        delete pending;
+        ++n_failed_;
+    }
+}
+
+bool ElasticBulkIndexer::add(const std::string& index, const Json::Value& document)
+{
+    return addSerialised(index, Json::writeString(builder_, document));
+}
+
+bool ElasticBulkIndexer::addSerialised(const std::string& index, std::string document)
+{
+    // Bounded push never allocates beyond the nodes reserved up front, hence the queue cannot grow.
+    PendingDocument* pending { new PendingDocument { index, std::move(document) } };
+    if (!queue_.bounded_push(pending)) {
+        // Elasticsearch cannot keep up, keep the document on disk instead.
+        const bool spooled { spool_ && spool_->append(pending->index, pending->document) };
+        delete pending;
+
+        if (spooled) {
+            ++n_spooled_;
+            return true;
+        }
+
+        ++n_rejected_;
+        return false;
+    }
+
+    ++queue_depth_;
+    return true;
+}
+
+ElasticBulkIndexerStats ElasticBulkIndexer::stats() const
+{
+    ElasticBulkIndexerStats stats {};
+    stats.queue_depth = queue_depth_;
+    stats.n_indexed = n_indexed_;
+    stats.n_rejected = n_rejected_;
+    stats.n_failed = n_failed_;
+    stats.n_requests = n_requests_;
+    stats.n_spooled = n_spooled_;
+    stats.n_replayed = n_replayed_;
+    stats.spool_bytes = spool_ ? spool_->bytes() : 0;
+    stats.last_flush_ms = last_flush_us_ / 1000.0;
+    stats.max_flush_ms = max_flush_us_ / 1000.0;
+    return stats;
+}
+
+void ElasticBulkIndexer::run()
+{
+    // A single client keeps its connection open between requests.
+    elasticlient::Client client { hosts_ };
+
+    Batch batch {};
+    std::size_t n_pending { 0 };
+    std::chrono::steady_clock::time_point oldest {};
+    std::chrono::steady_clock::time_point last_stats { std::chrono::steady_clock::now() };
+
+    for (;;) {
+        // Stop flag is sampled first, so that documents queued before it was set are still sent.
+        const bool stopping { !running_ };
+
+        PendingDocument* pending {};
+        while (n_pending < settings_.bulk_size && queue_.pop(pending)) {
+            --queue_depth_;
+
+            if (n_pending++ == 0) {
+                oldest = std::chrono::steady_clock::now();
+            }
+
+            batch[pending->index].push_back(std::move(pending->document));
+            delete pending;
+        }
+
+        const auto now { std::chrono::steady_clock::now() };
+        if (n_pending > 0 && (stopping || n_pending >= settings_.bulk_size || now - oldest >= settings_.bulk_interval)) {
+            flush(client, batch, n_pending);
+            continue;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (settings_.stats_interval.count() > 0 && now - last_stats >= settings_.stats_interval) {
+            addStats();
+            last_stats = now;
+        }
+
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+void ElasticBulkIndexer::replay()
+{
+    // Replayed documents have their own connection, not to delay fresh ones.
+    elasticlient::Client client { hosts_ };
+
+    // Batches take about a second at the replay rate.
+    const std::size_t max_records { std::min(settings_.bulk_size, static_cast<std::size_t>(settings_.replay_rate)) };
+    std::vector<ElasticSpoolRecord> records {};
+
+    while (running_) {
+        if (outage_) {
+            // Probe again after the retry interval, even if no fresh documents arrive meanwhile.
+            const auto retry_time { std::chrono::steady_clock::now() + settings_.retry_interval };
+            while (running_ && std::chrono::steady_clock::now() < retry_time) {
+                std::this_thread::sleep_for(REPLAY_POLL_INTERVAL);
+            }
+        }
+
+        const auto start { std::chrono::steady_clock::now() };
+        const ElasticSpoolPosition next { spool_->read(max_records, records) };
+        if (records.empty()) {
+            std::this_thread::sleep_for(REPLAY_POLL_INTERVAL);
+            continue;
+        }
+
+        std::string body {};
+        for (const ElasticSpoolRecord& record : records) {
+            appendAction(body, record.index, record.document);
+        }
+
+        try {
+            const std::size_t n_failed { send(client, body) };
+            spool_->commit(next);
+
+            n_failed_ += n_failed;
+            n_replayed_ += records.size() - n_failed;
+            outage_ = false;
+        } catch (const std::runtime_error& e) {
+            logWithoutES(WARNING, "Failed to replay {} spooled documents, error: {}", records.size(), e.what());
+            outage_ = true;
+            continue;
+        }
+
+        // Pace batches to the replay rate.
+        std::this_thread::sleep_until(start
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double> { records.size() / settings_.replay_rate }));
+    }
+}
+
+void ElasticBulkIndexer::flush(elasticlient::Client& client, Batch& batch, std::size_t& n_pending)
+{
+    bool sent { false };
+
+    // While elasticsearch is unreachable, do not wait for timeouts of further requests.
+    const auto start { std::chrono::steady_clock::now() };
+    if (!outage_ || start >= retry_time_) {
+        // Documents of the same index are kept together in the request body.
+        std::string body {};
+        for (const auto& index_documents : batch) {
+            for (const std::string& document : index_documents.second) {
+                appendAction(body, index_documents.first, document);
+            }
+        }
+
+        try {
+            const std::size_t n_failed { send(client, body) };
+            n_failed_ += n_failed;
+            n_indexed_ += n_pending - n_failed;
+            outage_ = false;
+            sent = true;
+        } catch (const std::runtime_error& e) {
+            logWithoutES(WARNING, "Failed to index {} documents, spooling for {} ms, error: {}",
+                n_pending, settings_.retry_interval.count(), e.what());
+            outage_ = true;
+            retry_time_ = std::chrono::steady_clock::now() + settings_.retry_interval;
+        }
+
+        const std::uint64_t duration_us {
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count())
+        };
+        last_flush_us_ = duration_us;
+        if (duration_us > max_flush_us_) {
+            max_flush_us_ = duration_us;
+        }
+    }
+
+    if (!sent) {
+        for (const auto& index_documents : batch) {
+            for (const std::string& document : index_documents.second) {
+                if (spool_ && spool_->append(index_documents.first, document)) {
+                    ++n_spooled_;
+                } else {
+                    ++n_failed_;
+                }
+            }
+        }
+    }
+
+    batch.clear();
+    n_pending = 0;
+}
+
+std::size_t ElasticBulkIndexer::send(elasticlient::Client& client, const std::string& body)
+{
+    ++n_requests_;
+
+    const cpr::Response res = client.performRequest(elasticlient::Client::HTTPMethod::POST, "_bulk?pipeline=info", body);
+    if (res.status_code != 200) {
+        throw std::runtime_error(fmt::format("received code {}", res.status_code));
+    }
+
+    return countFailed(res.text);
+}
+
+void ElasticBulkIndexer::appendAction(std::string& body, const std::string& index, const std::string& document)
+{
+    body += "{\"index\":{\"_index\":\"";
+    body += index;
+    body += "\"}}\n";
+    body += document;
+    body += '\n';
+}
+
+std::size_t ElasticBulkIndexer::countFailed(const std::string& response)
+{
+    Json::CharReaderBuilder reader_builder {};
+    std::unique_ptr<Json::CharReader> reader { reader_builder.newCharReader() };
+
+    Json::Value root {};
+    std::string errors {};
+    if (!reader->parse(response.data(), response.data() + response.size(), &root, &errors)) {
+        logWithoutES(WARNING, "Failed to parse bulk response: {}", errors);
+        return 0;
+    }
+
+    if (!root["errors"].asBool()) {
+        return 0;
+    }
+
+    // Every item is an object with a single key, naming the action.
+    std::size_t n_failed { 0 };
+    for (const Json::Value& item : root["items"]) {
+        for (const Json::Value& result : item) {
+            if (!result.isMember("error")) {
+                continue;
+            }
+
+            if (n_failed++ == 0) {
+                logWithoutES(WARNING, "Document refused by index '{}': {}",
+                    result["_index"].asString(), Json::writeString(builder_, result["error"]));
+            }
+        }
+    }
+
+    return n_failed;
+}
+
+void ElasticBulkIndexer::addStats()
+{
+    const ElasticBulkIndexerStats current { stats() };
+
+    Json::Value document {};
+    document["timestamp"] = static_cast<Json::Int64>(1e3 * utc_timestamp::now().combined_secs());
+    document["process"] = process_name_;
+    document["queue_depth"] = static_cast<Json::UInt64>(current.queue_depth);
+    document["n_indexed"] = static_cast<Json::UInt64>(current.n_indexed);
+    document["n_rejected"] = static_cast<Json::UInt64>(current.n_rejected);
+    document["n_failed"] = static_cast<Json::UInt64>(current.n_failed);
+    document["n_requests"] = static_cast<Json::UInt64>(current.n_requests);
+    document["n_spooled"] = static_cast<Json::UInt64>(current.n_spooled);
+    document["n_replayed"] = static_cast<Json::UInt64>(current.n_replayed);
+    document["spool_bytes"] = static_cast<Json::UInt64>(current.spool_bytes);
+    document["last_flush_ms"] = current.last_flush_ms;
+    document["max_flush_ms"] = current.max_flush_ms;
+    add("daqelastic", document);
+}
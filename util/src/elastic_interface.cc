@@ -12,8 +12,7 @@ ElasticInterface g_elastic; ///< Global instance of this class
 ElasticInterface::ElasticInterface()
     : Logging {}
     , mode_(ELASTIC)
-    , index_work_(index_service_)
-    , log_counter_(0)
+    , index_work_(new boost::asio::io_service::work(index_service_))
 {
     builder_["commentStyle"] = "None";
     builder_["indentation"] = ""; // If you want whitespace-less output
@@ -44,6 +43,9 @@ void ElasticInterface::init(const std::string& process_name)
         elasticlient::setLogFunction(elasticlientCallback);
     }
 
+    // Documents are sent in bulk over a single persistent connection
+    bulk_indexer_.reset(new ElasticBulkIndexer(ElasticBulkIndexerSettings::fromConfig(), client_list_, process_name_));
+
     for (std::uint32_t threadCount = 0; threadCount < index_threads; threadCount++) // start indexing threads
     {
         index_threads_.create_thread(boost::bind(&ElasticInterface::runThread, this));
@@ -52,8 +54,12 @@ void ElasticInterface::init(const std::string& process_name)
 
 void ElasticInterface::stop_and_join()
 {
-    index_service_.stop();
+    // Let the indexing threads run out of work, rather than dropping what is posted already
+    index_work_.reset();
     index_threads_.join_all();
+
+    // Send documents still queued
+    bulk_indexer_.reset();
 }
 
 void ElasticInterface::log(Severity level, const std::string& unit, const std::string& message)
@@ -71,6 +77,15 @@ void ElasticInterface::document(std::string index, Json::Value document)
     index_service_.post(boost::bind(&ElasticInterface::documentWork, this, index, document, timestamp()));
 }
 
+void ElasticInterface::bulk(std::string index, std::vector<Json::Value> documents)
+{
+    if (documents.empty()) {
+        return;
+    }
+
+    index_service_.post(boost::bind(&ElasticInterface::bulkWork, this, index, std::move(documents), timestamp()));
+}
+
 void ElasticInterface::value(std::string index, float value)
 {
     index_service_.post(boost::bind(&ElasticInterface::valueWork, this, index, value, timestamp()));
@@ -86,23 +101,33 @@ void ElasticInterface::channel(channel_data data)
     index_service_.post(boost::bind(&ElasticInterface::channelWork, this, data));
 }
 
+void ElasticInterface::serialised(const std::string& index, const JsonWriter& writer)
+{
+    // Indexed by the io_service threads, which stop before the bulk indexer is destroyed
+    index_service_.post(boost::bind(&ElasticInterface::serialisedWork, this, index, writer.str()));
+}
+
 void ElasticInterface::run(int run_num, int run_type)
 {
     index_service_.post(boost::bind(&ElasticInterface::runWork, this, run_num, run_type));
 }
 
-void ElasticInterface::logWork(Severity level, std::string unit, std::string message, long timestamp)
+ElasticBulkIndexerStats ElasticInterface::bulkStats() const
 {
-    if (suppress()) // Should we suppress this log?
-        return;
+    return bulk_indexer_ ? bulk_indexer_->stats() : ElasticBulkIndexerStats {};
+}
 
-    Json::Value document; // Populate daqlog JSON document
-    document["timestamp"] = timestamp; // Milliseconds since epoch timestamp
-    document["process"] = process_name_; // Process name
-    document["pid"] = pid_; // Process ID
-    document["unit"] = unit; // Unit name
-    document["severity"] = level; // severity level
-    document["message"] = message; // log message
+void ElasticInterface::logWork(Severity level, std::string unit, std::string message, long timestamp)
+{
+    JsonWriter document; // Populate daqlog JSON document
+    document.beginObject();
+    document.field("timestamp", timestamp); // Milliseconds since epoch timestamp
+    document.field("process", process_name_); // Process name
+    document.field("pid", pid_); // Process ID
+    document.field("unit", unit); // Unit name
+    document.field("severity", static_cast<int>(level)); // severity level
+    document.field("message", message); // log message
+    document.endObject();
 
     if (mode() == ELASTIC) // only ELASTIC mode
     {
@@ -111,7 +136,7 @@ void ElasticInterface::logWork(Severity level, std::string unit, std::string mes
         work_mutex_.lock();
         std::ofstream file;
         file.open(file_name_, std::ios_base::app);
-        file << Json::writeString(builder_, document) << "\n";
+        file.write(document.data(), document.size()) << "\n";
         file.close();
         work_mutex_.unlock();
     }
@@ -119,13 +144,15 @@ void ElasticInterface::logWork(Severity level, std::string unit, std::string mes
 
 void ElasticInterface::stateWork(std::string process, std::string state, long timestamp)
 {
-    Json::Value document; // Populate daqstate JSON document
-    document["timestamp"] = timestamp; // Milliseconds since epoch timestamp
-    document["process"] = process; // Process name
-    document["state"] = state; // Process state keyword
-
     if (mode() == ELASTIC) // only ELASTIC mode
     {
+        JsonWriter document; // Populate daqstate JSON document
+        document.beginObject();
+        document.field("timestamp", timestamp); // Milliseconds since epoch timestamp
+        document.field("process", process); // Process name
+        document.field("state", state); // Process state keyword
+        document.endObject();
+
         index("daqstate", document); // Index to elasticsearch
     }
 }
@@ -140,6 +167,26 @@ void ElasticInterface::documentWork(std::string name, Json::Value document, long
     }
 }
 
+void ElasticInterface::bulkWork(std::string name, std::vector<Json::Value> documents, long timestamp)
+{
+    if (mode() == ELASTIC) // only ELASTIC mode
+    {
+        for (Json::Value& document : documents) {
+            document["timestamp"] = timestamp; // add timestamp
+
+            index(name, document); // Queue for indexing, documents are sent together
+        }
+    }
+}
+
+void ElasticInterface::serialisedWork(std::string index, std::string document)
+{
+    if (mode() == ELASTIC && bulk_indexer_) // only ELASTIC mode, and not before init() or after stop_and_join()
+    {
+        bulk_indexer_->addSerialised(index, std::move(document));
+    }
+}
+
 void ElasticInterface::valueWork(std::string name, float value, long timestamp)
 {
     if (mode() == ELASTIC) // only ELASTIC mode
@@ -156,12 +203,14 @@ void ElasticInterface::pomWork(pom_data data)
 {
     if (mode() == ELASTIC) // only ELASTIC mode
     {
-        Json::Value document; // populate daqmon JSON document
-        document["timestamp"] = data.timestamp; // timestamp from the monitoring packet
-        document["pom"] = data.pom; // planar optical module ID
-        document["temperature"] = data.temperature; // planar optical module temperature
-        document["humidity"] = data.humidity; // planar optical module humidity
-        document["sync"] = data.sync; // is planar optical module time synced?
+        JsonWriter document; // populate daqmon JSON document
+        document.beginObject();
+        document.field("timestamp", data.timestamp); // timestamp from the monitoring packet
+        document.field("pom", data.pom); // planar optical module ID
+        document.field("temperature", data.temperature); // planar optical module temperature
+        document.field("humidity", data.humidity); // planar optical module humidity
+        document.field("sync", data.sync); // is planar optical module time synced?
+        document.endObject();
 
         index("monpom", document); // Index to elasticsearch
     }
@@ -171,34 +220,23 @@ void ElasticInterface::channelWork(channel_data data)
 {
     if (mode() == ELASTIC) // only ELASTIC mode
     {
-        // Now and again the client will not respond, therefore, we try a few times
-        std::shared_ptr<elasticlient::Client> client = std::make_shared<elasticlient::Client>(client_list_);
-        elasticlient::Bulk bulkIndexer(client); /// Create the elasticsearch client bulk indexer
-
-        // Populate the bulk data
-        elasticlient::SameIndexBulkData bulk("monchannel", 30);
-        for (int i = 0; i < 30; i++) {
-            Json::Value document;
-            document["timestamp"] = data.timestamp; // timestamp from the monitoring packet
-            document["pom"] = data.pom; // planar optical module ID
-            document["channel"] = i;
-            document["eid"] = 0;
-            document["rate"]["rate"] = data.rate[i];
-            document["rate"]["veto"] = (bool)data.veto[i];
-            bulk.indexDocument("_doc", "", Json::writeString(builder_, document));
+        // A single writer is reused, its buffer does not need to grow again
+        JsonWriter document;
+        for (int i = 0; i < data.n_channels; i++) {
+            document.clear();
+            document.beginObject();
+            document.field("timestamp", data.timestamp); // timestamp from the monitoring packet
+            document.field("pom", data.pom); // planar optical module ID
+            document.field("channel", i);
+            document.field("eid", 0);
+            document.beginObject("rate");
+            document.field("rate", data.rate[i]);
+            document.field("veto", (bool)data.veto[i]);
+            document.endObject();
+            document.endObject();
+
+            index("monchannel", document); // Queue for indexing, documents are sent together
         }
-
-        for (int attempt = 0; attempt < MAX_ELASTIC_ATTEMPTS; attempt++) {
-            try {
-                size_t errors = bulkIndexer.perform(bulk);
-                if (errors == 0) {
-                    return;
-                }
-            } catch (const std::runtime_error& e) {
-            }
-        }
-
-        //initFile("Exceeded MAX_ELASTIC_ATTEMPTS in bulkIndex()"); // Init file logging as elasticsearch unreachable
     }
 }
 
@@ -227,54 +265,25 @@ void ElasticInterface::runThread()
     index_service_.run();
 }
 
-bool ElasticInterface::suppress()
+void ElasticInterface::index(std::string index, Json::Value document)
 {
-    work_mutex_.lock();
-    if (log_counter_ == 0) {
-        timer_start_ = std::chrono::system_clock::now();
-        log_counter_++;
-    } else if (log_counter_ < MAX_LOG_RATE) {
-        log_counter_++;
-    } else {
-        std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-        int diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - timer_start_).count();
-        if (diff < 1000) {
-            log_counter_++;
-            work_mutex_.unlock();
-            return true;
-        } else if (log_counter_ > MAX_LOG_RATE) {
-            logWithoutES(WARNING, "ElasticInterface suppressed a rate of: {}", log_counter_);
-            log_counter_ = 0;
-        } else {
-            log_counter_ = 0;
-        }
+    if (!bulk_indexer_) {
+        // Not initialised yet, or already stopped.
+        return;
     }
 
-    work_mutex_.unlock();
-    return false;
+    // Failed requests are counted by the indexer, which has no way of retrying them
+    bulk_indexer_->add(index, document);
 }
 
-void ElasticInterface::index(std::string index, Json::Value document)
+void ElasticInterface::index(const std::string& index, const JsonWriter& writer)
 {
-    elasticlient::Client client(client_list_); /// Create the elasticsearch client
-
-    // Now and again the client will not respond, therefore, we try a few times
-    for (int attempt = 0; attempt < MAX_ELASTIC_ATTEMPTS; attempt++) {
-        try {
-            cpr::Response res = client.index(index, "_doc", "?pipeline=info", Json::writeString(builder_, document));
-            if (res.status_code == 201) {
-                return;
-            } else {
-                logWithoutES(WARNING, "Failed to index document (received code {}): '{}'",
-                    res.status_code, Json::writeString(builder_, document));
-            }
-        } catch (const std::runtime_error& e) {
-            logWithoutES(WARNING, "Failed to index document: '{}', error: {}",
-                Json::writeString(builder_, document), e.what());
-        }
+    if (!bulk_indexer_) {
+        // Not initialised yet, or already stopped.
+        return;
     }
 
-    //initFile("Exceeded MAX_ELASTIC_ATTEMPTS in index()"); // Init file logging as elasticsearch unreachable
+    bulk_indexer_->addSerialised(index, writer.str());
 }
 
 void ElasticInterface::initFile(std::string error)
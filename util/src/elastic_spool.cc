@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+#include <fmt/format.h>
+
+#include "elastic_spool.h"
+
+/// Every segment starts with this, followed by records.
+static constexpr char SEGMENT_MAGIC[] { 'E', 'S', 'S', 'P', 'O', 'O', 'L', '1' };
+static constexpr std::uint64_t SEGMENT_HEADER_SIZE { sizeof(SEGMENT_MAGIC) };
+
+/// Every record starts with the size and CRC-32 of its payload, "<index>\0<document>".
+static constexpr std::uint64_t RECORD_HEADER_SIZE { 2 * sizeof(std::uint32_t) };
+
+static constexpr const char* SEGMENT_SUFFIX { ".spool" };
+
+static std::uint32_t checksum(const char* data, std::size_t size)
+{
+    boost::crc_32_type crc {};
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+static bool writeAll(int fd, const char* data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t n_written { ::write(fd, data, size) };
+        if (n_written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        data += n_written;
+        size -= static_cast<std::size_t>(n_written);
+    }
+
+    return true;
+}
+
+static bool readAll(int fd, char* data, std::size_t size, std::uint64_t offset)
+{
+    while (size > 0) {
+        const ssize_t n_read { ::pread(fd, data, size, static_cast<off_t>(offset)) };
+        if (n_read < 0 && errno == EINTR) {
+            continue;
+        } else if (n_read <= 0) {
+            return false;
+        }
+
+        data += n_read;
+        size -= static_cast<std::size_t>(n_read);
+        offset += static_cast<std::uint64_t>(n_read);
+    }
+
+    return true;
+}
+
+static void makeDirectories(const std::string& path)
+{
+    for (std::size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            const std::string prefix { path.substr(0, i) };
+            if (::mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                throw std::runtime_error(fmt::format("Cannot create spool directory '{}': {}", prefix, std::strerror(errno)));
+            }
+        }
+    }
+}
+
+ElasticSpool::ElasticSpool(const ElasticSpoolSettings& settings)
+    : Logging {}
+    , settings_ { settings }
+    , mutex_ {}
+    , segments_ {}
+    , write_fd_ { -1 }
+    , position_ {}
+    , total_bytes_ { 0 }
+    , n_dropped_ { 0 }
+{
+    setUnitName("ElasticSpool");
+
+    makeDirectories(settings_.directory);
+    scanSegments();
+    loadPosition();
+
+    if (!segments_.empty()) {
+        logWithoutES(INFO, "Found {} spooled segments ({} bytes) in '{}'", segments_.size(), total_bytes_, settings_.directory);
+    }
+}
+
+ElasticSpool::~ElasticSpool()
+{
+    closeSegment();
+}
+
+std::string ElasticSpool::segmentPath(std::uint64_t segment) const
+{
+    return fmt::format("{}/{:020}{}", settings_.directory, segment, SEGMENT_SUFFIX);
+}
+
+std::string ElasticSpool::positionPath() const
+{
+    return settings_.directory + "/replay.pos";
+}
+
+void ElasticSpool::scanSegments()
+{
+    DIR* dir { ::opendir(settings_.directory.c_str()) };
+    if (!dir) {
+        throw std::runtime_error(fmt::format("Cannot open spool directory '{}': {}", settings_.directory, std::strerror(errno)));
+    }
+
+    const std::size_t suffix_length { std::strlen(SEGMENT_SUFFIX) };
+    while (const dirent* entry = ::readdir(dir)) {
+        const std::string name { entry->d_name };
+        if (name.size() <= suffix_length || name.compare(name.size() - suffix_length, suffix_length, SEGMENT_SUFFIX) != 0) {
+            continue;
+        }
+
+        struct stat status {};
+        if (::stat((settings_.directory + "/" + name).c_str(), &status) != 0) {
+            continue;
+        }
+
+        const std::uint64_t segment { std::strtoull(name.c_str(), nullptr, 10) };
+        segments_[segment] = static_cast<std::uint64_t>(status.st_size);
+        total_bytes_ += static_cast<std::uint64_t>(status.st_size);
+    }
+
+    ::closedir(dir);
+}
+
+void ElasticSpool::loadPosition()
+{
+    std::ifstream file { positionPath() };
+    if (!(file >> position_.segment >> position_.offset)) {
+        position_ = {};
+    }
+
+    // Segments before the position have been replayed, but may have survived a crash.
+    if (segments_.empty()) {
+        position_ = { 0, SEGMENT_HEADER_SIZE };
+    } else if (position_.segment < segments_.begin()->first) {
+        position_ = { segments_.begin()->first, SEGMENT_HEADER_SIZE };
+    } else if (position_.segment > segments_.rbegin()->first) {
+        position_ = { segments_.rbegin()->first, segments_.rbegin()->second };
+    }
+    position_.offset = std::max(position_.offset, SEGMENT_HEADER_SIZE);
+}
+
+void ElasticSpool::savePosition()
+{
+    // Replace the file atomically, so that a crash leaves either the old or the new position.
+    const std::string path { positionPath() };
+    const std::string temp_path { path + ".tmp" };
+    {
+        std::ofstream file { temp_path, std::ios::trunc };
+        file << position_.segment << ' ' << position_.offset << '\n';
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        logWithoutES(WARNING, "Cannot save replay position to '{}': {}", path, std::strerror(errno));
+    }
+}
+
+void ElasticSpool::openSegment(std::uint64_t segment)
+{
+    const std::string path { segmentPath(segment) };
+    write_fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (write_fd_ < 0) {
+        throw std::runtime_error(fmt::format("Cannot create spool segment '{}': {}", path, std::strerror(errno)));
+    }
+
+    if (!writeAll(write_fd_, SEGMENT_MAGIC, SEGMENT_HEADER_SIZE)) {
+        throw std::runtime_error(fmt::format("Cannot write spool segment '{}': {}", path, std::strerror(errno)));
+    }
+
+    segments_[segment] = SEGMENT_HEADER_SIZE;
+    total_bytes_ += SEGMENT_HEADER_SIZE;
+}
+
+void ElasticSpool::closeSegment()
+{
+    if (write_fd_ < 0) {
+        return;
+    }
+
+    ::fdatasync(write_fd_);
+    ::close(write_fd_);
+    write_fd_ = -1;
+}
+
+bool ElasticSpool::append(const std::string& index, const std::string& document)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    const std::uint64_t payload_size { index.size() + 1 + document.size() };
+    const std::uint64_t record_size { RECORD_HEADER_SIZE + payload_size };
+    if (total_bytes_ + record_size + SEGMENT_HEADER_SIZE > settings_.max_bytes) {
+        ++n_dropped_;
+        return false;
+    }
+
+    try {
+        // Segments of previous processes are left as they are, new records always go to a new one.
+        if (write_fd_ < 0) {
+            openSegment(segments_.empty() ? 0 : segments_.rbegin()->first + 1);
+        } else if (segments_.rbegin()->second + record_size > settings_.segment_bytes) {
+            const std::uint64_t next_segment { segments_.rbegin()->first + 1 };
+            closeSegment();
+            openSegment(next_segment);
+        }
+    } catch (const std::runtime_error& e) {
+        logWithoutES(ERROR, "{}", e.what());
+        closeSegment();
+        ++n_dropped_;
+        return false;
+    }
+
+    // Records are written with a single call, so a crash can only tear the last one.
+    std::string record(RECORD_HEADER_SIZE, '\0');
+    record.reserve(record_size);
+    record += index;
+    record += '\0';
+    record += document;
+
+    const std::uint32_t header[2] {
+        static_cast<std::uint32_t>(payload_size),
+        checksum(record.data() + RECORD_HEADER_SIZE, payload_size)
+    };
+    std::memcpy(&record[0], header, RECORD_HEADER_SIZE);
+
+    if (!writeAll(write_fd_, record.data(), record.size())) {
+        const std::string path { segmentPath(segments_.rbegin()->first) };
+        logWithoutES(ERROR, "Cannot write spool segment '{}': {}", path, std::strerror(errno));
+
+        // Cut off what was written of the record, later ones would otherwise follow a torn one,
+        // which makes the replayer skip the rest of the segment. Failing that, start a new segment.
+        if (::ftruncate(write_fd_, static_cast<off_t>(segments_.rbegin()->second)) != 0) {
+            logWithoutES(ERROR, "Cannot truncate spool segment '{}': {}", path, std::strerror(errno));
+            closeSegment();
+        }
+
+        ++n_dropped_;
+        return false;
+    }
+
+    segments_.rbegin()->second += record_size;
+    total_bytes_ += record_size;
+    return true;
+}
+
+ElasticSpoolPosition ElasticSpool::read(std::size_t max_records, std::vector<ElasticSpoolRecord>& records)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    records.clear();
+
+    ElasticSpoolPosition position { position_ };
+    int read_fd { -1 };
+    std::uint64_t read_segment { 0 };
+    std::vector<char> payload {};
+
+    while (records.size() < max_records) {
+        auto segment_it { segments_.lower_bound(position.segment) };
+        if (segment_it == segments_.end()) {
+            break;
+        }
+        if (segment_it->first != position.segment) {
+            position = { segment_it->first, SEGMENT_HEADER_SIZE };
+        }
+
+        // Move on to the next segment once this one is exhausted, unless it is still being written.
+        const std::uint64_t segment_size { segment_it->second };
+        if (position.offset >= segment_size) {
+            if (std::next(segment_it) == segments_.end()) {
+                break;
+            }
+            position = { std::next(segment_it)->first, SEGMENT_HEADER_SIZE };
+            continue;
+        }
+
+        if (read_fd < 0 || read_segment != position.segment) {
+            if (read_fd >= 0) {
+                ::close(read_fd);
+            }
+            read_segment = position.segment;
+            read_fd = ::open(segmentPath(read_segment).c_str(), O_RDONLY | O_CLOEXEC);
+        }
+
+        std::uint32_t header[2] {};
+        bool valid { read_fd >= 0 && position.offset + RECORD_HEADER_SIZE <= segment_size
+            && readAll(read_fd, reinterpret_cast<char*>(header), RECORD_HEADER_SIZE, position.offset)
+            && position.offset + RECORD_HEADER_SIZE + header[0] <= segment_size };
+
+        if (valid) {
+            payload.resize(header[0]);
+            valid = readAll(read_fd, payload.data(), payload.size(), position.offset + RECORD_HEADER_SIZE)
+                && checksum(payload.data(), payload.size()) == header[1];
+        }
+
+        const char* separator { valid ? static_cast<const char*>(std::memchr(payload.data(), '\0', payload.size())) : nullptr };
+        if (!separator) {
+            // Torn by a crash, nothing past this point can be trusted.
+            logWithoutES(WARNING, "Discarding corrupted spool segment '{}' from offset {}", segmentPath(position.segment), position.offset);
+            ++n_dropped_;
+            position.offset = segment_size;
+            continue;
+        }
+
+        ElasticSpoolRecord record {};
+        const char* begin { payload.data() };
+        record.index.assign(begin, separator);
+        record.document.assign(separator + 1, begin + payload.size());
+        records.push_back(std::move(record));
+
+        position.offset += RECORD_HEADER_SIZE + header[0];
+    }
+
+    if (read_fd >= 0) {
+        ::close(read_fd);
+    }
+
+    return position;
+}
+
+void ElasticSpool::commit(const ElasticSpoolPosition& position)
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+
+    position_ = position;
+
+    // Segments before the position are fully replayed. The newest segment always stays, it may be open.
+    for (auto segment_it = segments_.begin(); segment_it != segments_.end() && segment_it->first < position_.segment;) {
+        if (std::next(segment_it) == segments_.end()) {
+            break;
+        }
+
+        const std::string path { segmentPath(segment_it->first) };
+        if (::unlink(path.c_str()) != 0) {
+            logWithoutES(WARNING, "Cannot delete spool segment '{}': {}", path, std::strerror(errno));
+        }
+
+        total_bytes_ -= segment_it->second;
+        segment_it = segments_.erase(segment_it);
+    }
+
+    savePosition();
+}
+
+bool ElasticSpool::emptyUnlocked() const
+{
+    if (segments_.empty()) {
+        return true;
+    }
+
+    const auto& newest { *segments_.rbegin() };
+    return position_.segment == newest.first && position_.offset >= newest.second;
+}
+
+bool ElasticSpool::empty() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    return emptyUnlocked();
+}
+
+std::uint64_t ElasticSpool::bytes() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    return total_bytes_;
+}
+
+std::uint64_t ElasticSpool::nDropped() const
+{
+    std::lock_guard<std::mutex> lock { mutex_ };
+    return n_dropped_;
+}
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "json_writer.h"
+
+JsonWriter::JsonWriter()
+    : buffer_ {}
+    , needs_comma_ { false }
+{
+}
+
+void JsonWriter::clear()
+{
+    buffer_.clear();
+    needs_comma_ = false;
+}
+
+void JsonWriter::beginObject()
+{
+    append('{');
+    needs_comma_ = false;
+}
+
+void JsonWriter::beginObject(const char* name)
+{
+    key(name);
+    beginObject();
+}
+
+void JsonWriter::endObject()
+{
+    append('}');
+    needs_comma_ = true;
+}
+
+void JsonWriter::field(const char* name, std::int64_t value)
+{
+    key(name);
+    const fmt::format_int formatted { value };
+    append(formatted.data(), formatted.data() + formatted.size());
+}
+
+void JsonWriter::field(const char* name, double value)
+{
+    key(name);
+
+    // JSON has no representation of these, write them the way jsoncpp does by default.
+    if (std::isnan(value)) {
+        static constexpr char NULL_LITERAL[] { "null" };
+        append(NULL_LITERAL, NULL_LITERAL + sizeof(NULL_LITERAL) - 1);
+    } else if (std::isinf(value)) {
+        fmt::format_to(std::back_inserter(buffer_), "{}1e+9999", value < 0 ? "-" : "");
+    } else {
+        fmt::format_to(std::back_inserter(buffer_), "{}", value);
+    }
+}
+
+void JsonWriter::field(const char* name, bool value)
+{
+    key(name);
+
+    static constexpr char TRUE_LITERAL[] { "true" };
+    static constexpr char FALSE_LITERAL[] { "false" };
+    if (value) {
+        append(TRUE_LITERAL, TRUE_LITERAL + sizeof(TRUE_LITERAL) - 1);
+    } else {
+        append(FALSE_LITERAL, FALSE_LITERAL + sizeof(FALSE_LITERAL) - 1);
+    }
+}
+
+void JsonWriter::stringField(const char* name, const char* begin, const char* end)
+{
+    key(name);
+    append('"');
+    appendEscaped(begin, end);
+    append('"');
+}
+
+void JsonWriter::key(const char* name)
+{
+    if (needs_comma_) {
+        append(',');
+    }
+    needs_comma_ = true;
+
+    // Keys are literals of the schema, they never need escaping.
+    append('"');
+    append(name, name + std::strlen(name));
+    append('"');
+    append(':');
+}
+
+void JsonWriter::appendEscaped(const char* begin, const char* end)
+{
+    // Copy runs of plain characters at once, only special ones are written individually.
+    const char* run { begin };
+    for (const char* it = begin; it != end; ++it) {
+        const unsigned char c { static_cast<unsigned char>(*it) };
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        append(run, it);
+        run = it + 1;
+
+        switch (c) {
+        case '"':
+            append("\\\"", "\\\"" + 2);
+            break;
+        case '\\':
+            append("\\\\", "\\\\" + 2);
+            break;
+        case '\n':
+            append("\\n", "\\n" + 2);
+            break;
+        case '\r':
+            append("\\r", "\\r" + 2);
+            break;
+        case '\t':
+            append("\\t", "\\t" + 2);
+            break;
+        default:
+            fmt::format_to(std::back_inserter(buffer_), "\\u{:04x}", c);
+            break;
+        }
+    }
+
+    append(run, end);
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <cmath>
+
+#include "latency_histogram.h"
+
+constexpr std::uint64_t LatencyHistogram::SUB_BUCKETS;
+constexpr std::size_t LatencyHistogram::N_BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+    : buckets_ {}
+    , count_ { 0 }
+    , max_ { 0 }
+{
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    if (other.count_ == 0) {
+        return;
+    }
+
+    for (std::size_t idx = 0; idx < N_BUCKETS; ++idx) {
+        buckets_[idx] += other.buckets_[idx];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+}
+
+void LatencyHistogram::clear()
+{
+    buckets_.fill(0);
+    count_ = 0;
+    max_ = 0;
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(std::size_t idx)
+{
+    if (idx < 2 * SUB_BUCKETS) {
+        return idx;
+    }
+
+    const std::uint64_t shift { idx / SUB_BUCKETS - 1 };
+    const std::uint64_t sub_bucket { SUB_BUCKETS + idx % SUB_BUCKETS };
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+std::uint64_t LatencyHistogram::percentile(double percent) const
+{
+    if (count_ == 0) {
+        return 0;
+    }
+
+    const double fraction { std::min(std::max(percent, 0.0), 100.0) / 100.0 };
+    const std::uint64_t rank { std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * count_))) };
+
+    std::uint64_t n_counted { 0 };
+    for (std::size_t idx = 0; idx < N_BUCKETS; ++idx) {
+        n_counted += buckets_[idx];
+        if (n_counted >= rank) {
+            // The last bucket also holds the values beyond the range.
+            return idx == N_BUCKETS - 1 ? max_ : std::min(bucketUpperBound(idx), max_);
+        }
+    }
+
+    return max_;
+}
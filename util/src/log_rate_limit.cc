@@ -0,0 +1,61 @@
+#include <cstring>
+#include <thread>
+
+#include "log_rate_limit.h"
+
+LogSites::LogSites()
+    : sites_ { new LogSite[N_SITES]() }
+{
+}
+
+std::uint64_t LogSites::hashUnitName(const std::string& unit_name)
+{
+    // FNV-1a
+    std::uint64_t hash { 0xcbf29ce484222325ull };
+    for (const char c : unit_name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+LogSite* LogSites::find(std::uint64_t unit_hash, const char* format, const std::string& unit_name, Severity level, bool to_es)
+{
+    const std::uint64_t hash { (unit_hash * 0x9e3779b97f4a7c15ull) ^ reinterpret_cast<std::uintptr_t>(format) };
+    const std::uint64_t key { hash | 1 }; // never 0, which marks free sites
+
+    // Open addressing with linear probing, sites are never removed.
+    for (std::size_t probe = 0; probe < N_SITES; ++probe) {
+        LogSite& site { sites_[(hash + probe) % N_SITES] };
+
+        std::uint64_t site_key { site.key.load(std::memory_order_acquire) };
+        if (site_key == 0) {
+            if (site.key.compare_exchange_strong(site_key, key, std::memory_order_acq_rel)) {
+                site.unit_hash = unit_hash;
+                site.format = format;
+                const std::size_t unit_size { std::min(unit_name.size(), LogRecord::UNIT_SIZE - 1) };
+                std::memcpy(site.unit_name, unit_name.data(), unit_size);
+                site.unit_name[unit_size] = '\0';
+                site.level = level;
+                site.to_es = to_es;
+                site.ready.store(true, std::memory_order_release);
+                return &site;
+            }
+            // Taken by another thread in the meantime, site_key now holds its key.
+        }
+
+        if (site_key != key) {
+            continue;
+        }
+
+        // The thread which took the site is about to fill it in.
+        while (!site.ready.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        if (site.unit_hash == unit_hash && site.format == format) {
+            return &site;
+        }
+    }
+
+    return nullptr;
+}
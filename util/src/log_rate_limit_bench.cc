@@ -0,0 +1,141 @@
+/**
+ * Program name: util_log_rate_limit_bench - Checks and times rate limits of log messages.
+ *
+ * Buckets are driven by a simulated clock, so that the number of messages they let
+ * through can be checked exactly. The site table is checked to find the sites of units
+ * created anew under the same name, to stay bounded, and to hand out a single site to
+ * threads racing for it. Finally, the cost of a call turned away by its site is timed.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <util/log_rate_limit.h>
+
+namespace exit_code {
+static constexpr int success = 0;
+static constexpr int failure = 1;
+}
+
+static int n_failures { 0 };
+
+static void check(bool condition, const std::string& what)
+{
+    fmt::print("{:<72} {}\n", what, condition ? "ok" : "FAILED");
+    n_failures += !condition;
+}
+
+static void checkBucket()
+{
+    const LogLimit limit { 100000000, 1000000000 }; // 10 messages per second, bursts of 10
+    const std::int64_t start_ns { 1000000000000 };
+    LogBucket bucket {};
+
+    std::size_t n_passed { 0 };
+    for (std::size_t i = 0; i < 100000; ++i) {
+        n_passed += bucket.take(start_ns, limit);
+    }
+    check(n_passed == 10, fmt::format("storm of 100000 messages passes its burst of 10 (passed {})", n_passed));
+
+    n_passed = 0;
+    for (std::size_t i = 0; i < 100; ++i) {
+        n_passed += bucket.take(start_ns + limit.interval_ns, limit);
+    }
+    check(n_passed == 1, fmt::format("one more passes after one interval (passed {})", n_passed));
+
+    n_passed = 0;
+    for (std::int64_t t = 0; t < 10 * 1000000000ll; t += 1000000) {
+        n_passed += bucket.take(start_ns + 2 * limit.interval_ns + 1000000000 + t, limit);
+    }
+    check(n_passed >= 100 && n_passed <= 110, fmt::format("sustained storm passes the rate over 10 s (passed {})", n_passed));
+}
+
+static void checkSites()
+{
+    static const char* const FORMAT { "Spill {} closed" };
+    LogSites sites {};
+
+    // Units created for every run share the sites of their predecessors.
+    const std::uint64_t serialiser { LogSites::hashUnitName("DataRunSerialiser") };
+    LogSite* first { sites.find(serialiser, FORMAT, "DataRunSerialiser", INFO, true) };
+    bool same { first != nullptr };
+    for (std::size_t run = 0; run < 100000; ++run) {
+        same &= sites.find(LogSites::hashUnitName("DataRunSerialiser"), FORMAT, "DataRunSerialiser", INFO, true) == first;
+    }
+    check(same, "units created anew under the same name find the same site");
+
+    LogSite* other { sites.find(LogSites::hashUnitName("BasicHitReceiver[57001]"), FORMAT, "BasicHitReceiver[57001]", INFO, true) };
+    check(other != nullptr && other != first, "units of different names get sites of their own");
+
+    std::size_t n_sites { 0 };
+    sites.forEach([&](LogSite&) { ++n_sites; });
+    check(n_sites == 2, fmt::format("table holds one site per unit name and call site (holds {})", n_sites));
+
+    // Threads racing for a new site all end up with the same one.
+    const std::uint64_t raced { LogSites::hashUnitName("SpillSchedule") };
+    std::vector<LogSite*> found(8, nullptr);
+    std::atomic_bool go { false };
+    std::vector<std::thread> threads {};
+    for (std::size_t i = 0; i < found.size(); ++i) {
+        threads.emplace_back([&, i] {
+            while (!go) {
+            }
+            found[i] = sites.find(raced, FORMAT, "SpillSchedule", INFO, true);
+        });
+    }
+    go = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    bool all_same { found[0] != nullptr };
+    for (LogSite* site : found) {
+        all_same &= site == found[0];
+    }
+    check(all_same, "threads racing for a new site get the same one");
+
+    // Once full, the table turns new sites away rather than mixing them up.
+    for (std::size_t i = 0; i < LogSites::N_SITES; ++i) {
+        sites.find(LogSites::hashUnitName(fmt::format("Unit[{}]", i)), FORMAT, "Unit", INFO, true);
+    }
+    check(sites.find(LogSites::hashUnitName("Unit[new]"), FORMAT, "Unit", INFO, true) == nullptr,
+        "a full table returns no site");
+    check(sites.find(serialiser, FORMAT, "DataRunSerialiser", INFO, true) == first, "a full table still finds its sites");
+}
+
+static void timeSuppressed()
+{
+    static const char* const FORMAT { "Dropping datagram {}" };
+    const LogLimit limit { 100000000, 1000000000 };
+    LogSites sites {};
+    const std::uint64_t unit_hash { LogSites::hashUnitName("BasicHitReceiver[57001]") };
+
+    const std::size_t n_calls { 10000000 };
+    std::size_t n_passed { 0 };
+    const auto start { std::chrono::steady_clock::now() };
+    for (std::size_t i = 0; i < n_calls; ++i) {
+        LogSite* site { sites.find(unit_hash, FORMAT, "BasicHitReceiver[57001]", WARNING, true) };
+        if (site->bucket.take(0, limit)) {
+            ++n_passed;
+        } else {
+            site->n_suppressed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    const std::chrono::duration<double, std::nano> elapsed { std::chrono::steady_clock::now() - start };
+
+    fmt::print("suppressed call: {:.1f} ns ({} of {} passed)\n", elapsed.count() / n_calls, n_passed, n_calls);
+}
+
+int main()
+{
+    checkBucket();
+    checkSites();
+    timeSuppressed();
+
+    return n_failures == 0 ? exit_code::success : exit_code::failure;
+}
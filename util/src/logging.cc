@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
 #include <util/config.h>
 
 #include "elastic_interface.h"
@@ -46,22 +50,81 @@ Severity severityFromString(const std::string& str)
 
 Logging::Logging()
     : unit_name_ { "unknown_unit" }
+    , unit_hash_ { LogSites::hashUnitName(unit_name_) }
+    , bucket_ {}
 {
 }
 
 void Logging::setUnitName(std::string&& unit_name)
 {
     unit_name_ = unit_name;
+    unit_hash_ = LogSites::hashUnitName(unit_name_);
+}
+
+LogRing::LogRing()
+    : records_ { new LogRecord[N_RECORDS] }
+    , head_ { 0 }
+    , tail_ { 0 }
+    , abandoned_ { false }
+{
+}
+
+/// How long the logging thread sleeps at most when there is nothing to write
+static constexpr std::chrono::milliseconds CONSUMER_IDLE_WAIT { 5 };
+
+static std::int64_t steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Read a rate limit of the "logging.rate_limit" section of the configuration.
+static LogLimit limitFromConfig(const std::string& name)
+{
+    const std::string rate_path { "logging.rate_limit." + name + "_rate" };
+    const std::string burst_path { "logging.rate_limit." + name + "_burst" };
+    const double rate { g_config.lookupDouble(rate_path.c_str()) };
+    const std::uint32_t burst { g_config.lookupU32(burst_path.c_str()) };
+    if (rate <= 0.0 || burst < 1) {
+        throw std::runtime_error(fmt::format("Log rate limit '{}' needs a positive rate and burst, got {} and {}", name, rate, burst));
+    }
+
+    const std::int64_t interval_ns { static_cast<std::int64_t>(1e9 / rate) };
+    return LogLimit { interval_ns, interval_ns * burst };
 }
 
+std::atomic<int> LoggingMultiplexer::min_severity_ { FATAL + 1 };
+
 LoggingMultiplexer::LoggingMultiplexer()
-    : configured_ { false }
-    , stderr_enabled_ { false }
+    : stderr_enabled_ { false }
     , stderr_min_severity_ {}
-    , stderr_mutex_ {}
     , es_enabled_ { false }
     , es_min_severity_ {}
+    , sequence_ { 0 }
+    , n_dropped_ { 0 }
+    , site_limit_ {}
+    , unit_limit_ {}
+    , summary_interval_ {}
+    , sites_ {}
+    , n_suppressed_unknown_ { 0 }
+    , rings_mutex_ {}
+    , rings_ {}
+    , running_ { false }
+    , consumer_ {}
+    , consumer_id_ {}
+    , consumer_mutex_ {}
+    , consumer_cv_ {}
+{
+}
+
+LoggingMultiplexer::~LoggingMultiplexer()
 {
+    // Messages queued so far are still written, later ones are dropped.
+    min_severity_.store(FATAL + 1, std::memory_order_release);
+    running_ = false;
+    consumer_cv_.notify_one();
+    if (consumer_.joinable()) {
+        consumer_.join();
+    }
 }
 
 void LoggingMultiplexer::init()
@@ -77,42 +140,254 @@ void LoggingMultiplexer::configure()
     es_enabled_ = g_config.lookupBool("logging.elastic_search.enabled");
     es_min_severity_ = severityFromString(g_config.lookupString("logging.elastic_search.min_severity"));
 
-    configured_ = true;
+    site_limit_ = limitFromConfig("site");
+    unit_limit_ = limitFromConfig("unit");
+    summary_interval_ = std::chrono::nanoseconds { static_cast<std::int64_t>(1e9 * g_config.lookupDouble("logging.rate_limit.summary_interval")) };
+
+    if (!running_) {
+        running_ = true;
+        consumer_ = std::thread { &LoggingMultiplexer::consume, this };
+        consumer_id_ = consumer_.get_id();
+    }
+
+    int min_severity { FATAL + 1 };
+    if (stderr_enabled_) {
+        min_severity = std::min<int>(min_severity, stderr_min_severity_);
+    }
+    if (es_enabled_) {
+        min_severity = std::min<int>(min_severity, es_min_severity_);
+    }
+    min_severity_.store(min_severity, std::memory_order_release);
 }
 
 void LoggingMultiplexer::log(Severity level, const std::string& unit_name, const std::string& message)
 {
-    if (!configured_) {
-        return;
+    if (enabled(level)) {
+        push(level, true, unit_name, "{}", message);
     }
+}
 
-    if (stderr_enabled_ && level >= stderr_min_severity_) {
-        logToStderr(level, unit_name, message);
+void LoggingMultiplexer::logWithoutES(Severity level, const std::string& unit_name, const std::string& message)
+{
+    if (enabled(level)) {
+        push(level, false, unit_name, "{}", message);
+    }
+}
+
+bool LoggingMultiplexer::admit(Severity level, bool to_es, LogBucket& unit_bucket, std::uint64_t unit_hash, const std::string& unit_name, const char* format)
+{
+    if (level == FATAL) {
+        return true;
+    }
+
+    const std::int64_t now_ns { steadyNs() };
+    LogSite* site { format ? sites_.find(unit_hash, format, unit_name, level, to_es) : nullptr };
+    if (site && !site->bucket.take(now_ns, site_limit_)) {
+        site->n_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
-    if (es_enabled_ && level >= es_min_severity_) {
-        logToES(level, unit_name, message);
+    if (level < ERROR && !unit_bucket.take(now_ns, unit_limit_)) {
+        (site ? site->n_suppressed : n_suppressed_unknown_).fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
+
+    return true;
 }
 
-void LoggingMultiplexer::logWithoutES(Severity level, const std::string& unit_name, const std::string& message)
+LogRing& LoggingMultiplexer::threadRing()
+{
+    // The ring outlives its thread until the logging thread has written everything in it.
+    struct ThreadRing {
+        std::shared_ptr<LogRing> ring;
+
+        ~ThreadRing()
+        {
+            if (ring) {
+                ring->abandon();
+            }
+        }
+    };
+    static thread_local ThreadRing thread_ring {};
+
+    if (!thread_ring.ring) {
+        thread_ring.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> lock { rings_mutex_ };
+        rings_.push_back(thread_ring.ring);
+    }
+
+    return *thread_ring.ring;
+}
+
+LogRecord* LoggingMultiplexer::reserve(Severity level, bool to_es, const std::string& unit_name)
+{
+    LogRing& ring { threadRing() };
+
+    LogRecord* record { ring.reserve() };
+    while (!record) {
+        // Losing warnings and errors is worse than waiting for the logging thread.
+        if (level < WARNING || std::this_thread::get_id() == consumer_id_) {
+            n_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        consumer_cv_.notify_one();
+        std::this_thread::yield();
+        record = ring.reserve();
+    }
+
+    record->sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+    record->level = level;
+    record->to_es = to_es;
+
+    const std::size_t unit_size { std::min(unit_name.size(), LogRecord::UNIT_SIZE - 1) };
+    std::memcpy(record->unit, unit_name.data(), unit_size);
+    record->unit[unit_size] = '\0';
+
+    return record;
+}
+
+void LoggingMultiplexer::commit(Severity level)
+{
+    LogRing& ring { threadRing() };
+    const std::size_t position { ring.commit() };
+
+    // The process is likely to end right after a fatal message, make sure it is out. The
+    // logging thread writes fatal messages to stderr before it lets go of their records.
+    if (level == FATAL && std::this_thread::get_id() != consumer_id_) {
+        consumer_cv_.notify_one();
+        while (!ring.consumed(position)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void LoggingMultiplexer::consume()
+{
+    std::vector<std::shared_ptr<LogRing>> rings {};
+    fmt::memory_buffer message {};
+    fmt::memory_buffer lines {};
+    std::chrono::steady_clock::time_point last_summary { std::chrono::steady_clock::now() };
+
+    while (true) {
+        // Everything queued before stopping is still written.
+        const bool stopping { !running_ };
+
+        {
+            std::lock_guard<std::mutex> lock { rings_mutex_ };
+            rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<LogRing>& ring) {
+                return ring->abandoned() && !ring->front();
+            }),
+                rings_.end());
+            rings = rings_;
+        }
+
+        // Merge the rings, always writing the oldest call first.
+        std::size_t n_written { 0 };
+        while (true) {
+            LogRing* oldest_ring { nullptr };
+            const LogRecord* oldest { nullptr };
+            for (const std::shared_ptr<LogRing>& ring : rings) {
+                const LogRecord* record { ring->front() };
+                if (record && (!oldest || record->sequence < oldest->sequence)) {
+                    oldest_ring = ring.get();
+                    oldest = record;
+                }
+            }
+
+            if (!oldest) {
+                break;
+            }
+
+            write(*oldest, message, lines);
+
+            // The caller of a fatal message waits for its pop() and may end the process right after.
+            if (oldest->level == FATAL && lines.size() != 0) {
+                std::fwrite(lines.data(), 1, lines.size(), stderr);
+                std::fflush(stderr);
+                lines.clear();
+            }
+
+            oldest_ring->pop();
+            ++n_written;
+        }
+
+        const std::chrono::steady_clock::time_point now { std::chrono::steady_clock::now() };
+        if (now - last_summary >= summary_interval_ || stopping) {
+            summariseSuppressed(lines);
+            last_summary = now;
+        }
+
+        const std::uint64_t n_dropped { n_dropped_.exchange(0, std::memory_order_relaxed) };
+        if (n_dropped != 0 && stderr_enabled_) {
+            fmt::format_to(std::back_inserter(lines), "WARNING (LoggingMultiplexer):\t {} messages dropped, logging could not keep up\n", n_dropped);
+        }
+
+        if (lines.size() != 0) {
+            std::fwrite(lines.data(), 1, lines.size(), stderr);
+            lines.clear();
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (n_written == 0) {
+            std::unique_lock<std::mutex> lock { consumer_mutex_ };
+            consumer_cv_.wait_for(lock, CONSUMER_IDLE_WAIT, [this] { return !running_; });
+        }
+    }
+}
+
+void LoggingMultiplexer::write(const LogRecord& record, fmt::memory_buffer& message, fmt::memory_buffer& lines)
 {
-    if (!configured_) {
-        return;
+    message.clear();
+    if (record.format) {
+        try {
+            record.format(record, message);
+        } catch (const std::exception& e) {
+            fmt::format_to(std::back_inserter(message), "Cannot format '{}': {}", record.format_str, e.what());
+        }
+    } else {
+        const std::unique_ptr<std::string> owned { *reinterpret_cast<std::string* const*>(record.data) };
+        message.append(owned->data(), owned->data() + owned->size());
     }
 
+    output(record.level, record.to_es, record.unit, fmt::string_view { message.data(), message.size() }, lines);
+}
+
+void LoggingMultiplexer::output(Severity level, bool to_es, const char* unit_name, fmt::string_view message, fmt::memory_buffer& lines)
+{
     if (stderr_enabled_ && level >= stderr_min_severity_) {
-        logToStderr(level, unit_name, message);
+        fmt::format_to(std::back_inserter(lines), "{} ({}):\t {}\n", severityToString(level), unit_name, message);
+    }
+
+    if (to_es && es_enabled_ && level >= es_min_severity_) {
+        logToES(level, unit_name, std::string { message.data(), message.size() });
     }
 }
 
-void LoggingMultiplexer::logToStderr(Severity level, const std::string& unit_name, const std::string& message)
+void LoggingMultiplexer::summariseSuppressed(fmt::memory_buffer& lines)
 {
-    std::lock_guard<std::mutex> l { stderr_mutex_ };
-    fmt::print(stderr, "{} ({}):\t {}\n", severityToString(level), unit_name, message);
+    fmt::memory_buffer message {};
+    sites_.forEach([&](LogSite& site) {
+        const std::uint64_t n_suppressed { site.n_suppressed.exchange(0, std::memory_order_relaxed) };
+        if (n_suppressed != 0) {
+            message.clear();
+            fmt::format_to(std::back_inserter(message), "Suppressed {} occurrences of '{}'", n_suppressed, site.format);
+            output(site.level, site.to_es, site.unit_name, fmt::string_view { message.data(), message.size() }, lines);
+        }
+    });
+
+    const std::uint64_t n_suppressed { n_suppressed_unknown_.exchange(0, std::memory_order_relaxed) };
+    if (n_suppressed != 0) {
+        message.clear();
+        fmt::format_to(std::back_inserter(message), "Suppressed {} messages of units over their rate limit", n_suppressed);
+        output(WARNING, true, "LoggingMultiplexer", fmt::string_view { message.data(), message.size() }, lines);
+    }
 }
 
 void LoggingMultiplexer::logToES(Severity level, const std::string& unit_name, const std::string& message)
 {
     g_elastic.log(level, unit_name, message);
-}
\ No newline at end of file
+}
@@ -31,6 +31,11 @@ long double tai_timestamp::combined_secs() const
     return secs + 1e-9 * nanosecs;
 }
 
+std::uint64_t tai_timestamp::combined_nanosecs() const
+{
+    return secs * NS_PER_S + nanosecs;
+}
+
 bool tai_timestamp::empty() const
 {
     return secs == 0 && nanosecs == 0;